@@ -0,0 +1,94 @@
+/*
+ * bTreeThreaded.c
+ *
+ * Multithreaded B-tree insert and lookup throughput.  Each thread
+ * inserts a disjoint range of keys, and then looks up all of the keys
+ * it inserted.  Keys are big endian, so that threads insert into
+ * different parts of the tree.
+ */
+#include <config.h>
+#include <stasis/transactional.h>
+#include <stasis/util/time.h>
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+char * usage = "%s numthreads numops [always_commit]\n";
+
+static int count;
+static int alwaysCommit;
+static recordid tree;
+
+static void to_key(unsigned int i, byte * key) {
+  key[0] = i >> 24; key[1] = i >> 16; key[2] = i >> 8; key[3] = i;
+}
+
+static void * go(void * arg_ptr) {
+  unsigned int k = *(int*)arg_ptr;
+  byte key[4];
+  int xid = Tbegin();
+  for(unsigned int j = k * count; j < (k+1) * count; j++) {
+    to_key(j, key);
+    TbtreeInsert(xid, tree, NULL, key, sizeof(key), (byte*)&j, sizeof(j));
+    if(alwaysCommit) {
+      Tcommit(xid);
+      xid = Tbegin();
+    }
+  }
+  for(unsigned int j = k * count; j < (k+1) * count; j++) {
+    unsigned int * val;
+    size_t len;
+    to_key(j, key);
+    int found = TbtreeLookup(xid, tree, NULL, key, sizeof(key), (byte**)&val, &len);
+    assert(found && *val == j);
+    free(val);
+  }
+  Tcommit(xid);
+  return NULL;
+}
+
+int main(int argc, char** argv) {
+  if(argc != 3 && argc != 4) { printf(usage, argv[0]); abort(); }
+
+  int thread_count = atoi(argv[1]);
+  count = atoi(argv[2]);
+  alwaysCommit = (argc == 4);
+
+  unlink("storefile.txt");
+  unlink("logfile.txt");
+
+  pthread_t * workers = malloc(sizeof(pthread_t) * thread_count);
+  int * ks = malloc(sizeof(int) * thread_count);
+
+  Tinit();
+  int xid = Tbegin();
+  tree = TbtreeCreate(xid, BYTE_ARRAY_COMPARATOR);
+  Tcommit(xid);
+
+  struct timeval start, stop;
+  gettimeofday(&start, 0);
+
+  for(int k = 0; k < thread_count; k++) {
+    ks[k] = k;
+    pthread_create(&workers[k], 0, go, &ks[k]);
+  }
+  for(int k = 0; k < thread_count; k++) {
+    pthread_join(workers[k], NULL);
+  }
+
+  gettimeofday(&stop, 0);
+
+  Tdeinit();
+
+  double elapsed = stasis_timeval_to_double(stasis_subtract_timeval(stop, start));
+  double ops = 2.0 * thread_count * count;
+  printf("threads = %d elapsed = %f seconds, %f inserts + lookups / sec\n",
+         thread_count, elapsed, ops / elapsed);
+
+  free(ks);
+  free(workers);
+  return 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * checksumThroughput.c
+ *
+ * Measures the throughput of the page checksum (CRC32C, in hardware
+ * and in software) and of the log's CRC32, so that it can be compared
+ * with the raw I/O throughput reported by rawIOPS.
+ */
+#include <config.h>
+#include <stasis/common.h>
+#include <stasis/constants.h>
+#include <stasis/util/crc32.h>
+#include <stasis/util/time.h>
+
+#include <stdio.h>
+#include <string.h>
+
+char * usage = "%s [buffer_size [total_mb]]\n";
+
+static volatile uint32_t sink;
+
+static double run(const char * name, uint32_t (*crc)(const void*, size_t, uint32_t),
+                  const byte * buf, size_t len, uint64_t iters) {
+  struct timeval start, stop;
+  uint32_t c = 0;
+  gettimeofday(&start, 0);
+  for(uint64_t i = 0; i < iters; i++) {
+    c ^= crc(buf, len, (uint32_t)-1);
+  }
+  gettimeofday(&stop, 0);
+  sink = c;
+  double elapsed = stasis_timeval_to_double(stasis_subtract_timeval(stop, start));
+  double gb = ((double)len * iters) / (1024.0 * 1024.0 * 1024.0);
+  printf("%-16s buffer = %lld bytes elapsed = %f seconds, throughput %f GB/sec\n",
+         name, (long long)len, elapsed, gb / elapsed);
+  return gb / elapsed;
+}
+static uint32_t crc32_wrapper(const void * buf, size_t len, uint32_t crc) {
+  return stasis_crc32(buf, len, crc);
+}
+
+int main(int argc, char * argv[]) {
+  if(argc > 3) { printf(usage, argv[0]); abort(); }
+  char * endptr;
+  size_t len = PAGE_SIZE;
+  uint64_t total_mb = 1024;
+  if(argc > 1) {
+    len = strtoull(argv[1], &endptr, 10);
+    if(*endptr != 0 || !len) { printf(usage, argv[0]); abort(); }
+  }
+  if(argc > 2) {
+    total_mb = strtoull(argv[2], &endptr, 10);
+    if(*endptr != 0) { printf(usage, argv[0]); abort(); }
+  }
+  uint64_t iters = (total_mb * 1024 * 1024) / len;
+  if(!iters) { iters = 1; }
+
+  byte * buf = malloc(len);
+  for(size_t i = 0; i < len; i++) { buf[i] = (byte)(i * 31 + 7); }
+
+  if(stasis_crc32c_hardware()) {
+    run("crc32c (sse4.2)", stasis_crc32c, buf, len, iters);
+  } else {
+    printf("crc32c (sse4.2)  not supported by this cpu\n");
+  }
+  run("crc32c (table)", stasis_crc32c_table, buf, len, iters);
+  run("crc32 (log)", crc32_wrapper, buf, len, iters);
+
+  free(buf);
+  return 0;
+}
@@ -1,12 +1,22 @@
 #include <stasis/transactional.h>
+#include <stasis/flags.h>
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 
 int main(int argc, char** argv) {
 
+  if(argc > 2 && !strcmp(argv[1], "--page_size")) {
+    stasis_page_size = atoi(argv[2]);
+    // Keep the buffer pool the same size (in bytes) as the page size varies.
+    stasis_buffer_manager_size = (stasis_buffer_manager_size * STASIS_DEFAULT_PAGE_SIZE) / stasis_page_size;
+    argc -= 2;
+    argv += 2;
+  }
+
   assert(argc == 3 || argc == 4);
 
   int xact_count = atoi(argv[1]);
@@ -6,38 +6,78 @@
  */
 
 #include <stasis/transactional.h>
+#include <stasis/flags.h>
+#include <stasis/logger/logger2.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <string.h>
 
-char * usage = "%s numthreads numops\n";
+char * usage = "%s numthreads numops [soft|commit]\n";
+
+static unsigned long numops;
 
 static void* noopWorker(void* arg) {
-  unsigned long numops = *(unsigned long*) arg;
   for(unsigned long i = 0; i < numops; i++) {
     int xid = Tbegin();
     TsoftCommit(xid);
   }
   return 0;
 }
+/** Each transaction updates a record, so that Tcommit() goes through group commit. */
+static void* commitWorker(void* arg) {
+  recordid rid = *(recordid*)arg;
+  for(unsigned long i = 0; i < numops; i++) {
+    int xid = Tbegin();
+    Tset(xid, rid, &i);
+    Tcommit(xid);
+  }
+  return 0;
+}
 
 int main(int argc, char * argv[]) {
-  if(argc != 3) { printf(usage, argv[0]); abort(); }
+  if(argc != 3 && argc != 4) { printf(usage, argv[0]); abort(); }
   char * endptr;
   unsigned long numthreads = strtoul(argv[1], &endptr, 10);
   if(*endptr != 0) { printf(usage, argv[0]); abort(); }
-  unsigned long numops= strtoul(argv[2], &endptr, 10) / numthreads;
+  numops= strtoul(argv[2], &endptr, 10) / numthreads;
   if(*endptr != 0) { printf(usage, argv[0]); abort(); }
+  int commit = 0;
+  if(argc == 4) {
+    if(!strcmp(argv[3], "commit")) {
+      commit = 1;
+    } else if(strcmp(argv[3], "soft")) {
+      printf(usage, argv[0]); abort();
+    }
+  }
 
   pthread_t workers[numthreads];
+  recordid rids[numthreads];
 
+  if(commit) {
+    // Only the file log uses group commit.
+    stasis_log_type = LOG_TO_FILE;
+  }
   Tinit();
 
+  if(commit) {
+    int xid = Tbegin();
+    for(int i = 0; i < numthreads; i++) {
+      rids[i] = Talloc(xid, sizeof(unsigned long));
+    }
+    Tcommit(xid);
+  }
+
   for(int i = 0; i < numthreads; i++) {
-    pthread_create(&workers[i], 0, noopWorker, &numops);
+    pthread_create(&workers[i], 0, commit ? commitWorker : noopWorker, &rids[i]);
   }
   for(int i = 0; i < numthreads; i++) {
     pthread_join(workers[i], 0);
   }
 
+  stasis_log_t * log = stasis_log();
+  if(log->group_force) {
+    stasis_log_group_force_print_stats(log->group_force);
+  }
+
   Tdeinit();
 }
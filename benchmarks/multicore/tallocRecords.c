@@ -0,0 +1,54 @@
+/*
+ * tallocRecords.c
+ *
+ *  Measures how well Talloc() scales with the number of allocating threads.
+ */
+
+#include <stasis/transactional.h>
+#include <stasis/flags.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+char * usage = "%s numthreads numops [arena_pages]\n";
+
+static unsigned long numops;
+
+static void* allocWorker(void* arg) {
+  for(unsigned long i = 0; i < numops; i += 10) {
+    int xid = Tbegin();
+    for(int j = 0; j < 10; j++) {
+      recordid rid = Talloc(xid, sizeof(unsigned long));
+      Tset(xid, rid, &i);
+    }
+    TsoftCommit(xid);
+  }
+  return 0;
+}
+
+int main(int argc, char * argv[]) {
+  if(argc != 3 && argc != 4) { printf(usage, argv[0]); abort(); }
+  char * endptr;
+  unsigned long numthreads = strtoul(argv[1], &endptr, 10);
+  if(*endptr != 0) { printf(usage, argv[0]); abort(); }
+  numops= strtoul(argv[2], &endptr, 10) / numthreads;
+  if(*endptr != 0) { printf(usage, argv[0]); abort(); }
+  if(argc == 4) {
+    stasis_alloc_arena_pages = strtol(argv[3], &endptr, 10);
+    if(*endptr != 0) { printf(usage, argv[0]); abort(); }
+  }
+
+  pthread_t workers[numthreads];
+
+  stasis_log_type = LOG_TO_MEMORY;
+  Tinit();
+
+  for(int i = 0; i < numthreads; i++) {
+    pthread_create(&workers[i], 0, allocWorker, 0);
+  }
+  for(int i = 0; i < numthreads; i++) {
+    pthread_join(workers[i], 0);
+  }
+
+  Tdeinit();
+}
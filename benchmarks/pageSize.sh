@@ -0,0 +1,29 @@
+#!/bin/bash
+# Compare page sizes using sequential writeback and linear hash inserts.
+# Run from the directory that contains the benchmark binaries.  Each run
+# needs a fresh page file, since a page file's page size is fixed when
+# it is created.
+
+MB=${MB:-500}
+XACTS=${XACTS:-10}
+INSERTS=${INSERTS:-100000}
+
+clean() {
+  rm -rf storefile.txt logfile.txt stasis_log
+}
+
+for PS in 4096 8192 16384 32768
+do
+  clean
+  echo "sequentialThroughput, page size $PS"
+  ./sequentialThroughput --page_size $PS --mb $MB
+
+  clean
+  echo "linearHashNTA fixed length, page size $PS"
+  time ./linearHashNTA --page_size $PS $XACTS $INSERTS 1
+
+  clean
+  echo "linearHashNTA variable length, page size $PS"
+  time ./linearHashNTA --page_size $PS $XACTS $INSERTS
+done
+clean
@@ -0,0 +1,96 @@
+/*
+ * prefetchScan.c
+ *
+ * Measures sequential scan throughput as a function of the number of
+ * concurrent scanners.  Each scanner walks a disjoint range of the page
+ * file, and asks the buffer manager to prefetch a window of pages ahead
+ * of its current position.
+ */
+#include <config.h>
+#include <stasis/transactional.h>
+#include <stasis/bufferManager/bufferHash.h>
+#include <stasis/flags.h>
+#include <stasis/util/time.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+char * usage = "%s numthreads pages_per_thread [prefetch_window [prefetch_threads]]\n";
+
+pageid_t pages_per_thread;
+pageid_t prefetch_window = 64;
+
+static void* worker(void* arg) {
+  pageid_t start = *(pageid_t*)arg;
+  pageid_t stop = start + pages_per_thread;
+  pageid_t prefetched = start;
+  for(pageid_t i = start; i < stop; i++) {
+    // Keep at least one window of pages in flight ahead of the scan.
+    if(prefetch_window && prefetched < stop && prefetched - i < prefetch_window) {
+      pageid_t count = prefetch_window;
+      if(prefetched + count > stop) { count = stop - prefetched; }
+      prefetchPages(prefetched, count);
+      prefetched += count;
+    }
+    Page * p = loadPage(-1, i);
+    releasePage(p);
+  }
+  return 0;
+}
+
+int main(int argc, char * argv[]) {
+  if(argc < 3 || argc > 5) { printf(usage, argv[0]); abort(); }
+  char * endptr;
+  unsigned long numthreads = strtoul(argv[1], &endptr, 10);
+  if(*endptr != 0) { printf(usage, argv[0]); abort(); }
+  pages_per_thread = strtoll(argv[2], &endptr, 10);
+  if(*endptr != 0) { printf(usage, argv[0]); abort(); }
+  if(argc > 3) {
+    prefetch_window = strtoll(argv[3], &endptr, 10);
+    if(*endptr != 0) { printf(usage, argv[0]); abort(); }
+  }
+  if(argc > 4) {
+    stasis_buffer_manager_hash_prefetch_count = strtol(argv[4], &endptr, 10);
+    if(*endptr != 0) { printf(usage, argv[0]); abort(); }
+  }
+
+  // Only the hash buffer manager implements prefetch.
+  stasis_buffer_manager_factory = stasis_buffer_manager_hash_factory;
+
+  pthread_t workers[numthreads];
+  pageid_t starts[numthreads];
+
+  // Populate the page file, so that the scans below have to go to the OS.
+  Tinit();
+  for(pageid_t i = 0; i < pages_per_thread * numthreads; i++) {
+    Page * p = loadUninitializedPage(-1, i);
+    stasis_dirty_page_table_set_dirty(stasis_runtime_dirty_page_table(), p);
+    releasePage(p);
+  }
+  Tdeinit();
+
+  Tinit();
+
+  struct timeval start, stop;
+  gettimeofday(&start, 0);
+
+  for(int i = 0; i < numthreads; i++) {
+    starts[i] = i * pages_per_thread;
+    pthread_create(&workers[i], 0, worker, &starts[i]);
+  }
+  for(int i = 0; i < numthreads; i++) {
+    pthread_join(workers[i], 0);
+  }
+
+  gettimeofday(&stop, 0);
+
+  Tdeinit();
+
+  double elapsed = stasis_timeval_to_double(stasis_subtract_timeval(stop, start));
+  double mb = ((double)(pages_per_thread * numthreads) * PAGE_SIZE) / (1024.0 * 1024.0);
+  printf("threads = %lu window = %lld prefetchers = %d elapsed = %f seconds, scanned %f mb, throughput %f MB/sec\n",
+         numthreads, (long long)prefetch_window, stasis_buffer_manager_hash_prefetch_count,
+         elapsed, mb, mb / elapsed);
+  return 0;
+}
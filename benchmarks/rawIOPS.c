@@ -9,6 +9,8 @@
 #include <stasis/util/random.h>
 #include <stasis/util/time.h>
 #include <stasis/util/histogram.h>
+#include <stasis/io/handle.h>
+#include <stasis/flags.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -21,6 +23,10 @@ static const long MB = (1024 * 1024);
 
 typedef struct {
   int fd;
+  /** If non-null, read through this handle instead of calling pread(). */
+  stasis_handle_t * h;
+  /** The number of reads to pass to the handle at once. */
+  int batch;
   int page_size;
   uint64_t start_off;
   uint64_t end_off;
@@ -47,6 +53,49 @@ void * status_worker(void * ignored) {
   }
 }
 
+/**
+   Like worker(), but issues arg->batch reads at a time through a Stasis
+   file handle, so that pfile (which reads one page at a time) can be
+   compared with handles that keep the whole batch in flight.
+ */
+void * handle_worker(void * argp) {
+  thread_arg * arg = argp;
+  stasis_handle_iov_t * iov = malloc(sizeof(iov[0]) * arg->batch);
+  for(int j = 0; j < arg->batch; j++) {
+    int err = posix_memalign((void**)&iov[j].buf, 512, arg->page_size);
+    if(err) {
+      printf("Couldn't allocate memory with posix_memalign: %s\n", strerror(err));
+      fflush(stdout);
+      abort();
+    }
+    iov[j].len = arg->page_size;
+  }
+  struct timeval start, stop;
+  for(uint64_t i = 0; (!arg->opcount) || i <  arg->opcount; i += arg->batch) {
+    gettimeofday(&start, 0);
+    for(int j = 0; j < arg->batch; j++) {
+      uint64_t offset
+        = arg->start_off + stasis_util_random64(arg->end_off
+                                     - (arg->start_off+arg->page_size));
+      iov[j].off = offset & ~(arg->page_size-1);
+    }
+    stasis_histogram_tick(&iop_hist);
+    int err = stasis_handle_read_batch(arg->h, iov, arg->batch);
+    stasis_histogram_tock(&iop_hist);
+    __sync_fetch_and_add(&completed_ops, arg->batch);
+    if(err) {
+      printf("Could not read from file: %s\n", strerror(err)); fflush(stdout); abort();
+    }
+    gettimeofday(&stop, 0);
+    arg->elapsed += stasis_timeval_to_double(stasis_subtract_timeval(stop, start));
+  }
+  for(int j = 0; j < arg->batch; j++) {
+    free(iov[j].buf);
+  }
+  free(iov);
+  return 0;
+}
+
 void * worker(void * argp) {
   thread_arg * arg = argp;
 
@@ -89,10 +138,11 @@ void * worker(void * argp) {
 }
 
 int main(int argc, char * argv[]) {
-  if(argc != 7) {
-    printf("Usage %s filename page_size num_threads op_count start_off end_off\n", argv[0]);
+  if(argc < 7 || argc > 9) {
+    printf("Usage %s filename page_size num_threads op_count start_off end_off [raw|pfile|uring [batch]]\n", argv[0]);
     printf(" Note:  If you get errors about invalid arguments during read, make sure\n"
-           "        page size is a power of two, and >= 512.");
+           "        page size is a power of two, and >= 512.\n"
+           "        pfile and uring read through Stasis file handles, batch pages at a time.");
     abort();
   }
   char * filename    = argv[1];
@@ -101,6 +151,8 @@ int main(int argc, char * argv[]) {
   op_count  = atoll(argv[4]);
   uint64_t start_off = atoll(argv[5]);
   uint64_t end_off   = atoll(argv[6]) * MB;
+  const char * mode  = argc > 7 ? argv[7] : "raw";
+  int batch          = argc > 8 ? atoi(argv[8]) : 1;
 
   completed_ops = 0;
 
@@ -114,6 +166,20 @@ int main(int argc, char * argv[]) {
     perror("Couldn't open file");
     abort();
   }
+  stasis_handle_t * h = 0;
+  if(!strcmp(mode, "pfile")) {
+    h = stasis_handle_open_pfile(filename, fcntl(fd, F_GETFL) & ~O_ACCMODE, 0);
+  } else if(!strcmp(mode, "uring")) {
+    stasis_handle_uring_queue_depth = batch * num_threads;
+    h = stasis_handle_open_uring(filename, fcntl(fd, F_GETFL) & ~O_ACCMODE, 0);
+  } else if(strcmp(mode, "raw")) {
+    printf("Unknown mode %s\n", mode);
+    abort();
+  }
+  if(h && h->error) {
+    printf("Couldn't open file handle: %s\n", strerror(h->error));
+    abort();
+  }
   struct timeval start, stop;
   pthread_t status;
   pthread_t * threads = malloc(sizeof(threads[0]) * num_threads);
@@ -123,12 +189,14 @@ int main(int argc, char * argv[]) {
   pthread_create(&status, 0, status_worker, 0);
   for(int i = 0; i < num_threads; i++) {
     arg[i].fd = fd;
+    arg[i].h = h;
+    arg[i].batch = batch;
     arg[i].page_size = page_size;
     arg[i].start_off = start_off;
     arg[i].end_off = end_off;
     arg[i].opcount = op_count / num_threads;
     arg[i].elapsed = 0.0;
-    pthread_create(&threads[i], 0, worker, &arg[i]);
+    pthread_create(&threads[i], 0, h ? handle_worker : worker, &arg[i]);
   }
 
   double sum_elapsed = 0;
@@ -145,8 +213,9 @@ int main(int argc, char * argv[]) {
   }
   double wallclock_elapsed = stasis_timeval_to_double(
                               stasis_subtract_timeval(stop, start));
-  printf("%d threads %lld mb %lld ops / %f seconds = %f IOPS.\n", num_threads, (long long)(end_off / MB), (long long)op_count, wallclock_elapsed, ((double)op_count) / wallclock_elapsed);
+  printf("%s batch %d: %d threads %lld mb %lld ops / %f seconds = %f IOPS.\n", mode, batch, num_threads, (long long)(end_off / MB), (long long)op_count, wallclock_elapsed, ((double)op_count) / wallclock_elapsed);
 
+  if(h) { h->close(h); }
   close(fd);
   stasis_histograms_auto_dump();
   return 0;
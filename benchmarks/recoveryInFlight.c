@@ -0,0 +1,68 @@
+/*
+ * recoveryInFlight.c
+ *
+ * Measures crash recovery time as a function of the number of
+ * transactions that are in flight at crash time.  Each transaction
+ * updates its own records, and the updates are interleaved in the log,
+ * so analysis sees every loser on every pass over the log and undo
+ * has to roll all of them back.
+ *
+ * Each run needs a fresh page file and log; see recoveryInFlight.sh.
+ */
+#include <config.h>
+#include <stasis/transactional.h>
+#include <stasis/flags.h>
+#include <stasis/util/time.h>
+
+#include <stdio.h>
+#include <string.h>
+
+char * usage = "%s num_xacts updates_per_xact\n";
+
+int main(int argc, char * argv[]) {
+  if(argc != 3) { printf(usage, argv[0]); abort(); }
+  char * endptr;
+  long num_xacts = strtol(argv[1], &endptr, 10);
+  if(*endptr != 0 || num_xacts < 1) { printf(usage, argv[0]); abort(); }
+  long updates_per_xact = strtol(argv[2], &endptr, 10);
+  if(*endptr != 0 || updates_per_xact < 1) { printf(usage, argv[0]); abort(); }
+
+  // Replay the entire log, rather than whatever truncation left behind.
+  stasis_truncation_automatic = 0;
+
+  Tinit();
+  recordid * rids = malloc(sizeof(recordid) * num_xacts);
+  int * xids = malloc(sizeof(int) * num_xacts);
+  int xid = Tbegin();
+  for(long i = 0; i < num_xacts; i++) {
+    rids[i] = Talloc(xid, sizeof(long));
+    Tset(xid, rids[i], &i);
+  }
+  Tcommit(xid);
+  for(long i = 0; i < num_xacts; i++) {
+    xids[i] = Tbegin();
+    if(xids[i] < 0) {
+      printf("Could only begin %ld transactions\n", i);
+      abort();
+    }
+  }
+  for(long j = 0; j < updates_per_xact; j++) {
+    for(long i = 0; i < num_xacts; i++) {
+      Tset(xids[i], rids[i], &j);
+    }
+  }
+  TuncleanShutdown();
+  free(xids);
+  free(rids);
+
+  struct timeval start, stop;
+  gettimeofday(&start, 0);
+  Tinit();
+  gettimeofday(&stop, 0);
+  Tdeinit();
+
+  double elapsed = stasis_timeval_to_double(stasis_subtract_timeval(stop, start));
+  printf("in flight xacts = %ld updates = %ld recovery took %f seconds\n",
+         num_xacts, num_xacts * updates_per_xact, elapsed);
+  return 0;
+}
@@ -0,0 +1,18 @@
+#!/bin/bash
+# Report crash recovery time against the number of transactions that
+# were in flight at crash time.  The total number of log entries is held
+# constant, so recovery time should not depend on the number of losers.
+# Run from the directory that contains the benchmark binaries.
+
+UPDATES=${UPDATES:-400000}
+
+clean() {
+  rm -rf storefile.txt logfile.txt stasis_log
+}
+
+for XACTS in 10 100 250 500 999
+do
+  clean
+  ./recoveryInFlight $XACTS $(( UPDATES / XACTS ))
+done
+clean
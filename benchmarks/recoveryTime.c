@@ -0,0 +1,92 @@
+/*
+ * recoveryTime.c
+ *
+ * Measures crash recovery time as a function of the number of redo
+ * threads.  Populates a table of fixed length records, updates random
+ * records (so that the log touches many pages), crashes without writing
+ * back the buffer pool, and times the Tinit() call that recovers.
+ * If checkpoint_interval is non-zero, it calls Tcheckpoint() every
+ * checkpoint_interval updates, so redo can skip updates that the
+ * buffer manager had already written back.
+ *
+ * Each run needs a fresh page file and log; see recoveryTime.sh.
+ */
+#include <config.h>
+#include <stasis/transactional.h>
+#include <stasis/flags.h>
+#include <stasis/util/random.h>
+#include <stasis/util/time.h>
+
+#include <stdio.h>
+#include <string.h>
+
+char * usage = "%s redo_threads num_records num_updates [updates_per_xact [checkpoint_interval]]\n";
+
+typedef struct {
+  int64_t key;
+  char pad[120];
+} record;
+
+int main(int argc, char * argv[]) {
+  if(argc < 4 || argc > 6) { printf(usage, argv[0]); abort(); }
+  char * endptr;
+  int redo_threads = strtol(argv[1], &endptr, 10);
+  if(*endptr != 0 || redo_threads < 1) { printf(usage, argv[0]); abort(); }
+  long num_records = strtol(argv[2], &endptr, 10);
+  if(*endptr != 0 || num_records < 1) { printf(usage, argv[0]); abort(); }
+  long num_updates = strtol(argv[3], &endptr, 10);
+  if(*endptr != 0) { printf(usage, argv[0]); abort(); }
+  long updates_per_xact = 1000;
+  if(argc > 4) {
+    updates_per_xact = strtol(argv[4], &endptr, 10);
+    if(*endptr != 0 || updates_per_xact < 1) { printf(usage, argv[0]); abort(); }
+  }
+  long checkpoint_interval = 0;
+  if(argc > 5) {
+    checkpoint_interval = strtol(argv[5], &endptr, 10);
+    if(*endptr != 0 || checkpoint_interval < 0) { printf(usage, argv[0]); abort(); }
+  }
+
+  // Replay the entire log, rather than whatever truncation left behind.
+  stasis_truncation_automatic = 0;
+
+  Tinit();
+  recordid * rids = malloc(sizeof(recordid) * num_records);
+  record r;
+  memset(&r, 0, sizeof(r));
+  int xid = Tbegin();
+  for(long i = 0; i < num_records; i++) {
+    rids[i] = Talloc(xid, sizeof(r));
+    r.key = i;
+    Tset(xid, rids[i], &r);
+  }
+  Tcommit(xid);
+  for(long i = 0; i < num_updates; i++) {
+    if(!(i % updates_per_xact)) {
+      if(i) { Tcommit(xid); }
+      xid = Tbegin();
+    }
+    if(checkpoint_interval && i && !(i % checkpoint_interval)) {
+      Tcheckpoint();
+    }
+    long victim = stasis_util_random64(num_records);
+    r.key = i;
+    Tset(xid, rids[victim], &r);
+  }
+  Tcommit(xid);
+  TuncleanShutdown();
+  free(rids);
+
+  stasis_recovery_redo_threads = redo_threads;
+
+  struct timeval start, stop;
+  gettimeofday(&start, 0);
+  Tinit();
+  gettimeofday(&stop, 0);
+  Tdeinit();
+
+  double elapsed = stasis_timeval_to_double(stasis_subtract_timeval(stop, start));
+  printf("redo threads = %d records = %ld updates = %ld recovery took %f seconds\n",
+         redo_threads, num_records, num_updates, elapsed);
+  return 0;
+}
@@ -0,0 +1,18 @@
+#!/bin/bash
+# Report crash recovery time against the number of redo threads.
+# Run from the directory that contains the benchmark binaries.  Each run
+# needs a fresh page file and log.
+
+RECORDS=${RECORDS:-200000}
+UPDATES=${UPDATES:-1000000}
+
+clean() {
+  rm -rf storefile.txt logfile.txt stasis_log
+}
+
+for THREADS in 1 2 4 8 16
+do
+  clean
+  ./recoveryTime $THREADS $RECORDS $UPDATES
+done
+clean
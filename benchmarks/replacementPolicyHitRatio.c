@@ -0,0 +1,161 @@
+/*
+ * replacementPolicyHitRatio.c
+ *
+ * Trace driven hit ratio benchmark for the replacement policies.  It
+ * simulates a cache of cache_pages frames in front of a table of
+ * 16 * cache_pages pages.  Most of the trace is point lookups, and
+ * hot_percent percent of them go to a hot set of cache_pages / 2 pages.
+ * Every scan_interval lookups (by default, cache_pages), a scan reads
+ * 2 * cache_pages consecutive pages, which is enough to flush an LRU cache.
+ * A scan_interval of zero disables scans.
+ *
+ * Each access pins and unpins the page the way the buffer manager does,
+ * so the policies see the same sequence of calls as they would under
+ * loadPage() / releasePage().
+ */
+#include <stasis/common.h>
+#include <stasis/replacementPolicy.h>
+#include <stasis/page.h>
+#include <stasis/util/random.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+char * usage = "%s cache_pages num_lookups [hot_percent [scan_interval]]\n";
+
+#define POLICY_COUNT 5
+static const char * policy_names[POLICY_COUNT] = {
+  "lru", "clock", "arc", "concurrent lru", "concurrent arc"
+};
+#define CONCURRENT_BUCKETS 37
+
+static pageid_t cache_pages;
+static pageid_t table_pages;
+
+typedef struct {
+  replacementPolicy * rp;
+  Page * frames;
+  pageid_t frames_used;
+  Page ** map;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t lookup_hits;
+  uint64_t lookups;
+} cache_t;
+
+static replacementPolicy * open_policy(int policy, Page * frames) {
+  replacementPolicy * rps[CONCURRENT_BUCKETS];
+  switch(policy) {
+  case 0: return lruFastInit();
+  case 1: return replacementPolicyClockInit(frames, cache_pages);
+  case 2: return replacementPolicyArcInit(cache_pages);
+  case 3:
+    for(int i = 0; i < CONCURRENT_BUCKETS; i++) { rps[i] = lruFastInit(); }
+    return replacementPolicyConcurrentWrapperInit(rps, CONCURRENT_BUCKETS);
+  case 4:
+    for(int i = 0; i < CONCURRENT_BUCKETS; i++) { rps[i] = replacementPolicyArcInit(cache_pages / CONCURRENT_BUCKETS); }
+    return replacementPolicyConcurrentWrapperInit(rps, CONCURRENT_BUCKETS);
+  }
+  abort();
+}
+
+static void access_page(cache_t * c, pageid_t id, int is_lookup) {
+  Page * p = c->map[id];
+  if(p) {
+    c->hits++;
+    if(is_lookup) { c->lookup_hits++; }
+    c->rp->remove(c->rp, p);
+  } else {
+    c->misses++;
+    if(c->frames_used < cache_pages) {
+      p = &c->frames[c->frames_used++];
+    } else {
+      p = c->rp->getStaleAndRemove(c->rp);
+      assert(p);
+      c->map[p->id] = NULL;
+    }
+    // The concurrent buffer manager inserts newly loaded pages before
+    // pinning them, so do the same.
+    p->id = id;
+    c->map[id] = p;
+    c->rp->insert(c->rp, p);
+    c->rp->remove(c->rp, p);
+  }
+  if(is_lookup) { c->lookups++; }
+  c->rp->insert(c->rp, p);
+}
+
+int main(int argc, char * argv[]) {
+  if(argc < 3 || argc > 5) { printf(usage, argv[0]); abort(); }
+  char * endptr;
+  cache_pages = strtoll(argv[1], &endptr, 10);
+  if(*endptr || cache_pages < CONCURRENT_BUCKETS) { printf(usage, argv[0]); abort(); }
+  uint64_t num_lookups = strtoull(argv[2], &endptr, 10);
+  if(*endptr) { printf(usage, argv[0]); abort(); }
+  int hot_percent = 90;
+  if(argc > 3) {
+    hot_percent = strtol(argv[3], &endptr, 10);
+    if(*endptr || hot_percent < 0 || hot_percent > 100) { printf(usage, argv[0]); abort(); }
+  }
+  uint64_t scan_interval = cache_pages;
+  if(argc > 4) {
+    scan_interval = strtoull(argv[4], &endptr, 10);
+    if(*endptr) { printf(usage, argv[0]); abort(); }
+  }
+  table_pages = 16 * cache_pages;
+  pageid_t hot_pages = cache_pages / 2;
+  pageid_t scan_pages = 2 * cache_pages;
+
+  // Generate the trace once, so that every policy sees the same accesses.
+  // Negative entries are scan accesses.
+  uint64_t scans = scan_interval ? num_lookups / scan_interval : 0;
+  uint64_t trace_len = num_lookups + scans * scan_pages;
+  pageid_t * trace = malloc(sizeof(trace[0]) * trace_len);
+  srandom(0);
+  uint64_t n = 0;
+  for(uint64_t i = 0; i < num_lookups; i++) {
+    if(scan_interval && i && !(i % scan_interval)) {
+      pageid_t start = stasis_util_random64(table_pages - scan_pages);
+      for(pageid_t j = 0; j < scan_pages; j++) {
+        trace[n++] = -1 - (start + j);
+      }
+    }
+    if((int)stasis_util_random64(100) < hot_percent) {
+      // The hot set is spread over the table, so that scans hit it too.
+      trace[n++] = stasis_util_random64(hot_pages) * 16;
+    } else {
+      trace[n++] = stasis_util_random64(table_pages);
+    }
+  }
+
+  printf("%-16s %10s %12s\n", "policy", "hit ratio", "lookup hits");
+  for(int policy = 0; policy < POLICY_COUNT; policy++) {
+    cache_t c;
+    c.frames = calloc(cache_pages, sizeof(Page));
+    for(pageid_t i = 0; i < cache_pages; i++) {
+      c.frames[i].pinCount = 1;  // not in the policy yet
+    }
+    c.frames_used = 0;
+    c.map = calloc(table_pages, sizeof(Page*));
+    c.hits = c.misses = c.lookup_hits = c.lookups = 0;
+    c.rp = open_policy(policy, c.frames);
+
+    for(uint64_t i = 0; i < n; i++) {
+      if(trace[i] < 0) {
+        access_page(&c, -1 - trace[i], 0);
+      } else {
+        access_page(&c, trace[i], 1);
+      }
+    }
+    printf("%-16s %10.4f %12.4f\n", policy_names[policy],
+           (double)c.hits / (double)(c.hits + c.misses),
+           (double)c.lookup_hits / (double)c.lookups);
+
+    c.rp->deinit(c.rp);
+    free(c.map);
+    free(c.frames);
+  }
+  free(trace);
+  return 0;
+}
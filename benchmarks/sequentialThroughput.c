@@ -47,16 +47,16 @@ static inline long mb_to_page(long mb) {
 static inline long page_to_mb(long page) {
   return (page * PAGE_SIZE) / (1024 * 1024);
 }
-const char * usage = "./sequentialThroughput [--direct] [--mb mb] [--stake mb]\n  [--deprecatedBM|--deprecatedFH|--log_safe_writes|--log_memory|--log_file_pool|--nb|--file|--pfile|--nb_pfile|--nb_file] [--read]\n";
+const char * usage = "./sequentialThroughput [--direct] [--mb mb] [--stake mb] [--page_size bytes]\n  [--deprecatedBM|--deprecatedFH|--log_safe_writes|--log_memory|--log_file_pool|--nb|--file|--pfile|--nb_pfile|--nb_file] [--read]\n";
 
 int main(int argc, char ** argv) {
   int direct = 0;
   int legacyBM = 0;
   int legacyFH = 0;
-  int stake = 0;
+  long stake_mb = 0;
   int log_mode = 0;
   int read_mode = 0;
-  long page_count = mb_to_page(100);
+  long mb = 100;
   for(int i = 1; i < argc; i++) {
     if(!strcmp(argv[i], "--direct")) {
       direct = 1;
@@ -99,10 +99,13 @@ int main(int argc, char ** argv) {
       stasis_non_blocking_handle_file_factory = stasis_handle_open_file;
     } else if(!strcmp(argv[i], "--mb")) {
       i++;
-      page_count = mb_to_page(atoll(argv[i]));
+      mb = atoll(argv[i]);
     } else if(!strcmp(argv[i], "--stake")) {
       i++;
-      stake = mb_to_page(atoll(argv[i]));
+      stake_mb = atoll(argv[i]);
+    } else if(!strcmp(argv[i], "--page_size")) {
+      i++;
+      stasis_page_size = atoi(argv[i]);
     } else if(!strcmp(argv[i], "--read")) {
       read_mode = 1;
     } else if(!strcmp(argv[i], "--hint-sequential-writes")) {
@@ -119,6 +122,11 @@ int main(int argc, char ** argv) {
     return 1;
   }
 
+  // Keep the buffer pool the same size (in bytes) as the page size varies.
+  stasis_buffer_manager_size = (stasis_buffer_manager_size * STASIS_DEFAULT_PAGE_SIZE) / PAGE_SIZE;
+  long page_count = mb_to_page(mb);
+  long stake = mb_to_page(stake_mb);
+
   struct timeval start;
 
   gettimeofday(&start,0);
@@ -172,10 +180,11 @@ int main(int argc, char ** argv) {
   double elapsed = stasis_timeval_to_double(
                      stasis_subtract_timeval(stop,start));
 
-  printf("Elasped = %f seconds, %s %ld mb, throughput %f MB/sec\n",
+  printf("Elasped = %f seconds, %s %ld mb with %d byte pages, throughput %f MB/sec\n",
 	 elapsed,
 	 read_mode ? "read": "wrote",
 	 page_to_mb(page_count),
+	 PAGE_SIZE,
 	 ((double)page_to_mb(page_count)) / elapsed);
   return 0;
 }
@@ -1,9 +1,61 @@
 #include "lsn_bench_common.h"
+#include <stasis/flags.h>
+#include <stasis/dirtyPageTable.h>
+#include <sys/time.h>
+
+static double now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/**
+ * Dirty num_pages contiguous pages num_rounds times, and time how long the
+ * dirty page table takes to write them back, and how long the page file
+ * takes to force them to disk.
+ */
+static void flush_bench(long long num_pages, long long num_rounds) {
+  int xid = Tbegin();
+  pageid_t first = TpageAllocMany(xid, num_pages);
+  Tcommit(xid);
+
+  double flush_time = 0, force_time = 0;
+  for(long long i = 0; i < num_rounds; i++) {
+    for(long long j = 0; j < num_pages; j++) {
+      Page * p = loadPage(-1, first + j);
+      writelock(p->rwlatch,0);
+      stasis_page_slotted_initialize_page(p);
+      stasis_page_lsn_write(-1, p, i + 1);
+      unlock(p->rwlatch);
+      releasePage(p);
+    }
+    double start = now();
+    // The write back thread may be flushing too; wait for it to finish.
+    while(stasis_dirty_page_table_flush(stasis_runtime_dirty_page_table()) == EAGAIN) { }
+    double flushed = now();
+    stasis_buffer_manager_t * bm = stasis_runtime_buffer_manager();
+    bm->forcePages(bm, 0);
+    double forced = now();
+    flush_time += flushed - start;
+    force_time += forced - flushed;
+  }
+  double mb = (double)num_pages * num_rounds * PAGE_SIZE / (1024.0 * 1024.0);
+  printf("flush: %.3f sec (%.1f MB/s) force: %.3f sec\n",
+         flush_time, mb / flush_time, force_time);
+}
 
 int main (int argc, char ** argv) {
   unlink("storefile.txt");
   unlink("logfile.txt");
   char * mode = argv[1];
+  if(!(strcmp(mode, "flush")&&strcmp(mode, "flush-uncoalesced"))) {
+    // argv[2] is the number of pages; argv[3] is the number of rounds.
+    stasis_handle_coalesce_batches = !strcmp(mode, "flush");
+    Tinit();
+    flush_bench(atoll(argv[2]), atoll(argv[3]));
+    Tdeinit();
+    return 0;
+  }
   long long num_rids = atoll(argv[2]);
   long long num_xacts = atoll(argv[3]);
   long long writes_per_xact = atoll(argv[4]);
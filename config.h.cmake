@@ -5,6 +5,7 @@
 #cmakedefine HAVE_POSIX_FADVISE
 #cmakedefine HAVE_FDATASYNC
 #cmakedefine HAVE_SYNC_FILE_RANGE
+#cmakedefine HAVE_IO_URING
 #cmakedefine HAVE_O_NOATIME
 #cmakedefine HAVE_O_DIRECT
 #cmakedefine HAVE_O_DSYNC
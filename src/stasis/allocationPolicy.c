@@ -57,6 +57,10 @@
  *
  *   The rows of AllPages with an entry in xidAlloced, and at most one
  *   entry in xidDealloced, key1: pageid, key2 = xid, freespace, pageid
+ *
+ * Pages listed in CheckedOut (_pageid_) have been handed to a caller by
+ * stasis_allocation_policy_checkout_page(), and appear in neither view
+ * until they are checked back in.
  */
 // Tables:
 typedef struct {
@@ -92,6 +96,7 @@ struct stasis_allocation_policy_t {
   struct rbtree * xidAlloced_key_pageid_xid;
   struct rbtree * xidDealloced_key_xid_pageid;
   struct rbtree * xidDealloced_key_pageid_xid;
+  struct rbtree * checkedOut_key_pageid;
   // flags
   char reuseWithinXact;
 };
@@ -282,6 +287,23 @@ static int xidAllocedDealloced_helper_lookup_by_pageid(struct rbtree *t, pageid_
   return ret;
 }
 
+// ######## CheckedOut #############
+static int checkedOut_lookup_by_pageid(stasis_allocation_policy_t *ap, pageid_t pageid) {
+  allPages_pageid_freespace query = { pageid, 0 };
+  return rbfind(&query, ap->checkedOut_key_pageid) != 0;
+}
+static void checkedOut_add(stasis_allocation_policy_t *ap, pageid_t pageid) {
+  allPages_pageid_freespace * tup = malloc(sizeof(*tup));
+  tup->pageid = pageid;
+  tup->freespace = 0;
+  int existed = void_single_add(tup, ap->checkedOut_key_pageid);
+  assert(!existed);
+}
+static int checkedOut_remove(stasis_allocation_policy_t *ap, pageid_t pageid) {
+  allPages_pageid_freespace tup = { pageid, 0 };
+  return void_single_remove(&tup, ap->checkedOut_key_pageid);
+}
+
 static int xidAlloced_lookup_by_pageid(stasis_allocation_policy_t *ap, pageid_t pageid, int **xids, size_t * count);
 static int xidDealloced_lookup_by_pageid(stasis_allocation_policy_t *ap, pageid_t pageid, int **xids, size_t * count);
 
@@ -296,6 +318,12 @@ static int update_views_for_page(stasis_allocation_policy_t *ap, pageid_t pageid
   if(!inAllPages) {
     stasis_allocation_policy_register_new_page(ap, pageid, 0);
   }
+  if(checkedOut_lookup_by_pageid(ap, pageid)) {
+    // Whoever checked the page out owns it until it is checked back in.
+    pageOwners_remove(ap, pageid);
+    availablePages_remove(ap, pageid);
+    return ret;
+  }
   int inXidAlloced = xidAlloced_lookup_by_pageid(ap, pageid, &allocXids, &xidAllocCount);
   int inXidDealloced = xidDealloced_lookup_by_pageid(ap, pageid, &deallocXids, &xidDeallocCount);
   if(! inXidAlloced) { xidAllocCount = 0; allocXids = 0;}
@@ -464,11 +492,12 @@ stasis_allocation_policy_t * stasis_allocation_policy_init() {
   ap->xidAlloced_key_xid_pageid = rbinit(xidAllocedDealloced_cmp_xid_pageid, 0);
   ap->xidDealloced_key_pageid_xid = rbinit(xidAllocedDealloced_cmp_pageid_xid, 0);
   ap->xidDealloced_key_xid_pageid = rbinit(xidAllocedDealloced_cmp_xid_pageid, 0);
+  ap->checkedOut_key_pageid = rbinit(allPages_cmp_pageid, 0);
   ap->reuseWithinXact = 0;
   return ap;
 }
 void stasis_allocation_policy_deinit(stasis_allocation_policy_t * ap) {
-  allPages_removeAll(ap);  // frees entries in availablePages, asserts that all pages are available.
+  allPages_removeAll(ap);  // frees entries in availablePages, asserts that all pages are available (and not checked out).
   rbdestroy(ap->availablePages_key_pageid);
   rbdestroy(ap->availablePages_key_freespace_pageid);
   rbdestroy(ap->pageOwners_key_pageid);
@@ -478,6 +507,7 @@ void stasis_allocation_policy_deinit(stasis_allocation_policy_t * ap) {
   rbdestroy(ap->xidAlloced_key_xid_pageid);
   rbdestroy(ap->xidDealloced_key_pageid_xid);
   rbdestroy(ap->xidDealloced_key_xid_pageid);
+  rbdestroy(ap->checkedOut_key_pageid);
   free(ap);
 }
 void stasis_allocation_policy_register_new_page(stasis_allocation_policy_t * ap, pageid_t pageid, size_t freespace) {
@@ -504,6 +534,29 @@ pageid_t stasis_allocation_policy_pick_suitable_page(stasis_allocation_policy_t
     return INVALID_PAGE;
   }
 }
+pageid_t stasis_allocation_policy_checkout_page(stasis_allocation_policy_t * ap, size_t freespace, size_t * pageFreespace) {
+  // Hand out the emptiest available page; the caller will keep
+  // allocating from it for a while.  Among equally empty pages, prefer the
+  // lowest pageid, as Talloc always has (a fresh store's first record
+  // lands on ROOT_RECORD).
+  const availablePages_pageid_freespace *tup = rbmax(ap->availablePages_key_freespace_pageid);
+  if(!tup || tup->freespace < freespace) {
+    return INVALID_PAGE;
+  }
+  const availablePages_pageid_freespace query = { 0, tup->freespace };
+  tup = rblookup(RB_LUGTEQ, &query, ap->availablePages_key_freespace_pageid);
+  pageid_t pageid = tup->pageid;
+  *pageFreespace = tup->freespace;
+  checkedOut_add(ap, pageid);
+  update_views_for_page(ap, pageid);
+  return pageid;
+}
+void stasis_allocation_policy_checkin_page(stasis_allocation_policy_t * ap, pageid_t pageid, size_t freespace) {
+  int found = checkedOut_remove(ap, pageid);
+  assert(found);
+  allPages_set_freespace(ap, pageid, freespace);
+  update_views_for_page(ap, pageid);
+}
 void stasis_allocation_policy_transaction_completed(stasis_allocation_policy_t * ap, int xid) {
   pageid_t *allocPages;
   pageid_t *deallocPages;
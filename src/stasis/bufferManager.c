@@ -153,6 +153,39 @@ void stasis_buffer_manager_set_redo_mode(int in_redo) {
   ((stasis_buffer_manager_t*)stasis_runtime_buffer_manager())->in_redo = in_redo;
 }
 
+static pthread_mutex_t stasis_buffer_manager_resize_mut = PTHREAD_MUTEX_INITIALIZER;
+
+static void stasis_buffer_manager_scale_limits(pageid_t old_size, pageid_t new_size) {
+  stasis_dirty_page_count_soft_limit = (stasis_dirty_page_count_soft_limit * new_size) / old_size;
+  stasis_dirty_page_count_hard_limit = (stasis_dirty_page_count_hard_limit * new_size) / old_size;
+  stasis_dirty_page_low_water_mark   = (stasis_dirty_page_low_water_mark   * new_size) / old_size;
+}
+
+int stasis_buffer_manager_resize(pageid_t size) {
+  stasis_buffer_manager_t * bm = stasis_runtime_buffer_manager();
+  if(bm->resize == NULL) { return ENOTSUP; }
+  if(size < 1) { return EINVAL; }
+  pthread_mutex_lock(&stasis_buffer_manager_resize_mut);
+  pageid_t old_size = stasis_buffer_manager_size;
+  pageid_t soft = stasis_dirty_page_count_soft_limit;
+  pageid_t hard = stasis_dirty_page_count_hard_limit;
+  pageid_t low  = stasis_dirty_page_low_water_mark;
+  // When shrinking, lower the dirty page limits first, so that writeback
+  // makes room for the eviction.
+  if(size < old_size) { stasis_buffer_manager_scale_limits(old_size, size); }
+  int ret = bm->resize(bm, size);
+  if(ret) {
+    stasis_dirty_page_count_soft_limit = soft;
+    stasis_dirty_page_count_hard_limit = hard;
+    stasis_dirty_page_low_water_mark   = low;
+  } else {
+    if(size > old_size) { stasis_buffer_manager_scale_limits(old_size, size); }
+    stasis_buffer_manager_size = size;
+  }
+  pthread_mutex_unlock(&stasis_buffer_manager_resize_mut);
+  return ret;
+}
+
 Page * loadPage(int xid, pageid_t pageid) {
   // This lock is released at Tcommit()
   if(globalLockManager.readLockPage) { globalLockManager.readLockPage(xid, pageid); }
@@ -165,6 +198,22 @@ Page * loadPageOfType(int xid, pageid_t pageid, pagetype_t type) {
   Page *p = bm->loadPageImpl(bm, 0, xid, pageid, type);
   return p;
 }
+stasis_buffer_manager_handle_t * stasis_buffer_manager_open_sequential_handle(void) {
+  stasis_buffer_manager_t * bm = stasis_runtime_buffer_manager();
+  return bm->openHandleImpl(bm, 1);
+}
+void stasis_buffer_manager_close_handle(stasis_buffer_manager_handle_t * h) {
+  stasis_buffer_manager_t * bm = stasis_runtime_buffer_manager();
+  bm->closeHandleImpl(bm, h);
+}
+Page * loadPageWithHandle(stasis_buffer_manager_handle_t * h, int xid, pageid_t pageid) {
+  return loadPageOfTypeWithHandle(h, xid, pageid, UNKNOWN_TYPE_PAGE);
+}
+Page * loadPageOfTypeWithHandle(stasis_buffer_manager_handle_t * h, int xid, pageid_t pageid, pagetype_t type) {
+  if(globalLockManager.readLockPage) { globalLockManager.readLockPage(xid, pageid); }
+  stasis_buffer_manager_t * bm = stasis_runtime_buffer_manager();
+  return bm->loadPageImpl(bm, h, xid, pageid, type);
+}
 Page * loadUninitializedPage(int xid, pageid_t pageid) {
   // This lock is released at Tcommit()
   if(globalLockManager.readLockPage) { globalLockManager.readLockPage(xid, pageid); }
@@ -23,13 +23,26 @@
 
 //#define LATCH_SANITY_CHECKING
 
+/** A pending prefetch request: count pages, starting at pageid. */
+typedef struct {
+  pageid_t pageid;
+  pageid_t count;
+} stasis_buffer_hash_prefetch_t;
+
 typedef struct {
   struct LH_ENTRY(table) * cachedPages;
   pthread_t worker;
   pthread_mutex_t mut;
   pthread_cond_t readComplete;
   pthread_cond_t needFree;
+  /** Signalled by bhReleasePage() while getFreePage() waits for an unpinned frame. */
+  pthread_cond_t frameUnpinned;
+  int frameWaiters;
   pageid_t pageCount;
+  /** The maximum number of frames; getFreePage() allocates them lazily. */
+  pageid_t size;
+  /** The size of the clock policy's frame array, or -1 if the policy can grow. */
+  pageid_t maxSize;
   replacementPolicy *lru;
   stasis_buffer_pool_t *buffer_pool;
   stasis_page_handle_t *page_handle;
@@ -43,8 +56,10 @@ typedef struct {
   pthread_mutex_t prefetch_mut;
   pthread_cond_t prefetcher_available;
   pthread_cond_t prefetch_waiting;
-  pageid_t prefetch_next_pageid;
-  pageid_t prefetch_next_count;
+  /** Bounded FIFO of pending requests; never holds overlapping or adjacent ranges. */
+  stasis_buffer_hash_prefetch_t * prefetch_queue;
+  int prefetch_queue_len;
+  int prefetch_queue_max;
 } stasis_buffer_hash_t;
 
 static inline int needFlush(stasis_buffer_manager_t * bm) {
@@ -115,11 +130,11 @@ static int bhTryToWriteBackPage(stasis_buffer_manager_t *bm, pageid_t page) {
 }
 
 /** Returns a free page.  The page will not be in freeList,
-    cachedPages or lru. */
+    cachedPages or lru.  Blocks while every frame is pinned. */
 inline static Page * getFreePage(stasis_buffer_manager_t *bm) {
   stasis_buffer_hash_t * bh = bm->impl;
   Page * ret;
-  if(bh->pageCount < stasis_buffer_manager_size) {
+  if(bh->pageCount < bh->size) {
     ret = stasis_buffer_pool_malloc_page(bh->buffer_pool);
     stasis_buffer_pool_free_page(bh->buffer_pool, ret,-1);
     ret->pending = 0;
@@ -127,7 +142,15 @@ inline static Page * getFreePage(stasis_buffer_manager_t *bm) {
     ret->pinCount = 1; // to match what happens after the next block calls lru->remove()
     bh->pageCount++;
   } else {
-    while((ret = bh->lru->getStale(bh->lru))) {
+    while(1) {
+      ret = bh->lru->getStale(bh->lru);
+      if(!ret) {
+        // Every frame is pinned; wait for one to be released.
+        bh->frameWaiters++;
+        pthread_cond_wait(&bh->frameUnpinned, &bh->mut);
+        bh->frameWaiters--;
+        continue;
+      }
       // Make sure we have an exclusive lock on victim.
       assert(!ret->pinCount);
       assert(!ret->pending);
@@ -329,39 +352,90 @@ static Page * bhLoadUninitPageImpl(stasis_buffer_manager_t *bm, int xid, const p
 static void* prefetch_worker(void * arg) {
   stasis_buffer_hash_t * bh = arg; //bm->impl;
   pthread_mutex_lock(&bh->prefetch_mut);
-  int done = 0;
   while(1) {
-    while(bh->prefetch_next_count == 0) {
+    while(bh->prefetch_queue_len == 0 && bh->running) {
       // nothing to do.
-      pthread_cond_broadcast(&bh->prefetcher_available);
-      if(!bh->running) { done = 1; break; } // shutdown
       pthread_cond_wait(&bh->prefetch_waiting, &bh->prefetch_mut);
     }
-    if(done) break;
-    // we have some work.
-    pageid_t pageid = bh->prefetch_next_pageid;
-    pageid_t count = bh->prefetch_next_count;
-    bh->prefetch_next_pageid = 0;
-    bh->prefetch_next_count = 0;
+    if(bh->prefetch_queue_len == 0) break; // shutdown
+    // we have some work.  Take our share of the oldest requests, and let
+    // blocked producers know there is room.  The page handle submits the
+    // requests we take as a single batch.
+    int n = (bh->prefetch_queue_len + bh->prefetch_thread_count - 1) / bh->prefetch_thread_count;
+    pageid_t pageids[n];
+    pageid_t counts[n];
+    for(int i = 0; i < n; i++) {
+      pageids[i] = bh->prefetch_queue[i].pageid;
+      counts[i] = bh->prefetch_queue[i].count;
+    }
+    bh->prefetch_queue_len -= n;
+    memmove(&bh->prefetch_queue[0], &bh->prefetch_queue[n],
+            sizeof(bh->prefetch_queue[0]) * bh->prefetch_queue_len);
+    pthread_cond_broadcast(&bh->prefetcher_available);
     pthread_mutex_unlock(&bh->prefetch_mut);
-    bh->page_handle->prefetch_range(bh->page_handle, pageid, count);
+    bh->page_handle->prefetch_ranges(bh->page_handle, pageids, counts, n);
     pthread_mutex_lock(&bh->prefetch_mut);
   }
   pthread_mutex_unlock(&bh->prefetch_mut);
   return 0;
 }
-
+/**
+   Merge [*pageid, *pageid + *count) with any queued requests that overlap or
+   abut it.  Merged requests are removed from the queue, and the union is
+   returned through pageid and count.  Caller must hold prefetch_mut.
+ */
+static void bhPrefetchCoalesce(stasis_buffer_hash_t * bh, pageid_t * pageid, pageid_t * count) {
+  int i = 0;
+  while(i < bh->prefetch_queue_len) {
+    stasis_buffer_hash_prefetch_t * q = &bh->prefetch_queue[i];
+    if(q->pageid <= *pageid + *count && *pageid <= q->pageid + q->count) {
+      pageid_t start = q->pageid < *pageid ? q->pageid : *pageid;
+      pageid_t stop  = (q->pageid + q->count) > (*pageid + *count)
+                     ? (q->pageid + q->count) : (*pageid + *count);
+      *pageid = start;
+      *count = stop - start;
+      bh->prefetch_queue_len--;
+      memmove(q, q+1, sizeof(*q) * (bh->prefetch_queue_len - i));
+      // The union may now touch requests that we already passed over.
+      i = 0;
+    } else {
+      i++;
+    }
+  }
+}
 void bhPrefetchPagesImpl(stasis_buffer_manager_t *bm, pageid_t pageid, pageid_t count) {
   stasis_buffer_hash_t * bh = bm->impl;
+
+  // Don't bother reading pages that are already cached (or being read) at
+  // either end of the range.
+  pthread_mutex_lock(&bh->mut);
+  while(count > 0 && LH_ENTRY(find)(bh->cachedPages, &pageid, sizeof(pageid))) {
+    pageid++;
+    count--;
+  }
+  while(count > 0) {
+    pageid_t last = pageid + count - 1;
+    if(!LH_ENTRY(find)(bh->cachedPages, &last, sizeof(last))) { break; }
+    count--;
+  }
+  pthread_mutex_unlock(&bh->mut);
+
+  if(count <= 0) { return; }
+
   if(bh->prefetch_thread_count > 0) {
     pthread_mutex_lock(&bh->prefetch_mut);
-    while(bh->prefetch_next_count != 0) {
-      pthread_cond_broadcast(&bh->prefetch_waiting);
+    bhPrefetchCoalesce(bh, &pageid, &count);
+    while(bh->prefetch_queue_len == bh->prefetch_queue_max) {
       pthread_cond_wait(&bh->prefetcher_available, &bh->prefetch_mut);
+      // A worker dequeued a request, but other producers may have enqueued
+      // neighbors of this range while we slept.
+      bhPrefetchCoalesce(bh, &pageid, &count);
     }
     // fire and forget.
-    bh->prefetch_next_pageid = pageid;
-    bh->prefetch_next_count = count;
+    bh->prefetch_queue[bh->prefetch_queue_len].pageid = pageid;
+    bh->prefetch_queue[bh->prefetch_queue_len].count = count;
+    bh->prefetch_queue_len++;
+    pthread_cond_signal(&bh->prefetch_waiting);
 
     pthread_mutex_unlock(&bh->prefetch_mut);
   } else {  // synchronously prefetch in this thread
@@ -382,6 +456,7 @@ static void bhReleasePage(stasis_buffer_manager_t * bm, Page * p) {
   pthread_mutex_lock(&bh->mut);
   checkPageState(p);
   bh->lru->insert(bh->lru,p);
+  if(bh->frameWaiters) { pthread_cond_broadcast(&bh->frameUnpinned); }
 
 #ifdef LATCH_SANITY_CHECKING
   unlock(p->loadlatch);
@@ -419,7 +494,9 @@ static void bhBufDeinit(stasis_buffer_manager_t * bm) {
   pthread_mutex_unlock(&bh->mut);
 
   pthread_cond_signal(&bh->needFree); // Wake up the writeback thread so it will exit.
+  pthread_mutex_lock(&bh->prefetch_mut);
   pthread_cond_broadcast(&bh->prefetch_waiting);
+  pthread_mutex_unlock(&bh->prefetch_mut);
   pthread_join(bh->worker, 0);
 
   for(int i = 0; i < bh->prefetch_thread_count; i++) {
@@ -427,6 +504,7 @@ static void bhBufDeinit(stasis_buffer_manager_t * bm) {
   }
 
   free(bh->prefetch_workers);
+  free(bh->prefetch_queue);
   // XXX flush range should return an error number, which we would check.  (Right now, it aborts...)
   int ret = stasis_dirty_page_table_flush(bh->dpt);
   assert(!ret); // currently the only return value that we'll see is EAGAIN, which means a concurrent thread is in writeback... That should never be the case!
@@ -456,6 +534,7 @@ static void bhBufDeinit(stasis_buffer_manager_t * bm) {
   pthread_mutex_destroy(&bh->mut);
   pthread_cond_destroy(&bh->needFree);
   pthread_cond_destroy(&bh->readComplete);
+  pthread_cond_destroy(&bh->frameUnpinned);
   free(bh);
 }
 static void bhSimulateBufferManagerCrash(stasis_buffer_manager_t *bm) {
@@ -467,10 +546,17 @@ static void bhSimulateBufferManagerCrash(stasis_buffer_manager_t *bm) {
   pthread_cond_signal(&bh->needFree);
   pthread_join(bh->worker, 0);
 
+  pthread_mutex_lock(&bh->prefetch_mut);
   pthread_cond_broadcast(&bh->prefetch_waiting);
+  pthread_mutex_unlock(&bh->prefetch_mut);
   for(int i = 0; i < bh->prefetch_thread_count; i++) {
     pthread_join(bh->prefetch_workers[i], 0);
   }
+  free(bh->prefetch_workers);
+  free(bh->prefetch_queue);
+  pthread_mutex_destroy(&bh->prefetch_mut);
+  pthread_cond_destroy(&bh->prefetch_waiting);
+  pthread_cond_destroy(&bh->prefetcher_available);
 
 
   struct LH_ENTRY(list) iter;
@@ -493,9 +579,43 @@ static void bhSimulateBufferManagerCrash(stasis_buffer_manager_t *bm) {
   pthread_mutex_destroy(&bh->mut);
   pthread_cond_destroy(&bh->needFree);
   pthread_cond_destroy(&bh->readComplete);
+  pthread_cond_destroy(&bh->frameUnpinned);
   free(bh);
 }
 
+static int bhResize(stasis_buffer_manager_t *bm, pageid_t size) {
+  stasis_buffer_hash_t * bh = bm->impl;
+  if(size < 1) { return EINVAL; }
+  if(bh->maxSize != -1 && size > bh->maxSize) { return ENOTSUP; }
+  pthread_mutex_lock(&bh->mut);
+  if(size > bh->pageCount) {
+    stasis_buffer_pool_reserve(bh->buffer_pool, size - bh->pageCount);
+  }
+  bh->size = size;
+  while(bh->pageCount > bh->size) {
+    // Writes back dirty pages through the dirty page table.  This may release our latch.
+    Page * p = getFreePage(bm);
+    stasis_page_cleanup(p);
+    p->id = -1;
+    stasis_buffer_pool_release_page(bh->buffer_pool, p);
+    bh->pageCount--;
+  }
+  // ARC sizes its ghost queues and T1 target from the number of frames.
+  if(bh->lru->setCapacity) {
+    bh->lru->setCapacity(bh->lru, size);
+  }
+  pthread_mutex_unlock(&bh->mut);
+  return 0;
+}
+
+int stasis_buffer_manager_hash_frame_waiters(stasis_buffer_manager_t *bm) {
+  stasis_buffer_hash_t * bh = bm->impl;
+  pthread_mutex_lock(&bh->mut);
+  int ret = bh->frameWaiters;
+  pthread_mutex_unlock(&bh->mut);
+  return ret;
+}
+
 static stasis_buffer_manager_handle_t * bhOpenHandleImpl(stasis_buffer_manager_t *bm, int is_sequential) {
   stasis_buffer_hash_t * bh = bm->impl;
   return (stasis_buffer_manager_handle_t*)bh->page_handle->dup(bh->page_handle, is_sequential);
@@ -519,11 +639,13 @@ stasis_buffer_manager_t* stasis_buffer_manager_hash_open(stasis_page_handle_t *
   bm->releasePageImpl = bhReleasePage;
   bm->writeBackPage = bhWriteBackPage;
   bm->tryToWriteBackPage = bhTryToWriteBackPage;
+  bm->tryToWriteBackPages = NULL;
   bm->forcePages = bhForcePages;
   bm->asyncForcePages = bhAsyncForcePages;
   bm->forcePageRange = bhForcePageRange;
   bm->stasis_buffer_manager_close = bhBufDeinit;
   bm->stasis_buffer_manager_simulate_crash = bhSimulateBufferManagerCrash;
+  bm->resize = bhResize;
 
   bm->impl = bh;
 
@@ -542,6 +664,8 @@ stasis_buffer_manager_t* stasis_buffer_manager_hash_open(stasis_page_handle_t *
   if(stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_CONCURRENT_LRU ||
      stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_THREADSAFE_LRU) {
     bh->lru = lruFastInit();
+  } else if(stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_ARC) {
+    bh->lru = replacementPolicyArcInit(stasis_buffer_manager_size);
   } else if(stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_CLOCK) {
     bh->lru = replacementPolicyClockInit(stasis_buffer_pool_get_underlying_array(bh->buffer_pool), stasis_buffer_manager_size);
   }
@@ -549,6 +673,8 @@ stasis_buffer_manager_t* stasis_buffer_manager_hash_open(stasis_page_handle_t *
   bh->cachedPages = LH_ENTRY(create)(stasis_buffer_manager_size);
 
   bh->pageCount = 0;
+  bh->size = stasis_buffer_manager_size;
+  bh->maxSize = stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_CLOCK ? stasis_buffer_manager_size : -1;
 
   bh->running = 1;
 
@@ -558,6 +684,9 @@ stasis_buffer_manager_t* stasis_buffer_manager_hash_open(stasis_page_handle_t *
 
   pthread_cond_init(&bh->readComplete,0);
 
+  pthread_cond_init(&bh->frameUnpinned,0);
+  bh->frameWaiters = 0;
+
   pthread_create(&bh->worker, 0, writeBackWorker, bm);
 
   bh->prefetch_thread_count = stasis_buffer_manager_hash_prefetch_count;
@@ -565,8 +694,10 @@ stasis_buffer_manager_t* stasis_buffer_manager_hash_open(stasis_page_handle_t *
   pthread_mutex_init(&bh->prefetch_mut, 0);
   pthread_cond_init(&bh->prefetch_waiting, 0);
   pthread_cond_init(&bh->prefetcher_available, 0);
-  bh->prefetch_next_count = 0;
-  bh->prefetch_next_pageid = 0;
+  bh->prefetch_queue_max = stasis_buffer_manager_hash_prefetch_queue_length;
+  if(bh->prefetch_queue_max < 1) { bh->prefetch_queue_max = 1; }
+  bh->prefetch_queue = malloc(sizeof(bh->prefetch_queue[0]) * bh->prefetch_queue_max);
+  bh->prefetch_queue_len = 0;
 
   bh->prefetch_workers = malloc(sizeof(pthread_t) * bh->prefetch_thread_count);
   for(int i = 0; i < bh->prefetch_thread_count; i++) {
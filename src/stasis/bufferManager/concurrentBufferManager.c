@@ -21,6 +21,12 @@ typedef struct {
   hashtable_t *ht;
   pthread_t worker;
   pageid_t pageCount;
+  /** The number of frames owned by this buffer manager. */
+  pageid_t frameCount;
+  /** Free frames are hashed under negative ids; this is the next one to try. */
+  pageid_t nextFrameId;
+  /** The size of the clock policy's frame array, or -1 if the policy can grow. */
+  pageid_t maxFrameCount;
   replacementPolicy *lru;
   stasis_buffer_pool_t *buffer_pool;
   stasis_page_handle_t *page_handle;
@@ -32,6 +38,25 @@ typedef struct {
   pthread_cond_t needFree;
 } stasis_buffer_concurrent_hash_t;
 
+/**
+   The buffer manager handles returned by chOpenHandle().  Sequential
+   handles own a ring of frames.  Each frame in the ring holds one pin
+   on behalf of the handle, which keeps it out of the shared replacement
+   policy, so pages that the scan reads are never promoted there.  When
+   the scan wraps around, it evicts its own pages to make room.
+ */
+typedef struct {
+  stasis_page_handle_t *ph;
+  Page **ring;
+  /** The number of frames in the ring, or zero if this is not a scan handle. */
+  int ring_size;
+  /** The ring slot that will be reused next. */
+  int ring_next;
+  int readahead;
+  /** The page after the last one this handle read; misses here read ahead. */
+  pageid_t next_pageid;
+} stasis_buffer_concurrent_hash_handle_t;
+
 static inline int needFlush(stasis_buffer_manager_t * bm) {
   stasis_buffer_concurrent_hash_t *bh = bm->impl;
   pageid_t count = stasis_dirty_page_table_dirty_count(bh->dpt);
@@ -120,6 +145,41 @@ static int chTryToWriteBackPage(stasis_buffer_manager_t* bm, pageid_t pageid) {
   DEBUG("chTryToWriteBackPage called");
   return chWriteBackPage_helper(bm,pageid,1); // just a hint.  Return EBUSY on contention.
 }
+static int chTryToWriteBackPages(stasis_buffer_manager_t* bm, const pageid_t * pids, int count) {
+  DEBUG("chTryToWriteBackPages called");
+  stasis_buffer_concurrent_hash_t *ch = bm->impl;
+  Page ** batch = malloc(sizeof(Page*) * count);
+  int n = 0;
+  int busy = 0;
+  // Latch as many of the pages as we can without blocking (as in
+  // chWriteBackPage_helper's is_hint case), then write them back together.
+  for(int i = 0; i < count; i++) {
+    Page * p = hashtable_lookup(ch->ht, pids[i]);
+    if(!p) { continue; }
+    if(!trywritelock(p->loadlatch,0)) {
+      busy++;
+      p->needsFlush = 1; // Not atomic.  Oh well.
+      continue;
+    }
+    if(p->id != pids[i]) {  // it must have been written back...
+      unlock(p->loadlatch);
+      continue;
+    }
+    if(stasis_buffer_manager_hint_writes_are_sequential)
+      ch->lru->remove(ch->lru, p);
+    batch[n++] = p;
+  }
+  // write_batch calls stasis_page_flushed() on each page.
+  ch->page_handle->write_batch(ch->page_handle, batch, n);
+  for(int i = 0; i < n; i++) {
+    if(stasis_buffer_manager_hint_writes_are_sequential)
+      ch->lru->insert(ch->lru, batch[i]);
+    batch[i]->needsFlush = 0;
+    unlock(batch[i]->loadlatch);
+  }
+  free(batch);
+  return busy;
+}
 static void * writeBackWorker(void * bmp) {
   stasis_buffer_manager_t* bm = bmp;
   stasis_buffer_concurrent_hash_t * ch = bm->impl;
@@ -173,17 +233,15 @@ static void deinitTLS(void *tlsp) {
   ch->lru->insert(ch->lru, tls->p); // TODO: put it into the LRU end instead of the MRU end, so the memory is treated as stale.
   free(tls);
 }
-static inline stasis_buffer_concurrent_hash_tls_t * populateTLS(stasis_buffer_manager_t* bm) {
+/**
+   Evict a page, and return its (clean) frame.  The frame is not in the
+   hashtable or the replacement policy, so the caller owns it.
+ */
+static Page * chGetFreeFrame(stasis_buffer_manager_t* bm) {
   stasis_buffer_concurrent_hash_t *ch = bm->impl;
-  stasis_buffer_concurrent_hash_tls_t *tls = pthread_getspecific(ch->key);
-  if(tls == NULL) {
-    tls = malloc(sizeof(*tls));
-    tls->p = NULL;
-    tls->bm = bm;
-    pthread_setspecific(ch->key, tls);
-  }
+  Page * p = NULL;
   int count = 0;
-  while(tls->p == NULL) {
+  while(1) {
     Page * tmp;
     int spin_count = 0;
     while(!(tmp = ch->lru->getStaleAndRemove(ch->lru))) {
@@ -209,53 +267,53 @@ static inline stasis_buffer_concurrent_hash_tls_t * populateTLS(stasis_buffer_ma
       }
     }
     hashtable_bucket_handle_t h;
-    tls->p = hashtable_remove_begin(ch->ht, tmp->id, &h);
-    if(tls->p) {
+    p = hashtable_remove_begin(ch->ht, tmp->id, &h);
+    if(p) {
       // It used to be the case that we could get in trouble because page->id could change concurrently with us.  However, this is no longer a problem,
       // since getStaleAndRemove is atomic, and the only code that changes page->id does so with pages that are in TLS (and therefore went through getStaleAndRemove)
       int succ =
-      trywritelock(tls->p->loadlatch,0);  // if this blocks, it is because someone else has pinned the page (it can't be due to eviction because the lru is atomic)
+      trywritelock(p->loadlatch,0);  // if this blocks, it is because someone else has pinned the page (it can't be due to eviction because the lru is atomic)
 
-      if(tls->p->dirty) pthread_cond_signal(&ch->needFree);
+      if(p->dirty) pthread_cond_signal(&ch->needFree);
 
       if(succ && (
           // Work-stealing heuristic: If we don't know that writes are sequential, then write back the page we just encountered.
           (!stasis_buffer_manager_hint_writes_are_sequential)
           // Otherwise, if writes are sequential, then we never want to steal work from the writeback thread,
           // so, pass over pages that are dirty.
-          || (!tls->p->dirty)
+          || (!p->dirty)
         )) {
         // The getStaleAndRemove was not atomic with the hashtable remove, which is OK (but we can't trust tmp anymore...)
-        if(tmp != tls->p) {
+        if(tmp != p) {
           int copy_count = hashtable_debug_number_of_key_copies(ch->ht, tmp->id);
           assert(copy_count == 1);
-          assert(tmp == tls->p);
+          assert(tmp == p);
           abort();
         }
         // note that we'd like to assert that the page is unpinned here.  However, we can't simply look at p->queue, since another thread could be inside the "spooky" quote below.
         tmp = 0;
-        if(tls->p->id >= 0) {
+        if(p->id >= 0) {
           DEBUG("App thread stole work from write back.\n");
           // Page is not in LRU, so we don't have to worry about the case where we
           // are in sequential mode, and have to remove/add the page from/to the LRU.
-          ch->page_handle->write(ch->page_handle, tls->p);
+          ch->page_handle->write(ch->page_handle, p);
         }
         hashtable_remove_finish(ch->ht, &h);  // need to hold bucket lock until page is flushed.  Otherwise, another thread could read stale data from the filehandle.
-        tls->p->id = INVALID_PAGE; // in case loadPage has a pointer to it, and we did this in race with it; when loadPage reacquires loadlatch, it will notice the discrepancy
-        assert(!tls->p->dirty);
-        unlock(tls->p->loadlatch);
-        break;
+        p->id = INVALID_PAGE; // in case loadPage has a pointer to it, and we did this in race with it; when loadPage reacquires loadlatch, it will notice the discrepancy
+        assert(!p->dirty);
+        unlock(p->loadlatch);
+        return p;
       } else {
         if(succ) {
-          assert(tmp == tls->p);
+          assert(tmp == p);
           // can only reach this if writes are sequential, and the page is dirty.
-          unlock(tls->p->loadlatch);
+          unlock(p->loadlatch);
         }
         // put back in LRU before making it accessible (again) via the hash.
         // otherwise, someone could try to pin it.
         ch->lru->insert(ch->lru, tmp);  // OK because lru now does refcounting, and we know that tmp->id can't change (because we're the ones that got it from LRU)
         hashtable_remove_cancel(ch->ht, &h);
-        tls->p = NULL; // This iteration of the loop failed, set this so the loop runs again.
+        p = NULL; // This iteration of the loop failed, set this so the loop runs again.
         if(succ) {
           // writes are sequential, p is dirty, and there is a big backlog.  Go to sleep for 1 msec to let things calm down.
           if(count > 10) {
@@ -275,6 +333,19 @@ static inline stasis_buffer_concurrent_hash_tls_t * populateTLS(stasis_buffer_ma
       printf("Hashtable is spinning attempting to evict a page");
     }
   }
+}
+static inline stasis_buffer_concurrent_hash_tls_t * populateTLS(stasis_buffer_manager_t* bm) {
+  stasis_buffer_concurrent_hash_t *ch = bm->impl;
+  stasis_buffer_concurrent_hash_tls_t *tls = pthread_getspecific(ch->key);
+  if(tls == NULL) {
+    tls = malloc(sizeof(*tls));
+    tls->p = NULL;
+    tls->bm = bm;
+    pthread_setspecific(ch->key, tls);
+  }
+  if(tls->p == NULL) {
+    tls->p = chGetFreeFrame(bm);
+  }
   return tls;
 }
 
@@ -341,8 +412,138 @@ static Page * chLoadPageImpl_helper(stasis_buffer_manager_t* bm, int xid, stasis
   } while(p->id != pageid); // On the off chance that the page got evicted, we'll need to try again.
   return p;
 }
+/**
+   Remove one of a scan's pages from the hashtable, so that its frame can
+   be reused.  This fails if anyone else has the page pinned (or is in
+   the middle of pinning it), or if it is dirty.
+ */
+static int chScanEvict(stasis_buffer_manager_t *bm, Page *p) {
+  stasis_buffer_concurrent_hash_t *ch = bm->impl;
+  if(p->id == INVALID_PAGE) { return 1; }
+  hashtable_bucket_handle_t h;
+  // Only the handle that owns the frame changes its id.
+  Page * q = hashtable_remove_begin(ch->ht, p->id, &h);
+  assert(q == p);
+  // Pinning a page increments its pin count while holding the bucket
+  // latch, so the pin count cannot go up until we release it.
+  if(p->pinCount != 1 || !trywritelock(p->loadlatch, 0)) {
+    hashtable_remove_cancel(ch->ht, &h);
+    return 0;
+  }
+  if(p->dirty) {
+    unlock(p->loadlatch);
+    hashtable_remove_cancel(ch->ht, &h);
+    return 0;
+  }
+  hashtable_remove_finish(ch->ht, &h);
+  p->id = INVALID_PAGE;
+  unlock(p->loadlatch);
+  return 1;
+}
+/**
+   Make the frame in the next ring slot free, and return it.  This does
+   not advance the ring; call chScanUseFrame() once the frame is in use.
+ */
+static Page * chScanPeekFrame(stasis_buffer_manager_t *bm, stasis_buffer_concurrent_hash_handle_t *sh) {
+  stasis_buffer_concurrent_hash_t *ch = bm->impl;
+  Page ** slot = &sh->ring[sh->ring_next];
+  if(*slot && !chScanEvict(bm, *slot)) {
+    // Someone else is using the page (or dirtied it).  Hand it over to the
+    // shared replacement policy, and replace it with a fresh frame.
+    ch->lru->insert(ch->lru, *slot);
+    *slot = NULL;
+  }
+  if(!*slot) {
+    *slot = chGetFreeFrame(bm);
+  }
+  return *slot;
+}
+static void chScanUseFrame(stasis_buffer_concurrent_hash_handle_t *sh) {
+  sh->ring_next = (sh->ring_next + 1) % sh->ring_size;
+}
+/**
+   Undo the hashtable insertion of a page that was read ahead, but that
+   turned out not to be a valid page.  The caller holds its write latch.
+ */
+static void chScanDiscard(stasis_buffer_manager_t *bm, Page *p) {
+  stasis_buffer_concurrent_hash_t *ch = bm->impl;
+  hashtable_bucket_handle_t h;
+  Page * q = hashtable_remove_begin(ch->ht, p->id, &h);
+  assert(q == p);
+  hashtable_remove_finish(ch->ht, &h);
+  // Anyone waiting for the latch will notice that the id changed, and retry.
+  p->id = INVALID_PAGE;
+  unlock(p->loadlatch);
+}
+static Page * chScanLoadPage(stasis_buffer_manager_t *bm, stasis_buffer_concurrent_hash_handle_t *sh, int xid, const pageid_t pageid, pagetype_t type) {
+  stasis_buffer_concurrent_hash_t *ch = bm->impl;
+  hashtable_bucket_handle_t h;
+
+  Page * p = chScanPeekFrame(bm, sh);
+  if(hashtable_test_and_set_lock(ch->ht, pageid, p, &h)) {
+    // Cache hit.  Pin the page the usual way; the free frame stays in the ring.
+    hashtable_unlock(&h);
+    return chLoadPageImpl_helper(bm, xid, sh->ph, pageid, 0, type);
+  }
+  chScanUseFrame(sh);
+  writelock(p->loadlatch, 0);
+  p->id = pageid;
+  // Pin the page for the caller.  The ring's pin keeps it out of the replacement policy.
+  ch->lru->remove(ch->lru, p);
+  hashtable_unlock(&h);
+
+  // If the scan is sequential, read the pages that follow this one, as
+  // long as they are not already in cache.  Pages that the caller gave a
+  // type (such as segment pages) may not have headers, so the ones that
+  // follow them cannot be validated; do not read ahead of them.
+  Page * batch[sh->readahead];
+  int n = 0;
+  batch[n++] = p;
+  if(pageid == sh->next_pageid && type == UNKNOWN_TYPE_PAGE) {
+    while(n < sh->readahead) {
+      Page * q = chScanPeekFrame(bm, sh);
+      if(hashtable_test_and_set_lock(ch->ht, pageid + n, q, &h)) {
+        hashtable_unlock(&h);
+        break;
+      }
+      chScanUseFrame(sh);
+      writelock(q->loadlatch, 0);
+      q->id = pageid + n;
+      hashtable_unlock(&h);
+      batch[n++] = q;
+    }
+  }
+  sh->next_pageid = pageid + n;
+
+  if(n == 1) {
+    sh->ph->read(sh->ph, p, type);
+  } else {
+    sh->ph->read_batch(sh->ph, batch, n);
+    stasis_page_loaded(p, type);
+    for(int i = 1; i < n; i++) {
+      // We do not know what these pages hold (they may be past the end of
+      // the file, or part of a segment), so only keep the ones that are
+      // valid Stasis pages.
+      if(stasis_page_try_loaded(batch[i])) {
+        unlock(batch[i]->loadlatch);
+      } else {
+        chScanDiscard(bm, batch[i]);
+      }
+    }
+  }
+  unlock(p->loadlatch);
+  if(needFlush(bm)) { pthread_cond_signal(&ch->needFree); }
+  // Only this handle evicts the page, so it cannot change while unlatched.
+  readlock(p->loadlatch, 0);
+  assert(p->id == pageid);
+  return p;
+}
 static Page * chLoadPageImpl(stasis_buffer_manager_t *bm, stasis_buffer_manager_handle_t *h, int xid, const pageid_t pageid, pagetype_t type) {
-  return chLoadPageImpl_helper(bm, xid, (stasis_page_handle_t*)h, pageid, 0, type);
+  stasis_buffer_concurrent_hash_handle_t *sh = (stasis_buffer_concurrent_hash_handle_t*)h;
+  if(sh && sh->ring_size && !bm->in_redo) {
+    return chScanLoadPage(bm, sh, xid, pageid, type);
+  }
+  return chLoadPageImpl_helper(bm, xid, sh ? sh->ph : 0, pageid, 0, type);
 }
 static Page * chLoadUninitPageImpl(stasis_buffer_manager_t *bm, int xid, const pageid_t pageid) {
   assert(!bm->in_redo);
@@ -399,12 +600,85 @@ static void chSimulateBufferManagerCrash(stasis_buffer_manager_t *bm) {
 static void chBufDeinit(stasis_buffer_manager_t * bm) {
   chBufDeinitHelper(bm, 0);
 }
+static int chResize(stasis_buffer_manager_t *bm, pageid_t size) {
+  stasis_buffer_concurrent_hash_t *ch = bm->impl;
+  if(size < 1) { return EINVAL; }
+  // The clock policy sweeps a fixed array of frames.  Frames released by a
+  // shrink stay in the array, but are skipped until they are reinserted.
+  if(ch->maxFrameCount != -1 && size > ch->maxFrameCount) { return ENOTSUP; }
+
+  if(size > ch->frameCount) {
+    pageid_t count = size - ch->frameCount;
+    stasis_buffer_pool_reserve(ch->buffer_pool, count);
+    for(pageid_t i = 0; i < count; i++) {
+      Page *p = stasis_buffer_pool_malloc_page(ch->buffer_pool);
+      p->prev = p->next = NULL;
+      p->pinCount = 1;
+      // As in deinitTLS(), the frame has to be in the hash before it enters the replacement policy.
+      do {
+        stasis_buffer_pool_free_page(ch->buffer_pool, p, ch->nextFrameId);
+        ch->nextFrameId--;
+      } while(hashtable_test_and_set(ch->ht, p->id, p));
+      ch->lru->insert(ch->lru, p);  // decrements pin count ptr (setting it to zero)
+    }
+  } else {
+    // Evict pages the same way application threads do.  Dirty victims are
+    // written back (and removed from the dirty page table) before their
+    // frames are released.
+    pageid_t count = ch->frameCount - size;
+    // The dirty page limits were just lowered; let writeback catch up.
+    pthread_cond_signal(&ch->needFree);
+    for(pageid_t i = 0; i < count; i++) {
+      Page *p = chGetFreeFrame(bm);
+      stasis_buffer_pool_release_page(ch->buffer_pool, p);
+    }
+  }
+  ch->frameCount = size;
+  // ARC sizes its ghost queues and T1 target from the number of frames.
+  if(ch->lru->setCapacity) {
+    ch->lru->setCapacity(ch->lru, size);
+  }
+  return 0;
+}
 static stasis_buffer_manager_handle_t * chOpenHandle(stasis_buffer_manager_t *bm, int is_sequential) {
   stasis_buffer_concurrent_hash_t * bh = bm->impl;
-  return (stasis_buffer_manager_handle_t*)bh->page_handle->dup(bh->page_handle, is_sequential);
+  stasis_page_handle_t * ph = bh->page_handle->dup(bh->page_handle, is_sequential);
+  if(!ph) { return NULL; }
+  stasis_buffer_concurrent_hash_handle_t * sh = malloc(sizeof(*sh));
+  sh->ph = ph;
+  sh->ring_size = 0;
+  if(is_sequential) {
+    pageid_t max_ring = bh->frameCount / 8;
+    sh->ring_size = stasis_buffer_manager_scan_ring_size < max_ring ? stasis_buffer_manager_scan_ring_size : max_ring;
+    // With fewer than two frames, the scan would evict the page it just returned.
+    if(sh->ring_size < 2) { sh->ring_size = 0; }
+  }
+  sh->ring = sh->ring_size ? calloc(sh->ring_size, sizeof(Page*)) : NULL;
+  sh->ring_next = 0;
+  sh->readahead = stasis_buffer_manager_scan_readahead < sh->ring_size / 2 ? stasis_buffer_manager_scan_readahead : sh->ring_size / 2;
+  if(sh->readahead < 1) { sh->readahead = 1; }
+  sh->next_pageid = INVALID_PAGE;
+  return (stasis_buffer_manager_handle_t*)sh;
 }
 static int chCloseHandle(stasis_buffer_manager_t *bm, stasis_buffer_manager_handle_t* h) {
-  ((stasis_page_handle_t*)h)->close((stasis_page_handle_t*)h);
+  stasis_buffer_concurrent_hash_t * ch = bm->impl;
+  stasis_buffer_concurrent_hash_handle_t * sh = (stasis_buffer_concurrent_hash_handle_t*)h;
+  for(int i = 0; i < sh->ring_size; i++) {
+    Page * p = sh->ring[i];
+    if(!p) { continue; }
+    if(chScanEvict(bm, p)) {
+      // Return the frame to the buffer manager, as in deinitTLS().
+      p->id = -2;
+      while(hashtable_test_and_set(ch->ht, p->id, p)) {
+        p->id --;
+      }
+    }
+    // Drop the ring's pin.  Pages that are still cached become ordinary pages.
+    ch->lru->insert(ch->lru, p);
+  }
+  free(sh->ring);
+  sh->ph->close(sh->ph);
+  free(sh);
   return 0;
 }
 
@@ -421,11 +695,13 @@ stasis_buffer_manager_t* stasis_buffer_manager_concurrent_hash_open(stasis_page_
   bm->releasePageImpl = chReleasePage;
   bm->writeBackPage = chWriteBackPage;
   bm->tryToWriteBackPage = chTryToWriteBackPage;
+  bm->tryToWriteBackPages = chTryToWriteBackPages;
   bm->forcePages = chForcePages;
   bm->asyncForcePages = chAsyncForcePages;
   bm->forcePageRange = chForcePageRange;
   bm->stasis_buffer_manager_close = chBufDeinit;
   bm->stasis_buffer_manager_simulate_crash = chSimulateBufferManagerCrash;
+  bm->resize = chResize;
 
   bm->impl = ch;
 
@@ -447,6 +723,14 @@ stasis_buffer_manager_t* stasis_buffer_manager_concurrent_hash_open(stasis_page_
     }
     ch->lru = replacementPolicyConcurrentWrapperInit(lrus, 37);
     free(lrus);
+  } else if(stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_ARC) {
+    // Each partition of the wrapper gets its own share of the cache.
+    replacementPolicy ** arcs = malloc(sizeof(arcs[0]) * 37);
+    for(int i = 0; i < 37; i++) {
+      arcs[i] = replacementPolicyArcInit(stasis_buffer_manager_size / 37);
+    }
+    ch->lru = replacementPolicyConcurrentWrapperInit(arcs, 37);
+    free(arcs);
   } else if(stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_THREADSAFE_LRU) {
     ch->lru = replacementPolicyThreadsafeWrapperInit(lruFastInit());
   } else if(stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_CLOCK) {
@@ -464,6 +748,9 @@ stasis_buffer_manager_t* stasis_buffer_manager_concurrent_hash_open(stasis_page_
   }
 
   ch->pageCount = 0;
+  ch->frameCount = stasis_buffer_manager_size;
+  ch->nextFrameId = -2 - stasis_buffer_manager_size;
+  ch->maxFrameCount = stasis_replacement_policy == STASIS_REPLACEMENT_POLICY_CLOCK ? stasis_buffer_manager_size : -1;
 
   ch->running = 1;
 
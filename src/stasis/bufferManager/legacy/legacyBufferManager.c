@@ -64,10 +64,12 @@ stasis_buffer_manager_t* stasis_buffer_manager_deprecated_open(stasis_page_handl
   bm->preallocatePages = NULL;
   bm->getCachedPageImpl = bufManGetCachedPage;
   bm->writeBackPage = pageWrite_legacyWrapper;
+  bm->tryToWriteBackPages = NULL;
   bm->forcePages = forcePageFile_legacyWrapper;
   bm->forcePageRange = forceRangePageFile_legacyWrapper;
   bm->stasis_buffer_manager_close = bufManBufDeinit;
   bm->stasis_buffer_manager_simulate_crash = bufManSimulateBufferManagerCrash;
+  bm->resize = NULL;
 
   stasis_buffer_pool = stasis_buffer_pool_init();
 
@@ -40,7 +40,7 @@ static void pfPageRead(stasis_page_handle_t * h, Page *ret, pagetype_t type) {
   pageid_t pageoffset;
   pageid_t offset;
 
-  pageoffset = ret->id * PAGE_SIZE;
+  pageoffset = stasis_page_file_offset(ret->id);
   pthread_mutex_lock(&stable_mutex);
 
 
@@ -82,7 +82,7 @@ static void pfPageWrite(stasis_page_handle_t * h, Page * ret) {
     DEBUG(" =^)~ ");
     return;
   }
-  pageid_t pageoffset = ret->id * PAGE_SIZE;
+  pageid_t pageoffset = stasis_page_file_offset(ret->id);
   pageid_t offset ;
 
   stasis_page_flushed(ret);
@@ -158,6 +158,28 @@ stasis_page_handle_t*  openPageFile(stasis_log_t * log, stasis_dirty_page_table_
     abort();
   }
 
+  byte * buf = calloc(1, STASIS_MAX_PAGE_SIZE);
+  if(pread(stable, buf, STASIS_MIN_PAGE_SIZE, 0) == -1) {
+    perror("couldn't read storefile header");
+    fflush(NULL);
+    abort();
+  }
+  struct stat st;
+  if(fstat(stable, &st)) {
+    perror("couldn't stat storefile");
+    fflush(NULL);
+    abort();
+  }
+  if(!stasis_page_file_header_load((stasis_page_file_header_t*)buf, st.st_size)) {
+    stasis_page_file_header_init((stasis_page_file_header_t*)buf);
+    if(pwrite(stable, buf, PAGE_SIZE, 0) != PAGE_SIZE) {
+      perror("couldn't write storefile header");
+      fflush(NULL);
+      abort();
+    }
+  }
+  free(buf);
+
   pthread_mutex_init(&stable_mutex, NULL);
   return ret;
 }
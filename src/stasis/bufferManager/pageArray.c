@@ -95,11 +95,13 @@ stasis_buffer_manager_t * stasis_buffer_manager_mem_array_open () {
   bm->getCachedPageImpl = paGetCachedPage;
   bm->writeBackPage = paWriteBackPage;
   bm->tryToWriteBackPage = paWriteBackPage;
+  bm->tryToWriteBackPages = NULL;
   bm->forcePages = paForcePages;
   bm->asyncForcePages = paAsyncForcePages;
   bm->forcePageRange = paForcePageRange;
   bm->stasis_buffer_manager_close = paBufDeinit;
   bm->stasis_buffer_manager_simulate_crash = paBufDeinit;
+  bm->resize = NULL;
   bm->impl = pa;
   pa->pageCount = 0;
   pa->pageMap = 0;
@@ -54,79 +54,138 @@ terms specified in this license.
 #include <stasis/bufferPool.h>
 #include <stasis/page.h>
 #include <assert.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/**
+   A contiguous array of page frames.  The pool starts with a single
+   extent, and stasis_buffer_pool_reserve() adds more.  Extents are
+   never freed before stasis_buffer_pool_deinit(), since the buffer
+   managers rely on Page pointers remaining valid forever.
+ */
+typedef struct {
+  Page* pool;
+  pageid_t count;
+  void * addr_to_free;
+} stasis_buffer_pool_extent_t;
 
 struct stasis_buffer_pool_t {
 	pageid_t nextPage;
-	Page* pool;
+	stasis_buffer_pool_extent_t * extents;
+	int extent_count;
+	/** Frames that were handed back by stasis_buffer_pool_release_page(). */
+	Page ** released;
+	pageid_t released_count;
+	pageid_t released_size;
 	pthread_mutex_t mut;
-	void * addr_to_free;
 };
 
-stasis_buffer_pool_t* stasis_buffer_pool_init() {
-
-  stasis_buffer_pool_t * ret = malloc(sizeof(*ret));
-
-  ret->nextPage = 0;
-
-  pthread_mutex_init(&(ret->mut), NULL);
+static void stasis_buffer_pool_add_extent(stasis_buffer_pool_t * ret, pageid_t count) {
+  stasis_buffer_pool_extent_t * e;
+  ret->extents = realloc(ret->extents, sizeof(ret->extents[0]) * (ret->extent_count+1));
+  e = &ret->extents[ret->extent_count];
+  ret->extent_count++;
+  e->count = count;
 
 #ifndef VALGRIND_MODE
 
-  byte * bufferSpace = malloc((stasis_buffer_manager_size + 2) * PAGE_SIZE);
+  byte * bufferSpace = malloc((count + 1) * PAGE_SIZE);
   assert(bufferSpace);
-  ret->addr_to_free = bufferSpace;
+  e->addr_to_free = bufferSpace;
 
   bufferSpace = (byte*)(((long)bufferSpace) +
 			PAGE_SIZE -
 			(((long)bufferSpace) % PAGE_SIZE));
 #else
-  fprintf(stderr, "WARNING: VALGRIND_MODE #defined; Using memory allocation strategy designed to catch bugs under valgrind\n");
+  e->addr_to_free = 0;
 #endif // VALGRIND_MODE
 
-  // We need one dummy page for locking purposes,
-  //  so this array has one extra page in it.
-  ret->pool = malloc(sizeof(ret->pool[0])*(stasis_buffer_manager_size+1));
+  e->pool = malloc(sizeof(e->pool[0])*count);
 
-  for(pageid_t i = 0; i < stasis_buffer_manager_size+1; i++) {
-    ret->pool[i].rwlatch = initlock();
-    ret->pool[i].loadlatch = initlock();
+  for(pageid_t i = 0; i < count; i++) {
+    e->pool[i].rwlatch = initlock();
+    e->pool[i].loadlatch = initlock();
 #ifndef VALGRIND_MODE
-    ret->pool[i].memAddr = &(bufferSpace[i*PAGE_SIZE]);
+    e->pool[i].memAddr = &(bufferSpace[i*PAGE_SIZE]);
 #else
-    ret->pool[i].memAddr = malloc(PAGE_SIZE);
+    e->pool[i].memAddr = malloc(PAGE_SIZE);
 #endif
-    ret->pool[i].dirty = 0;
-    ret->pool[i].needsFlush = 0;
+    e->pool[i].dirty = 0;
+    e->pool[i].needsFlush = 0;
+    // Not in any replacement policy yet; the clock skips pinned frames.
+    e->pool[i].next = e->pool[i].prev = NULL;
+    e->pool[i].pinCount = 1;
+    e->pool[i].queue = 0;
   }
+  ret->nextPage = 0;
+}
+
+stasis_buffer_pool_t* stasis_buffer_pool_init() {
+
+  stasis_buffer_pool_t * ret = malloc(sizeof(*ret));
+
+  ret->extents = 0;
+  ret->extent_count = 0;
+  ret->released = 0;
+  ret->released_count = 0;
+  ret->released_size = 0;
+
+  pthread_mutex_init(&(ret->mut), NULL);
+
+#ifdef VALGRIND_MODE
+  fprintf(stderr, "WARNING: VALGRIND_MODE #defined; Using memory allocation strategy designed to catch bugs under valgrind\n");
+#endif // VALGRIND_MODE
+
+  // We need one dummy page for locking purposes,
+  //  so this extent has one extra page in it.
+  stasis_buffer_pool_add_extent(ret, stasis_buffer_manager_size+1);
+
   return ret;
 }
 
 void stasis_buffer_pool_deinit(stasis_buffer_pool_t * ret) {
-  for(pageid_t i = 0; i < stasis_buffer_manager_size+1; i++) {
-    deletelock(ret->pool[i].rwlatch);
-    deletelock(ret->pool[i].loadlatch);
+  for(int e = 0; e < ret->extent_count; e++) {
+    stasis_buffer_pool_extent_t * ext = &ret->extents[e];
+    for(pageid_t i = 0; i < ext->count; i++) {
+      deletelock(ext->pool[i].rwlatch);
+      deletelock(ext->pool[i].loadlatch);
 #ifdef VALGRIND_MODE
-    free(ret->pool[i].memAddr);
+      free(ext->pool[i].memAddr);
 #endif
-  }
+    }
 #ifndef VALGRIND_MODE
-  free(ret->addr_to_free); // breaks efence
+    free(ext->addr_to_free); // breaks efence
 #endif
-  free(ret->pool);
+    free(ext->pool);
+  }
+  free(ret->extents);
+  free(ret->released);
   pthread_mutex_destroy(&ret->mut);
   free(ret);
 }
 
+static void stasis_buffer_pool_push_released(stasis_buffer_pool_t * ret, Page * p) {
+  if(ret->released_count == ret->released_size) {
+    ret->released_size = ret->released_size ? ret->released_size * 2 : 16;
+    ret->released = realloc(ret->released, sizeof(ret->released[0]) * ret->released_size);
+  }
+  ret->released[ret->released_count++] = p;
+}
+
 Page* stasis_buffer_pool_malloc_page(stasis_buffer_pool_t * ret) {
   Page *page;
 
   pthread_mutex_lock(&ret->mut);
 
-  page = &(ret->pool[ret->nextPage]);
+  if(ret->released_count) {
+    page = ret->released[--ret->released_count];
+  } else {
+    stasis_buffer_pool_extent_t * e = &ret->extents[ret->extent_count-1];
+    assert(ret->nextPage < e->count);
+    page = &(e->pool[ret->nextPage]);
+    (ret->nextPage)++;
+  }
   assert(!page->dirty);
-  (ret->nextPage)++;
-  /* There's a dummy page that we need to keep around, thus the +1 */
-  assert(ret->nextPage <= stasis_buffer_manager_size + 1);
 
   pthread_mutex_unlock(&ret->mut);
 
@@ -134,6 +193,35 @@ Page* stasis_buffer_pool_malloc_page(stasis_buffer_pool_t * ret) {
 
 }
 
+void stasis_buffer_pool_reserve(stasis_buffer_pool_t * ret, pageid_t count) {
+  pthread_mutex_lock(&ret->mut);
+  stasis_buffer_pool_extent_t * e = &ret->extents[ret->extent_count-1];
+  pageid_t available = ret->released_count + (e->count - ret->nextPage);
+  if(available < count) {
+    // Don't strand the tail of the current extent.
+    while(ret->nextPage < e->count) {
+      stasis_buffer_pool_push_released(ret, &e->pool[ret->nextPage++]);
+    }
+    stasis_buffer_pool_add_extent(ret, count - available);
+  }
+  pthread_mutex_unlock(&ret->mut);
+}
+
+void stasis_buffer_pool_release_page(stasis_buffer_pool_t * ret, Page * p) {
+  assert(!p->dirty);
+#ifndef VALGRIND_MODE
+  // Return the frame's memory to the operating system.  It will be
+  // zero filled if the frame is reused.
+  long os_page_size = sysconf(_SC_PAGESIZE);
+  if(os_page_size > 0 && PAGE_SIZE % os_page_size == 0) {
+    madvise(p->memAddr, PAGE_SIZE, MADV_DONTNEED);
+  }
+#endif
+  pthread_mutex_lock(&ret->mut);
+  stasis_buffer_pool_push_released(ret, p);
+  pthread_mutex_unlock(&ret->mut);
+}
+
 void stasis_buffer_pool_free_page(stasis_buffer_pool_t * ret, Page *p, pageid_t id) {
   writelock(p->rwlatch, 10);
   p->id = id;
@@ -145,5 +233,5 @@ void stasis_buffer_pool_free_page(stasis_buffer_pool_t * ret, Page *p, pageid_t
 }
 
 Page * stasis_buffer_pool_get_underlying_array(stasis_buffer_pool_t *ret) {
-  return ret->pool;
+  return ret->extents[0].pool;
 }
@@ -6,8 +6,6 @@
  */
 #include <config.h>
 #include <stasis/common.h>
-#include <stasis/util/redblack.h>
-#include <stasis/util/multiset.h>
 #include <stasis/util/latches.h>
 #include <stasis/util/time.h>
 #include <stasis/flags.h>
@@ -15,36 +13,319 @@
 #include <stasis/page.h>
 #include <stdio.h>
 
+/**
+   The dirty page table is split into independently latched shards, so that
+   dirty / clean transitions on different pages do not contend with each
+   other.  Each shard keeps its entries in a min-heap ordered by recLSN (so
+   minRecLSN() just merges the shards' heap tops), and an open-addressed
+   index from page id to heap slot (so set_clean() can find an entry in
+   constant time).  Both arrays only grow, so steady-state transitions never
+   call malloc().
+
+   Ordered traversals (by page for writeback, by LSN for truncation) copy the
+   relevant entries out of each shard into a sorted run, and then merge the
+   runs.  Callers that only want the first few entries (such as
+   get_flush_candidates()) bound each run, so they never sort more than they
+   return, and they stop merging once they have enough.
+ */
+#define DPT_SHARD_COUNT 64
+#define DPT_CACHE_LINE_SIZE 64
+
 typedef struct {
   pageid_t p;
   lsn_t lsn;
 } dpt_entry;
 
+typedef struct {
+  pageid_t p;   // -1 if the slot is empty.
+  pageid_t idx; // The position of p in the shard's heap.
+} dpt_slot;
 
-static int dpt_cmp_page(const void *ap, const void * bp, const void * ignored) {
+typedef struct {
+  pthread_mutex_t mutex;
+  dpt_entry * heap;
+  pageid_t count;
+  pageid_t heap_size;
+  dpt_slot * slots;
+  pageid_t slot_count; // always a power of two
+  // Keep shards on separate cache lines; the table is allocated with
+  // posix_memalign() so that this holds.
+} __attribute__((aligned(DPT_CACHE_LINE_SIZE))) dpt_shard;
+
+static int dpt_cmp_page(const void *ap, const void * bp) {
   const dpt_entry * a = ap;
   const dpt_entry * b = bp;
   return (a->p < b->p) ? -1 : ((a->p == b->p) ? 0 : 1);
 }
-static int dpt_cmp_lsn_and_page(const void *ap, const void * bp, const void * ignored) {
+static int dpt_cmp_lsn_and_page(const void *ap, const void * bp) {
   const dpt_entry * a = ap;
   const dpt_entry * b = bp;
 
-  return (a->lsn < b->lsn) ? -1 : ((a->lsn == b->lsn) ? dpt_cmp_page(ap, bp, 0) : 1);
+  return (a->lsn < b->lsn) ? -1 : ((a->lsn == b->lsn) ? dpt_cmp_page(ap, bp) : 1);
 }
 
 struct stasis_dirty_page_table_t {
-  struct rbtree * tableByPage;
-  struct rbtree * tableByLsnAndPage;
+  dpt_shard shards[DPT_SHARD_COUNT];
   stasis_buffer_manager_t * bufferManager;
   uint32_t count; // NOTE: this is 32 bit so that it is cheap to atomically manipulate it on 32 bit intels.
+  /** Protects flushing and waiting; never held by set_dirty() or set_clean(). */
   pthread_mutex_t mutex;
   pthread_cond_t flushDone;
   int flushing;
-  stasis_util_multiset_t * outstanding_flush_lsns;
+  /** The number of threads blocked in flush_with_target() waiting for minRecLSN to advance. */
+  int waiting;
   pthread_cond_t writebackCond;
 };
 
+static inline dpt_shard * dpt_shard_for(stasis_dirty_page_table_t * dpt, pageid_t p) {
+  return &dpt->shards[((uint64_t)p) % DPT_SHARD_COUNT];
+}
+static inline pageid_t dpt_slot_hash(dpt_shard * shard, pageid_t p) {
+  // Pages within a shard are congruent mod DPT_SHARD_COUNT; mix the bits.
+  return (pageid_t)((((uint64_t)p) * 0x9E3779B97F4A7C15ULL) >> 17) & (shard->slot_count - 1);
+}
+static dpt_slot * dpt_slot_find(dpt_shard * shard, pageid_t p) {
+  pageid_t i = dpt_slot_hash(shard, p);
+  while(shard->slots[i].p != -1) {
+    if(shard->slots[i].p == p) { return &shard->slots[i]; }
+    i = (i + 1) & (shard->slot_count - 1);
+  }
+  return 0;
+}
+static void dpt_slot_insert(dpt_shard * shard, pageid_t p, pageid_t idx) {
+  pageid_t i = dpt_slot_hash(shard, p);
+  while(shard->slots[i].p != -1) {
+    assert(shard->slots[i].p != p); // otherwise, the entry was already in the table.
+    i = (i + 1) & (shard->slot_count - 1);
+  }
+  shard->slots[i].p = p;
+  shard->slots[i].idx = idx;
+}
+static void dpt_slot_remove(dpt_shard * shard, dpt_slot * s) {
+  // Backward shift deletion; linear probing needs no tombstones.
+  pageid_t mask = shard->slot_count - 1;
+  pageid_t hole = s - shard->slots;
+  pageid_t i = hole;
+  while(1) {
+    i = (i + 1) & mask;
+    if(shard->slots[i].p == -1) { break; }
+    pageid_t home = dpt_slot_hash(shard, shard->slots[i].p);
+    // Can the entry at i be moved back into the hole?
+    if(((i - home) & mask) >= ((i - hole) & mask)) {
+      shard->slots[hole] = shard->slots[i];
+      hole = i;
+    }
+  }
+  shard->slots[hole].p = -1;
+}
+static void dpt_shard_grow(dpt_shard * shard) {
+  if(shard->count == shard->heap_size) {
+    shard->heap_size *= 2;
+    shard->heap = realloc(shard->heap, sizeof(dpt_entry) * shard->heap_size);
+  }
+  if(2 * (shard->count + 1) > shard->slot_count) {
+    pageid_t old_count = shard->slot_count;
+    dpt_slot * old = shard->slots;
+    shard->slot_count *= 2;
+    shard->slots = malloc(sizeof(dpt_slot) * shard->slot_count);
+    for(pageid_t i = 0; i < shard->slot_count; i++) { shard->slots[i].p = -1; }
+    for(pageid_t i = 0; i < old_count; i++) {
+      if(old[i].p != -1) { dpt_slot_insert(shard, old[i].p, old[i].idx); }
+    }
+    free(old);
+  }
+}
+static inline void dpt_heap_set(dpt_shard * shard, pageid_t i, dpt_entry e) {
+  shard->heap[i] = e;
+  dpt_slot_find(shard, e.p)->idx = i;
+}
+static void dpt_heap_sift_up(dpt_shard * shard, pageid_t i) {
+  dpt_entry e = shard->heap[i];
+  while(i > 0) {
+    pageid_t parent = (i - 1) / 2;
+    if(dpt_cmp_lsn_and_page(&shard->heap[parent], &e) <= 0) { break; }
+    dpt_heap_set(shard, i, shard->heap[parent]);
+    i = parent;
+  }
+  dpt_heap_set(shard, i, e);
+}
+static void dpt_heap_sift_down(dpt_shard * shard, pageid_t i) {
+  dpt_entry e = shard->heap[i];
+  while(1) {
+    pageid_t child = 2 * i + 1;
+    if(child >= shard->count) { break; }
+    if(child + 1 < shard->count &&
+       dpt_cmp_lsn_and_page(&shard->heap[child+1], &shard->heap[child]) < 0) {
+      child++;
+    }
+    if(dpt_cmp_lsn_and_page(&e, &shard->heap[child]) <= 0) { break; }
+    dpt_heap_set(shard, i, shard->heap[child]);
+    i = child;
+  }
+  dpt_heap_set(shard, i, e);
+}
+/** @return the recLSN of p, which must be in the shard. */
+static lsn_t dpt_shard_remove(dpt_shard * shard, pageid_t p) {
+  dpt_slot * s = dpt_slot_find(shard, p);
+  assert(s);
+  pageid_t i = s->idx;
+  assert(shard->heap[i].p == p);
+  lsn_t lsn = shard->heap[i].lsn;
+  dpt_slot_remove(shard, s);
+  shard->count--;
+  if(i != shard->count) {
+    dpt_entry last = shard->heap[shard->count];
+    shard->heap[i] = last;
+    dpt_slot_find(shard, last.p)->idx = i;
+    if(i > 0 && dpt_cmp_lsn_and_page(&shard->heap[(i-1)/2], &last) > 0) {
+      dpt_heap_sift_up(shard, i);
+    } else {
+      dpt_heap_sift_down(shard, i);
+    }
+  }
+  return lsn;
+}
+/**
+   Add e to run, which holds at most limit entries (0 means no limit).  A
+   bounded run is kept as a max-heap under cmp, so that once it is full, e
+   only displaces the largest entry it holds.
+ */
+static void dpt_run_offer(dpt_entry ** run, pageid_t * n, pageid_t * size, pageid_t limit,
+                          int (*cmp)(const void*, const void*), dpt_entry e) {
+  if(limit && *n == limit) {
+    if(cmp(&e, &(*run)[0]) >= 0) { return; }
+    // Replace the root, and sift it down.
+    pageid_t i = 0;
+    while(1) {
+      pageid_t child = 2 * i + 1;
+      if(child >= *n) { break; }
+      if(child + 1 < *n && cmp(&(*run)[child+1], &(*run)[child]) > 0) { child++; }
+      if(cmp(&e, &(*run)[child]) >= 0) { break; }
+      (*run)[i] = (*run)[child];
+      i = child;
+    }
+    (*run)[i] = e;
+    return;
+  }
+  if(*n == *size) {
+    *size = *size ? 2 * *size : 64;
+    if(limit && *size > limit) { *size = limit; }
+    *run = realloc(*run, sizeof(dpt_entry) * *size);
+  }
+  pageid_t i = (*n)++;
+  if(limit) {
+    while(i > 0 && cmp(&(*run)[(i-1)/2], &e) < 0) {
+      (*run)[i] = (*run)[(i-1)/2];
+      i = (i-1)/2;
+    }
+  }
+  (*run)[i] = e;
+}
+/** Offer the entries in the subheap rooted at i with lsn < targetLsn to run. */
+static void dpt_shard_collect(dpt_shard * shard, pageid_t i, pageid_t start, pageid_t stop, lsn_t targetLsn,
+                              pageid_t limit, int (*cmp)(const void*, const void*),
+                              dpt_entry ** run, pageid_t * n, pageid_t * size) {
+  if(i >= shard->count || shard->heap[i].lsn >= targetLsn) { return; }
+  dpt_entry * e = &shard->heap[i];
+  if(e->p >= start && (stop == 0 || e->p < stop)) {
+    dpt_run_offer(run, n, size, limit, cmp, *e);
+  }
+  dpt_shard_collect(shard, 2*i+1, start, stop, targetLsn, limit, cmp, run, n, size);
+  dpt_shard_collect(shard, 2*i+2, start, stop, targetLsn, limit, cmp, run, n, size);
+}
+
+/**
+   A k-way merge over sorted runs copied out of each shard.
+ */
+typedef struct {
+  int (*cmp)(const void*, const void*);
+  dpt_entry * runs[DPT_SHARD_COUNT];
+  pageid_t pos[DPT_SHARD_COUNT];
+  pageid_t len[DPT_SHARD_COUNT];
+  /** Min-heap of the non-empty runs, ordered by their next entry. */
+  int heap[DPT_SHARD_COUNT];
+  int count;
+} dpt_merge;
+
+static inline int dpt_merge_cmp(dpt_merge * m, int a, int b) {
+  return m->cmp(&m->runs[a][m->pos[a]], &m->runs[b][m->pos[b]]);
+}
+static void dpt_merge_sift_down(dpt_merge * m, int i) {
+  int r = m->heap[i];
+  while(1) {
+    int child = 2 * i + 1;
+    if(child >= m->count) { break; }
+    if(child + 1 < m->count && dpt_merge_cmp(m, m->heap[child+1], m->heap[child]) < 0) { child++; }
+    if(dpt_merge_cmp(m, r, m->heap[child]) <= 0) { break; }
+    m->heap[i] = m->heap[child];
+    i = child;
+  }
+  m->heap[i] = r;
+}
+/**
+   Copy the entries for pages in [start, stop) with recLSN < targetLsn out
+   of the table (stop == 0 means no upper bound), in the order given by
+   cmp.  If limit is non-zero, only the first limit entries of each shard
+   are kept, which is enough for callers that will read at most limit
+   entries from the merge.
+ */
+static void dpt_merge_init(dpt_merge * m, stasis_dirty_page_table_t * dirtyPages, pageid_t start, pageid_t stop,
+                           lsn_t targetLsn, pageid_t limit, int (*cmp)(const void*, const void*)) {
+  m->cmp = cmp;
+  m->count = 0;
+  for(int i = 0; i < DPT_SHARD_COUNT; i++) {
+    dpt_shard * shard = &dirtyPages->shards[i];
+    pageid_t size = 0;
+    m->runs[i] = 0;
+    m->pos[i] = 0;
+    m->len[i] = 0;
+    pthread_mutex_lock(&shard->mutex);
+    dpt_shard_collect(shard, 0, start, stop, targetLsn, limit, cmp, &m->runs[i], &m->len[i], &size);
+    pthread_mutex_unlock(&shard->mutex);
+    if(m->len[i]) {
+      qsort(m->runs[i], m->len[i], sizeof(dpt_entry), cmp);
+      m->heap[m->count++] = i;
+    }
+  }
+  for(int i = m->count / 2 - 1; i >= 0; i--) {
+    dpt_merge_sift_down(m, i);
+  }
+}
+/** @return 1 and set *e to the next entry, or 0 if the runs are exhausted. */
+static int dpt_merge_next(dpt_merge * m, dpt_entry * e) {
+  if(!m->count) { return 0; }
+  int r = m->heap[0];
+  *e = m->runs[r][m->pos[r]];
+  m->pos[r]++;
+  if(m->pos[r] == m->len[r]) {
+    m->heap[0] = m->heap[--m->count];
+  }
+  if(m->count) { dpt_merge_sift_down(m, 0); }
+  return 1;
+}
+static void dpt_merge_deinit(dpt_merge * m) {
+  for(int i = 0; i < DPT_SHARD_COUNT; i++) {
+    free(m->runs[i]);
+  }
+}
+/**
+   Merge every matching entry into a single array; see dpt_merge_init().
+
+   @return a malloc()ed array, which the caller must free.
+ */
+static dpt_entry * dpt_snapshot(stasis_dirty_page_table_t * dirtyPages, pageid_t start, pageid_t stop, lsn_t targetLsn,
+                                int (*cmp)(const void*, const void*), pageid_t * n) {
+  dpt_merge m;
+  dpt_merge_init(&m, dirtyPages, start, stop, targetLsn, 0, cmp);
+  pageid_t len = 0;
+  for(int i = 0; i < DPT_SHARD_COUNT; i++) { len += m.len[i]; }
+  dpt_entry * buf = malloc(sizeof(dpt_entry) * (len ? len : 1));
+  *n = 0;
+  while(dpt_merge_next(&m, &buf[*n])) { (*n)++; }
+  dpt_merge_deinit(&m);
+  return buf;
+}
+
 void stasis_dirty_page_table_set_dirty(stasis_dirty_page_table_t * dirtyPages, Page * p) {
   if(!p->dirty) {
     while(stasis_dirty_page_table_dirty_count(dirtyPages)
@@ -52,64 +333,51 @@ void stasis_dirty_page_table_set_dirty(stasis_dirty_page_table_t * dirtyPages, P
       struct timespec ts = stasis_double_to_timespec(0.01);
       nanosleep(&ts,0);
     }
-    pthread_mutex_lock(&dirtyPages->mutex);
+    dpt_shard * shard = dpt_shard_for(dirtyPages, p->id);
+    pthread_mutex_lock(&shard->mutex);
     if(!p->dirty) {
       p->dirty = 1;
-      dpt_entry * e = malloc(sizeof(*e));
-      e->p = p->id;
-      e->lsn = p->LSN;
-      const void * ret = rbsearch(e, dirtyPages->tableByPage);
-      assert(ret == e); // otherwise, the entry was already in the table.
-
-      e = malloc(sizeof(*e));
-      e->p = p->id;
-      e->lsn = p->LSN;
-      ret = rbsearch(e, dirtyPages->tableByLsnAndPage);
-      assert(ret == e); // otherwise, the entry was already in the table.
+      dpt_shard_grow(shard);
+      dpt_entry e = { p->id, p->LSN };
+      shard->heap[shard->count] = e;
+      dpt_slot_insert(shard, p->id, shard->count);
+      shard->count++;
+      dpt_heap_sift_up(shard, shard->count-1);
       FETCH_AND_ADD(&dirtyPages->count,1);
     }
-    pthread_mutex_unlock(&dirtyPages->mutex);
+    pthread_mutex_unlock(&shard->mutex);
 #ifdef SANITY_CHECKS
   } else {
-    pthread_mutex_lock(&dirtyPages->mutex);
-    dpt_entry e = { p->id, 0};
-    assert(rbfind(&e, dirtyPages->tableByPage));
-    pthread_mutex_unlock(&dirtyPages->mutex);
+    dpt_shard * shard = dpt_shard_for(dirtyPages, p->id);
+    pthread_mutex_lock(&shard->mutex);
+    assert(dpt_slot_find(shard, p->id));
+    pthread_mutex_unlock(&shard->mutex);
 #endif //SANITY_CHECKS
   }
 }
 
 void stasis_dirty_page_table_set_clean(stasis_dirty_page_table_t * dirtyPages, Page * p) {
   if(p->dirty) {
-    pthread_mutex_lock(&dirtyPages->mutex);
+    dpt_shard * shard = dpt_shard_for(dirtyPages, p->id);
+    int waiting = 0;
+    pthread_mutex_lock(&shard->mutex);
     if(p->dirty) {
-      dpt_entry dummy = {p->id, 0};
-
-      const dpt_entry * e = rbdelete(&dummy, dirtyPages->tableByPage);
-      assert(e);
-      assert(e->p == p->id);
-      dummy.lsn = e->lsn;
-      free((void*)e);
-
-      e = rbdelete(&dummy, dirtyPages->tableByLsnAndPage);
-      assert(e);
-      assert(e->p == p->id);
-      assert(e->lsn == dummy.lsn);
-      free((void*)e);
+      dpt_shard_remove(shard, p->id);
       assert(p->dirty);
       p->dirty = 0;
 
-      lsn_t min_waiting = stasis_util_multiset_min(dirtyPages->outstanding_flush_lsns);
-      e = rbmin(dirtyPages->tableByLsnAndPage);
-      if(dummy.lsn >= min_waiting &&
-         (!e || e->lsn >= min_waiting)) {
-        pthread_cond_broadcast( &dirtyPages->writebackCond );
-      }
-
       //dirtyPages->count--;
       FETCH_AND_ADD(&dirtyPages->count, -1);
+      // Sampled while holding the shard latch; see flush_with_target().
+      waiting = ATOMIC_READ_32(0, &dirtyPages->waiting);
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    if(waiting) {
+      // Some thread is waiting for minRecLSN to advance; let it recheck.
+      pthread_mutex_lock(&dirtyPages->mutex);
+      pthread_cond_broadcast( &dirtyPages->writebackCond );
+      pthread_mutex_unlock(&dirtyPages->mutex);
     }
-    pthread_mutex_unlock(&dirtyPages->mutex);
   }
 }
 
@@ -118,20 +386,25 @@ int stasis_dirty_page_table_is_dirty(stasis_dirty_page_table_t * dirtyPages, Pag
 
   ret = p->dirty;
 #ifdef SANITY_CHECKS
-  pthread_mutex_lock(&dirtyPages->mutex);
-  dpt_entry e = { p->id, 0};
-  const void* found = rbfind(&e, dirtyPages->tableByPage);
+  dpt_shard * shard = dpt_shard_for(dirtyPages, p->id);
+  pthread_mutex_lock(&shard->mutex);
+  const void* found = dpt_slot_find(shard, p->id);
   assert((found && ret) || !(found||ret));
-  pthread_mutex_unlock(&dirtyPages->mutex);
+  pthread_mutex_unlock(&shard->mutex);
 #endif
   return ret;
 }
 
 lsn_t stasis_dirty_page_table_minRecLSN(stasis_dirty_page_table_t * dirtyPages) {
-  pthread_mutex_lock(&dirtyPages->mutex);
-  const dpt_entry * e = rbmin(dirtyPages->tableByLsnAndPage);
-  lsn_t lsn =  e ? e->lsn : LSN_T_MAX;
-  pthread_mutex_unlock(&dirtyPages->mutex);
+  lsn_t lsn = LSN_T_MAX;
+  for(int i = 0; i < DPT_SHARD_COUNT; i++) {
+    dpt_shard * shard = &dirtyPages->shards[i];
+    pthread_mutex_lock(&shard->mutex);
+    if(shard->count && shard->heap[0].lsn < lsn) {
+      lsn = shard->heap[0].lsn;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+  }
   return lsn;
 }
 
@@ -139,9 +412,63 @@ pageid_t stasis_dirty_page_table_dirty_count(stasis_dirty_page_table_t * dirtyPa
   return ATOMIC_READ_32(&dirtyPages->mutex, &dirtyPages->count);
 }
 
+/**
+   Write back the dirty pages with recLSN < targetLsn once, in the order
+   given by cmp, skipping any that are pinned.
+
+   @return 1 if every page was written back, 0 if some were busy.
+ */
+static int dpt_flush_pass(stasis_dirty_page_table_t * dirtyPages, lsn_t targetLsn,
+                          int (*cmp)(const void*, const void*)) {
+  const long stride = stasis_dirty_page_table_flush_quantum;
+  dpt_merge m;
+  dpt_entry e;
+  dpt_merge_init(&m, dirtyPages, 0, 0, targetLsn, 0, cmp);
+  long buffered = 0;
+  int all_flushed = 1;
+  if(dirtyPages->bufferManager->tryToWriteBackPages) {
+    // Hand each quantum to the buffer manager as a single batch.
+    pageid_t * batch = malloc(sizeof(pageid_t) * stride);
+    int count;
+    do {
+      for(count = 0; count < stride && dpt_merge_next(&m, &e); count++) {
+        batch[count] = e.p;
+      }
+      if(!count) { break; }
+      if(dirtyPages->bufferManager->tryToWriteBackPages(dirtyPages->bufferManager, batch, count)) {
+        all_flushed = 0;
+      }
+      if(count == stride) {
+        DEBUG("Forcing %lld pages A\n", (long long)stride);
+        dirtyPages->bufferManager->asyncForcePages(dirtyPages->bufferManager, 0);
+      }
+    } while(count == stride);
+    free(batch);
+  } else {
+    while(dpt_merge_next(&m, &e)) {
+      if (dirtyPages->bufferManager->tryToWriteBackPage(dirtyPages->bufferManager, e.p) == EBUSY) {
+        all_flushed = 0;
+      } else {
+        buffered++;
+      }
+      if(buffered == stride) {
+        DEBUG("Forcing %lld pages A\n", buffered);
+        buffered = 0;
+        dirtyPages->bufferManager->asyncForcePages(dirtyPages->bufferManager, 0);
+      }
+    }
+  }
+  dpt_merge_deinit(&m);
+  DEBUG("Forcing %lld pages B\n", buffered);
+  dirtyPages->bufferManager->asyncForcePages(dirtyPages->bufferManager, 0);
+
+  DEBUG("Finished elevator sweep.\n");
+
+  return all_flushed;
+}
+
 int stasis_dirty_page_table_flush_with_target(stasis_dirty_page_table_t * dirtyPages, lsn_t targetLsn) {
   DEBUG("stasis_dirty_page_table_flush_with_target called");
-  const long stride = stasis_dirty_page_table_flush_quantum;
   int all_flushed;
   pthread_mutex_lock(&dirtyPages->mutex);
   if (targetLsn == LSN_T_MAX) {
@@ -155,6 +482,7 @@ int stasis_dirty_page_table_flush_with_target(stasis_dirty_page_table_t * dirtyP
     }
     dirtyPages->flushing = 1;
   }
+  pthread_mutex_unlock(&dirtyPages->mutex);
 
   // Normally, we will be called by a background thread that wants to maximize
   // write back throughput, and sets targetLsn to LSN_T_MAX.
@@ -165,61 +493,16 @@ int stasis_dirty_page_table_flush_with_target(stasis_dirty_page_table_t * dirtyP
   // If we are writing back for the buffer manager, sort writebacks by page number.
   // Otherwise, sort them by the LSN that first dirtied the page.
   // TODO: Re-sort LSN ordered pages before passing them to the OS?
-  struct rbtree * tree = targetLsn == LSN_T_MAX ? dirtyPages->tableByPage
-                                                : dirtyPages->tableByLsnAndPage;
+  int (*cmp)(const void*, const void*) = targetLsn == LSN_T_MAX ? dpt_cmp_page
+                                                                : dpt_cmp_lsn_and_page;
 
-  long buffered = 0;
   do {
-    dpt_entry dummy = { 0, 0 };
-    pageid_t vals[stride];
-    int off = 0;
-    int strides = 0;
-    all_flushed = 1;
-    for(const dpt_entry * e = rblookup(RB_LUGTEQ, &dummy, tree);
-        e && e->lsn < targetLsn;
-        e = rblookup(RB_LUGREAT, &dummy, tree)) {
-      dummy = *e;
-      vals[off] = dummy.p;
-      off++;
-      if(off == stride) {
-        pthread_mutex_unlock(&dirtyPages->mutex);
-        for(pageid_t i = 0; i < off; i++) {
-          if (dirtyPages->bufferManager->tryToWriteBackPage(dirtyPages->bufferManager, vals[i]) == EBUSY) {
-            all_flushed = 0;
-          } else {
-            buffered++;
-          }
-          if(buffered == stride) {
-            DEBUG("Forcing %lld pages A\n", buffered);
-            buffered = 0;
-            dirtyPages->bufferManager->asyncForcePages(dirtyPages->bufferManager, 0);
-          }
-        }
-        off = 0;
-        strides++;
-        pthread_mutex_lock(&dirtyPages->mutex);
-      }
-    }
-    pthread_mutex_unlock(&dirtyPages->mutex);
-    for(pageid_t i = 0; i < off; i++) {
-      if (dirtyPages->bufferManager->tryToWriteBackPage(dirtyPages->bufferManager, vals[i]) == EBUSY) {
-        all_flushed = 0;
-      } else {
-        buffered++;
-      }
-      DEBUG("Forcing %lld pages B\n", buffered);
-      buffered = 0;
-    }
-    dirtyPages->bufferManager->asyncForcePages(dirtyPages->bufferManager, 0);
-    pthread_mutex_lock(&dirtyPages->mutex);
-    dpt_entry * e = ((dpt_entry*)rbmin(tree));
-
-    DEBUG("Finished elevator sweep.\n");
+    all_flushed = dpt_flush_pass(dirtyPages, targetLsn, cmp);
 
     if (!all_flushed &&
         targetLsn < LSN_T_MAX &&
         ATOMIC_READ_32(0, &dirtyPages->count) > 0 &&
-        e && targetLsn > e->lsn ) {
+        targetLsn > stasis_dirty_page_table_minRecLSN(dirtyPages)) {
       struct timespec ts;
       struct timeval tv;
 
@@ -244,62 +527,73 @@ int stasis_dirty_page_table_flush_with_target(stasis_dirty_page_table_t * dirtyP
       ts.tv_sec = tv.tv_sec;
       ts.tv_nsec = 1000*tv.tv_usec;
 
-      dpt_entry * e = ((dpt_entry*)rbmin(tree));
-
-      if(targetLsn != LSN_T_MAX) { stasis_util_multiset_insert(dirtyPages->outstanding_flush_lsns, targetLsn); }
+      pthread_mutex_lock(&dirtyPages->mutex);
+      // set_clean() samples waiting while holding a shard latch, so any page
+      // cleaned after minRecLSN() reads its shard below will wake us up.
+      FETCH_AND_ADD(&dirtyPages->waiting, 1);
 
-      while( e && targetLsn > e->lsn ) {
+      while( targetLsn > stasis_dirty_page_table_minRecLSN(dirtyPages) ) {
         if (pthread_cond_timedwait(&dirtyPages->writebackCond, &dirtyPages->mutex, &ts) == ETIMEDOUT) {
           all_flushed = 0;
           break;
         }
-        e = ((dpt_entry*)rbmin(tree));
-      }
-
-      if(targetLsn != LSN_T_MAX) {
-        int found = stasis_util_multiset_remove(dirtyPages->outstanding_flush_lsns, targetLsn);
-        assert(found);
       }
 
+      FETCH_AND_ADD(&dirtyPages->waiting, -1);
+      pthread_mutex_unlock(&dirtyPages->mutex);
     }
 
   } while(targetLsn != LSN_T_MAX && !all_flushed);
   if (targetLsn == LSN_T_MAX) {
+    pthread_mutex_lock(&dirtyPages->mutex);
     pthread_cond_broadcast(&dirtyPages->flushDone);
     dirtyPages->flushing = 0;
+    pthread_mutex_unlock(&dirtyPages->mutex);
   }
 
-  pthread_mutex_unlock(&dirtyPages->mutex);
-
   return 0;
 }
 
+int stasis_dirty_page_table_try_flush_with_target(stasis_dirty_page_table_t * dirtyPages, lsn_t targetLsn) {
+  return dpt_flush_pass(dirtyPages, targetLsn, dpt_cmp_lsn_and_page) ? 0 : EAGAIN;
+}
+
+stasis_checkpoint_page_t * stasis_dirty_page_table_checkpoint(stasis_dirty_page_table_t * dirtyPages, pageid_t * count) {
+  dpt_entry * vals = dpt_snapshot(dirtyPages, 0, 0, LSN_T_MAX, dpt_cmp_page, count);
+  stasis_checkpoint_page_t * ret = malloc(sizeof(*ret) * (*count ? *count : 1));
+  for(pageid_t i = 0; i < *count; i++) {
+    ret[i].page = vals[i].p;
+    ret[i].recLSN = vals[i].lsn;
+  }
+  free(vals);
+  return ret;
+}
+
 int stasis_dirty_page_table_flush(stasis_dirty_page_table_t * dirtyPages) {
     DEBUG("stasis_dirty_page_table_flush called");
     return stasis_dirty_page_table_flush_with_target(dirtyPages, LSN_T_MAX);
 }
 
 int stasis_dirty_page_table_get_flush_candidates(stasis_dirty_page_table_t * dirtyPages, pageid_t start, pageid_t stop, int count, pageid_t* range_starts, pageid_t* range_ends) {
-  pthread_mutex_lock(&dirtyPages->mutex);
   int n = 0;
   int b = -1;
-  dpt_entry dummy;
-  dummy.lsn = -1;
-  dummy.p = start;
-
-  for(const dpt_entry *e = rblookup(RB_LUGTEQ, &dummy, dirtyPages->tableByPage);
-      e && (stop == 0 || e->p < stop) && n < ATOMIC_READ_32(0, &count);
-      e = rblookup(RB_LUGREAT, e, dirtyPages->tableByPage)) {
-    if(n == 0 || range_ends[b] != e->p) {
+  if(count <= 0) { return 0; }
+  // Only the first count pages can be returned, so bound each shard's run.
+  dpt_merge m;
+  dpt_entry e;
+  dpt_merge_init(&m, dirtyPages, start, stop, LSN_T_MAX, count, dpt_cmp_page);
+
+  while(n < count && dpt_merge_next(&m, &e)) {
+    if(n == 0 || range_ends[b] != e.p) {
       b++;
-      range_starts[b] = e->p;
-      range_ends[b] = e->p+1;
+      range_starts[b] = e.p;
+      range_ends[b] = e.p+1;
     } else {
       range_ends[b]++;
     }
     n++;
   }
-  pthread_mutex_unlock(&dirtyPages->mutex);
+  dpt_merge_deinit(&m);
   return b+1;
 }
 void stasis_dirty_page_table_flush_range(stasis_dirty_page_table_t * dirtyPages, pageid_t start, pageid_t stop) {
@@ -315,25 +609,17 @@ void stasis_dirty_page_table_flush_range(stasis_dirty_page_table_t * dirtyPages,
       return;
     } // else, a call to flush returned, but that call could have been initiated before we were called...
   }
-
-  pageid_t * staleDirtyPages = 0;
-  pageid_t n = 0;
-  dpt_entry dummy = { start, 0 };
-  for(const dpt_entry * e = rblookup(RB_LUGTEQ, &dummy, dirtyPages->tableByPage);
-         e && (stop == 0 || e->p < stop);
-         e = rblookup(RB_LUGREAT, e, dirtyPages->tableByPage)) {
-    n++;
-    staleDirtyPages = realloc(staleDirtyPages, sizeof(pageid_t) * n);
-    staleDirtyPages[n-1] = e->p;
-  }
   pthread_mutex_unlock(&dirtyPages->mutex);
 
+  pageid_t n;
+  dpt_entry * staleDirtyPages = dpt_snapshot(dirtyPages, start, stop, LSN_T_MAX, dpt_cmp_page, &n);
+
   for(pageid_t i = 0; i < n; i++) {
     if(stop) {
-      int err = dirtyPages->bufferManager->writeBackPage(dirtyPages->bufferManager, staleDirtyPages[i]);
+      int err = dirtyPages->bufferManager->writeBackPage(dirtyPages->bufferManager, staleDirtyPages[i].p);
       if(err == EBUSY) { abort(); /*api violation!*/ }
     } else {
-      dirtyPages->bufferManager->tryToWriteBackPage(dirtyPages->bufferManager, staleDirtyPages[i]);
+      dirtyPages->bufferManager->tryToWriteBackPage(dirtyPages->bufferManager, staleDirtyPages[i].p);
     }
   }
   free(staleDirtyPages);
@@ -344,50 +630,46 @@ void stasis_dirty_page_table_set_buffer_manager(stasis_dirty_page_table_t * dpt,
 }
 
 stasis_dirty_page_table_t * stasis_dirty_page_table_init() {
-  stasis_dirty_page_table_t * ret = malloc(sizeof(*ret));
-  ret->outstanding_flush_lsns = stasis_util_multiset_create();
-
-  ret->tableByPage = rbinit(dpt_cmp_page, 0);
-  ret->tableByLsnAndPage = rbinit(dpt_cmp_lsn_and_page, 0);
+  stasis_dirty_page_table_t * ret;
+  int err = posix_memalign((void**)&ret, DPT_CACHE_LINE_SIZE, sizeof(*ret));
+  if(err) { errno = err; perror("Couldn't allocate dirty page table"); abort(); }
+
+  for(int i = 0; i < DPT_SHARD_COUNT; i++) {
+    dpt_shard * shard = &ret->shards[i];
+    pthread_mutex_init(&shard->mutex, 0);
+    shard->count = 0;
+    shard->heap_size = 8;
+    shard->heap = malloc(sizeof(dpt_entry) * shard->heap_size);
+    shard->slot_count = 16;
+    shard->slots = malloc(sizeof(dpt_slot) * shard->slot_count);
+    for(pageid_t j = 0; j < shard->slot_count; j++) { shard->slots[j].p = -1; }
+  }
   ret->count = 0;
   pthread_mutex_init(&ret->mutex, 0);
   pthread_cond_init(&ret->flushDone, 0);
   ret->flushing = 0;
+  ret->waiting = 0;
   pthread_cond_init(&ret->writebackCond, 0);
   return ret;
 }
 
 void stasis_dirty_page_table_deinit(stasis_dirty_page_table_t * dirtyPages) {
   int areDirty = 0;
-  dpt_entry dummy = {0, 0};
-  for(const dpt_entry * e = rblookup(RB_LUGTEQ, &dummy, dirtyPages->tableByPage);
-         e;
-         e = rblookup(RB_LUGREAT, &dummy, dirtyPages->tableByPage)) {
-
-    if((!areDirty) &&
+  for(int i = 0; i < DPT_SHARD_COUNT; i++) {
+    dpt_shard * shard = &dirtyPages->shards[i];
+    if(shard->count &&
+       (!areDirty) &&
        (!stasis_suppress_unclean_shutdown_warnings)) {
       printf("Warning:  dirtyPagesDeinit detected dirty, unwritten pages.  "
          "Updates lost?\n");
       areDirty = 1;
     }
-    dummy = *e;
-    rbdelete(e, dirtyPages->tableByPage);
-    free((void*)e);
-  }
-
-  dpt_entry dummy2 = {0, 0};
-  for(const dpt_entry * e = rblookup(RB_LUGTEQ, &dummy2, dirtyPages->tableByLsnAndPage);
-         e;
-         e = rblookup(RB_LUGREAT, &dummy2, dirtyPages->tableByLsnAndPage)) {
-    dummy2 = *e;
-    rbdelete(e, dirtyPages->tableByLsnAndPage);
-    free((void*)e);
+    free(shard->heap);
+    free(shard->slots);
+    pthread_mutex_destroy(&shard->mutex);
   }
 
-  rbdestroy(dirtyPages->tableByPage);
-  rbdestroy(dirtyPages->tableByLsnAndPage);
   pthread_mutex_destroy(&dirtyPages->mutex);
-  stasis_util_multiset_destroy(dirtyPages->outstanding_flush_lsns);
   pthread_cond_destroy(&dirtyPages->flushDone);
   pthread_cond_destroy(&dirtyPages->writebackCond);
   free(dirtyPages);
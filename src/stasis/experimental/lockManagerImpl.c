@@ -1,363 +1,557 @@
 #include <config.h>
-#include <pbl/pbl.h>
 #include <stasis/lockManager.h>
-#include <stasis/util/latches.h>
+#include <stasis/flags.h>
 #include <stasis/util/hash.h>
+#include <stasis/util/lhtable.h>
 
-#include <sys/time.h>
 #include <time.h>
 
 #include <assert.h>
 #include <pthread.h>
 
-static pthread_mutex_t stasis_lock_manager_ht_mut = PTHREAD_MUTEX_INITIALIZER;
+/**
+   A hierarchical (page / record) lock manager.
+
+   Locks are stored in a partitioned table.  Each partition has its own
+   mutex, and maps lock names to a queue of requests, so lock requests on
+   different partitions never contend.  Every transaction keeps a list of
+   the requests it holds; this list is only touched by the thread that is
+   running the transaction, so acquiring and releasing locks never takes a
+   global mutex.
+
+   Record locks take an intention lock on the record's page first, so page
+   and record locks can be mixed.
+
+   Requests that cannot be granted wait on a condition variable that
+   belongs to their transaction.  Once any transaction is waiting, a
+   background thread periodically latches every partition, walks the
+   waits-for graph, and aborts the youngest transaction in each cycle that
+   it finds.
+ */
+
+typedef enum {
+  LM_NL = 0,
+  LM_IS,
+  LM_IX,
+  LM_S,
+  LM_SIX,
+  LM_X,
+} lm_mode;
+
+static const char lm_compatible[6][6] = {
+  /*          NL IS IX  S SIX X */
+  /* NL  */ {  1, 1, 1, 1, 1, 1 },
+  /* IS  */ {  1, 1, 1, 1, 1, 0 },
+  /* IX  */ {  1, 1, 1, 0, 0, 0 },
+  /* S   */ {  1, 1, 0, 1, 0, 0 },
+  /* SIX */ {  1, 1, 0, 0, 0, 0 },
+  /* X   */ {  1, 0, 0, 0, 0, 0 },
+};
+/** The weakest mode that is at least as strong as both a and b. */
+static const lm_mode lm_supremum[6][6] = {
+  /*          NL      IS      IX      S       SIX     X    */
+  /* NL  */ { LM_NL,  LM_IS,  LM_IX,  LM_S,   LM_SIX, LM_X },
+  /* IS  */ { LM_IS,  LM_IS,  LM_IX,  LM_S,   LM_SIX, LM_X },
+  /* IX  */ { LM_IX,  LM_IX,  LM_IX,  LM_SIX, LM_SIX, LM_X },
+  /* S   */ { LM_S,   LM_S,   LM_SIX, LM_S,   LM_SIX, LM_X },
+  /* SIX */ { LM_SIX, LM_SIX, LM_SIX, LM_SIX, LM_SIX, LM_X },
+  /* X   */ { LM_X,   LM_X,   LM_X,   LM_X,   LM_X,   LM_X },
+};
+
+#define LM_PAGE_LEVEL   0
+#define LM_RECORD_LEVEL 1
 
-static int pblHtInsert_r(pblHashTable_t * h, void * key, size_t keylen, void * val) {
-  pthread_mutex_lock(&stasis_lock_manager_ht_mut);
-  int ret = pblHtInsert(h, key, keylen, val);
-  pthread_mutex_unlock(&stasis_lock_manager_ht_mut);
-  return ret;
-}
-static void * pblHtLookup_r(pblHashTable_t * h, void * key, size_t keylen) {
-  pthread_mutex_lock(&stasis_lock_manager_ht_mut);
-  void * ret = pblHtLookup(h, key, keylen);
-  pthread_mutex_unlock(&stasis_lock_manager_ht_mut);
-  return ret;
-}
-static int pblHtRemove_r(pblHashTable_t * h, void * key, size_t keylen) {
-  pthread_mutex_lock(&stasis_lock_manager_ht_mut);
-  int ret = pblHtRemove(h, key, keylen);
-  pthread_mutex_unlock(&stasis_lock_manager_ht_mut);
-  return ret;
-}
-static void * pblHtFirst_r(pblHashTable_t *h) {
-  pthread_mutex_lock(&stasis_lock_manager_ht_mut);
-  void * ret = pblHtFirst(h);
-  pthread_mutex_unlock(&stasis_lock_manager_ht_mut);
-  return ret;
-}
-static void * pblHtNext_r(pblHashTable_t *h) {
-  pthread_mutex_lock(&stasis_lock_manager_ht_mut);
-  void * ret = pblHtNext(h);
-  pthread_mutex_unlock(&stasis_lock_manager_ht_mut);
-  return ret;
+typedef struct {
+  pageid_t page;
+  slotid_t slot;
+  int level;
+} lm_key;
+
+typedef struct lm_request lm_request;
+typedef struct lm_head lm_head;
+typedef struct lm_xact lm_xact;
+typedef struct lm_partition lm_partition;
+
+struct lm_request {
+  lm_head * head;
+  lm_xact * xact;
+  /** The mode this transaction holds, or LM_NL if it is still waiting for its first grant. */
+  lm_mode granted;
+  /** The mode this transaction is waiting for, or LM_NL if it is not waiting. */
+  lm_mode want;
+  /** The lock's queue, in arrival order. */
+  lm_request * prev;
+  lm_request * next;
+  /** The partition's list of waiting requests. */
+  lm_request * prev_waiter;
+  lm_request * next_waiter;
+  /** The transaction's list of requests. */
+  lm_request * next_in_xact;
+};
+
+struct lm_head {
+  lm_key key;
+  lm_partition * part;
+  lm_request * first;
+  lm_request * last;
+};
+
+struct lm_partition {
+  pthread_mutex_t mutex;
+  struct LH_ENTRY(table) * heads;
+  lm_request * waiters;
+  // Keep partitions on separate cache lines.
+  char pad[64];
+};
+
+struct lm_xact {
+  int xid;
+  /** Used to pick the youngest transaction in a cycle as the victim. */
+  uint64_t start;
+  lm_request * locks;
+  /** The request this transaction is blocked on.  Protected by its partition's mutex. */
+  lm_request * waiting;
+  /** Set by the deadlock detector, which holds every partition's mutex. */
+  int deadlocked;
+  pthread_cond_t cond;
+  /** Scratch space for the deadlock detector. */
+  int color;
+};
+
+typedef struct {
+  pthread_mutex_t mutex;
+  struct LH_ENTRY(table) * xacts;
+  // Keep partitions on separate cache lines.
+  char pad[64];
+} lm_xact_partition;
+
+#define LM_PARTITION_COUNT 64
+// These next two correspond to LM_PARTITION_COUNT, and are the appropriate values to pass into hash().
+#define LM_PARTITION_BITS  6
+#define LM_PARTITION_EXT   64
+
+static lm_partition lm_partitions[LM_PARTITION_COUNT];
+static lm_xact_partition lm_xact_partitions[LM_PARTITION_COUNT];
+
+static uint64_t lm_next_start;
+/** The number of requests that are waiting; the detector sleeps while this is zero. */
+static int lm_waiting;
+
+static pthread_t lm_detector;
+static pthread_mutex_t lm_detector_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t lm_detector_cond = PTHREAD_COND_INITIALIZER;
+static int lm_detector_shutdown;
+static int lm_initted;
+
+static lm_partition * lm_partition_for(const lm_key * key) {
+  return &lm_partitions[stasis_linear_hash(key, sizeof(*key), LM_PARTITION_BITS, LM_PARTITION_EXT)];
 }
-static void * pblHtCurrentKey_r(pblHashTable_t *h) {
-  pthread_mutex_lock(&stasis_lock_manager_ht_mut);
-  void * ret = pblHtCurrentKey(h);
-  pthread_mutex_unlock(&stasis_lock_manager_ht_mut);
-  return ret;
+static lm_xact_partition * lm_xact_partition_for(int xid) {
+  return &lm_xact_partitions[((unsigned int)xid) % LM_PARTITION_COUNT];
 }
 
-#define MUTEX_COUNT 32
-// These next two correspond to MUTEX count, and are the appropriate values to pass into hash().
-#define MUTEX_BITS  5
-#define MUTEX_EXT   32
-
-static pthread_mutex_t mutexes[MUTEX_COUNT];
-
-static pthread_mutex_t xid_table_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t * getMutex(byte * dat, int datLen) {
-  return &mutexes[stasis_linear_hash(dat, datLen, MUTEX_BITS, MUTEX_EXT)];
+static lm_xact * lm_xact_get(int xid, int create) {
+  lm_xact_partition * xp = lm_xact_partition_for(xid);
+  pthread_mutex_lock(&xp->mutex);
+  lm_xact * x = LH_ENTRY(find)(xp->xacts, &xid, sizeof(xid));
+  if(!x && create) {
+    x = malloc(sizeof(*x));
+    x->xid = xid;
+    x->start = __sync_fetch_and_add(&lm_next_start, 1);
+    x->locks = NULL;
+    x->waiting = NULL;
+    x->deadlocked = 0;
+    pthread_cond_init(&x->cond, NULL);
+    x->color = 0;
+    LH_ENTRY(insert)(xp->xacts, &x->xid, sizeof(x->xid), x);
+  }
+  pthread_mutex_unlock(&xp->mutex);
+  return x;
 }
 
-static pblHashTable_t * xidLockTable;
-static pblHashTable_t * ridLockTable;
-
-typedef struct {
-  pthread_cond_t writeOK;
-  pthread_cond_t readOK;
-  int readers;
-  int writers;
-  int waiting;
-  int active;
-} lock;
-
-void lockManagerInitHashed() {
-  int i = 0;
-  for(i = 0; i < MUTEX_COUNT; i++) {
-    pthread_mutex_init(&mutexes[i], NULL);
+/**
+   @param ahead true if r is in front of w in the lock's queue.
+   @return true if w cannot be granted until r's transaction releases r.
+ */
+static int lm_blocks(lm_request * r, lm_request * w, int ahead) {
+  if(r->xact == w->xact) { return 0; }
+  if(!lm_compatible[r->granted][w->want]) { return 1; }
+  // New requests queue behind earlier incompatible requests, so that
+  // writers are not starved.  Conversions do not.
+  return ahead && w->granted == LM_NL && r->want != LM_NL
+      && !lm_compatible[r->want][w->want];
+}
+static int lm_is_blocked(lm_request * w) {
+  int ahead = 1;
+  for(lm_request * r = w->head->first; r; r = r->next) {
+    if(r == w) { ahead = 0; continue; }
+    if(lm_blocks(r, w, ahead)) { return 1; }
   }
-  xidLockTable = pblHtCreate();
-  ridLockTable = pblHtCreate();
-
+  return 0;
 }
-pblHashTable_t * lockManagerBeginTransactionUnlocked(int xid) {
-  pblHashTable_t * xidLocks = pblHtCreate();
-  pblHtInsert_r(xidLockTable, &xid, sizeof(int), xidLocks);
-  return xidLocks;
+/** Grant every waiting request that is no longer blocked.  Called with the partition's mutex held. */
+static void lm_grant_waiters(lm_head * h) {
+  for(lm_request * r = h->first; r; r = r->next) {
+    if(r->want != LM_NL && !lm_is_blocked(r)) {
+      r->granted = r->want;
+      r->want = LM_NL;
+      pthread_cond_signal(&r->xact->cond);
+    }
+  }
 }
-int lockManagerBeginTransaction(int xid) {
-  pthread_mutex_lock(&xid_table_mutex);
-  lockManagerBeginTransactionUnlocked(xid);
-  pthread_mutex_unlock(&xid_table_mutex);
-  return 0;
+static void lm_queue_remove(lm_request * r) {
+  lm_head * h = r->head;
+  if(r->prev) { r->prev->next = r->next; } else { h->first = r->next; }
+  if(r->next) { r->next->prev = r->prev; } else { h->last = r->prev; }
+  if(h->first) {
+    lm_grant_waiters(h);
+  } else {
+    LH_ENTRY(remove)(h->part->heads, &h->key, sizeof(h->key));
+    free(h);
+  }
 }
-
-lock* createLock(byte * dat, int datLen) {
-  lock * ret = malloc(sizeof(lock));
-
-  if(!ret) { return NULL; }
-
-  //  pthread_mutex_init(&ret->mut, NULL);
-  pthread_cond_init(&ret->writeOK, NULL);
-  pthread_cond_init(&ret->readOK, NULL);
-  ret->active  = 0;
-  ret->readers = 0;
-  ret->writers = 0;
-  ret->waiting = 0;
-
-  pblHtInsert_r(ridLockTable, dat, datLen, ret);
-  return ret;
+static void lm_waiter_add(lm_partition * part, lm_request * r) {
+  r->prev_waiter = NULL;
+  r->next_waiter = part->waiters;
+  if(part->waiters) { part->waiters->prev_waiter = r; }
+  part->waiters = r;
 }
-
-void destroyLock(byte * dat, int datLen, lock * l) {
-  pthread_cond_destroy(&l->writeOK);
-  pthread_cond_destroy(&l->readOK);
-  free (l);
-  pblHtRemove_r(ridLockTable, dat, datLen);
+static void lm_waiter_remove(lm_partition * part, lm_request * r) {
+  if(r->prev_waiter) { r->prev_waiter->next_waiter = r->next_waiter; } else { part->waiters = r->next_waiter; }
+  if(r->next_waiter) { r->next_waiter->prev_waiter = r->prev_waiter; }
 }
 
-#define LM_READLOCK 1
-#define LM_WRITELOCK 2
-
-int lockManagerReadLockHashed(int xid, byte * dat, int datLen) {
+static int lm_lock(int xid, const lm_key * key, lm_mode mode) {
   if(xid == -1) { return 0; }
-  pthread_mutex_lock(&xid_table_mutex);
-  pblHashTable_t * xidLocks = pblHtLookup_r(xidLockTable, &xid, sizeof(int));
-  if(!xidLocks) {
-    xidLocks = lockManagerBeginTransactionUnlocked(xid);
+  lm_xact * x = lm_xact_get(xid, 1);
+  lm_partition * part = lm_partition_for(key);
+
+  pthread_mutex_lock(&part->mutex);
+  lm_head * h = LH_ENTRY(find)(part->heads, key, sizeof(*key));
+  if(!h) {
+    h = malloc(sizeof(*h));
+    h->key = *key;
+    h->part = part;
+    h->first = NULL;
+    h->last = NULL;
+    LH_ENTRY(insert)(part->heads, &h->key, sizeof(h->key), h);
   }
-  long currentLockLevel = (long)pblHtLookup_r(xidLocks, dat, datLen);
-  //  printf("xid %d read lock (%d)\n", xid, currentLockLevel);
-  if(currentLockLevel >= LM_READLOCK) {
-    pthread_mutex_unlock(&xid_table_mutex);
+  lm_request * r;
+  for(r = h->first; r; r = r->next) {
+    if(r->xact == x) { break; }
+  }
+  if(r && lm_supremum[r->granted][mode] == r->granted) {
+    // Already held.
+    pthread_mutex_unlock(&part->mutex);
     return 0;
   }
-  assert(!currentLockLevel);
-  pthread_mutex_unlock(&xid_table_mutex);
-  pthread_mutex_t * mut = getMutex(dat, datLen);
-
-  pthread_mutex_lock(mut);
-  lock * ridLock = pblHtLookup_r(ridLockTable, dat, datLen);
-
-  if(!ridLock) {
-    ridLock = createLock(dat, datLen);
+  if(!r) {
+    r = malloc(sizeof(*r));
+    r->head = h;
+    r->xact = x;
+    r->granted = LM_NL;
+    r->next = NULL;
+    r->prev = h->last;
+    if(h->last) { h->last->next = r; } else { h->first = r; }
+    h->last = r;
+    r->next_in_xact = x->locks;
+    x->locks = r;
   }
-  ridLock->active++;
+  r->want = lm_supremum[r->granted][mode];
 
-  if(ridLock->writers || ridLock->waiting) {
-    struct timeval tv;
-    int tod_ret = gettimeofday (&tv, NULL);
-    tv.tv_sec++; // Wait up to one second to obtain a lock before detecting deadlock.
-    struct timespec ts;
-    ts.tv_sec = tv.tv_sec;
-    ts.tv_nsec = tv.tv_usec * 1000;
-    if(tod_ret != 0) {
-      perror("Could not get time of day");
-      return LLADD_INTERNAL_ERROR;
+  int ret = 0;
+  if(!lm_is_blocked(r)) {
+    r->granted = r->want;
+    r->want = LM_NL;
+  } else {
+    lm_waiter_add(part, r);
+    x->waiting = r;
+    if(!__sync_fetch_and_add(&lm_waiting, 1)) {
+      pthread_mutex_lock(&lm_detector_mutex);
+      pthread_cond_signal(&lm_detector_cond);
+      pthread_mutex_unlock(&lm_detector_mutex);
+    }
+    while(r->want != LM_NL && !x->deadlocked) {
+      pthread_cond_wait(&x->cond, &part->mutex);
     }
-    do {
-      int wait_ret = pthread_cond_timedwait(&ridLock->readOK, mut, &ts);
-      if(wait_ret == ETIMEDOUT) {
-        ridLock->active--;
-        pthread_mutex_unlock(mut);
-        return LLADD_DEADLOCK;
+    x->waiting = NULL;
+    lm_waiter_remove(part, r);
+    __sync_fetch_and_sub(&lm_waiting, 1);
+    if(r->want != LM_NL) {
+      r->want = LM_NL;
+      if(r->granted == LM_NL) {
+        // r was pushed onto the transaction's list above.
+        assert(x->locks == r);
+        x->locks = r->next_in_xact;
+        lm_queue_remove(r);
+        free(r);
+      } else {
+        // Other requests may have queued behind our conversion.
+        lm_grant_waiters(h);
       }
-    } while(ridLock->writers);
+      ret = LLADD_DEADLOCK;
+    }
+    x->deadlocked = 0;
   }
-  if(currentLockLevel < LM_READLOCK) {
-    ridLock->readers++;
-    pblHtRemove_r(xidLocks, dat, datLen);
-    pblHtInsert_r(xidLocks, dat, datLen, (void*)LM_READLOCK);
+  pthread_mutex_unlock(&part->mutex);
+  return ret;
+}
+
+static int lm_unlock(int xid, const lm_key * key) {
+  if(xid == -1) { return 0; }
+  lm_xact * x = lm_xact_get(xid, 0);
+  assert(x); // Someone tried to release a lock they didn't own!
+  lm_request ** rp;
+  for(rp = &x->locks; *rp; rp = &(*rp)->next_in_xact) {
+    if(!memcmp(&(*rp)->head->key, key, sizeof(*key))) { break; }
   }
-  ridLock->active--;
-  pthread_mutex_unlock(mut);
+  lm_request * r = *rp;
+  assert(r); // Someone tried to release a lock they didn't own!
+  *rp = r->next_in_xact;
+
+  lm_partition * part = r->head->part;
+  pthread_mutex_lock(&part->mutex);
+  lm_queue_remove(r);
+  pthread_mutex_unlock(&part->mutex);
+  free(r);
   return 0;
 }
-int lockManagerWriteLockHashed(int xid, byte * dat, int datLen) {
 
+/** Release all of a transaction's locks.  Used for commit and abort. */
+static int lm_release_all(int xid) {
   if(xid == -1) { return 0; }
-  pthread_mutex_lock(&xid_table_mutex);
-  pblHashTable_t * xidLocks = pblHtLookup_r(xidLockTable, &xid, sizeof(int));
-
-  if(!xidLocks) {
-    xidLocks = lockManagerBeginTransactionUnlocked(xid);
+  lm_xact_partition * xp = lm_xact_partition_for(xid);
+  pthread_mutex_lock(&xp->mutex);
+  lm_xact * x = LH_ENTRY(remove)(xp->xacts, &xid, sizeof(xid));
+  pthread_mutex_unlock(&xp->mutex);
+  if(!x) { return 0; }
+
+  while(x->locks) {
+    lm_request * r = x->locks;
+    x->locks = r->next_in_xact;
+    lm_partition * part = r->head->part;
+    pthread_mutex_lock(&part->mutex);
+    lm_queue_remove(r);
+    pthread_mutex_unlock(&part->mutex);
+    free(r);
   }
+  pthread_cond_destroy(&x->cond);
+  free(x);
+  return 0;
+}
 
-  long currentLockLevel = (long)pblHtLookup_r(xidLocks, dat, datLen);
-
-  //  printf("xid %d write lock (%d)\n", xid, currentLockLevel);
-
-  int me = 0;
-  pthread_mutex_unlock(&xid_table_mutex);
+int lockManagerBeginTransaction(int xid) {
+  lm_xact_get(xid, 1);
+  return 0;
+}
 
-  if(currentLockLevel >= LM_WRITELOCK) {
-    return 0;
-  } else if(currentLockLevel == LM_READLOCK) {
-    me = 1;
+#define LM_WHITE 0
+#define LM_GREY  1
+#define LM_BLACK 2
+
+/**
+   Depth first search of the waits-for graph.  Every partition's mutex
+   must be held.
+
+   @return the victim, if a cycle was found.
+ */
+static lm_xact * lm_find_cycle(lm_xact * x, lm_xact ** stack, int depth) {
+  x->color = LM_GREY;
+  stack[depth] = x;
+  lm_request * w = x->waiting;
+  int ahead = 1;
+  for(lm_request * r = w->head->first; r; r = r->next) {
+    if(r == w) { ahead = 0; continue; }
+    if(!lm_blocks(r, w, ahead)) { continue; }
+    lm_xact * y = r->xact;
+    // Transactions that are not waiting (or are about to abort) will make progress.
+    if(!y->waiting || y->deadlocked) { continue; }
+    if(y->color == LM_GREY) {
+      lm_xact * victim = y;
+      for(int i = depth; stack[i] != y; i--) {
+        if(stack[i]->start > victim->start) { victim = stack[i]; }
+      }
+      return victim;
+    }
+    if(y->color == LM_WHITE) {
+      lm_xact * victim = lm_find_cycle(y, stack, depth + 1);
+      if(victim) { return victim; }
+    }
   }
-
-  pthread_mutex_t * mut = getMutex(dat, datLen);
-
-  pthread_mutex_lock(mut);
-  lock * ridLock = pblHtLookup_r(ridLockTable, dat, datLen);
-  if(!ridLock) {
-    ridLock = createLock(dat, datLen);
+  x->color = LM_BLACK;
+  return NULL;
+}
+/** @return the number of transactions that were chosen as victims. */
+static int lm_detect_deadlocks() {
+  for(int i = 0; i < LM_PARTITION_COUNT; i++) {
+    pthread_mutex_lock(&lm_partitions[i].mutex);
   }
-
-  ridLock->active++;
-  ridLock->waiting++;
-  if(ridLock->writers || (ridLock->readers - me)) {
-    struct timeval tv;
-    int tod_ret = gettimeofday(&tv, NULL);
-    tv.tv_sec++;
-    struct timespec ts;
-    ts.tv_sec = tv.tv_sec;
-    ts.tv_nsec = tv.tv_usec * 1000;
-    if(tod_ret != 0) {
-      perror("Could not get time of day");
-      return LLADD_INTERNAL_ERROR;
+  int count = 0;
+  for(int i = 0; i < LM_PARTITION_COUNT; i++) {
+    for(lm_request * r = lm_partitions[i].waiters; r; r = r->next_waiter) { count++; }
+  }
+  lm_xact ** stack = malloc(sizeof(stack[0]) * (count + 1));
+  int victims = 0;
+  lm_xact * victim;
+  do {
+    victim = NULL;
+    for(int i = 0; i < LM_PARTITION_COUNT; i++) {
+      for(lm_request * r = lm_partitions[i].waiters; r; r = r->next_waiter) {
+        r->xact->color = LM_WHITE;
+      }
     }
-    while(ridLock->writers || (ridLock->readers - me)) {
-      int lockret = pthread_cond_timedwait(&ridLock->writeOK, mut, &ts);
-      if(lockret == ETIMEDOUT) {
-        ridLock->waiting--;
-        ridLock->active--;
-        pthread_mutex_unlock(mut);
-        return LLADD_DEADLOCK;
+    for(int i = 0; !victim && i < LM_PARTITION_COUNT; i++) {
+      for(lm_request * r = lm_partitions[i].waiters; !victim && r; r = r->next_waiter) {
+        if(r->xact->color == LM_WHITE && !r->xact->deadlocked) {
+          victim = lm_find_cycle(r->xact, stack, 0);
+        }
       }
     }
+    if(victim) {
+      DEBUG("lock manager: aborting xid %d to break a deadlock\n", victim->xid);
+      victim->deadlocked = 1;
+      pthread_cond_signal(&victim->cond);
+      victims++;
+    }
+  } while(victim);
+  free(stack);
+  for(int i = LM_PARTITION_COUNT - 1; i >= 0; i--) {
+    pthread_mutex_unlock(&lm_partitions[i].mutex);
   }
-  ridLock->waiting--;
-  if(currentLockLevel == 0) {
-    ridLock->readers++;
-    ridLock->writers++;
-  } else if (currentLockLevel == LM_READLOCK) {
-    ridLock->writers++;
-    pblHtRemove_r(xidLocks, dat, datLen);
-  }
-  if(currentLockLevel != LM_WRITELOCK) {
-    pblHtInsert_r(xidLocks, dat, datLen, (void*)LM_WRITELOCK);
-  }
-
-  ridLock->active--;
-  pthread_mutex_unlock(mut);
-  return 0;
+  return victims;
 }
 
-static int decrementLock(void * dat, int datLen, int currentLevel) {
-  //  pthread_mutex_unlock(&xid_table_mutex);
-  pthread_mutex_t * mut = getMutex(dat, datLen);
-  pthread_mutex_lock(mut);
-  lock * ridLock = pblHtLookup_r(ridLockTable, dat, datLen);
-  assert(ridLock);
-  ridLock->active++;
-  if(currentLevel == LM_WRITELOCK) {
-    ridLock->writers--;
-    ridLock->readers--;
-  } else if(currentLevel == LM_READLOCK) {
-    ridLock->readers--;
-  } else if(currentLevel == 0) {
-    assert(0); // Someone tried to release a lock they didn't own!
-  } else {
-    fprintf(stderr, "Unknown lock type encountered!");
-    ridLock->active--;
-    pthread_mutex_unlock(mut);
-    return LLADD_INTERNAL_ERROR;
-  }
-
-  ridLock->active--;
-
-  if(!(ridLock->active || ridLock->waiting || ridLock->readers || ridLock->writers)) {
-    //   printf("destroyed lock");
-    destroyLock(dat, datLen, ridLock);
-  } else {
-    //    printf("(%d %d %d %d)", ridLock->active, ridLock->waiting, ridLock->readers, ridLock->writers);
+static void * lm_detector_worker(void * ignored) {
+  pthread_mutex_lock(&lm_detector_mutex);
+  while(!lm_detector_shutdown) {
+    if(!__sync_fetch_and_add(&lm_waiting, 0)) {
+      pthread_cond_wait(&lm_detector_cond, &lm_detector_mutex);
+      continue;
+    }
+    // Give the waiters a chance to be granted their locks first.
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t deadline = ((uint64_t)ts.tv_sec) * 1000000000 + ts.tv_nsec
+                        + stasis_lock_manager_deadlock_check_nsec;
+    ts.tv_sec = deadline / 1000000000;
+    ts.tv_nsec = deadline % 1000000000;
+    while(!lm_detector_shutdown
+          && ETIMEDOUT != pthread_cond_timedwait(&lm_detector_cond, &lm_detector_mutex, &ts)) { }
+    if(lm_detector_shutdown) { break; }
+    pthread_mutex_unlock(&lm_detector_mutex);
+    lm_detect_deadlocks();
+    pthread_mutex_lock(&lm_detector_mutex);
   }
-  pthread_mutex_unlock(mut);
-  return 0;
+  pthread_mutex_unlock(&lm_detector_mutex);
+  return NULL;
 }
 
-int lockManagerUnlockHashed(int xid, byte * dat, int datLen) {
-
-
-  if(xid == -1) { return 0; }
-  //  printf("xid %d unlock\n", xid);
-
-  pthread_mutex_lock(&xid_table_mutex);
-
-  pblHashTable_t * xidLocks = pblHtLookup_r(xidLockTable, &xid, sizeof(int));
-
-  if(!xidLocks) {
-    xidLocks = lockManagerBeginTransactionUnlocked(xid);
+void lockManagerInitHashed() {
+  for(int i = 0; i < LM_PARTITION_COUNT; i++) {
+    pthread_mutex_init(&lm_partitions[i].mutex, NULL);
+    lm_partitions[i].heads = LH_ENTRY(create)(16);
+    lm_partitions[i].waiters = NULL;
+    pthread_mutex_init(&lm_xact_partitions[i].mutex, NULL);
+    lm_xact_partitions[i].xacts = LH_ENTRY(create)(16);
   }
-
-  pthread_mutex_unlock(&xid_table_mutex);
-
-  long currentLevel = (long)pblHtLookup_r(xidLocks, dat, datLen);
-
-  assert(currentLevel);
-  pblHtRemove_r(xidLocks, dat, datLen);
-  decrementLock(dat, datLen, currentLevel);
-
-  return 0;
+  lm_next_start = 0;
+  lm_waiting = 0;
+  lm_detector_shutdown = 0;
+  pthread_create(&lm_detector, NULL, lm_detector_worker, NULL);
+  lm_initted = 1;
 }
-
-int lockManagerCommitHashed(int xid, int datLen) {
-  if(xid == -1) { return 0; }
-  pthread_mutex_lock(&xid_table_mutex);
-
-  pblHashTable_t * xidLocks = pblHtLookup_r(xidLockTable, &xid, sizeof(int));
-  pblHtRemove_r(xidLockTable, &xid, sizeof(int));
-  if(!xidLocks) {
-    xidLocks = lockManagerBeginTransactionUnlocked(xid);
-  }
-
-  pthread_mutex_unlock(&xid_table_mutex);
-  long currentLevel;
-  int ret = 0;
-  for(currentLevel = (long)pblHtFirst_r(xidLocks); currentLevel; currentLevel  = (long)pblHtNext_r(xidLocks)) {
-    void * currentKey = pblHtCurrentKey_r(xidLocks);
-    int tmpret = decrementLock(currentKey, datLen, currentLevel);
-    // Pass any error(s) up to the user.
-    // (This logic relies on the fact that currently it only returns 0 and LLADD_INTERNAL_ERROR)
-    if(tmpret) {
-      ret = tmpret;
+void lockManagerDeinitHashed() {
+  if(!lm_initted) { return; }
+  pthread_mutex_lock(&lm_detector_mutex);
+  lm_detector_shutdown = 1;
+  pthread_cond_signal(&lm_detector_cond);
+  pthread_mutex_unlock(&lm_detector_mutex);
+  pthread_join(lm_detector, NULL);
+
+  // Release the locks of any transactions that are still running.
+  for(int i = 0; i < LM_PARTITION_COUNT; i++) {
+    struct LH_ENTRY(list) l;
+    const struct LH_ENTRY(pair_t) * p;
+    int * xids = NULL;
+    int n = 0;
+    LH_ENTRY(openlist)(lm_xact_partitions[i].xacts, &l);
+    while((p = LH_ENTRY(readlist)(&l))) {
+      xids = realloc(xids, sizeof(xids[0]) * (n + 1));
+      xids[n++] = ((lm_xact*)p->value)->xid;
     }
+    LH_ENTRY(closelist)(&l);
+    for(int j = 0; j < n; j++) { lm_release_all(xids[j]); }
+    free(xids);
   }
-  pblHtDelete(xidLocks);
-  return ret;
+  for(int i = 0; i < LM_PARTITION_COUNT; i++) {
+    assert(!lm_partitions[i].waiters);
+    LH_ENTRY(destroy)(lm_partitions[i].heads);
+    pthread_mutex_destroy(&lm_partitions[i].mutex);
+    LH_ENTRY(destroy)(lm_xact_partitions[i].xacts);
+    pthread_mutex_destroy(&lm_xact_partitions[i].mutex);
+  }
+  lm_initted = 0;
+}
+
+static inline lm_key lm_page_key(pageid_t p) {
+  lm_key key;
+  memset(&key, 0, sizeof(key));
+  key.page = p;
+  key.level = LM_PAGE_LEVEL;
+  return key;
+}
+static inline lm_key lm_record_key(recordid rid) {
+  lm_key key;
+  memset(&key, 0, sizeof(key));
+  key.page = rid.page;
+  key.slot = rid.slot;
+  key.level = LM_RECORD_LEVEL;
+  return key;
 }
 
 int lockManagerReadLockRecord(int xid, recordid rid) {
-  return lockManagerReadLockHashed(xid, (byte*)&rid, sizeof(recordid));
+  lm_key page = lm_page_key(rid.page);
+  int ret = lm_lock(xid, &page, LM_IS);
+  if(ret) { return ret; }
+  lm_key rec = lm_record_key(rid);
+  return lm_lock(xid, &rec, LM_S);
 }
 int lockManagerWriteLockRecord(int xid, recordid rid) {
-  return lockManagerWriteLockHashed(xid, (byte*)&rid, sizeof(recordid));
+  lm_key page = lm_page_key(rid.page);
+  int ret = lm_lock(xid, &page, LM_IX);
+  if(ret) { return ret; }
+  lm_key rec = lm_record_key(rid);
+  return lm_lock(xid, &rec, LM_X);
 }
 int lockManagerUnlockRecord(int xid, recordid rid) {
-  return lockManagerUnlockHashed(xid, (byte*)&rid, sizeof(recordid));
+  // The intention lock on the page is held until the transaction ends.
+  lm_key rec = lm_record_key(rid);
+  return lm_unlock(xid, &rec);
 }
 int lockManagerCommitRecords(int xid) {
-  return lockManagerCommitHashed(xid, sizeof(recordid));
+  return lm_release_all(xid);
 }
 
 int lockManagerReadLockPage(int xid, pageid_t p) {
-  return lockManagerReadLockHashed(xid, (byte*)&p, sizeof(p));
+  lm_key page = lm_page_key(p);
+  return lm_lock(xid, &page, LM_S);
 }
 int lockManagerWriteLockPage(int xid, pageid_t p) {
-  return lockManagerWriteLockHashed(xid, (byte*)&p, sizeof(p));
+  lm_key page = lm_page_key(p);
+  return lm_lock(xid, &page, LM_X);
 }
 int lockManagerUnlockPage(int xid, pageid_t p) {
-  return lockManagerUnlockHashed(xid, (byte*)&p, sizeof(p));
+  lm_key page = lm_page_key(p);
+  return lm_unlock(xid, &page);
 }
 int lockManagerCommitPages(int xid) {
-  return lockManagerCommitHashed(xid, sizeof(pageid_t));
+  return lm_release_all(xid);
 }
 
 void setupLockManagerCallbacksPage() {
+  if(globalLockManager.deinit) { globalLockManager.deinit(); }
   globalLockManager.init = &lockManagerInitHashed;
+  globalLockManager.deinit = &lockManagerDeinitHashed;
   globalLockManager.readLockPage    = &lockManagerReadLockPage;
   globalLockManager.writeLockPage   = &lockManagerWriteLockPage;
   globalLockManager.unlockPage      = &lockManagerUnlockPage;
@@ -372,7 +566,9 @@ void setupLockManagerCallbacksPage() {
 }
 
 void setupLockManagerCallbacksRecord () {
+  if(globalLockManager.deinit) { globalLockManager.deinit(); }
   globalLockManager.init = &lockManagerInitHashed;
+  globalLockManager.deinit = &lockManagerDeinitHashed;
   globalLockManager.readLockPage    = NULL;
   globalLockManager.writeLockPage   = NULL;
   globalLockManager.unlockPage      = NULL;
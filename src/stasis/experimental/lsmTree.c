@@ -804,6 +804,8 @@ lladdIterator_t* lsmTreeIterator_open(int xid, recordid root) {
   DEBUG("keysize = %d, slot = %d\n", keySize, impl->current.slot);
   impl->t = 0;
   impl->justOnePage = (depth == 0);
+  // Leaves are scanned in order, so keep them out of the shared cache.
+  impl->h = impl->justOnePage ? 0 : stasis_buffer_manager_open_sequential_handle();
 
   lladdIterator_t *it = malloc(sizeof(lladdIterator_t));
   it->type = -1; // XXX  LSM_TREE_ITERATOR;
@@ -844,6 +846,7 @@ lladdIterator_t* lsmTreeIterator_openAt(int xid, recordid root, const byte* key)
 
   impl->t = 0; // must be zero so free() doesn't croak.
   impl->justOnePage = (depth==0);
+  impl->h = impl->justOnePage ? 0 : stasis_buffer_manager_open_sequential_handle();
 
   lladdIterator_t *it = malloc(sizeof(lladdIterator_t));
   it->type = -1; // XXX LSM_TREE_ITERATOR
@@ -869,6 +872,8 @@ lladdIterator_t *lsmTreeIterator_copy(int xid, lladdIterator_t* i) {
     mine->t = 0;
   }
   mine->justOnePage = it->justOnePage;
+  // Copies are short lived; they use the shared cache.
+  mine->h = 0;
   lladdIterator_t * ret = malloc(sizeof(lladdIterator_t));
   ret->type = -1; // XXX LSM_TREE_ITERATOR
   ret->impl = mine;
@@ -881,6 +886,7 @@ void lsmTreeIterator_close(int xid, lladdIterator_t *it) {
     releasePage(impl->p);
   }
   if(impl->t) { free(impl->t); }
+  if(impl->h) { stasis_buffer_manager_close_handle(impl->h); }
   free(impl);
   free(it);
 }
@@ -898,7 +904,8 @@ int lsmTreeIterator_next(int xid, lladdIterator_t *it) {
     DEBUG("done with page %lld next = %lld\n", impl->p->id, next_rec.ptr);
 
     if(next_rec.ptr != -1 && ! impl->justOnePage) {
-      impl->p = loadPage(xid, next_rec.ptr);
+      impl->p = impl->h ? loadPageWithHandle(impl->h, xid, next_rec.ptr)
+                        : loadPage(xid, next_rec.ptr);
       readlock(impl->p->rwlatch,0);
       impl->current.page = next_rec.ptr;
       impl->current.slot = 2;
@@ -48,13 +48,19 @@ int stasis_buffer_manager_preallocate_mode =
 #endif
 #endif
 
+#ifdef STASIS_PAGE_SIZE
+int stasis_page_size = STASIS_PAGE_SIZE;
+#else
+int stasis_page_size = STASIS_DEFAULT_PAGE_SIZE;
+#endif
+
 #ifdef STASIS_BUFFER_MANAGER_SIZE
 pageid_t stasis_buffer_manager_size = STASIS_BUFFER_MANAGER_SIZE;
 #else // STASIS_BUFFER_MANAGER_SIZE
 #ifdef MAX_BUFFER_SIZE
 pageid_t stasis_buffer_manager_size = MAX_BUFFER_SIZE;
 #else // MAX_BUFFER_SIZE
-pageid_t stasis_buffer_manager_size = 83107840 / PAGE_SIZE; // ~ 82MB
+pageid_t stasis_buffer_manager_size = 83107840 / STASIS_DEFAULT_PAGE_SIZE; // ~ 82MB
 #endif // MAX_BUFFER_SIZE
 #endif // STASIS_BUFFER_MANAGER_SIZE
 
@@ -62,26 +68,26 @@ pageid_t stasis_dirty_page_count_soft_limit=
 #ifdef STASIS_DIRTY_PAGE_count_SOFT_LIMIT
   STASIS_DIRTY_PAGE_COUNT_SOFT_LIMIT;
 #else
-  (32 * 1024 * 1024) / PAGE_SIZE;
+  (32 * 1024 * 1024) / STASIS_DEFAULT_PAGE_SIZE;
 #endif
 pageid_t stasis_dirty_page_low_water_mark =
 #ifdef STASIS_DIRTY_PAGE_LOW_WATER_MARK
   STASIS_DIRTY_PAGE_LOW_WATER_MARK;
 #else
-  (16 * 1024 * 1024) / PAGE_SIZE;
+  (16 * 1024 * 1024) / STASIS_DEFAULT_PAGE_SIZE;
 #endif
 pageid_t stasis_dirty_page_count_hard_limit =
 #ifdef STASIS_DIRTY_PAGE_COUNT_HARD_LIMIT
   STASIS_DIRTY_PAGE_COUNT_HARD_LIMIT;
 #else
-  (40 * 1024 * 1024) / PAGE_SIZE;
+  (40 * 1024 * 1024) / STASIS_DEFAULT_PAGE_SIZE;
 #endif
 
 pageid_t stasis_dirty_page_table_flush_quantum =
 #ifdef STASIS_DIRTY_PAGE_TABLE_FLUSH_QUANTUM
   STASIS_DIRTY_PAGE_TABLE_FLUSH_QUANTUM;
 #else
-  (4 * 1024 * 1024) / PAGE_SIZE;
+  (4 * 1024 * 1024) / STASIS_DEFAULT_PAGE_SIZE;
 #endif
 
 stasis_page_handle_t* (*stasis_page_handle_factory)(stasis_log_t*, stasis_dirty_page_table_t*) =
@@ -103,6 +109,19 @@ stasis_handle_t* (*stasis_handle_file_factory)(const char* filename, int open_mo
   stasis_handle_open_pfile;
 #endif
 
+int stasis_handle_uring_queue_depth =
+#ifdef STASIS_HANDLE_URING_QUEUE_DEPTH
+  STASIS_HANDLE_URING_QUEUE_DEPTH;
+#else
+  128;
+#endif
+
+#ifdef STASIS_HANDLE_COALESCE_BATCHES
+int stasis_handle_coalesce_batches = STASIS_HANDLE_COALESCE_BATCHES;
+#else
+int stasis_handle_coalesce_batches = 1;
+#endif
+
 stasis_handle_t* (*stasis_non_blocking_handle_file_factory)(const char* filename, int open_mode, int creat_perms) =
 #ifdef STASIS_NON_BLOCKING_HANDLE_FILE_FACTORY
   STASIS_NON_BLOCKING_HANDLE_FILE_FACTORY;
@@ -119,6 +138,13 @@ uint32_t stasis_handle_raid0_stripe_size =
 
 char ** stasis_handle_raid0_filenames = 0;
 
+uint32_t stasis_handle_raid1_stall_timeout =
+#ifdef STASIS_HANDLE_RAID1_STALL_TIMEOUT
+  STASIS_HANDLE_RAID1_STALL_TIMEOUT;
+#else
+  10000;
+#endif
+
 #ifdef STASIS_BUFFER_MANAGER_HINT_WRITES_ARE_SEQUENTIAL
 int stasis_buffer_manager_hint_writes_are_sequential = STASIS_BUFFER_MANAGER_HINT_WRITES_ARE_SEQUENTIAL;
 #else
@@ -160,6 +186,12 @@ int stasis_truncation_automatic = STASIS_TRUNCATION_AUTOMATIC;
 int stasis_truncation_automatic = 1;
 #endif
 
+#ifdef STASIS_TRUNCATION_CHECKPOINT_INTERVAL
+lsn_t stasis_truncation_checkpoint_interval = STASIS_TRUNCATION_CHECKPOINT_INTERVAL;
+#else
+lsn_t stasis_truncation_checkpoint_interval = 10 * 1024 * 1024;
+#endif
+
 #ifdef STASIS_LOG_TYPE
 int stasis_log_type = STASIS_LOG_TYPE;
 #else
@@ -196,12 +228,36 @@ char * stasis_store_file_2_name = STASIS_STORE_FILE_2_NAME;
 char * stasis_store_file_2_name = "storefile2.txt";
 #endif
 
+#ifdef STASIS_STORE_FILE_RAID1_DEGRADED_NAME
+char * stasis_store_file_raid1_degraded_name = STASIS_STORE_FILE_RAID1_DEGRADED_NAME;
+#else
+char * stasis_store_file_raid1_degraded_name = "storefile_degraded.txt";
+#endif
+
 #ifdef STASIS_BUFFER_MANAGER_HASH_PREFETCH_COUNT
 int stasis_buffer_manager_hash_prefetch_count = STASIS_BUFFER_MANAGER_HASH_PREFETCH_COUNT;
 #else
 int stasis_buffer_manager_hash_prefetch_count = 2;
 #endif
 
+#ifdef STASIS_BUFFER_MANAGER_HASH_PREFETCH_QUEUE_LENGTH
+int stasis_buffer_manager_hash_prefetch_queue_length = STASIS_BUFFER_MANAGER_HASH_PREFETCH_QUEUE_LENGTH;
+#else
+int stasis_buffer_manager_hash_prefetch_queue_length = 64;
+#endif
+
+#ifdef STASIS_BUFFER_MANAGER_SCAN_RING_SIZE
+int stasis_buffer_manager_scan_ring_size = STASIS_BUFFER_MANAGER_SCAN_RING_SIZE;
+#else
+int stasis_buffer_manager_scan_ring_size = 64;
+#endif
+
+#ifdef STASIS_BUFFER_MANAGER_SCAN_READAHEAD
+int stasis_buffer_manager_scan_readahead = STASIS_BUFFER_MANAGER_SCAN_READAHEAD;
+#else
+int stasis_buffer_manager_scan_readahead = 16;
+#endif
+
 #ifdef STASIS_LOG_FILE_MODE
 int stasis_log_file_mode = STASIS_LOG_FILE_MODE;
 #else
@@ -247,13 +303,62 @@ const char* stasis_log_chunk_name = "log-chunk-";
 #endif //STASIS_LOG_DIR_LSN_CHARS
 const int stasis_log_file_pool_lsn_chars = 20;
 
+#ifdef STASIS_LOG_FILE_POOL_BACKGROUND_CRC
+int stasis_log_file_pool_background_crc = STASIS_LOG_FILE_POOL_BACKGROUND_CRC;
+#else
+int stasis_log_file_pool_background_crc = 1;
+#endif
+
 #ifdef STASIS_LOG_FILE_WRITE_BUFFER_SIZE
 lsn_t stasis_log_file_write_buffer_size = STASIS_LOG_FILE_WRITE_BUFFER_SIZE;
 #else
 lsn_t stasis_log_file_write_buffer_size = 1024 * 1024;
 #endif
+#ifdef STASIS_LOG_FILE_COMPACT_ENTRIES
+int stasis_log_file_compact_entries = STASIS_LOG_FILE_COMPACT_ENTRIES;
+#else
+int stasis_log_file_compact_entries = 0;
+#endif
+#ifdef STASIS_LOG_SCAN_BUFFER_SIZE
+lsn_t stasis_log_scan_buffer_size = STASIS_LOG_SCAN_BUFFER_SIZE;
+#else
+lsn_t stasis_log_scan_buffer_size = 1024 * 1024;
+#endif
+#ifdef STASIS_LOG_GROUP_COMMIT_ADAPTIVE
+int stasis_log_group_commit_adaptive = STASIS_LOG_GROUP_COMMIT_ADAPTIVE;
+#else
+int stasis_log_group_commit_adaptive = 1;
+#endif
+#ifdef STASIS_LOG_GROUP_COMMIT_MAX_WAIT_NSEC
+uint64_t stasis_log_group_commit_max_wait_nsec = STASIS_LOG_GROUP_COMMIT_MAX_WAIT_NSEC;
+#else
+uint64_t stasis_log_group_commit_max_wait_nsec = 10 * 1000 * 1000; // 10 msec
+#endif
+#ifdef STASIS_LOCK_MANAGER_DEADLOCK_CHECK_NSEC
+uint64_t stasis_lock_manager_deadlock_check_nsec = STASIS_LOCK_MANAGER_DEADLOCK_CHECK_NSEC;
+#else
+uint64_t stasis_lock_manager_deadlock_check_nsec = 5 * 1000 * 1000; // 5 msec
+#endif
 #ifdef STASIS_SEGMENTS_ENABLED
 int stasis_segments_enabled = STASIS_SEGMENTS_ENABLED;
 #else
 int stasis_segments_enabled = 0;
 #endif
+
+#ifdef STASIS_PAGE_CHECKSUMS
+int stasis_page_checksums = STASIS_PAGE_CHECKSUMS;
+#else
+int stasis_page_checksums = 0;
+#endif
+
+#ifdef STASIS_RECOVERY_REDO_THREADS
+int stasis_recovery_redo_threads = STASIS_RECOVERY_REDO_THREADS;
+#else
+int stasis_recovery_redo_threads = 1;
+#endif
+
+#ifdef STASIS_ALLOC_ARENA_PAGES
+int stasis_alloc_arena_pages = STASIS_ALLOC_ARENA_PAGES;
+#else
+int stasis_alloc_arena_pages = 4;
+#endif
@@ -21,3 +21,21 @@
 stasis_handle_t* stasis_handle_default_factory() {
   return stasis_handle_file_factory(stasis_store_file_name, O_CREAT | O_RDWR | stasis_buffer_manager_io_handle_flags, FILE_PERM);
 }
+int stasis_handle_read_batch(stasis_handle_t * h, stasis_handle_iov_t * iov, int count) {
+  if(h->read_batch) { return h->read_batch(h, iov, count); }
+  int ret = 0;
+  for(int i = 0; i < count; i++) {
+    iov[i].error = h->read(h, iov[i].off, iov[i].buf, iov[i].len);
+    if(iov[i].error && !ret) { ret = iov[i].error; }
+  }
+  return ret;
+}
+int stasis_handle_write_batch(stasis_handle_t * h, stasis_handle_iov_t * iov, int count) {
+  if(h->write_batch) { return h->write_batch(h, iov, count); }
+  int ret = 0;
+  for(int i = 0; i < count; i++) {
+    iov[i].error = h->write(h, iov[i].off, iov[i].buf, iov[i].len);
+    if(iov[i].error && !ret) { ret = iov[i].error; }
+  }
+  return ret;
+}
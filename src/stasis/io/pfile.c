@@ -1,10 +1,13 @@
 #include <config.h>
 
 #include <stasis/io/handle.h>
+#include <stasis/flags.h>
 #include <stasis/util/histogram.h>
 
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
+#include <sys/uio.h>
 #include <assert.h>
 
 //#define PFILE_LATENCY_PROF
@@ -196,6 +199,121 @@ static int pfile_write(stasis_handle_t *h, lsn_t off, const byte *dat,
   return error;
 }
 
+/**
+   Read or write a run of adjacent requests with preadv() / pwritev().
+
+   @param done Set to the number of requests in vec that completed.
+   @return 0, an error code, or EDOM if a read reached the end of the file.
+ */
+static int pfile_rw_run(int fd, lsn_t off, struct iovec *vec, int n,
+                        int is_write, int *done) {
+  int error = 0;
+  *done = 0;
+  while (*done < n) {
+    ssize_t count = is_write ? pwritev(fd, vec + *done, n - *done, off)
+                             : preadv(fd, vec + *done, n - *done, off);
+    if (count == -1) {
+      if (errno == EAGAIN || errno == EINTR) {
+        continue;
+      }
+      error = errno;
+      break;
+    } else if (count == 0 && !is_write) {
+      // EOF
+      error = EDOM;
+      break;
+    }
+    off += count;
+    // Skip the requests that completed, and trim the one that did not.
+    while (*done < n && (size_t)count >= vec[*done].iov_len) {
+      count -= vec[*done].iov_len;
+      (*done)++;
+    }
+    if (*done < n) {
+      vec[*done].iov_base = (byte*)vec[*done].iov_base + count;
+      vec[*done].iov_len -= count;
+    }
+  }
+  return error;
+}
+static int pfile_iov_cmp(const void *a, const void *b) {
+  const stasis_handle_iov_t *x = *(stasis_handle_iov_t * const *)a;
+  const stasis_handle_iov_t *y = *(stasis_handle_iov_t * const *)b;
+  return x->off < y->off ? -1 : (x->off > y->off ? 1 : 0);
+}
+/**
+   Sort the requests by offset, and issue one system call for each run of
+   adjacent requests, so that writeback of contiguous dirty pages (and
+   readahead) turns into large sequential I/O.
+ */
+static int pfile_rw_batch(stasis_handle_t *h, stasis_handle_iov_t *iov,
+                          int count, int is_write) {
+  pfile_impl *impl = (pfile_impl*)(h->impl);
+  int ret = 0;
+  if (!stasis_handle_coalesce_batches) {
+    for (int i = 0; i < count; i++) {
+      iov[i].error = is_write ? pfile_write(h, iov[i].off, iov[i].buf, iov[i].len)
+                              : pfile_read(h, iov[i].off, iov[i].buf, iov[i].len);
+      if (iov[i].error && !ret) { ret = iov[i].error; }
+    }
+    return ret;
+  }
+  stasis_handle_iov_t **sorted = malloc(sizeof(sorted[0]) * count);
+  for (int i = 0; i < count; i++) {
+    sorted[i] = &iov[i];
+    iov[i].error = 0;
+  }
+  qsort(sorted, count, sizeof(sorted[0]), pfile_iov_cmp);
+  int max_run = count < IOV_MAX ? count : IOV_MAX;
+  struct iovec *vec = malloc(sizeof(vec[0]) * max_run);
+
+  for (int i = 0; i < count; ) {
+    if (sorted[i]->off < 0) {
+      sorted[i]->error = EDOM;
+      i++;
+      continue;
+    }
+    int n = 1;
+    while (n < max_run && i + n < count &&
+           sorted[i+n-1]->off + sorted[i+n-1]->len == sorted[i+n]->off) {
+      n++;
+    }
+    for (int j = 0; j < n; j++) {
+      vec[j].iov_base = sorted[i+j]->buf;
+      vec[j].iov_len = sorted[i+j]->len;
+    }
+    int done;
+    if (is_write) { TICK(write_hist); } else { TICK(read_hist); }
+    int error = pfile_rw_run(impl->fd, sorted[i]->off, vec, n, is_write, &done);
+    if (is_write) { TOCK(write_hist); } else { TOCK(read_hist); }
+    if (error == EDOM) {
+      // The run extends past the end of the file.  Let pfile_read() sort
+      // out which requests were (partially) readable.
+      for (int j = done; j < n; j++) {
+        sorted[i+j]->error = pfile_read(h, sorted[i+j]->off, sorted[i+j]->buf, sorted[i+j]->len);
+      }
+    } else if (error) {
+      if (error == EBADF) { h->error = EBADF; }
+      for (int j = done; j < n; j++) {
+        sorted[i+j]->error = error;
+      }
+    }
+    i += n;
+  }
+  for (int i = 0; i < count; i++) {
+    if (iov[i].error) { ret = iov[i].error; break; }
+  }
+  free(vec);
+  free(sorted);
+  return ret;
+}
+static int pfile_read_batch(stasis_handle_t *h, stasis_handle_iov_t *iov, int count) {
+  return pfile_rw_batch(h, iov, count, 0);
+}
+static int pfile_write_batch(stasis_handle_t *h, stasis_handle_iov_t *iov, int count) {
+  return pfile_rw_batch(h, iov, count, 1);
+}
+
 static stasis_write_buffer_t * pfile_write_buffer(stasis_handle_t *h,
                                                  lsn_t off, lsn_t len) {
   stasis_write_buffer_t *ret = malloc(sizeof(stasis_write_buffer_t));
@@ -412,6 +530,8 @@ static struct stasis_handle_t pfile_func = {
   .async_force = pfile_async_force,
   .force_range = pfile_force_range,
   .fallocate = pfile_fallocate,
+  .read_batch = pfile_read_batch,
+  .write_batch = pfile_write_batch,
   .error = 0
 };
 
@@ -29,12 +29,145 @@ DECLARE_HISTOGRAM(force_range_hist)
 #define TOCK(hist)
 #endif
 
+/** Lets a caller wait for the requests it handed to member workers. */
+typedef struct raid0_wait_t {
+  pthread_mutex_t mut;
+  pthread_cond_t cond;
+  int pending;
+} raid0_wait_t;
+
+enum raid0_op_type {
+  RAID0_OP_NONE = 0,
+  RAID0_OP_READ_BATCH,
+  RAID0_OP_WRITE_BATCH,
+  RAID0_OP_FORCE,
+  RAID0_OP_ASYNC_FORCE,
+  RAID0_OP_FORCE_RANGE
+};
+
+/** A request against a single member handle. */
+typedef struct raid0_op_t {
+  enum raid0_op_type type;
+  stasis_handle_iov_t * iov;
+  int count;
+  lsn_t start;
+  lsn_t stop;
+  int ret;
+  raid0_wait_t * wait;
+  struct raid0_op_t * next;
+} raid0_op_t;
+
+/**
+   Each member handle has a worker thread, so that requests that touch
+   several members (batches and forces) run on all of them at once.
+ */
+typedef struct raid0_member_t {
+  pthread_t worker;
+  pthread_mutex_t mut;
+  pthread_cond_t cond;
+  raid0_op_t * head;
+  raid0_op_t * tail;
+  int shutdown;
+  stasis_handle_t * h;
+} raid0_member_t;
+
 typedef struct raid0_impl {
   stasis_handle_t ** h;
+  raid0_member_t * members;
   int handle_count;
   int stripe_size;
 } raid0_impl;
 
+static void raid0_op_run(stasis_handle_t * h, raid0_op_t * op) {
+  switch(op->type) {
+  case RAID0_OP_READ_BATCH:  op->ret = stasis_handle_read_batch(h, op->iov, op->count); break;
+  case RAID0_OP_WRITE_BATCH: op->ret = stasis_handle_write_batch(h, op->iov, op->count); break;
+  case RAID0_OP_FORCE:       op->ret = h->force(h); break;
+  case RAID0_OP_ASYNC_FORCE: op->ret = h->async_force(h); break;
+  case RAID0_OP_FORCE_RANGE: op->ret = h->force_range(h, op->start, op->stop); break;
+  default: abort();
+  }
+}
+static void* raid0_worker(void * arg) {
+  raid0_member_t * m = arg;
+  pthread_mutex_lock(&m->mut);
+  while(1) {
+    while(!m->head && !m->shutdown) {
+      pthread_cond_wait(&m->cond, &m->mut);
+    }
+    if(!m->head) { break; }
+    raid0_op_t * op = m->head;
+    m->head = op->next;
+    if(!m->head) { m->tail = 0; }
+    pthread_mutex_unlock(&m->mut);
+
+    raid0_op_run(m->h, op);
+
+    raid0_wait_t * wait = op->wait;
+    pthread_mutex_lock(&wait->mut);
+    wait->pending--;
+    if(!wait->pending) { pthread_cond_signal(&wait->cond); }
+    pthread_mutex_unlock(&wait->mut);
+
+    pthread_mutex_lock(&m->mut);
+  }
+  pthread_mutex_unlock(&m->mut);
+  return 0;
+}
+/**
+   Run ops[i] against member i, for each op whose type is not
+   RAID0_OP_NONE.  The first such op runs in the calling thread; the
+   rest are handed to the members' workers.
+
+   @return the error returned by the lowest numbered member that failed, or 0.
+ */
+static int raid0_run(raid0_impl * r, raid0_op_t * ops) {
+  raid0_wait_t wait;
+  pthread_mutex_init(&wait.mut, 0);
+  pthread_cond_init(&wait.cond, 0);
+  wait.pending = 0;
+  int first = -1;
+  for(int i = 0; i < r->handle_count; i++) {
+    if(ops[i].type == RAID0_OP_NONE) { continue; }
+    if(first == -1) { first = i; } else { wait.pending++; }
+  }
+  for(int i = first + 1; first != -1 && i < r->handle_count; i++) {
+    if(ops[i].type == RAID0_OP_NONE) { continue; }
+    raid0_member_t * m = &r->members[i];
+    ops[i].wait = &wait;
+    ops[i].next = 0;
+    pthread_mutex_lock(&m->mut);
+    if(m->tail) { m->tail->next = &ops[i]; } else { m->head = &ops[i]; }
+    m->tail = &ops[i];
+    pthread_cond_signal(&m->cond);
+    pthread_mutex_unlock(&m->mut);
+  }
+  if(first != -1) {
+    raid0_op_run(r->h[first], &ops[first]);
+  }
+  pthread_mutex_lock(&wait.mut);
+  while(wait.pending) {
+    pthread_cond_wait(&wait.cond, &wait.mut);
+  }
+  pthread_mutex_unlock(&wait.mut);
+  pthread_mutex_destroy(&wait.mut);
+  pthread_cond_destroy(&wait.cond);
+
+  int ret = 0;
+  for(int i = 0; i < r->handle_count; i++) {
+    if(ops[i].type != RAID0_OP_NONE && ops[i].ret && !ret) { ret = ops[i].ret; }
+  }
+  return ret;
+}
+/** Run the same op against every member. */
+static int raid0_run_all(raid0_impl * r, enum raid0_op_type type) {
+  raid0_op_t ops[r->handle_count];
+  for(int i = 0; i < r->handle_count; i++) {
+    ops[i].type = type;
+  }
+  return raid0_run(r, ops);
+}
+
 static int raid0_num_copies(stasis_handle_t *h) {
   raid0_impl * i = h->impl;
   return i->h[0]->num_copies(i->h[0]);
@@ -46,10 +179,21 @@ static int raid0_num_copies_buffer(stasis_handle_t *h) {
 static int raid0_close(stasis_handle_t *h) {
   raid0_impl * r = h->impl;
   int ret = 0;
+  for(int i = 0; i < r->handle_count; i++) {
+    raid0_member_t * m = &r->members[i];
+    pthread_mutex_lock(&m->mut);
+    m->shutdown = 1;
+    pthread_cond_signal(&m->cond);
+    pthread_mutex_unlock(&m->mut);
+    pthread_join(m->worker, 0);
+    pthread_mutex_destroy(&m->mut);
+    pthread_cond_destroy(&m->cond);
+  }
   for(int i = 0; i < r->handle_count; i++) {
     int this_ret = r->h[i]->close(r->h[i]);
     if(this_ret && !ret) ret = this_ret;
   }
+  free(r->members);
   free(r->h);
   free(r);
   free(h);
@@ -132,30 +276,97 @@ static stasis_read_buffer_t *raid0_read_buffer(stasis_handle_t *h,
 static int raid0_release_read_buffer(stasis_read_buffer_t *r) {
   return r->h->release_read_buffer(r);
 }
-static int raid0_force(stasis_handle_t *h) {
-  raid0_impl * r = h->impl;
-  int ret = 0;
+/**
+   Split a batch by member, and hand each member its part of the batch.
+ */
+static int raid0_rw_batch(stasis_handle_t *h, stasis_handle_iov_t *iov, int count, enum raid0_op_type type) {
+  raid0_impl *r = h->impl;
+  stasis_handle_iov_t * sub = malloc(sizeof(sub[0]) * count);
+  int * idx = malloc(sizeof(idx[0]) * count);
+  int * stripes = malloc(sizeof(stripes[0]) * count);
+  raid0_op_t ops[r->handle_count];
+  int start[r->handle_count + 1];
+
+  for(int i = 0; i <= r->handle_count; i++) {
+    start[i] = 0;
+  }
+  for(int i = 0; i < count; i++) {
+    stripes[i] = raid0_calc_stripe(r, iov[i].off, iov[i].len);
+    start[stripes[i] + 1]++;
+  }
   for(int i = 0; i < r->handle_count; i++) {
-    int this_ret = r->h[i]->force(r->h[i]);
-    if(this_ret && !ret) ret = this_ret;
+    start[i + 1] += start[i];
+    ops[i].type = (start[i + 1] > start[i]) ? type : RAID0_OP_NONE;
+    ops[i].iov = sub + start[i];
+    ops[i].count = start[i + 1] - start[i];
+  }
+  for(int i = 0; i < count; i++) {
+    int k = start[stripes[i]]++;
+    sub[k].off = raid0_calc_off(r, iov[i].off, iov[i].len);
+    sub[k].buf = iov[i].buf;
+    sub[k].len = iov[i].len;
+    sub[k].error = 0;
+    idx[k] = i;
   }
+
+  raid0_run(r, ops);
+
+  int ret = 0;
+  for(int k = 0; k < count; k++) {
+    iov[idx[k]].error = sub[k].error;
+  }
+  for(int i = 0; i < count; i++) {
+    if(iov[i].error) { ret = iov[i].error; break; }
+  }
+  free(stripes);
+  free(idx);
+  free(sub);
+  return ret;
+}
+static int raid0_read_batch(stasis_handle_t *h, stasis_handle_iov_t *iov, int count) {
+  return raid0_rw_batch(h, iov, count, RAID0_OP_READ_BATCH);
+}
+static int raid0_write_batch(stasis_handle_t *h, stasis_handle_iov_t *iov, int count) {
+  return raid0_rw_batch(h, iov, count, RAID0_OP_WRITE_BATCH);
+}
+static int raid0_force(stasis_handle_t *h) {
+  TICK(force_hist);
+  int ret = raid0_run_all(h->impl, RAID0_OP_FORCE);
+  TOCK(force_hist);
   return ret;
 }
 /**
- * TODO Implement raid0_force_range properly instead of forcing whole file.
+ * Force the bytes in [start, stop).  Each member only syncs the part of
+ * its file that holds stripes in that range.
  */
 static int raid0_force_range(stasis_handle_t *h, lsn_t start, lsn_t stop) {
-  return raid0_force(h);
-}
-static int raid0_async_force(stasis_handle_t *h) {
   raid0_impl * r = h->impl;
-  int ret = 0;
+  if(stop <= start) { return 0; }
+  TICK(force_range_hist);
+  lsn_t n = r->handle_count;
+  lsn_t unit = r->stripe_size;
+  lsn_t first_unit = start / unit;
+  lsn_t last_unit = (stop - 1) / unit;
+  raid0_op_t ops[r->handle_count];
   for(int i = 0; i < r->handle_count; i++) {
-    int this_ret = r->h[i]->async_force(r->h[i]);
-    if(this_ret && !ret) ret = this_ret;
+    // The first and last stripe units in the range that live on member i.
+    lsn_t lo = first_unit + ((i - first_unit % n) + n) % n;
+    lsn_t hi = last_unit - ((last_unit % n - i) + n) % n;
+    if(lo > hi) {
+      ops[i].type = RAID0_OP_NONE;
+      continue;
+    }
+    ops[i].type = RAID0_OP_FORCE_RANGE;
+    ops[i].start = (lo / n) * unit + (lo == first_unit ? start % unit : 0);
+    ops[i].stop  = (hi / n) * unit + (hi == last_unit ? (stop - 1) % unit + 1 : unit);
   }
+  int ret = raid0_run(r, ops);
+  TOCK(force_range_hist);
   return ret;
 }
+static int raid0_async_force(stasis_handle_t *h) {
+  return raid0_run_all(h->impl, RAID0_OP_ASYNC_FORCE);
+}
 static int raid0_fallocate(stasis_handle_t *h, lsn_t off, lsn_t len) {
   raid0_impl * r = h->impl;
   int ret = 0;
@@ -187,6 +398,8 @@ struct stasis_handle_t raid0_func = {
   .async_force = raid0_async_force,
   .force_range = raid0_force_range,
   .fallocate = raid0_fallocate,
+  .read_batch = raid0_read_batch,
+  .write_batch = raid0_write_batch,
   .error = 0
 };
 
@@ -197,8 +410,16 @@ stasis_handle_t * stasis_handle_open_raid0(int handle_count, stasis_handle_t** h
   r->stripe_size = stripe_size;
   r->handle_count = handle_count;
   r->h = malloc(sizeof(r->h[0]) * handle_count);
+  r->members = malloc(sizeof(r->members[0]) * handle_count);
   for(int i = 0; i < handle_count; i++) {
     r->h[i] = h[i];
+    raid0_member_t * m = &r->members[i];
+    m->h = h[i];
+    m->head = m->tail = 0;
+    m->shutdown = 0;
+    pthread_mutex_init(&m->mut, 0);
+    pthread_cond_init(&m->cond, 0);
+    pthread_create(&m->worker, 0, raid0_worker, m);
   }
   ret->impl = r;
   return ret;
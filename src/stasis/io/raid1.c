@@ -5,6 +5,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
 
 #include <stasis/io/handle.h>
 #include <stasis/util/histogram.h>
@@ -23,110 +24,401 @@ DECLARE_HISTOGRAM(force_range_hist)
 #define TOCK(hist)
 #endif
 
+/**
+   Mirror health is shared by every dup() of a raid1 handle, so that a
+   mirror that one handle stopped writing to is never read by another.
+   If degraded_file is set, dropping a mirror is recorded there, so that
+   the stale mirror is not read after a restart either.
+ */
+typedef struct raid1_health_t {
+  pthread_mutex_t mut;
+  int refcount;
+  int failed[2];
+  char * degraded_file;
+} raid1_health_t;
+
+enum raid1_op_type {
+  RAID1_OP_WRITE,
+  RAID1_OP_FORCE,
+  RAID1_OP_ASYNC_FORCE,
+  RAID1_OP_FORCE_RANGE,
+  RAID1_OP_FALLOCATE
+};
+
+/**
+   An update, handed to the worker threads of both mirrors.  The caller
+   may give up on a mirror that stalls, so the op owns a copy of any data
+   it writes, and is freed by whichever of the caller and the workers is
+   done with it last.
+ */
+typedef struct raid1_op_t {
+  enum raid1_op_type type;
+  lsn_t off;
+  lsn_t len;
+  byte * buf;
+  int ret[2];
+  int done[2];
+  int refcount;
+  pthread_mutex_t mut;
+  pthread_cond_t cond;
+  /** The next op in each mirror's queue. */
+  struct raid1_op_t * next[2];
+} raid1_op_t;
+
+typedef struct raid1_mirror_t {
+  stasis_handle_t * h;
+  /** This mirror's index in raid1_impl.m. */
+  int idx;
+  pthread_t worker;
+  pthread_mutex_t mut;
+  pthread_cond_t cond;
+  raid1_op_t * head;
+  raid1_op_t * tail;
+  int shutdown;
+  /** Number of reads currently running against this mirror. */
+  int inflight;
+  /** Moving average of recent read latency, in microseconds. */
+  int64_t read_latency;
+} raid1_mirror_t;
+
 typedef struct raid1_impl {
-  stasis_handle_t * a;
-  stasis_handle_t * b;
+  raid1_mirror_t m[2];
+  raid1_health_t * health;
+  uint64_t reads;
 } raid1_impl;
 
+/** Every this many reads go to the mirror that is not preferred, so that
+    its latency estimate does not go stale. */
+#define RAID1_PROBE_INTERVAL 64
+
+static int64_t raid1_now() {
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  return ((int64_t)tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+static void raid1_note_latency(int64_t * avg, int64_t start) {
+  int64_t sample = raid1_now() - start;
+  // Races between concurrent updates lose a sample; that's fine.
+  *avg += (sample - *avg) / 8;
+}
+static int raid1_failed(raid1_impl * i, int m) {
+  return *(volatile int*)&i->health->failed[m];
+}
+/**
+   Durably record that mirror m is out of date.
+
+   @return 0 on success, or an errno.
+ */
+static int raid1_persist_failure(raid1_health_t * health, int m) {
+  int fd = open(health->degraded_file, O_CREAT | O_WRONLY | O_TRUNC, FILE_PERM);
+  if(fd == -1) { return errno; }
+  char buf[16];
+  int len = snprintf(buf, sizeof(buf), "%d\n", m);
+  int ret = 0;
+  if(write(fd, buf, len) != len || fsync(fd)) { ret = errno ? errno : EIO; }
+  close(fd);
+  return ret;
+}
+/**
+   Stop using mirror m, unless it is the only one left, or the failure
+   could not be recorded in the degraded file.
+
+   @return 1 if the mirror was dropped, 0 if it is still in use.
+ */
+static int raid1_fail(raid1_impl * i, int m) {
+  int ret = 0;
+  pthread_mutex_lock(&i->health->mut);
+  if(!i->health->failed[!m]) {
+    if(i->health->failed[m]) {
+      ret = 1;
+    } else if(i->health->degraded_file
+              && (ret = raid1_persist_failure(i->health, m))) {
+      fprintf(stderr, "raid1: mirror %d failed, but could not record that in %s: %s\n",
+              m, i->health->degraded_file, strerror(ret));
+      ret = 0;
+    } else {
+      fprintf(stderr, "raid1: mirror %d failed or stalled; continuing with one mirror\n", m);
+      i->health->failed[m] = 1;
+      ret = 1;
+    }
+  }
+  pthread_mutex_unlock(&i->health->mut);
+  return ret;
+}
+static int raid1_op_run(stasis_handle_t * h, enum raid1_op_type type, lsn_t off, lsn_t len, const byte * buf) {
+  switch(type) {
+  case RAID1_OP_WRITE:       return h->write(h, off, buf, len);
+  case RAID1_OP_FORCE:       return h->force(h);
+  case RAID1_OP_ASYNC_FORCE: return h->async_force(h);
+  case RAID1_OP_FORCE_RANGE: return h->force_range(h, off, len);
+  case RAID1_OP_FALLOCATE:   return h->fallocate(h, off, len);
+  default: abort();
+  }
+}
+static void raid1_op_release(raid1_op_t * op) {
+  pthread_mutex_lock(&op->mut);
+  int last = !--op->refcount;
+  pthread_mutex_unlock(&op->mut);
+  if(last) {
+    pthread_mutex_destroy(&op->mut);
+    pthread_cond_destroy(&op->cond);
+    free(op->buf);
+    free(op);
+  }
+}
+static void* raid1_worker(void * arg) {
+  raid1_mirror_t * m = arg;
+  pthread_mutex_lock(&m->mut);
+  while(1) {
+    while(!m->head && !m->shutdown) {
+      pthread_cond_wait(&m->cond, &m->mut);
+    }
+    if(!m->head) { break; }
+    raid1_op_t * op = m->head;
+    m->head = op->next[m->idx];
+    if(!m->head) { m->tail = 0; }
+    pthread_mutex_unlock(&m->mut);
+
+    int ret = raid1_op_run(m->h, op->type, op->off, op->len, op->buf);
+
+    pthread_mutex_lock(&op->mut);
+    op->ret[m->idx] = ret;
+    op->done[m->idx] = 1;
+    pthread_cond_signal(&op->cond);
+    pthread_mutex_unlock(&op->mut);
+    raid1_op_release(op);
+
+    pthread_mutex_lock(&m->mut);
+  }
+  pthread_mutex_unlock(&m->mut);
+  return 0;
+}
+/**
+   Wait for both mirrors to finish op.  Once one of them has succeeded,
+   give up on the other after stasis_handle_raid1_stall_timeout
+   milliseconds; its result is reported as ETIMEDOUT.
+ */
+static void raid1_op_wait(raid1_op_t * op, int ret[2]) {
+  int64_t first_ok = -1;
+  pthread_mutex_lock(&op->mut);
+  while(!op->done[0] || !op->done[1]) {
+    if(first_ok == -1 && ((op->done[0] && !op->ret[0]) || (op->done[1] && !op->ret[1]))) {
+      first_ok = raid1_now();
+    }
+    if(first_ok != -1 && stasis_handle_raid1_stall_timeout) {
+      int64_t deadline = first_ok + ((int64_t)stasis_handle_raid1_stall_timeout) * 1000;
+      struct timespec ts = { deadline / 1000000, (deadline % 1000000) * 1000 };
+      if(pthread_cond_timedwait(&op->cond, &op->mut, &ts) == ETIMEDOUT
+         && (!op->done[0] || !op->done[1])) {
+        break;
+      }
+    } else {
+      pthread_cond_wait(&op->cond, &op->mut);
+    }
+  }
+  for(int j = 0; j < 2; j++) {
+    ret[j] = op->done[j] ? op->ret[j] : ETIMEDOUT;
+  }
+  pthread_mutex_unlock(&op->mut);
+}
+/**
+   Apply an update to both mirrors at once.  Each mirror's copy runs on
+   its worker thread, so that the caller can drop whichever mirror stalls.
+   If one mirror fails or stalls and the other succeeds, the raid1 handle
+   keeps going with the mirror that succeeded.
+ */
+static int raid1_update(raid1_impl * i, enum raid1_op_type type, lsn_t off, lsn_t len, const byte * dat) {
+  if(raid1_failed(i, 0) || raid1_failed(i, 1)) {
+    int m = raid1_failed(i, 0) ? 1 : 0;
+    return raid1_op_run(i->m[m].h, type, off, len, dat);
+  }
+  raid1_op_t * op = malloc(sizeof(*op));
+  op->type = type;
+  op->off = off;
+  op->len = len;
+  op->buf = 0;
+  if(type == RAID1_OP_WRITE) {
+    op->buf = malloc(len);
+    memcpy(op->buf, dat, len);
+  }
+  op->refcount = 3;
+  pthread_mutex_init(&op->mut, 0);
+  pthread_cond_init(&op->cond, 0);
+  for(int j = 0; j < 2; j++) {
+    op->ret[j] = 0;
+    op->done[j] = 0;
+    op->next[j] = 0;
+  }
+  for(int j = 0; j < 2; j++) {
+    raid1_mirror_t * m = &i->m[j];
+    pthread_mutex_lock(&m->mut);
+    if(m->tail) { m->tail->next[j] = op; } else { m->head = op; }
+    m->tail = op;
+    pthread_cond_signal(&m->cond);
+    pthread_mutex_unlock(&m->mut);
+  }
+
+  int ret[2];
+  // A mirror that times out finishes (and releases) the op in the background.
+  raid1_op_wait(op, ret);
+  raid1_op_release(op);
+
+  if(ret[0] && !ret[1] && raid1_fail(i, 0)) { return 0; }
+  if(ret[1] && !ret[0] && raid1_fail(i, 1)) { return 0; }
+  return ret[0] ? ret[0] : ret[1];
+}
+/**
+   Pick the mirror that should serve a read: the one with the lowest
+   recent read latency, scaled by the number of reads already queued on it.
+ */
+static int raid1_pick_reader(raid1_impl * i) {
+  if(raid1_failed(i, 0)) { return 1; }
+  if(raid1_failed(i, 1)) { return 0; }
+  uint64_t n = __sync_fetch_and_add(&i->reads, 1);
+  int64_t costA = (i->m[0].read_latency + 1) * (i->m[0].inflight + 1);
+  int64_t costB = (i->m[1].read_latency + 1) * (i->m[1].inflight + 1);
+  int best = costA == costB ? (int)(n & 1) : (costA < costB ? 0 : 1);
+  if(n % RAID1_PROBE_INTERVAL == RAID1_PROBE_INTERVAL - 1) { best = !best; }
+  return best;
+}
+static int raid1_read_mirror(raid1_impl * i, int m, lsn_t off, byte *buf, lsn_t len) {
+  raid1_mirror_t * mirror = &i->m[m];
+  __sync_fetch_and_add(&mirror->inflight, 1);
+  int64_t start = raid1_now();
+  int ret = mirror->h->read(mirror->h, off, buf, len);
+  raid1_note_latency(&mirror->read_latency, start);
+  __sync_fetch_and_sub(&mirror->inflight, 1);
+  return ret;
+}
+
 static int raid1_num_copies(stasis_handle_t *h) {
   raid1_impl * i = h->impl;
-  return i->a->num_copies(i->a);
+  return i->m[0].h->num_copies(i->m[0].h);
 }
 static int raid1_num_copies_buffer(stasis_handle_t *h) {
   raid1_impl * i = h->impl;
-  return i->a->num_copies_buffer(i->a);
+  return i->m[0].h->num_copies_buffer(i->m[0].h);
 }
 static int raid1_close(stasis_handle_t *h) {
   raid1_impl * i = h->impl;
-  int reta = i->a->close(i->a);
-  int retb = i->b->close(i->b);
+  for(int j = 0; j < 2; j++) {
+    raid1_mirror_t * m = &i->m[j];
+    pthread_mutex_lock(&m->mut);
+    m->shutdown = 1;
+    pthread_cond_signal(&m->cond);
+    pthread_mutex_unlock(&m->mut);
+    pthread_join(m->worker, 0);
+    pthread_mutex_destroy(&m->mut);
+    pthread_cond_destroy(&m->cond);
+  }
+  int reta = i->m[0].h->close(i->m[0].h);
+  int retb = i->m[1].h->close(i->m[1].h);
+  pthread_mutex_lock(&i->health->mut);
+  int last = !--i->health->refcount;
+  pthread_mutex_unlock(&i->health->mut);
+  if(last) {
+    pthread_mutex_destroy(&i->health->mut);
+    free(i->health->degraded_file);
+    free(i->health);
+  }
   free(i);
   free(h);
   return reta ? reta : retb;
 }
+static stasis_handle_t * raid1_open(stasis_handle_t * a, stasis_handle_t * b, raid1_health_t * health);
 static stasis_handle_t* raid1_dup(stasis_handle_t *h) {
   raid1_impl * i = h->impl;
-  return stasis_handle_open_raid1(i->a->dup(i->a), i->b->dup(i->b));
+  pthread_mutex_lock(&i->health->mut);
+  i->health->refcount++;
+  pthread_mutex_unlock(&i->health->mut);
+  return raid1_open(i->m[0].h->dup(i->m[0].h), i->m[1].h->dup(i->m[1].h), i->health);
 }
 static void raid1_enable_sequential_optimizations(stasis_handle_t *h) {
   raid1_impl * i = h->impl;
-  i->a->enable_sequential_optimizations(i->a);
-  i->b->enable_sequential_optimizations(i->b);
+  i->m[0].h->enable_sequential_optimizations(i->m[0].h);
+  i->m[1].h->enable_sequential_optimizations(i->m[1].h);
 }
 static lsn_t raid1_end_position(stasis_handle_t *h) {
   raid1_impl *i = h->impl;
-  return i->a->end_position(i->a);
+  int m = raid1_failed(i, 0) ? 1 : 0;
+  return i->m[m].h->end_position(i->m[m].h);
 }
 static int raid1_read(stasis_handle_t *h, lsn_t off, byte *buf, lsn_t len) {
   raid1_impl *i = h->impl;
-  struct timeval tv;
-  gettimeofday(&tv, 0);
-  // use some low bit that's likely "real" as a source of randomness
-  if(tv.tv_usec & 0x040) {
-    return i->a->read(i->a, off, buf, len);
-  } else {
-    return i->b->read(i->b, off, buf, len);
+  TICK(read_hist);
+  int m = raid1_pick_reader(i);
+  int ret = raid1_read_mirror(i, m, off, buf, len);
+  if(ret && ret != EDOM && !raid1_failed(i, !m)) {
+    // Only drop m if the other mirror can serve the read.
+    if(!raid1_read_mirror(i, !m, off, buf, len)) {
+      raid1_fail(i, m);
+      ret = 0;
+    }
   }
+  TOCK(read_hist);
+  return ret;
 }
 static int raid1_write(stasis_handle_t *h, lsn_t off, const byte *dat, lsn_t len) {
-  raid1_impl *i = h->impl;
-  int retA = i->a->write(i->a, off, dat, len);
-  int retB = i->b->write(i->b, off, dat, len);
-  return retA ? retA : retB;
+  TICK(write_hist);
+  int ret = raid1_update(h->impl, RAID1_OP_WRITE, off, len, dat);
+  TOCK(write_hist);
+  return ret;
 }
 static stasis_write_buffer_t * raid1_write_buffer(stasis_handle_t *h, lsn_t off, lsn_t len) {
-  raid1_impl *i = h->impl;
-  stasis_write_buffer_t * ret = i->a->write_buffer(i->a, off, len);
+  stasis_write_buffer_t * ret = malloc(sizeof(*ret));
   ret->h = h;
+  ret->impl = 0;
+  if(off < 0) {
+    ret->off = 0;
+    ret->buf = 0;
+    ret->len = 0;
+    ret->error = EDOM;
+  } else {
+    ret->off = off;
+    ret->buf = malloc(len);
+    ret->len = len;
+    ret->error = 0;
+  }
   return ret;
 }
 static int raid1_release_write_buffer(stasis_write_buffer_t *w) {
-  raid1_impl *i = w->h->impl;
-  w->h = i->a;
-  assert(w->h == i->a);
-  int retA = i->b->write(i->b, w->off, w->buf, w->len);
-  int retB = w->h->release_write_buffer(w);
-  return retA ? retA : retB;
+  int ret = w->error ? w->error : raid1_write(w->h, w->off, w->buf, w->len);
+  free(w->buf);
+  free(w);
+  return ret;
 }
 static stasis_read_buffer_t *raid1_read_buffer(stasis_handle_t *h,
 					       lsn_t off, lsn_t len) {
   raid1_impl *i = h->impl;
-  struct timeval tv;
-  gettimeofday(&tv, 0);
-  // use some low bit that's likely "real" as a source of randomness
-  if(tv.tv_usec & 0x040) {
-    return i->a->read_buffer(i->a, off, len);
-  } else {
-    return i->b->read_buffer(i->b, off, len);
-  }
+  raid1_mirror_t * m = &i->m[raid1_pick_reader(i)];
+  __sync_fetch_and_add(&m->inflight, 1);
+  int64_t start = raid1_now();
+  stasis_read_buffer_t * ret = m->h->read_buffer(m->h, off, len);
+  raid1_note_latency(&m->read_latency, start);
+  __sync_fetch_and_sub(&m->inflight, 1);
+  return ret;
 }
 static int raid1_release_read_buffer(stasis_read_buffer_t *r) {
   // Should not be called.
   abort();
 }
 static int raid1_force(stasis_handle_t *h) {
-  raid1_impl *i = h->impl;
-  int retA = i->a->force(i->a);
-  int retB = i->b->force(i->b);
-  return retA ? retA : retB;
+  TICK(force_hist);
+  int ret = raid1_update(h->impl, RAID1_OP_FORCE, 0, 0, 0);
+  TOCK(force_hist);
+  return ret;
 }
 static int raid1_async_force(stasis_handle_t *h) {
-  raid1_impl *i = h->impl;
-  int retA = i->a->async_force(i->a);
-  int retB = i->b->async_force(i->b);
-  return retA ? retA : retB;
+  return raid1_update(h->impl, RAID1_OP_ASYNC_FORCE, 0, 0, 0);
 }
 static int raid1_force_range(stasis_handle_t *h, lsn_t start, lsn_t stop) {
-  raid1_impl *i = h->impl;
-  int retA = i->a->force_range(i->a, start, stop);
-  int retB = i->b->force_range(i->b, start, stop);
-  return retA ? retA : retB;
+  TICK(force_range_hist);
+  int ret = raid1_update(h->impl, RAID1_OP_FORCE_RANGE, start, stop, 0);
+  TOCK(force_range_hist);
+  return ret;
 }
 static int raid1_fallocate(stasis_handle_t *h, lsn_t off, lsn_t len) {
-  raid1_impl *i = h->impl;
-  int retA = i->a->fallocate(i->a, off, len);
-  int retB = i->b->fallocate(i->b, off, len);
-  return retA ? retA : retB;
+  return raid1_update(h->impl, RAID1_OP_FALLOCATE, off, len, 0);
 }
 struct stasis_handle_t raid1_func = {
   .num_copies = raid1_num_copies,
@@ -148,17 +440,56 @@ struct stasis_handle_t raid1_func = {
   .error = 0
 };
 
-stasis_handle_t * stasis_handle_open_raid1(stasis_handle_t* a, stasis_handle_t* b) {
+static stasis_handle_t * raid1_open(stasis_handle_t * a, stasis_handle_t * b, raid1_health_t * health) {
   stasis_handle_t * ret = malloc(sizeof(*ret));
   *ret = raid1_func;
   raid1_impl * i = malloc(sizeof(*i));
-  i->a = a; i->b = b;
+  i->m[0].h = a; i->m[1].h = b;
+  i->health = health;
+  i->reads = 0;
+  for(int j = 0; j < 2; j++) {
+    raid1_mirror_t * m = &i->m[j];
+    m->head = m->tail = 0;
+    m->shutdown = 0;
+    m->inflight = 0;
+    m->idx = j;
+    m->read_latency = 0;
+    pthread_mutex_init(&m->mut, 0);
+    pthread_cond_init(&m->cond, 0);
+    pthread_create(&m->worker, 0, raid1_worker, m);
+  }
   ret->impl = i;
   return ret;
 }
+stasis_handle_t * stasis_handle_open_raid1_durable(stasis_handle_t* a, stasis_handle_t* b, const char * degraded_file) {
+  raid1_health_t * health = malloc(sizeof(*health));
+  pthread_mutex_init(&health->mut, 0);
+  health->refcount = 1;
+  health->failed[0] = health->failed[1] = 0;
+  health->degraded_file = 0;
+  if(degraded_file) {
+    health->degraded_file = strdup(degraded_file);
+    FILE * f = fopen(degraded_file, "r");
+    if(f) {
+      int m = -1;
+      if(fscanf(f, "%d", &m) != 1 || (m != 0 && m != 1)) {
+        fprintf(stderr, "raid1: %s is corrupt\n", degraded_file);
+        fflush(NULL);
+        abort();
+      }
+      fclose(f);
+      fprintf(stderr, "raid1: mirror %d is out of date (see %s); using one mirror\n", m, degraded_file);
+      health->failed[m] = 1;
+    }
+  }
+  return raid1_open(a, b, health);
+}
+stasis_handle_t * stasis_handle_open_raid1(stasis_handle_t* a, stasis_handle_t* b) {
+  return stasis_handle_open_raid1_durable(a, b, 0);
+}
 
 stasis_handle_t * stasis_handle_raid1_factory() {
   stasis_handle_t * a = stasis_handle_file_factory(stasis_store_file_1_name, O_CREAT | O_RDWR | stasis_buffer_manager_io_handle_flags, FILE_PERM);
   stasis_handle_t * b = stasis_handle_file_factory(stasis_store_file_2_name, O_CREAT | O_RDWR | stasis_buffer_manager_io_handle_flags, FILE_PERM);
-  return stasis_handle_open_raid1(a, b);
+  return stasis_handle_open_raid1_durable(a, b, stasis_store_file_raid1_degraded_name);
 }
@@ -0,0 +1,566 @@
+#include <config.h>
+
+#include <stasis/io/handle.h>
+#include <stasis/flags.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <assert.h>
+
+/**
+   @file
+
+   A file-backed io handle that uses Linux's io_uring interface to
+   submit batches of reads, writes and syncs with a single system
+   call.
+
+   Single reads and writes use pread() and pwrite(), exactly like
+   pfile.c; a request that is not part of a batch gains nothing from
+   a round trip through the ring.  read_batch(), write_batch(),
+   force_range() and async_force() queue their requests on the
+   submission ring, and then wait for the completions.
+
+   The handle has a single ring, which is shared by all of the threads
+   that use it.  A mutex protects the ring's head and tail pointers,
+   and at most one thread at a time (the "reaper") waits inside the
+   kernel for completions.  The other threads wait for the reaper to
+   broadcast on a condition variable after it has consumed the
+   completion ring.  Only the reaper consumes completions, so a thread
+   that decides to become the reaper knows that the requests it is
+   waiting for are still in the kernel or in the completion ring.
+
+   The number of requests in flight never exceeds the size of the
+   submission ring, which is half the size of the completion ring, so
+   the completion ring cannot overflow.
+
+   @see handle.h
+*/
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sched.h>
+
+/**
+   The kernel limits the length of a single io_uring request to 32
+   bits.  Longer requests are split, or finished synchronously.
+*/
+#define URING_MAX_LEN (1 << 30)
+
+/**
+   Per-handle information for uring
+*/
+typedef struct uring_impl {
+  /** File descriptor */
+  int fd;
+  /** Flags passed into open */
+  int file_flags;
+  /** File creation mode */
+  int file_mode;
+  /** The name of the underlying file. */
+  char *filename;
+  /** If 1, then call fadvise(DONTNEED) on sync, like pfile. */
+  int sequential;
+
+  int ring_fd;
+  /** The submission and completion rings share one mapping. */
+  void *ring;
+  size_t ring_len;
+  struct io_uring_sqe *sqes;
+  size_t sqes_len;
+  unsigned sq_entries;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+
+  /** Protects the fields below, and the ring pointers. */
+  pthread_mutex_t mut;
+  /** Broadcast each time the reaper consumes completions. */
+  pthread_cond_t reaped;
+  /** The number of requests that have been queued, but not reaped. */
+  unsigned in_flight;
+  /** Non-zero if some thread is waiting in io_uring_enter() for completions. */
+  int reaping;
+} uring_impl;
+
+/**
+   A request on the ring, and the result that its completion produced.
+*/
+typedef struct uring_op {
+  __u8 opcode;
+  __u32 op_flags;
+  lsn_t off;
+  byte *buf;
+  __u32 len;
+  /** The iov this request was issued for, if any. */
+  stasis_handle_iov_t *iov;
+  /** Decremented when the completion is reaped. */
+  int *outstanding;
+  int res;
+} uring_op;
+
+static int uring_setup(unsigned entries, struct io_uring_params *p) {
+  return syscall(SYS_io_uring_setup, entries, p);
+}
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return syscall(SYS_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+/**
+   Create the ring, and map it into our address space.
+
+   @return 0 on success, or an error code if the kernel does not
+   support io_uring (or does not support the operations that we need).
+*/
+static int uring_ring_open(uring_impl *impl, unsigned entries) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = uring_setup(entries, &p);
+  if(fd < 0) { return errno; }
+  // FAST_POLL was added after IORING_OP_READ, IORING_OP_WRITE and
+  // IORING_OP_SYNC_FILE_RANGE, so it doubles as a version check.
+  if(!(p.features & IORING_FEAT_FAST_POLL) || !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+    close(fd);
+    return ENOSYS;
+  }
+  size_t sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  size_t cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  impl->ring_len = sq_len > cq_len ? sq_len : cq_len;
+  impl->ring = mmap(0, impl->ring_len, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if(impl->ring == MAP_FAILED) {
+    int err = errno;
+    close(fd);
+    return err;
+  }
+  impl->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  impl->sqes = mmap(0, impl->sqes_len, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if(impl->sqes == MAP_FAILED) {
+    int err = errno;
+    munmap(impl->ring, impl->ring_len);
+    close(fd);
+    return err;
+  }
+  byte *r = impl->ring;
+  impl->sq_head = (unsigned*)(r + p.sq_off.head);
+  impl->sq_tail = (unsigned*)(r + p.sq_off.tail);
+  impl->sq_mask = (unsigned*)(r + p.sq_off.ring_mask);
+  impl->cq_head = (unsigned*)(r + p.cq_off.head);
+  impl->cq_tail = (unsigned*)(r + p.cq_off.tail);
+  impl->cq_mask = (unsigned*)(r + p.cq_off.ring_mask);
+  impl->cqes = (struct io_uring_cqe*)(r + p.cq_off.cqes);
+  // Submission queue entry i always lives in slot i.
+  unsigned *sq_array = (unsigned*)(r + p.sq_off.array);
+  for(unsigned i = 0; i < p.sq_entries; i++) { sq_array[i] = i; }
+  impl->sq_entries = p.sq_entries;
+  impl->ring_fd = fd;
+  return 0;
+}
+static void uring_ring_close(uring_impl *impl) {
+  munmap(impl->sqes, impl->sqes_len);
+  munmap(impl->ring, impl->ring_len);
+  close(impl->ring_fd);
+}
+
+/** Pass n newly queued requests to the kernel.  Caller holds impl->mut. */
+static void uring_submit(uring_impl *impl, unsigned n) {
+  while(n) {
+    int ret = uring_enter(impl->ring_fd, n, 0, 0);
+    if(ret < 0) {
+      if(errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+        sched_yield();
+        continue;
+      }
+      perror("io_uring_enter() could not submit requests");
+      abort();
+    }
+    n -= ret;
+  }
+}
+/** Consume the completion ring.  Caller holds impl->mut, and is the reaper. */
+static void uring_reap(uring_impl *impl) {
+  unsigned head = *impl->cq_head;
+  unsigned tail = __atomic_load_n(impl->cq_tail, __ATOMIC_ACQUIRE);
+  while(head != tail) {
+    struct io_uring_cqe *cqe = &impl->cqes[head & *impl->cq_mask];
+    uring_op *op = (uring_op*)(intptr_t)cqe->user_data;
+    op->res = cqe->res;
+    (*op->outstanding)--;
+    impl->in_flight--;
+    head++;
+  }
+  __atomic_store_n(impl->cq_head, head, __ATOMIC_RELEASE);
+}
+/**
+   Queue each of the requests, and block until all of them have
+   completed.  If there are more requests than free slots, new
+   requests are queued as old ones complete.
+*/
+static void uring_run(uring_impl *impl, uring_op *ops, int count) {
+  int outstanding = count;
+  int queued = 0;
+  pthread_mutex_lock(&impl->mut);
+  while(1) {
+    unsigned tail = *impl->sq_tail;
+    unsigned n = 0;
+    while(queued < count && impl->in_flight < impl->sq_entries) {
+      uring_op *op = &ops[queued];
+      struct io_uring_sqe *sqe = &impl->sqes[tail & *impl->sq_mask];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = op->opcode;
+      sqe->fd = impl->fd;
+      sqe->off = op->off;
+      sqe->addr = (__u64)(intptr_t)op->buf;
+      sqe->len = op->len;
+      sqe->rw_flags = op->op_flags; // aliases fsync_flags and sync_range_flags
+      sqe->user_data = (__u64)(intptr_t)op;
+      op->outstanding = &outstanding;
+      tail++;
+      n++;
+      queued++;
+      impl->in_flight++;
+    }
+    if(n) {
+      __atomic_store_n(impl->sq_tail, tail, __ATOMIC_RELEASE);
+      uring_submit(impl, n);
+    }
+    if(!outstanding) { break; }
+    if(impl->reaping) {
+      pthread_cond_wait(&impl->reaped, &impl->mut);
+    } else {
+      // Some of our requests (or, if the ring was full, someone else's)
+      // are in flight, so this will eventually return.
+      assert(impl->in_flight);
+      impl->reaping = 1;
+      pthread_mutex_unlock(&impl->mut);
+      int ret = uring_enter(impl->ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+      if(ret < 0 && errno != EINTR && errno != EAGAIN) {
+        perror("io_uring_enter() could not wait for completions");
+        abort();
+      }
+      pthread_mutex_lock(&impl->mut);
+      uring_reap(impl);
+      impl->reaping = 0;
+      pthread_cond_broadcast(&impl->reaped);
+    }
+  }
+  pthread_mutex_unlock(&impl->mut);
+}
+
+static int uring_pread(uring_impl *impl, lsn_t off, byte *buf, lsn_t len) {
+  lsn_t bytes_read = 0;
+  while(bytes_read < len) {
+    ssize_t count = pread(impl->fd, buf + bytes_read, len - bytes_read, off + bytes_read);
+    if(count == -1) {
+      if(errno == EAGAIN || errno == EINTR) { continue; }
+      return errno;
+    } else if(count == 0) {
+      // EOF
+      return EDOM;
+    }
+    bytes_read += count;
+  }
+  return 0;
+}
+static int uring_pwrite(uring_impl *impl, lsn_t off, const byte *dat, lsn_t len) {
+  lsn_t bytes_written = 0;
+  while(bytes_written < len) {
+    ssize_t count = pwrite(impl->fd, dat + bytes_written, len - bytes_written, off + bytes_written);
+    if(count == -1) {
+      if(errno == EAGAIN || errno == EINTR) { continue; }
+      return errno;
+    }
+    bytes_written += count;
+  }
+  return 0;
+}
+
+static int uring_rw_batch(stasis_handle_t *h, stasis_handle_iov_t *iov, int count, int is_write) {
+  uring_impl *impl = h->impl;
+  uring_op *ops = malloc(sizeof(*ops) * count);
+  int n = 0;
+  for(int i = 0; i < count; i++) {
+    iov[i].error = 0;
+    if(iov[i].off < 0) {
+      iov[i].error = EDOM;
+      continue;
+    }
+    ops[n].opcode = is_write ? IORING_OP_WRITE : IORING_OP_READ;
+    ops[n].op_flags = 0;
+    ops[n].off = iov[i].off;
+    ops[n].buf = iov[i].buf;
+    ops[n].len = iov[i].len > URING_MAX_LEN ? URING_MAX_LEN : iov[i].len;
+    ops[n].iov = &iov[i];
+    n++;
+  }
+  uring_run(impl, ops, n);
+  int ret = 0;
+  for(int i = 0; i < n; i++) {
+    stasis_handle_iov_t *v = ops[i].iov;
+    int res = ops[i].res;
+    if(res == -EAGAIN || res == -EINTR) {
+      // Transient; nothing was transferred, so redo the whole request.
+      v->error = is_write ? uring_pwrite(impl, v->off, v->buf, v->len)
+                          : uring_pread(impl, v->off, v->buf, v->len);
+    } else if(res < 0) {
+      v->error = -res;
+    } else if(res == 0 && v->len && !is_write) {
+      v->error = EDOM;
+    } else if(res < v->len) {
+      // Short transfer; finish it the old fashioned way.
+      v->error = is_write ? uring_pwrite(impl, v->off + res, v->buf + res, v->len - res)
+                          : uring_pread(impl, v->off + res, v->buf + res, v->len - res);
+    }
+    if(v->error == EBADF) { h->error = EBADF; }
+  }
+  for(int i = 0; i < count; i++) {
+    if(iov[i].error) { ret = iov[i].error; break; }
+  }
+  free(ops);
+  return ret;
+}
+static int uring_read_batch(stasis_handle_t *h, stasis_handle_iov_t *iov, int count) {
+  return uring_rw_batch(h, iov, count, 0);
+}
+static int uring_write_batch(stasis_handle_t *h, stasis_handle_iov_t *iov, int count) {
+  return uring_rw_batch(h, iov, count, 1);
+}
+
+static int uring_num_copies(stasis_handle_t *h) { return 0; }
+static int uring_num_copies_buffer(stasis_handle_t *h) { return 0; }
+
+static int uring_close(stasis_handle_t *h) {
+  uring_impl *impl = h->impl;
+  int fd = impl->fd;
+  uring_ring_close(impl);
+  pthread_mutex_destroy(&impl->mut);
+  pthread_cond_destroy(&impl->reaped);
+  free(impl->filename);
+  free(impl);
+  free(h);
+  int ret = close(fd);
+  if (!ret) return 0;
+  else     return errno;
+}
+static stasis_handle_t * uring_dup(stasis_handle_t *h) {
+  uring_impl *impl = h->impl;
+  return stasis_handle_open_uring(impl->filename, impl->file_flags, impl->file_mode);
+}
+static void uring_enable_sequential_optimizations(stasis_handle_t *h) {
+  uring_impl *impl = h->impl;
+  impl->sequential = 1;
+#ifdef HAVE_POSIX_FADVISE
+  int err = posix_fadvise(impl->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  if(err) perror("Attempt to pass POSIX_FADV_SEQUENTIAL to kernel failed");
+#endif
+}
+static lsn_t uring_end_position(stasis_handle_t *h) {
+  uring_impl *impl = h->impl;
+  return lseek(impl->fd, 0, SEEK_END);
+}
+static int uring_read(stasis_handle_t *h, lsn_t off, byte *buf, lsn_t len) {
+  if(off < 0) { return EDOM; }
+  int error = uring_pread(h->impl, off, buf, len);
+  if(error == EBADF) { h->error = EBADF; }
+  return error;
+}
+static int uring_write(stasis_handle_t *h, lsn_t off, const byte *dat, lsn_t len) {
+  if(off < 0) { return EDOM; }
+  int error = uring_pwrite(h->impl, off, dat, len);
+  if(error == EBADF) { h->error = EBADF; }
+  return error;
+}
+static stasis_write_buffer_t * uring_write_buffer(stasis_handle_t *h, lsn_t off, lsn_t len) {
+  stasis_write_buffer_t *ret = malloc(sizeof(stasis_write_buffer_t));
+  if (!ret) {
+    h->error = ENOMEM;
+    return NULL;
+  }
+  ret->h = h;
+  ret->impl = 0;
+  ret->off = off;
+  ret->len = len;
+  ret->error = 0;
+  ret->buf = 0;
+  if(off < 0) {
+    ret->error = EDOM;
+  } else if(!(ret->buf = malloc(len))) {
+    ret->error = ENOMEM;
+  }
+  if(ret->error) {
+    ret->off = 0;
+    ret->len = 0;
+  }
+  return ret;
+}
+static int uring_release_write_buffer(stasis_write_buffer_t *w) {
+  int error = w->error;
+  if(!error) {
+    error = uring_write(w->h, w->off, w->buf, w->len);
+  }
+  free(w->buf);
+  free(w);
+  return error;
+}
+static stasis_read_buffer_t * uring_read_buffer(stasis_handle_t *h, lsn_t off, lsn_t len) {
+  stasis_read_buffer_t *ret = malloc(sizeof(stasis_read_buffer_t));
+  if (!ret) { return NULL; }
+  byte *buf = malloc(len);
+  int error = buf ? uring_read(h, off, buf, len) : ENOMEM;
+  ret->h = h;
+  ret->impl = 0;
+  ret->error = error;
+  if(error) {
+    free(buf);
+    ret->buf = 0;
+    ret->off = 0;
+    ret->len = 0;
+  } else {
+    ret->buf = buf;
+    ret->off = off;
+    ret->len = len;
+  }
+  return ret;
+}
+static int uring_release_read_buffer(stasis_read_buffer_t *r) {
+  free((void*)r->buf);
+  free(r);
+  return 0;
+}
+static int uring_force(stasis_handle_t *h) {
+  uring_impl *impl = h->impl;
+  if(!(impl->file_flags & O_SYNC)) {
+#ifdef HAVE_FDATASYNC
+    fdatasync(impl->fd);
+#else
+    fsync(impl->fd);
+#endif
+  }
+#ifdef HAVE_POSIX_FADVISE
+  if(impl->sequential) {
+    int err = posix_fadvise(impl->fd, 0, 0, POSIX_FADV_DONTNEED);
+    if(err) perror("Attempt to pass POSIX_FADV_DONTNEED to kernel failed");
+  }
+#endif
+  return 0;
+}
+/**
+   Issue sync_file_range(2) for [start, stop) through the ring.  The
+   kernel limits each request to 32 bits, so large ranges become a
+   batch of requests.  A stop of zero syncs to the end of the file.
+*/
+static int uring_sync_range(stasis_handle_t *h, lsn_t start, lsn_t stop, unsigned flags) {
+  uring_impl *impl = h->impl;
+  int count = stop > start ? (int)((stop - start + URING_MAX_LEN - 1) / URING_MAX_LEN) : 1;
+  uring_op *ops = malloc(sizeof(*ops) * count);
+  for(int i = 0; i < count; i++) {
+    lsn_t off = start + (lsn_t)i * URING_MAX_LEN;
+    ops[i].opcode = IORING_OP_SYNC_FILE_RANGE;
+    ops[i].op_flags = flags;
+    ops[i].off = off;
+    ops[i].buf = 0;
+    ops[i].len = stop > start ? ((stop - off) > URING_MAX_LEN ? URING_MAX_LEN : stop - off) : 0;
+    ops[i].iov = 0;
+  }
+  uring_run(impl, ops, count);
+  int ret = 0;
+  for(int i = 0; i < count; i++) {
+    if(ops[i].res < 0 && !ret) { ret = -ops[i].res; }
+  }
+  free(ops);
+  if(ret) {
+    // With the possible exceptions of ENOMEM and ENOSPACE, all of the sync
+    // errors are unrecoverable.
+    h->error = EBADF;
+  }
+#ifdef HAVE_POSIX_FADVISE
+  if(impl->sequential) {
+    int err = posix_fadvise(impl->fd, start, stop > start ? stop - start : 0, POSIX_FADV_DONTNEED);
+    if(err) perror("Attempt to pass POSIX_FADV_DONTNEED (for a range of a file) to kernel failed");
+  }
+#endif
+  return ret;
+}
+static int uring_async_force(stasis_handle_t *h) {
+  return uring_sync_range(h, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE);
+}
+static int uring_force_range(stasis_handle_t *h, lsn_t start, lsn_t stop) {
+  return uring_sync_range(h, start, stop, SYNC_FILE_RANGE_WAIT_BEFORE
+                                        | SYNC_FILE_RANGE_WRITE
+                                        | SYNC_FILE_RANGE_WAIT_AFTER);
+}
+static int uring_fallocate(struct stasis_handle_t* h, lsn_t off, lsn_t len) {
+  uring_impl * impl = h->impl;
+#ifdef HAVE_POSIX_FALLOCATE
+  return posix_fallocate(impl->fd, off, len);
+#else
+  (void)impl;
+  fprintf(stderr, "uring.c: fallocate called, but not supported by this build.\n");
+  return -1;
+#endif
+}
+
+static struct stasis_handle_t uring_func = {
+  .num_copies = uring_num_copies,
+  .num_copies_buffer = uring_num_copies_buffer,
+  .close = uring_close,
+  .dup = uring_dup,
+  .enable_sequential_optimizations = uring_enable_sequential_optimizations,
+  .end_position = uring_end_position,
+  .write = uring_write,
+  .write_buffer = uring_write_buffer,
+  .release_write_buffer = uring_release_write_buffer,
+  .read = uring_read,
+  .read_buffer = uring_read_buffer,
+  .release_read_buffer = uring_release_read_buffer,
+  .force = uring_force,
+  .async_force = uring_async_force,
+  .force_range = uring_force_range,
+  .fallocate = uring_fallocate,
+  .read_batch = uring_read_batch,
+  .write_batch = uring_write_batch,
+  .error = 0
+};
+
+#endif // HAVE_IO_URING
+
+stasis_handle_t *stasis_handle(open_uring)(const char *filename, int flags, int mode) {
+  static int warned = 0;
+  int err = ENOSYS;
+#ifdef HAVE_IO_URING
+  uring_impl *impl = malloc(sizeof(uring_impl));
+  if(!impl) { return NULL; }
+  err = uring_ring_open(impl, stasis_handle_uring_queue_depth);
+  if(!err) {
+    stasis_handle_t *ret = malloc(sizeof(stasis_handle_t));
+    *ret = uring_func;
+    ret->impl = impl;
+    impl->fd = open(filename, flags, mode);
+    if(impl->fd == -1) {
+      ret->error = errno;
+    }
+    impl->filename = strdup(filename);
+    impl->file_flags = flags;
+    impl->file_mode = mode;
+    impl->sequential = 0;
+    impl->in_flight = 0;
+    impl->reaping = 0;
+    pthread_mutex_init(&impl->mut, 0);
+    pthread_cond_init(&impl->reaped, 0);
+    return ret;
+  }
+  free(impl);
+#endif
+  if(!warned) {
+    warned = 1;
+    fprintf(stderr, "uring.c: io_uring is not available (%s); falling back on pfile.\n", strerror(err));
+  }
+  return stasis_handle_open_pfile(filename, flags, mode);
+}
@@ -10,7 +10,9 @@
 LockManagerSetup globalLockManager;
 
 void setupLockManagerCallbacksNil () {
+  if(globalLockManager.deinit) { globalLockManager.deinit(); }
   globalLockManager.init            = NULL;
+  globalLockManager.deinit          = NULL;
   globalLockManager.readLockPage    = NULL;
   globalLockManager.writeLockPage   = NULL;
   globalLockManager.unlockPage      = NULL;
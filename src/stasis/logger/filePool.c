@@ -82,8 +82,41 @@ typedef struct {
 
   int shutdown;
 
+  /**
+   * If true, the writeback thread computes the entries' checksums.
+   * @see stasis_log_file_pool_background_crc
+   */
+  int background_crc;
+  /**
+   * The LSN of the next entry the writeback thread will checksum.  Only
+   * touched by the writeback thread.
+   */
+  lsn_t crc_next;
+
 } stasis_log_file_pool_state;
 
+/**
+ * The high bit of an entry's length field is set if the entry's
+ * checksum is a CRC32C computed by the writeback thread.  Otherwise,
+ * it is a CRC32 computed by write_entry().
+ */
+#define STASIS_LOG_FILE_POOL_CRC32C 0x80000000u
+
+/**
+ * No latching required.  Does not touch shared state.
+ *
+ * @param len the entry's length field; it is updated to the entry's length.
+ * @return the checksum of the entry, computed as the length field says.
+ */
+static inline uint32_t stasis_log_file_pool_entry_crc(const void * e, uint32_t * len) {
+  if(*len & STASIS_LOG_FILE_POOL_CRC32C) {
+    *len &= ~STASIS_LOG_FILE_POOL_CRC32C;
+    return stasis_crc32c(e, *len, (uint32_t)-1);
+  } else {
+    return stasis_crc32(e, *len, (uint32_t)-1);
+  }
+}
+
 enum file_type {
   UNKNOWN = 0,
   LIVE,
@@ -374,7 +407,8 @@ LogEntry * stasis_log_file_pool_reserve_entry(stasis_log_t * log, size_t szs) {
 
   byte * buf = stasis_ringbuffer_get_wr_buf(fp->ring, off, framed_size);
 
-  memcpy(buf,            &sz, sizeof(uint32_t));
+  uint32_t len_field = fp->background_crc ? (sz | STASIS_LOG_FILE_POOL_CRC32C) : sz;
+  memcpy(buf,            &len_field, sizeof(uint32_t));
   LogEntry * e = (LogEntry*)(buf + (2 * sizeof(uint32_t)));
   e->LSN = off;
 
@@ -403,13 +437,13 @@ int stasis_log_file_pool_write_entry(stasis_log_t * log, LogEntry * e) {
   byte * buf = (byte*)e;
   lsn_t sz = sizeofLogEntry(log, e);
 
-  assert(*(((uint32_t*)buf)-2)==sz);
+  assert((*(((uint32_t*)buf)-2) & ~STASIS_LOG_FILE_POOL_CRC32C)==sz);
 
-  // TODO figure out how to move this computation into background threads.
-  // One possibility is to enqueue the size, len on some other ringbuffer, and
-  // have workers dequeue entries to checksum.  It's not clear it would be worth
-  // the extra synchronization overhead...
-  *(((uint32_t*)buf)-1) = stasis_crc32(buf, sz, (uint32_t)-1);
+  // In background_crc mode, the writeback thread checksums the entry
+  // along with the rest of the bytes it writes.
+  if(!fp->background_crc) {
+    *(((uint32_t*)buf)-1) = stasis_crc32(buf, sz, (uint32_t)-1);
+  }
   stasis_ringbuffer_write_done(fp->ring, handle);
   return 0;
 }
@@ -424,6 +458,8 @@ const LogEntry* stasis_log_file_pool_chunk_read_entry(stasis_log_file_pool_state
     abort();
   }
   if(*len == 0) { DEBUG(stderr, "Reached end of log\n"); return 0; }
+  uint32_t len_field = *len;
+  *len &= ~STASIS_LOG_FILE_POOL_CRC32C;
 
   // Force bytes containing body of log entry to disk.
   if(fp->ring) {  // if not, then we're in startup, and don't need to flush.
@@ -450,7 +486,7 @@ const LogEntry* stasis_log_file_pool_chunk_read_entry(stasis_log_file_pool_state
     abort();
   }
   uint32_t logged_crc = *(uint32_t*)(buf);
-  uint32_t calc_crc = (uint32_t)stasis_crc32(buf+sizeof(uint32_t), *len, (uint32_t)-1);
+  uint32_t calc_crc = stasis_log_file_pool_entry_crc(buf+sizeof(uint32_t), &len_field);
   if(logged_crc != calc_crc) {
     // crc does not match
     fprintf(stderr, "CRC mismatch reading from log.  LSN %lld Got %d, Expected %d", lsn, calc_crc, logged_crc);
@@ -521,6 +557,148 @@ void stasis_log_file_pool_read_entry_done(struct stasis_log_t *log, const LogEnt
 lsn_t stasis_log_file_pool_next_entry(struct stasis_log_t* log, const LogEntry * e) {
   return e->LSN + sizeofLogEntry(log, e) + sizeof(uint32_t) + sizeof(uint32_t);
 }
+/**
+ * A sequential scan over the log.  buf holds the bytes of the log from
+ * buf_start to buf_end, and entries are returned in place.  Entries
+ * that have not been written back yet are read with read_entry(), and
+ * stored in copy.
+ */
+typedef struct {
+  lsn_t next;
+  byte * buf;
+  lsn_t buf_size;
+  lsn_t buf_start;
+  lsn_t buf_end;
+  const LogEntry * copy;
+} stasis_log_file_pool_scan_t;
+
+/**
+ * No latching.  No shared state.
+ */
+void * stasis_log_file_pool_scan_open(stasis_log_t * log, lsn_t lsn) {
+  stasis_log_file_pool_scan_t * scan = malloc(sizeof(*scan));
+  scan->next = lsn;
+  scan->buf_size = stasis_log_scan_buffer_size;
+  scan->buf = malloc(scan->buf_size);
+  scan->buf_start = lsn;
+  scan->buf_end = lsn;
+  scan->copy = 0;
+  return scan;
+}
+/**
+ * Refill the scan's buffer, starting at scan->next.  Only reads bytes
+ * whose writers have finished, and never reads past the end of a
+ * chunk.  Holds mut while looking up the chunk, but not while hitting
+ * disk.
+ *
+ * @return the number of bytes now in the buffer.
+ */
+static lsn_t stasis_log_file_pool_scan_fill(stasis_log_t * log, stasis_log_file_pool_scan_t * scan) {
+  stasis_log_file_pool_state * fp = log->impl;
+  lsn_t lsn = scan->next;
+  lsn_t end = lsn + scan->buf_size;
+  if(fp->ring) {
+    lsn_t wt = stasis_ringbuffer_get_write_tail(fp->ring);
+    if(wt <= lsn) { return 0; }
+    if(end > wt) { end = wt; }
+  }
+  pthread_mutex_lock(&fp->mut);
+  int chunk = get_chunk_from_offset(log, lsn);
+  if(chunk == -1) {
+    pthread_mutex_unlock(&fp->mut);
+    return 0;
+  }
+  // As in read_entry(), the fd and offset are stable while we read.
+  int fd    = fp->ro_fd[chunk];
+  lsn_t off = fp->live_offsets[chunk];
+  int chunk_end = chunk + 1 < fp->live_count && end >= fp->live_offsets[chunk+1];
+  if(chunk_end) { end = fp->live_offsets[chunk+1]; }
+  pthread_mutex_unlock(&fp->mut);
+
+  // Make sure the bytes we want have been written back.
+  if(fp->ring) { stasis_ringbuffer_flush(fp->ring, end); }
+
+  lsn_t got = 0;
+  while(lsn + got < end) {
+    ssize_t ret = pread(fd, scan->buf + got, end - (lsn + got), lsn + got - off);
+    if(ret == -1) {
+      perror("Error reading from log.");
+      abort();
+    }
+    if(ret == 0) { break; }
+    got += ret;
+  }
+  scan->buf_start = lsn;
+  scan->buf_end = lsn + got;
+  if(!chunk_end && got == end - lsn) {
+    // Ask the kernel to start reading the next block while the caller
+    // works through this one.
+    posix_fadvise(fd, end - off, scan->buf_size, POSIX_FADV_WILLNEED);
+  }
+  return got;
+}
+/**
+ * No latching.  Only touches shared state through read_entry() and
+ * stasis_log_file_pool_scan_fill().
+ */
+const LogEntry * stasis_log_file_pool_scan_next(stasis_log_t * log, void * scanp) {
+  stasis_log_file_pool_scan_t * scan = scanp;
+  const lsn_t header = 2 * sizeof(uint32_t);
+  if(scan->copy) {
+    stasis_log_file_pool_read_entry_done(log, scan->copy);
+    scan->copy = 0;
+  }
+  while(1) {
+    lsn_t avail = scan->buf_end - scan->next;
+    const byte * buf = scan->buf + (scan->next - scan->buf_start);
+    if(avail >= (lsn_t)sizeof(uint32_t)) {
+      uint32_t len_field;
+      memcpy(&len_field, buf, sizeof(len_field));
+      if(len_field == 0) { DEBUG(stderr, "Reached end of log\n"); return 0; }
+      uint32_t len = len_field & ~STASIS_LOG_FILE_POOL_CRC32C;
+      if(avail >= len + header) {
+        uint32_t logged_crc;
+        memcpy(&logged_crc, buf + sizeof(uint32_t), sizeof(logged_crc));
+        const LogEntry * e = (const LogEntry*)(buf + header);
+        uint32_t calc_crc = stasis_log_file_pool_entry_crc(e, &len_field);
+        if(logged_crc != calc_crc) {
+          fprintf(stderr, "CRC mismatch reading from log.  LSN %lld Got %d, Expected %d", scan->next, calc_crc, logged_crc);
+          return 0;
+        }
+        assert(sizeofLogEntry(log, e) == len);
+        scan->next += len + header;
+        return e;
+      }
+      if(len + header > scan->buf_size) {
+        scan->buf_size = len + header;
+        free(scan->buf);
+        scan->buf = malloc(scan->buf_size);
+        scan->buf_end = scan->buf_start = scan->next;
+        avail = 0;
+      }
+    }
+    if(stasis_log_file_pool_scan_fill(log, scan) <= avail) {
+      // The next entry has not been written back, or we are at the end
+      // of the log.  read_entry() knows how to deal with both.
+      const LogEntry * e = stasis_log_file_pool_read_entry(log, scan->next);
+      if(e) {
+        scan->copy = e;
+        scan->next = stasis_log_file_pool_next_entry(log, e);
+        scan->buf_start = scan->buf_end = scan->next;
+      }
+      return e;
+    }
+  }
+}
+/**
+ * No latching.  No shared state.
+ */
+void stasis_log_file_pool_scan_close(stasis_log_t * log, void * scanp) {
+  stasis_log_file_pool_scan_t * scan = scanp;
+  if(scan->copy) { stasis_log_file_pool_read_entry_done(log, scan->copy); }
+  free(scan->buf);
+  free(scan);
+}
 /**
  * Does no latching.  Relies on ringbuffer for synchronization.
  */
@@ -647,6 +825,27 @@ int stasis_log_file_pool_close(stasis_log_t * log) {
   return 0;
 }
 
+/**
+ * Fill in the checksums of the entries that start in the span of the
+ * ringbuffer that begins at off.  An entry that starts in the span may
+ * end after it, but its writer is done, since the span ends at or
+ * before the ringbuffer's write tail.  Only the writeback thread may
+ * call this.
+ */
+static void stasis_log_file_pool_checksum_span(stasis_log_file_pool_state * fp, byte * buf, lsn_t off, lsn_t len) {
+  while(fp->crc_next < off + len) {
+    byte * p = buf + (fp->crc_next - off);
+    uint32_t len_field;
+    memcpy(&len_field, p, sizeof(len_field));
+    uint32_t sz = len_field & ~STASIS_LOG_FILE_POOL_CRC32C;
+    if(len_field & STASIS_LOG_FILE_POOL_CRC32C) {
+      uint32_t crc = stasis_crc32c(p + 2 * sizeof(uint32_t), sz, (uint32_t)-1);
+      memcpy(p + sizeof(uint32_t), &crc, sizeof(crc));
+    }
+    fp->crc_next += sz + 2 * sizeof(uint32_t);
+  }
+}
+
 void * stasis_log_file_pool_writeback_worker(void * arg) {
   stasis_log_t * log = arg;
   stasis_log_file_pool_state * fp = log->impl;
@@ -659,6 +858,9 @@ void * stasis_log_file_pool_writeback_worker(void * arg) {
     const byte * buf = stasis_ringbuffer_get_rd_buf(fp->ring, off, len);
 
     if(off == RING_CLOSED) break;
+    if(fp->background_crc) {
+      stasis_log_file_pool_checksum_span(fp, (byte*)buf, off, len);
+    }
     pthread_mutex_lock(&fp->mut);
     int chunk = get_chunk_from_offset(log, off);
     int endchunk = get_chunk_from_offset(log, off + len);
@@ -751,6 +953,9 @@ stasis_log_t* stasis_log_file_pool_open(const char* dirname, int filemode, int f
     stasis_log_file_pool_truncation_point,
     stasis_log_file_pool_close,
     0,//stasis_log_file_pool_is_durable,
+    stasis_log_file_pool_scan_open,
+    stasis_log_file_pool_scan_next,
+    stasis_log_file_pool_scan_close,
   };
   memcpy(ret, &proto, sizeof(proto));
   ret->impl = fp;
@@ -874,6 +1079,8 @@ stasis_log_t* stasis_log_file_pool_open(const char* dirname, int filemode, int f
   // The previous segment must have been forced to disk before we created the current one, so we're good to go.
 
   fp->ring = stasis_ringbuffer_init(26, next_lsn); // 64mb buffer
+  fp->background_crc = stasis_log_file_pool_background_crc;
+  fp->crc_next = next_lsn;
   pthread_key_create(&fp->handle_key, key_destr);
 
   fp->dead_threshold = 1;
@@ -6,9 +6,14 @@
  */
 #include <stasis/logger/logger2.h>
 #include <stasis/transactional.h>
+#include <stasis/flags.h>
+#include <stasis/util/log2.h>
 #include <stdio.h>
 #include <assert.h>
-#include <sys/time.h>
+#include <time.h>
+
+/** Weight given to each new sample by the moving averages below. */
+#define GROUP_FORCE_EWMA_WEIGHT 0.125
 
 struct stasis_log_group_force_t {
     stasis_log_t * log;
@@ -17,22 +22,51 @@ struct stasis_log_group_force_t {
     int pendingCommits;
     int minNumActive;
     uint64_t wait_nsec;
+    /** Moving average of force_tail() latency. */
+    double force_nsec;
+    /** Moving average of the time between calls to stasis_log_group_force(). */
+    double arrival_nsec;
+    uint64_t last_arrival;
+    uint64_t start;
+    // Statistics
+    uint64_t commits;
+    uint64_t forces;
+    uint64_t waits;
+    uint64_t total_wait_nsec;
+    uint64_t batch_size[STASIS_LOG_GROUP_FORCE_BATCH_BUCKETS];
 };
 
+static uint64_t group_force_now(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ((uint64_t)ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static void group_force_ewma(double * avg, uint64_t sample) {
+  *avg = (1.0 - GROUP_FORCE_EWMA_WEIGHT) * (*avg) + GROUP_FORCE_EWMA_WEIGHT * (double)sample;
+}
+
 stasis_log_group_force_t * stasis_log_group_force_init(stasis_log_t * log, uint64_t wait_nsec) {
-  static int warned = 0;
-  if(wait_nsec > (1000 * 1000 * 1000)) {
-    warned  = 1;
-    fprintf(stderr, "TODO stasis_log_group_force: Efficiently support wait "
-                    "times > 1 second.  (%llu second wait time requested)\n",
-                    (long long unsigned int) (wait_nsec / (1000 * 1000 * 1000)));
-  }
   stasis_log_group_force_t * ret = malloc(sizeof(*ret));
   ret->log = log;
   pthread_mutex_init(&ret->check_commit,0);
   pthread_cond_init(&ret->tooFewXacts,0);
   ret->pendingCommits = 0;
+  ret->minNumActive = 0;
   ret->wait_nsec = wait_nsec;
+  // Until we have measurements, assume forces are free and commits are
+  // rare, so that the first few commits do not wait.
+  ret->force_nsec = 0;
+  ret->arrival_nsec = wait_nsec;
+  ret->start = group_force_now(CLOCK_MONOTONIC);
+  ret->last_arrival = ret->start;
+  ret->commits = 0;
+  ret->forces = 0;
+  ret->waits = 0;
+  ret->total_wait_nsec = 0;
+  for(int i = 0; i < STASIS_LOG_GROUP_FORCE_BATCH_BUCKETS; i++) {
+    ret->batch_size[i] = 0;
+  }
   return ret;
 }
 
@@ -44,13 +78,46 @@ static int stasis_log_group_force_should_wait(int xactcount, int pendingCommits)
     return 0;
   }
 }
+/**
+   Decide how long the caller should wait for other transactions to
+   join its force.  Returns zero if it should force immediately.
 
-void stasis_log_group_force(stasis_log_group_force_t* lh, lsn_t lsn) {
-//  static pthread_mutex_t check_commit = PTHREAD_MUTEX_INITIALIZER;
-//  static pthread_cond_t tooFewXacts = PTHREAD_COND_INITIALIZER;
-//  static int pendingCommits;
+   The adaptive policy waits for the remaining active transactions to
+   arrive, but never longer than a force takes: a transaction that
+   commits after that may as well join the next force.  If fewer than
+   one more commit is expected in that window, waiting only adds latency.
+ */
+static uint64_t stasis_log_group_force_window(stasis_log_group_force_t * lh, int xactcount) {
+  if(!stasis_log_group_commit_adaptive) {
+    return stasis_log_group_force_should_wait(xactcount, lh->pendingCommits) ? lh->wait_nsec : 0;
+  }
+  if(xactcount <= 1 || lh->pendingCommits >= xactcount) {
+    return 0;
+  }
+  double window = lh->arrival_nsec * (double)(xactcount - lh->pendingCommits);
+  if(window > lh->force_nsec) {
+    window = lh->force_nsec;
+  }
+  if(lh->arrival_nsec >= window) {
+    return 0;
+  }
+  if(window > (double)lh->wait_nsec) {
+    window = lh->wait_nsec;
+  }
+  return (uint64_t)window;
+}
 
+void stasis_log_group_force(stasis_log_group_force_t* lh, lsn_t lsn) {
   pthread_mutex_lock(&lh->check_commit);
+
+  uint64_t now = group_force_now(CLOCK_MONOTONIC);
+  uint64_t interarrival = now - lh->last_arrival;
+  // Don't let an idle period make commits look rare for a long time.
+  if(interarrival > lh->wait_nsec) { interarrival = lh->wait_nsec; }
+  group_force_ewma(&lh->arrival_nsec, interarrival);
+  lh->last_arrival = now;
+  lh->commits++;
+
   lsn_t first_unstable = lh->log->first_unstable_lsn(lh->log,LOG_FORCE_COMMIT);
   lsn_t next_available = lh->log->next_available_lsn(lh->log);
   DEBUG(stderr, "state: lsn=%lld first_unstable=%lld next_available=%lld\n",
@@ -65,23 +132,16 @@ void stasis_log_group_force(stasis_log_group_force_t* lh, lsn_t lsn) {
   }
 
   if(lh->log->is_durable(lh->log)) {
-    struct timeval now;
-    struct timespec timeout;
-
-    gettimeofday(&now, NULL);
-    timeout.tv_sec = now.tv_sec;
-    timeout.tv_nsec = now.tv_usec * 1000;
-    //                   0123456789  <- number of zeros on the next three lines...
-//    timeout.tv_nsec +=   10000000; // wait ten msec.
-    timeout.tv_nsec += lh->wait_nsec;
-    while(timeout.tv_nsec > (1000 * 1000 * 1000)) {
-      timeout.tv_nsec -= (1000 * 1000 * 1000);
-      timeout.tv_sec++;
-    }
-
     lh->pendingCommits++;
     int xactcount = TactiveThreadCount();
-    if(stasis_log_group_force_should_wait(xactcount, lh->pendingCommits)) {
+    uint64_t window = stasis_log_group_force_window(lh, xactcount);
+    if(window) {
+      struct timespec timeout;
+      uint64_t deadline = group_force_now(CLOCK_REALTIME) + window;
+      timeout.tv_sec = deadline / 1000000000;
+      timeout.tv_nsec = deadline % 1000000000;
+
+      lh->waits++;
       int retcode;
       while(ETIMEDOUT != (retcode = pthread_cond_timedwait(&lh->tooFewXacts, &lh->check_commit, &timeout))) {
         if(retcode != 0) {
@@ -92,16 +152,24 @@ void stasis_log_group_force(stasis_log_group_force_t* lh, lsn_t lsn) {
         }
         if(lh->log->first_unstable_lsn(lh->log,LOG_FORCE_COMMIT) > lsn) {
           (lh->pendingCommits)--;
+          lh->total_wait_nsec += group_force_now(CLOCK_MONOTONIC) - now;
           pthread_mutex_unlock(&lh->check_commit);
           return;
         }
       }
+      lh->total_wait_nsec += group_force_now(CLOCK_MONOTONIC) - now;
     }
   } else {
     (lh->pendingCommits)++;
   }
   if(lh->log->first_unstable_lsn(lh->log,LOG_FORCE_COMMIT) <= lsn) {
+    uint64_t force_start = group_force_now(CLOCK_MONOTONIC);
     lh->log->force_tail(lh->log, LOG_FORCE_COMMIT);
+    group_force_ewma(&lh->force_nsec, group_force_now(CLOCK_MONOTONIC) - force_start);
+    lh->forces++;
+    int bucket = stasis_log_2_64(lh->pendingCommits);
+    if(bucket >= STASIS_LOG_GROUP_FORCE_BATCH_BUCKETS) { bucket = STASIS_LOG_GROUP_FORCE_BATCH_BUCKETS - 1; }
+    lh->batch_size[bucket]++;
     lh->minNumActive = 0;
     pthread_cond_broadcast(&lh->tooFewXacts);
   }
@@ -111,9 +179,44 @@ void stasis_log_group_force(stasis_log_group_force_t* lh, lsn_t lsn) {
   return;
 }
 
+void stasis_log_group_force_stats(stasis_log_group_force_t * lh, stasis_log_group_force_stats_t * stats) {
+  pthread_mutex_lock(&lh->check_commit);
+  double elapsed = (double)(group_force_now(CLOCK_MONOTONIC) - lh->start) / 1000000000.0;
+  stats->commits = lh->commits;
+  stats->forces = lh->forces;
+  stats->waits = lh->waits;
+  stats->total_wait_sec = (double)lh->total_wait_nsec / 1000000000.0;
+  stats->forces_per_sec = elapsed > 0 ? (double)lh->forces / elapsed : 0;
+  stats->force_latency_sec = lh->force_nsec / 1000000000.0;
+  stats->commit_interarrival_sec = lh->arrival_nsec / 1000000000.0;
+  for(int i = 0; i < STASIS_LOG_GROUP_FORCE_BATCH_BUCKETS; i++) {
+    stats->batch_size[i] = lh->batch_size[i];
+  }
+  pthread_mutex_unlock(&lh->check_commit);
+}
+
+void stasis_log_group_force_print_stats(stasis_log_group_force_t * lh) {
+  stasis_log_group_force_stats_t stats;
+  stasis_log_group_force_stats(lh, &stats);
+  printf("group commit: %llu commits %llu forces (%.1f forces/sec)\n",
+         (unsigned long long)stats.commits, (unsigned long long)stats.forces,
+         stats.forces_per_sec);
+  printf("group commit: %llu waits, %.6f sec waiting (%.6f sec/wait)\n",
+         (unsigned long long)stats.waits, stats.total_wait_sec,
+         stats.waits ? stats.total_wait_sec / (double)stats.waits : 0.0);
+  printf("group commit: force latency %.6f sec, commit interarrival %.6f sec\n",
+         stats.force_latency_sec, stats.commit_interarrival_sec);
+  printf("group commit: batch size histogram\n");
+  for(int i = 0; i < STASIS_LOG_GROUP_FORCE_BATCH_BUCKETS; i++) {
+    if(stats.batch_size[i]) {
+      printf("  %6llu-%-6llu %llu\n", 1ull << i, (2ull << i) - 1,
+             (unsigned long long)stats.batch_size[i]);
+    }
+  }
+}
+
 void stasis_log_group_force_deinit(stasis_log_group_force_t * lh) {
   pthread_mutex_destroy(&lh->check_commit);
   pthread_cond_destroy(&lh->tooFewXacts);
   free(lh);
 }
-
@@ -70,6 +70,43 @@ LogEntry * allocPrepareLogEntry(stasis_log_t* log, lsn_t prevLSN, int xid, lsn_t
   return ret;
 }
 
+/** The fixed size part of an XCHECKPOINT entry; the dirty pages follow it. */
+typedef struct {
+  lsn_t beginLSN;
+  pageid_t page_count;
+} stasis_checkpoint_header_t;
+
+static inline const stasis_checkpoint_header_t * checkpoint_header(const LogEntry * e) {
+  assert(e->type == XCHECKPOINT);
+  return (const stasis_checkpoint_header_t*)(((const struct __raw_log_entry*)e)+1);
+}
+
+LogEntry * allocCheckpointLogEntry(stasis_log_t* log, lsn_t beginLSN, pageid_t page_count) {
+  LogEntry * ret = log->reserve_entry(log, sizeof(struct __raw_log_entry)
+                                      + sizeof(stasis_checkpoint_header_t)
+                                      + page_count * sizeof(stasis_checkpoint_page_t));
+  ret->prevLSN = INVALID_LSN;
+  ret->xid = INVALID_XID;
+  ret->type = XCHECKPOINT;
+  stasis_checkpoint_header_t * h = (stasis_checkpoint_header_t*)checkpoint_header(ret);
+  h->beginLSN = beginLSN;
+  h->page_count = page_count;
+  return ret;
+}
+
+lsn_t getCheckpointBeginLSN(const LogEntry *e) {
+  return checkpoint_header(e)->beginLSN;
+}
+pageid_t getCheckpointPageCount(const LogEntry *e) {
+  return checkpoint_header(e)->page_count;
+}
+const stasis_checkpoint_page_t * stasis_log_entry_checkpoint_pages_cptr(const LogEntry * e) {
+  return (const stasis_checkpoint_page_t*)(checkpoint_header(e)+1);
+}
+stasis_checkpoint_page_t * stasis_log_entry_checkpoint_pages_ptr(LogEntry * e) {
+  return (stasis_checkpoint_page_t*)stasis_log_entry_checkpoint_pages_cptr(e);
+}
+
 const void * stasis_log_entry_update_args_cptr(const LogEntry * ret) {
   assert(ret->type == UPDATELOG ||
 	 ret->type == CLRLOG);
@@ -158,7 +195,159 @@ lsn_t sizeofLogEntry(stasis_log_t * log, const LogEntry * e) {
     return log->sizeof_internal_entry(log,e);
   case XPREPARE:
     return sizeof(struct __raw_log_entry)+sizeof(lsn_t);
+  case XCHECKPOINT:
+    return sizeof(struct __raw_log_entry) + sizeof(stasis_checkpoint_header_t)
+      + getCheckpointPageCount(e) * sizeof(stasis_checkpoint_page_t);
   default:
     return sizeof(struct __raw_log_entry);
   }
 }
+
+/*
+ * Compact encoding.  Each header is:
+ *
+ *   varint  type << 1 | (prevLSN == INVALID_LSN)
+ *   varint  zigzag(LSN - prevLSN)     (omitted if prevLSN is INVALID_LSN)
+ *   varint  zigzag(xid)
+ *
+ * followed, for UPDATELOG entries, by the funcID byte, zigzag(page) and
+ * arg_size.  CLRs store their header, then zigzag(LSN - compensated LSN),
+ * then the compensated entry's header.  The rest of the entry is copied
+ * unchanged.
+ */
+static inline byte * put_varint(byte * p, uint64_t v) {
+  while(v >= 0x80) {
+    *p++ = (byte)(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (byte)v;
+  return p;
+}
+static inline const byte * get_varint(const byte * p, const byte * end, uint64_t * v) {
+  uint64_t ret = 0;
+  for(int shift = 0; p < end && shift < 64; shift += 7) {
+    byte b = *p++;
+    ret |= (uint64_t)(b & 0x7f) << shift;
+    if(!(b & 0x80)) {
+      *v = ret;
+      return p;
+    }
+  }
+  return NULL;
+}
+static inline uint64_t zigzag(int64_t v) {
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+static inline int64_t unzigzag(uint64_t v) {
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+static inline int64_t lsn_delta(lsn_t a, lsn_t b) {
+  return (int64_t)((uint64_t)a - (uint64_t)b);
+}
+static inline lsn_t raw_header_size(unsigned int type) {
+  return sizeof(struct __raw_log_entry)
+    + (type == UPDATELOG ? sizeof(UpdateLogEntry) : 0);
+}
+/** Longest possible output of compact_headers(). */
+#define COMPACT_HEADERS_MAX 96
+
+static byte * compact_header(const LogEntry * e, byte * p) {
+  int no_prev = (e->prevLSN == INVALID_LSN);
+  p = put_varint(p, ((uint64_t)e->type << 1) | no_prev);
+  if(!no_prev) { p = put_varint(p, zigzag(lsn_delta(e->LSN, e->prevLSN))); }
+  p = put_varint(p, zigzag(e->xid));
+  if(e->type == UPDATELOG) {
+    *p++ = e->update.funcID;
+    p = put_varint(p, zigzag(e->update.page));
+    p = put_varint(p, e->update.arg_size);
+  }
+  return p;
+}
+/**
+   Encode the header(s) of e into p.
+
+   @param body Set to the entry whose payload follows the headers.
+   @return the end of the encoded headers.
+ */
+static byte * compact_headers(const LogEntry * e, byte * p, const LogEntry ** body) {
+  p = compact_header(e, p);
+  *body = e;
+  if(e->type == CLRLOG) {
+    const LogEntry * compensated = getCLRCompensated((const CLRLogEntry*)e);
+    assert(compensated->type != CLRLOG);
+    p = put_varint(p, zigzag(lsn_delta(e->LSN, compensated->LSN)));
+    p = compact_header(compensated, p);
+    *body = compensated;
+  }
+  return p;
+}
+static const byte * uncompact_header(const byte * p, const byte * end, lsn_t lsn, LogEntry * e) {
+  uint64_t v;
+  memset(e, 0, sizeof(*e));
+  if(!(p = get_varint(p, end, &v))) { return NULL; }
+  e->LSN = lsn;
+  e->type = v >> 1;
+  if(v & 1) {
+    e->prevLSN = INVALID_LSN;
+  } else {
+    if(!(p = get_varint(p, end, &v))) { return NULL; }
+    e->prevLSN = (lsn_t)((uint64_t)lsn - (uint64_t)unzigzag(v));
+  }
+  if(!(p = get_varint(p, end, &v))) { return NULL; }
+  e->xid = unzigzag(v);
+  if(e->type == UPDATELOG) {
+    if(p == end) { return NULL; }
+    e->update.funcID = *p++;
+    if(!(p = get_varint(p, end, &v))) { return NULL; }
+    e->update.page = unzigzag(v);
+    if(!(p = get_varint(p, end, &v))) { return NULL; }
+    e->update.arg_size = v;
+  }
+  return p;
+}
+
+lsn_t stasis_log_entry_compact(stasis_log_t * log, const LogEntry * e, byte * buf) {
+  const LogEntry * body;
+  byte * p = compact_headers(e, buf, &body);
+  lsn_t header_size = raw_header_size(body->type);
+  lsn_t payload_size = sizeofLogEntry(log, body) - header_size;
+  memcpy(p, ((const byte*)body) + header_size, payload_size);
+  return (p - buf) + payload_size;
+}
+lsn_t stasis_log_entry_compact_size(stasis_log_t * log, const LogEntry * e) {
+  byte buf[COMPACT_HEADERS_MAX];
+  const LogEntry * body;
+  byte * p = compact_headers(e, buf, &body);
+  return (p - buf) + sizeofLogEntry(log, body) - raw_header_size(body->type);
+}
+LogEntry * stasis_log_entry_uncompact(lsn_t lsn, const byte * buf, lsn_t len) {
+  const byte * end = buf + len;
+  LogEntry h, compensated;
+  const LogEntry * body = &h;
+  const byte * p = uncompact_header(buf, end, lsn, &h);
+  if(!p) { return NULL; }
+  lsn_t size = raw_header_size(h.type);
+  if(h.type == CLRLOG) {
+    uint64_t v;
+    if(!(p = get_varint(p, end, &v))) { return NULL; }
+    lsn_t compensated_lsn = (lsn_t)((uint64_t)lsn - (uint64_t)unzigzag(v));
+    if(!(p = uncompact_header(p, end, compensated_lsn, &compensated))) { return NULL; }
+    if(compensated.type == CLRLOG) { return NULL; }
+    size += raw_header_size(compensated.type);
+    body = &compensated;
+  }
+  lsn_t payload_size = end - p;
+  if(body->type == UPDATELOG && body->update.arg_size != payload_size) {
+    return NULL;
+  }
+  LogEntry * ret = malloc(size + payload_size);
+  byte * q = (byte*)ret;
+  memcpy(q, &h, raw_header_size(h.type));
+  q += raw_header_size(h.type);
+  if(body != &h) {
+    memcpy(q, &compensated, raw_header_size(compensated.type));
+    q += raw_header_size(compensated.type);
+  }
+  memcpy(q, p, payload_size);
+  return ret;
+}
@@ -40,6 +40,7 @@ permission to use and distribute the software in accordance with the
 terms specified in this license.
 ---*/
 #include <stasis/logger/logHandle.h>
+#include <stasis/flags.h>
 
 struct LogHandle {
   /** The LSN of the log entry that we would return if next is called. */
@@ -50,6 +51,10 @@ struct LogHandle {
   const LogEntry * last;
   /** The log this iterator traverses. */
   stasis_log_t* log;
+  /** The log's sequential scan, if nextInLog() is using one. */
+  void * scan;
+  /** Non-zero if last belongs to scan, and must not be passed to read_entry_done(). */
+  int last_is_scanned;
 };
 
 /**
@@ -73,16 +78,36 @@ LogHandle* getLSNHandle(stasis_log_t * log, lsn_t lsn) {
   ret->prev_offset = lsn;
   ret->last = 0;
   ret->log = log;
+  ret->scan = 0;
+  ret->last_is_scanned = 0;
   return ret;
 }
 
+/** Release the last entry returned by h, and (optionally) h's scan. */
+static void release_last(LogHandle * h, int close_scan) {
+  if(h->last && !h->last_is_scanned) { h->log->read_entry_done(h->log, h->last); }
+  h->last = 0;
+  if(close_scan && h->scan) {
+    h->log->scan_close(h->log, h->scan);
+    h->scan = 0;
+  }
+}
+
 void freeLogHandle(LogHandle* lh) {
-  if(lh->last) { lh->log->read_entry_done(lh->log, lh->last); }
+  release_last(lh, 1);
   free(lh);
 }
 const LogEntry * nextInLog(LogHandle * h) {
-  if(h->last) { h->log->read_entry_done(h->log, h->last); }
-  const LogEntry * ret = h->log->read_entry(h->log,h->next_offset);
+  release_last(h, 0);
+  const LogEntry * ret;
+  if(h->log->scan_open && stasis_log_scan_buffer_size) {
+    if(!h->scan) { h->scan = h->log->scan_open(h->log, h->next_offset); }
+    ret = h->log->scan_next(h->log, h->scan);
+    h->last_is_scanned = 1;
+  } else {
+    ret = h->log->read_entry(h->log,h->next_offset);
+    h->last_is_scanned = 0;
+  }
   if(ret != NULL) {
     set_offsets(h, ret);
   }
@@ -92,7 +117,9 @@ const LogEntry * nextInLog(LogHandle * h) {
 
 const LogEntry * previousInTransaction(LogHandle * h) {
   const LogEntry * ret = NULL;
-  if(h->last) { h->log->read_entry_done(h->log, h->last); }
+  // The scan (if any) is positioned after last; nextInLog() will open a new one.
+  release_last(h, 1);
+  h->last_is_scanned = 0;
   if(h->prev_offset > 0) {
     ret = h->log->read_entry(h->log, h->prev_offset);
     set_offsets(h, ret);
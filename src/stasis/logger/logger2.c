@@ -59,7 +59,7 @@ static lsn_t stasis_log_write_common(stasis_log_t* log, stasis_transaction_table
   log->write_entry(log, e);
 
 //  pthread_mutex_lock(&l->mut);
-  if(l->prevLSN == INVALID_LSN) { l->recLSN = e->LSN; }
+  if(l->prevLSN == INVALID_LSN) { stasis_transaction_table_set_recLSN(l, e->LSN); }
   l->prevLSN = e->LSN;
 //  pthread_mutex_unlock(&l->mut);
 
@@ -82,7 +82,7 @@ static lsn_t stasis_log_write_prepare(stasis_log_t* log, stasis_transaction_tabl
   log->write_entry(log, e);
 
 //  pthread_mutex_lock(&l->mut);
-  if(l->prevLSN == INVALID_LSN) { l->recLSN = e->LSN; }
+  if(l->prevLSN == INVALID_LSN) { stasis_transaction_table_set_recLSN(l, e->LSN); }
   l->prevLSN = e->LSN;
 //  pthread_mutex_unlock(&l->mut);
   DEBUG("Log Common prepare XXX %d, LSN: %ld type: %ld (prevLSN %ld)\n",
@@ -110,7 +110,7 @@ LogEntry * stasis_log_write_update(stasis_log_t* log, stasis_transaction_table_e
   DEBUG("Log Update %d, LSN: %ld type: %ld (prevLSN %ld) (arg_size %ld)\n", e->xid,
 	 (long int)e->LSN, (long int)e->type, (long int)e->prevLSN, (long int) arg_size);
 //  pthread_mutex_lock(&l->mut);
-  if(l->prevLSN == INVALID_LSN) { l->recLSN = e->LSN; }
+  if(l->prevLSN == INVALID_LSN) { stasis_transaction_table_set_recLSN(l, e->LSN); }
   l->prevLSN = e->LSN;
 //  pthread_mutex_unlock(&l->mut);
   return e;
@@ -129,7 +129,7 @@ lsn_t stasis_log_end_nta(stasis_log_t* log, stasis_transaction_table_entry_t * l
 
   log->write_entry(log, realEntry);
 //  pthread_mutex_lock(&l->mut);
-  if(l->prevLSN == INVALID_LSN) { l->recLSN = realEntry->LSN; }
+  if(l->prevLSN == INVALID_LSN) { stasis_transaction_table_set_recLSN(l, realEntry->LSN); }
   lsn_t ret = l->prevLSN = realEntry->LSN;
 //  pthread_mutex_unlock(&l->mut);
   log->write_entry_done(log, realEntry);
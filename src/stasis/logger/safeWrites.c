@@ -67,6 +67,16 @@ terms specified in this license.
  * @ingroup LOGGING_IMPLEMENTATIONS
  */
 
+/**
+   Set in the log file's header (which otherwise holds the global offset)
+   if the log stores entries in the compact encoding.
+*/
+#define STASIS_LOG_SAFE_WRITES_COMPACT_LOG   ((lsn_t)1 << 62)
+/**
+   Set in an entry's length field if the entry is in the compact encoding.
+*/
+#define STASIS_LOG_SAFE_WRITES_COMPACT_ENTRY ((lsn_t)1 << 62)
+
 /**
    Latch order:  truncate_mutex, write_mutex, read_mutex
 */
@@ -148,7 +158,16 @@ typedef struct {
       reset to zero each time a CRC entry is generated..
   */
   unsigned int crc;
-
+  /**
+     If true, entries other than INTERNALLOG entries are stored in the
+     compact encoding.  This is fixed when the log file is created.
+  */
+  char compact;
+  /**
+     Scratch space for compact encodings.  Protected by write_mutex.
+  */
+  byte * compact_buf;
+  lsn_t compact_buf_size;
 
 } stasis_log_safe_writes_state;
 
@@ -189,6 +208,12 @@ static LogEntry * readLogEntry(stasis_log_safe_writes_state * sw) {
   if(!size) {
     return NULL;
   }
+  int compact = (size & STASIS_LOG_SAFE_WRITES_COMPACT_ENTRY) != 0;
+  size &= ~STASIS_LOG_SAFE_WRITES_COMPACT_ENTRY;
+  lsn_t lsn = 0;
+  if(compact) {
+    lsn = lseek(sw->ro_fd, 0, SEEK_CUR) - sizeof(lsn_t) + sw->global_offset;
+  }
   ret = malloc(size);
 
   bytesRead = read(sw->ro_fd, ret, size);
@@ -230,6 +255,12 @@ static LogEntry * readLogEntry(stasis_log_safe_writes_state * sw) {
   // Would like to do this, but we could reading a partial log entry.
   //assert(sizeofLogEntry(ret) == size);
 
+  if(compact) {
+    LogEntry * e = stasis_log_entry_uncompact(lsn, (const byte*)ret, size);
+    free(ret);
+    ret = e; // NULL if the entry is garbage.
+  }
+
   return ret;
 }
 
@@ -238,9 +269,50 @@ static inline int isDurable_LogWriter(stasis_log_t* log) {
   return !sw->softcommit;
 }
 
+/**
+   @return the number of bytes that e takes up in the log file, not
+           counting its length field.
+*/
+static inline lsn_t sizeofStoredEntry_LogWriter(stasis_log_t* log,
+                                                const LogEntry* e) {
+  stasis_log_safe_writes_state* sw = log->impl;
+  if(sw->compact && e->type != INTERNALLOG) {
+    return stasis_log_entry_compact_size(log, e);
+  } else {
+    return sizeofLogEntry(log, e);
+  }
+}
+
 static inline lsn_t nextEntry_LogWriter(stasis_log_t* log,
                                         const LogEntry* e) {
-  return e->LSN + sizeofLogEntry(log, e) + sizeof(lsn_t);
+  return e->LSN + sizeofStoredEntry_LogWriter(log, e) + sizeof(lsn_t);
+}
+
+/**
+   Prepare e to be written to the log file.  INTERNALLOG entries are
+   never compacted, since truncation rewrites the CRC in the first one
+   it copies, and that must not change the entry's length.
+
+   Caller must hold write_mutex.
+
+   @param bytes Set to the bytes that follow the length field.
+   @return the length field.
+*/
+static lsn_t frameLogEntry_LogWriter(stasis_log_t* log, const LogEntry* e,
+                                     const void ** bytes) {
+  stasis_log_safe_writes_state* sw = log->impl;
+  lsn_t size = sizeofLogEntry(log, e);
+  if(!sw->compact || e->type == INTERNALLOG) {
+    *bytes = e;
+    return size;
+  }
+  if(size + STASIS_LOG_ENTRY_COMPACT_SLACK > sw->compact_buf_size) {
+    sw->compact_buf_size = size + STASIS_LOG_ENTRY_COMPACT_SLACK;
+    sw->compact_buf = realloc(sw->compact_buf, sw->compact_buf_size);
+  }
+  *bytes = sw->compact_buf;
+  return stasis_log_entry_compact(log, e, sw->compact_buf)
+    | STASIS_LOG_SAFE_WRITES_COMPACT_ENTRY;
 }
 
 static inline void log_crc_update(stasis_log_t* log, const LogEntry * e, uint32_t * crc) {
@@ -324,8 +396,6 @@ static int writeLogEntryUnlocked(stasis_log_t* log, LogEntry * e, int clearcrc)
 
   stasis_log_safe_writes_state* sw = log->impl;
 
-  const lsn_t size = sizeofLogEntry(log, e);
-
   assert(clearcrc == (e->type == INTERNALLOG));
 
   if(clearcrc) {
@@ -337,10 +407,14 @@ static int writeLogEntryUnlocked(stasis_log_t* log, LogEntry * e, int clearcrc)
     log_crc_update(log, e, &sw->crc);
   }
 
+  const void * bytes;
+  const lsn_t framed_size = frameLogEntry_LogWriter(log, e, &bytes);
+  const lsn_t size = framed_size & ~STASIS_LOG_SAFE_WRITES_COMPACT_ENTRY;
+
   DEBUG("Writing Log entry type = %d lsn = %ld, size = %ld\n",
         e->type, e->LSN, size);
 
-  size_t nmemb = fwrite(&size, sizeof(lsn_t), 1, sw->fp);
+  size_t nmemb = fwrite(&framed_size, sizeof(lsn_t), 1, sw->fp);
 
   if(nmemb != 1) {
     if(feof(sw->fp))   { abort();  /* feof makes no sense here */  }
@@ -356,7 +430,7 @@ static int writeLogEntryUnlocked(stasis_log_t* log, LogEntry * e, int clearcrc)
     return LLADD_IO_ERROR;
   }
 
-  nmemb = fwrite(e, size, 1, sw->fp);
+  nmemb = fwrite(bytes, size, 1, sw->fp);
 
   if(nmemb != 1) {
     if(feof(sw->fp)) { abort();  /* feof makes no sense here */ }
@@ -376,7 +450,7 @@ static int writeLogEntryUnlocked(stasis_log_t* log, LogEntry * e, int clearcrc)
   // next available LSN.  If we set this in reserve_entry (where it should be set), then this would
   // lead to reads off the end of the log during testing.
   pthread_mutex_lock(&sw->nextAvailableLSN_mutex);
-  sw->nextAvailableLSN = e->LSN + (sizeofLogEntry(log, e) + sizeof(lsn_t));
+  sw->nextAvailableLSN = e->LSN + (size + sizeof(lsn_t));
   pthread_mutex_unlock(&sw->nextAvailableLSN_mutex);
 
   return 0;
@@ -527,6 +601,7 @@ static int close_LogWriter(stasis_log_t* log) {
   pthread_mutex_destroy(&sw->nextAvailableLSN_mutex);
   pthread_mutex_destroy(&sw->truncate_mutex);
   free(sw->buffer);
+  free(sw->compact_buf);
 
   free((void*)sw->filename);
   free((void*)sw->scratch_filename);
@@ -587,6 +662,118 @@ static const LogEntry * readLSNEntry_LogWriter(stasis_log_t * log, const lsn_t L
 void readEntryDone_LogWriter(stasis_log_t *log, const LogEntry *e) {
   free((void*)e);
 }
+
+/**
+   A sequential scan over the log.  buf holds the bytes of the log
+   from buf_start to buf_end, and entries are returned in place.
+*/
+typedef struct {
+  lsn_t next;
+  byte * buf;
+  lsn_t buf_size;
+  lsn_t buf_start;
+  lsn_t buf_end;
+  /** The last entry returned, if it had to be decoded. */
+  LogEntry * copy;
+} stasis_log_safe_writes_scan_t;
+
+static void * scanOpen_LogWriter(stasis_log_t * log, lsn_t lsn) {
+  stasis_log_safe_writes_scan_t * scan = malloc(sizeof(*scan));
+  scan->next = lsn;
+  scan->buf_size = stasis_log_scan_buffer_size;
+  scan->buf = malloc(scan->buf_size);
+  scan->buf_start = lsn;
+  scan->buf_end = lsn;
+  scan->copy = NULL;
+  return scan;
+}
+/**
+   Refill the scan's buffer, starting at scan->next.  Holds read_mutex
+   for the duration of the read, as readLSNEntry_LogWriter() does, so
+   that truncation cannot swap the file out from under us.
+
+   @return the number of bytes now in the buffer.
+*/
+static lsn_t scanFill_LogWriter(stasis_log_t * log, stasis_log_safe_writes_scan_t * scan) {
+  stasis_log_safe_writes_state* sw = log->impl;
+  lsn_t lsn = scan->next;
+  lsn_t end = lsn + scan->buf_size;
+
+  pthread_mutex_lock(&sw->nextAvailableLSN_mutex);
+  if(end > sw->nextAvailableLSN) { end = sw->nextAvailableLSN; }
+  pthread_mutex_unlock(&sw->nextAvailableLSN_mutex);
+  if(end <= lsn) { return 0; }
+
+  pthread_mutex_lock(&sw->read_mutex);
+  if(flushedLSNInternal(sw) < end) {
+    syncLogInternal(sw);
+  }
+  if(sw->global_offset > lsn) {
+    pthread_mutex_unlock(&sw->read_mutex);
+    return 0;
+  }
+  lsn_t got = 0;
+  while(lsn + got < end) {
+    ssize_t ret = pread(sw->ro_fd, scan->buf + got, end - (lsn + got), lsn + got - sw->global_offset);
+    if(ret == -1) {
+      perror("error reading log");
+      abort();
+    }
+    if(ret == 0) { break; }
+    got += ret;
+  }
+  if(got == end - lsn) {
+    // Ask the kernel to start reading the next block while the caller
+    // works through this one.
+    posix_fadvise(sw->ro_fd, end - sw->global_offset, scan->buf_size, POSIX_FADV_WILLNEED);
+  }
+  pthread_mutex_unlock(&sw->read_mutex);
+
+  scan->buf_start = lsn;
+  scan->buf_end = lsn + got;
+  return got;
+}
+static const LogEntry * scanNext_LogWriter(stasis_log_t * log, void * scanp) {
+  stasis_log_safe_writes_scan_t * scan = scanp;
+  while(1) {
+    lsn_t avail = scan->buf_end - scan->next;
+    const byte * buf = scan->buf + (scan->next - scan->buf_start);
+    if(avail >= (lsn_t)sizeof(lsn_t)) {
+      lsn_t size;
+      memcpy(&size, buf, sizeof(size));
+      if(!size) { return NULL; }
+      int compact = (size & STASIS_LOG_SAFE_WRITES_COMPACT_ENTRY) != 0;
+      size &= ~STASIS_LOG_SAFE_WRITES_COMPACT_ENTRY;
+      if(avail >= size + (lsn_t)sizeof(lsn_t)) {
+        lsn_t lsn = scan->next;
+        scan->next += size + sizeof(lsn_t);
+        if(compact) {
+          free(scan->copy);
+          scan->copy = stasis_log_entry_uncompact(lsn, buf + sizeof(lsn_t), size);
+          return scan->copy;
+        }
+        return (const LogEntry*)(buf + sizeof(lsn_t));
+      }
+      if(size + (lsn_t)sizeof(lsn_t) > scan->buf_size) {
+        scan->buf_size = size + sizeof(lsn_t);
+        free(scan->buf);
+        scan->buf = malloc(scan->buf_size);
+        scan->buf_end = scan->buf_start = scan->next;
+        avail = 0;
+      }
+    }
+    if(scanFill_LogWriter(log, scan) <= avail) {
+      // End of log, or a partial entry at the end of the file.
+      return NULL;
+    }
+  }
+}
+static void scanClose_LogWriter(stasis_log_t * log, void * scanp) {
+  stasis_log_safe_writes_scan_t * scan = scanp;
+  free(scan->buf);
+  free(scan->copy);
+  free(scan);
+}
 /**
    Truncates the log file.  In the single-threaded case, this works as
    follows:
@@ -644,11 +831,10 @@ static int truncateLog_LogWriter(stasis_log_t* log, lsn_t LSN) {
   /* Need to write LSN - sizeof(lsn_t) to make room for the offset in
      the file.  If we truncate to lsn 10, we'll put lsn 10 in position
      4, so the file offset is 6. */
-  LSN -= sizeof(lsn_t);
+  lsn_t header = (LSN - sizeof(lsn_t))
+    | (sw->compact ? STASIS_LOG_SAFE_WRITES_COMPACT_LOG : 0);
 
-  myFwrite(&LSN, sizeof(lsn_t), tmpLog);
-
-  LSN += sizeof(lsn_t);
+  myFwrite(&header, sizeof(lsn_t), tmpLog);
 
   /**
      @todo truncateLog blocks writers too early.  Instead, read until
@@ -679,10 +865,14 @@ static int truncateLog_LogWriter(stasis_log_t* log, lsn_t LSN) {
       firstInternalEntry = 0;
     }
 
-    lengthOfCopiedLog += (size + sizeof(lsn_t));
+    const void * bytes;
+    lsn_t framed_size = frameLogEntry_LogWriter(log, le, &bytes);
+    lsn_t stored_size = framed_size & ~STASIS_LOG_SAFE_WRITES_COMPACT_ENTRY;
+
+    lengthOfCopiedLog += (stored_size + sizeof(lsn_t));
 
-    myFwrite(&size, sizeof(lsn_t), tmpLog);
-    myFwrite(le, size, tmpLog);
+    myFwrite(&framed_size, sizeof(lsn_t), tmpLog);
+    myFwrite(bytes, stored_size, tmpLog);
     if(firstCRC) { free(firstCRC); }
   }
   freeLogHandle(lh);
@@ -838,6 +1028,9 @@ stasis_log_t* stasis_log_safe_writes_open(const char * filename,
     firstLogEntry_LogWriter,// truncation_point
     close_LogWriter, // deinit
     isDurable_LogWriter, // is_durable
+    scanOpen_LogWriter, // scan_open
+    scanNext_LogWriter, // scan_next
+    scanClose_LogWriter, // scan_close
   };
 
   stasis_log_safe_writes_state * sw = malloc(sizeof(*sw));
@@ -851,6 +1044,8 @@ stasis_log_t* stasis_log_safe_writes_open(const char * filename,
   sw->filemode = filemode;
   sw->fileperm = fileperm;
   sw->softcommit = softcommit;
+  sw->compact_buf = NULL;
+  sw->compact_buf_size = 0;
 
   stasis_log_t* log = malloc(sizeof(*log));
   memcpy(log,&proto, sizeof(proto));
@@ -918,7 +1113,9 @@ stasis_log_t* stasis_log_safe_writes_open(const char * filename,
       global offset for the truncated log.
     */
     sw->global_offset = 0;
-    size_t nmemb = fwrite(&sw->global_offset, sizeof(lsn_t), 1, sw->fp);
+    sw->compact = stasis_log_file_compact_entries;
+    lsn_t header = sw->compact ? STASIS_LOG_SAFE_WRITES_COMPACT_LOG : 0;
+    size_t nmemb = fwrite(&header, sizeof(lsn_t), 1, sw->fp);
     if(nmemb != 1) {
       perror("Couldn't start new log file!");
       return 0; //LLADD_IO_ERROR;
@@ -931,12 +1128,15 @@ stasis_log_t* stasis_log_safe_writes_open(const char * filename,
       return 0; //LLADD_IO_ERROR;
     }
 
-    ssize_t bytesRead = read(sw->ro_fd, &sw->global_offset, sizeof(lsn_t));
+    lsn_t header;
+    ssize_t bytesRead = read(sw->ro_fd, &header, sizeof(lsn_t));
 
     if(bytesRead != sizeof(lsn_t)) {
       printf("Could not read log header.");
       return 0;//LLADD_IO_ERROR;
     }
+    sw->compact = (header & STASIS_LOG_SAFE_WRITES_COMPACT_LOG) != 0;
+    sw->global_offset = header & ~STASIS_LOG_SAFE_WRITES_COMPACT_LOG;
 
   }
 
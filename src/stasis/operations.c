@@ -115,6 +115,12 @@ void stasis_operation_table_init() {
 
   stasis_operation_impl_register(stasis_op_impl_segment_file_pwrite());
   stasis_operation_impl_register(stasis_op_impl_segment_file_pwrite_inverse());
+
+  stasis_operation_impl_register(stasis_op_impl_btree_node_insert());
+  stasis_operation_impl_register(stasis_op_impl_btree_node_remove());
+
+  stasis_operation_impl_register(stasis_op_impl_btree_insert());
+  stasis_operation_impl_register(stasis_op_impl_btree_remove());
 }
 
 
@@ -3,6 +3,8 @@
 #include <stasis/bufferManager.h>
 #include <stasis/allocationPolicy.h>
 #include <stasis/page.h>
+#include <stasis/flags.h>
+#include <stasis/util/lhtable.h>
 
 #include <string.h>
 #include <assert.h>
@@ -92,12 +94,44 @@ typedef struct {
   int64_t type;
 } alloc_arg;
 
+/**
+   A page that an arena has checked out of the allocation policy.
+   freespace is the arena's (possibly optimistic) estimate of the page's
+   free space.  revoked is set (while holding alloc->mut) once some
+   transaction deallocates from the page; the arena checks it while
+   holding the page's write latch, and stops allocating from the page.
+ */
+typedef struct {
+  pageid_t pageid;
+  int freespace;
+  int revoked;
+} stasis_alloc_arena_page_t;
+
+/**
+   Per-thread allocation state.  Talloc() allocates from the arena's
+   pages without holding alloc->mut, and only takes the mutex to
+   exchange pages with the allocation policy.
+ */
+typedef struct stasis_alloc_arena_t {
+  stasis_alloc_arena_page_t ** pages;
+  int count;
+  struct stasis_alloc_arena_t * prev;
+  struct stasis_alloc_arena_t * next;
+  stasis_alloc_t * alloc;
+} stasis_alloc_arena_t;
+
 struct stasis_alloc_t {
   pthread_mutex_t mut;
   pageid_t lastFreepage;
   int callback_id;
   stasis_transaction_table_t * xact_table;
   stasis_allocation_policy_t * allocPolicy;
+  /** Points to the calling thread's stasis_alloc_arena_t. */
+  pthread_key_t arena_key;
+  /** Every live arena.  Protected by mut. */
+  stasis_alloc_arena_t * arenas;
+  /** pageid -> stasis_alloc_arena_page_t for every checked out page.  Protected by mut. */
+  struct LH_ENTRY(table) * arena_pages;
 };
 
 static int op_alloc(const LogEntry* e, Page* p) {
@@ -211,6 +245,105 @@ int stasis_alloc_callback(int xid, void * arg) {
   return 0;
 }
 
+/** Return an arena page to the allocation policy.  Caller holds alloc->mut. */
+static void stasis_alloc_arena_checkin(stasis_alloc_arena_t * arena, int i) {
+  stasis_alloc_t * alloc = arena->alloc;
+  stasis_alloc_arena_page_t * ap = arena->pages[i];
+  void * found = LH_ENTRY(remove)(alloc->arena_pages, &ap->pageid, sizeof(ap->pageid));
+  assert(found == ap);
+  stasis_allocation_policy_checkin_page(alloc->allocPolicy, ap->pageid, ap->freespace);
+  free(ap);
+  arena->count--;
+  arena->pages[i] = arena->pages[arena->count];
+}
+/** Check in all of an arena's pages, and free it.  Caller holds alloc->mut. */
+static void stasis_alloc_arena_free(stasis_alloc_arena_t * arena) {
+  stasis_alloc_t * alloc = arena->alloc;
+  while(arena->count) {
+    stasis_alloc_arena_checkin(arena, arena->count - 1);
+  }
+  if(arena->prev) {
+    arena->prev->next = arena->next;
+  } else {
+    alloc->arenas = arena->next;
+  }
+  if(arena->next) { arena->next->prev = arena->prev; }
+  free(arena->pages);
+  free(arena);
+}
+static void stasis_alloc_arena_thread_destructor(void * p) {
+  stasis_alloc_arena_t * arena = p;
+  stasis_alloc_t * alloc = arena->alloc;
+  pthread_mutex_lock(&alloc->mut);
+  stasis_alloc_arena_free(arena);
+  pthread_mutex_unlock(&alloc->mut);
+}
+static stasis_alloc_arena_t * stasis_alloc_arena_get(stasis_alloc_t * alloc) {
+  stasis_alloc_arena_t * arena = pthread_getspecific(alloc->arena_key);
+  if(!arena) {
+    arena = malloc(sizeof(*arena));
+    arena->pages = malloc(sizeof(arena->pages[0]) * stasis_alloc_arena_pages);
+    arena->count = 0;
+    arena->alloc = alloc;
+    arena->prev = 0;
+    pthread_mutex_lock(&alloc->mut);
+    arena->next = alloc->arenas;
+    if(arena->next) { arena->next->prev = arena; }
+    alloc->arenas = arena;
+    pthread_mutex_unlock(&alloc->mut);
+    pthread_setspecific(alloc->arena_key, arena);
+  }
+  return arena;
+}
+/**
+   Mark a page that is checked out by an arena as unsafe for further
+   allocation.  Caller holds alloc->mut.
+ */
+static void stasis_alloc_arena_revoke(stasis_alloc_t * alloc, pageid_t pageid) {
+  stasis_alloc_arena_page_t * ap = LH_ENTRY(find)(alloc->arena_pages, &pageid, sizeof(pageid));
+  if(ap) { ap->revoked = 1; }
+}
+/**
+   Swap the arena's revoked and fullest pages for pages with at least
+   rec_size bytes free.
+
+   @return 0 if the allocation policy has no such pages.
+ */
+static int stasis_alloc_arena_refill(stasis_alloc_arena_t * arena, int rec_size) {
+  stasis_alloc_t * alloc = arena->alloc;
+  int ret = 0;
+  pthread_mutex_lock(&alloc->mut);
+  for(int i = 0; i < arena->count; i++) {
+    if(arena->pages[i]->revoked) {
+      stasis_alloc_arena_checkin(arena, i);
+      i--;
+    }
+  }
+  if(arena->count == stasis_alloc_arena_pages) {
+    int fullest = 0;
+    for(int i = 1; i < arena->count; i++) {
+      if(arena->pages[i]->freespace < arena->pages[fullest]->freespace) { fullest = i; }
+    }
+    stasis_alloc_arena_checkin(arena, fullest);
+  }
+  while(arena->count < stasis_alloc_arena_pages) {
+    size_t freespace;
+    pageid_t pageid = stasis_allocation_policy_checkout_page(alloc->allocPolicy, rec_size, &freespace);
+    if(pageid == INVALID_PAGE) { break; }
+    stasis_alloc_arena_page_t * ap = malloc(sizeof(*ap));
+    ap->pageid = pageid;
+    ap->freespace = freespace;
+    ap->revoked = 0;
+    void * old = LH_ENTRY(insert)(alloc->arena_pages, &ap->pageid, sizeof(ap->pageid), ap);
+    assert(!old);
+    arena->pages[arena->count] = ap;
+    arena->count++;
+    ret = 1;
+  }
+  pthread_mutex_unlock(&alloc->mut);
+  return ret;
+}
+
 stasis_alloc_t* stasis_alloc_init(stasis_transaction_table_t * tbl, stasis_allocation_policy_t * allocPolicy) {
   stasis_alloc_t * alloc = malloc(sizeof(*alloc));
   alloc->lastFreepage = PAGEID_T_MAX;
@@ -218,6 +351,9 @@ stasis_alloc_t* stasis_alloc_init(stasis_transaction_table_t * tbl, stasis_alloc
   pthread_mutex_init(&alloc->mut, 0);
   alloc->callback_id = stasis_transaction_table_register_callback(tbl, stasis_alloc_callback, AT_COMMIT);
   alloc->xact_table = tbl;
+  pthread_key_create(&alloc->arena_key, stasis_alloc_arena_thread_destructor);
+  alloc->arenas = 0;
+  alloc->arena_pages = LH_ENTRY(create)(16);
   return alloc;
 }
 
@@ -226,6 +362,14 @@ void stasis_alloc_post_init(stasis_alloc_t * alloc) {
   stasis_alloc_register_old_regions(alloc);
 }
 void stasis_alloc_deinit(stasis_alloc_t * alloc) {
+  // Once the key is gone, exiting threads no longer touch their arenas.
+  pthread_key_delete(alloc->arena_key);
+  pthread_mutex_lock(&alloc->mut);
+  while(alloc->arenas) {
+    stasis_alloc_arena_free(alloc->arenas);
+  }
+  pthread_mutex_unlock(&alloc->mut);
+  LH_ENTRY(destroy)(alloc->arena_pages);
   pthread_mutex_destroy(&alloc->mut);
   free(alloc);
 }
@@ -256,31 +400,114 @@ static void stasis_alloc_register_old_regions(stasis_alloc_t* alloc) {
   }
 }
 
-static void stasis_alloc_reserve_new_region(stasis_alloc_t* alloc, int xid) {
+/**
+   Allocate and format a region of slotted pages for Talloc().  The
+   caller must register the pages with the allocation policy.
+
+   @return the first page of the region.
+ */
+static pageid_t stasis_alloc_format_new_region(int xid, int * initialFreespace) {
      void* nta = TbeginNestedTopAction(xid, OPERATION_NOOP, 0,0);
 
      pageid_t firstPage = TregionAlloc(xid, TALLOC_REGION_SIZE, STORAGE_MANAGER_TALLOC);
-     int initialFreespace = -1;
+     *initialFreespace = -1;
 
      for(pageid_t i = 0; i < TALLOC_REGION_SIZE; i++) {
        TinitializeSlottedPage(xid, firstPage + i);
-       if(initialFreespace == -1) {
+       if(*initialFreespace == -1) {
          Page * p = loadPage(xid, firstPage);
          readlock(p->rwlatch,0);
-         initialFreespace = stasis_record_freespace(xid, p);
+         *initialFreespace = stasis_record_freespace(xid, p);
          unlock(p->rwlatch);
          releasePage(p);
        }
-       stasis_allocation_policy_register_new_page(alloc->allocPolicy, firstPage + i, initialFreespace);
      }
 
      TendNestedTopAction(xid, nta);
+     return firstPage;
+}
+/** Caller holds alloc->mut. */
+static void stasis_alloc_register_new_region(stasis_alloc_t* alloc, pageid_t firstPage, int initialFreespace) {
+     for(pageid_t i = 0; i < TALLOC_REGION_SIZE; i++) {
+       stasis_allocation_policy_register_new_page(alloc->allocPolicy, firstPage + i, initialFreespace);
+     }
+}
+/** Caller holds alloc->mut. */
+static void stasis_alloc_reserve_new_region(stasis_alloc_t* alloc, int xid) {
+     int initialFreespace;
+     pageid_t firstPage = stasis_alloc_format_new_region(xid, &initialFreespace);
+     stasis_alloc_register_new_region(alloc, firstPage, initialFreespace);
+}
+/**
+   Allocate a record from one of the calling thread's arena pages, and
+   log the allocation.
+
+   @return the page the record lives on, which is still pinned.
+ */
+static Page * stasis_alloc_arena_alloc(stasis_alloc_t * alloc, int xid, short type, recordid * rid) {
+  stasis_alloc_arena_t * arena = stasis_alloc_arena_get(alloc);
+  int rec_size = stasis_record_type_to_size(type);
+  if(rec_size < 4) { rec_size = 4; }
+
+  while(1) {
+    stasis_alloc_arena_page_t * ap = 0;
+    int idx;
+    for(idx = 0; idx < arena->count; idx++) {
+      if(arena->pages[idx]->freespace >= rec_size) {
+        ap = arena->pages[idx];
+        break;
+      }
+    }
+    if(!ap) {
+      if(!stasis_alloc_arena_refill(arena, rec_size)) {
+        int initialFreespace;
+        pageid_t firstPage = stasis_alloc_format_new_region(xid, &initialFreespace);
+        pthread_mutex_lock(&alloc->mut);
+        stasis_alloc_register_new_region(alloc, firstPage, initialFreespace);
+        pthread_mutex_unlock(&alloc->mut);
+      }
+      continue;
+    }
+
+    Page * p = loadPage(xid, ap->pageid);
+    writelock(p->rwlatch, 0);
+    if(ap->revoked) {
+      // Someone deallocated from this page; reusing that space could
+      // make their abort impossible.
+      unlock(p->rwlatch);
+      releasePage(p);
+      pthread_mutex_lock(&alloc->mut);
+      stasis_alloc_arena_checkin(arena, idx);
+      pthread_mutex_unlock(&alloc->mut);
+      continue;
+    }
+    if(stasis_record_freespace(xid, p) < rec_size) {
+      stasis_record_compact(p);
+    }
+    ap->freespace = stasis_record_freespace(xid, p);
+    if(ap->freespace < rec_size) {
+      // Our estimate was stale (TallocFromPage() used the page).
+      unlock(p->rwlatch);
+      releasePage(p);
+      continue;
+    }
+
+    *rid = stasis_record_alloc_begin(xid, p, type);
+    assert(rid->size != INVALID_SLOT);
+    stasis_record_alloc_done(xid, p, *rid);
+    ap->freespace = stasis_record_freespace(xid, p);
+    unlock(p->rwlatch);
+
+    alloc_arg a = { rid->slot, type };
+    Tupdate(xid, rid->page, &a, sizeof(a), OPERATION_ALLOC);
+    return p;
+  }
 }
 
 recordid Talloc(int xid, unsigned long size) {
   stasis_alloc_t* alloc = stasis_runtime_alloc_state();
   short type;
-  if(size >= BLOB_THRESHOLD_SIZE) {
+  if(size >= (unsigned long)BLOB_THRESHOLD_SIZE) {
     type = BLOB_SLOT;
   } else {
     assert(size >= 0);
@@ -289,6 +516,18 @@ recordid Talloc(int xid, unsigned long size) {
 
   recordid rid;
 
+  if(stasis_alloc_arena_pages) {
+    Page * p = stasis_alloc_arena_alloc(alloc, xid, type, &rid);
+    if(type == BLOB_SLOT) {
+      rid.size = size;
+      stasis_blob_alloc(xid, rid);
+    }
+    releasePage(p);
+    // Arena pages are not tracked per transaction, so there is nothing
+    // for stasis_alloc_callback() to clean up.
+    return rid;
+  }
+
   pthread_mutex_lock(&alloc->mut);
 
   pageid_t pageid =
@@ -365,7 +604,7 @@ recordid Talloc(int xid, unsigned long size) {
 recordid TallocFromPage(int xid, pageid_t page, unsigned long size) {
   stasis_alloc_t* alloc = stasis_runtime_alloc_state();
   short type;
-  if(size >= BLOB_THRESHOLD_SIZE) {
+  if(size >= (unsigned long)BLOB_THRESHOLD_SIZE) {
     type = BLOB_SLOT;
   } else {
     assert(size > 0);
@@ -412,13 +651,11 @@ void Tdealloc(int xid, recordid rid) {
 
   // @todo this needs to garbage collect empty storage regions.
 
-  pthread_mutex_lock(&alloc->mut);
   Page * p = loadPage(xid, rid.page);
 
   readlock(p->rwlatch,0);
 
   recordid newrid = stasis_record_dereference(xid, p, rid);
-  stasis_allocation_policy_dealloced_from_page(alloc->allocPolicy, xid, newrid.page);
 
   int64_t size = stasis_record_length_read(xid,p,rid);
   int64_t type = stasis_record_type_read(xid,p,rid);
@@ -442,8 +679,11 @@ void Tdealloc(int xid, recordid rid) {
   // allocationPolicy protects us from running out of space due to concurrent
   // xacts.
 
-  // Also, there can be no reordering of allocations / deallocations ,
-  // since we're holding alloc->mutex.  However, we might reorder a Tset()
+  // The slot stays allocated until Tupdate() frees it below, so no one
+  // can reuse it before the dealloc is logged.  Once the allocation policy
+  // and arenas have been told about the dealloc, no other transaction will
+  // allocate from the page, so there is no need to hold alloc->mut across
+  // the Tupdate().  However, we might reorder a Tset()
   // to and a Tdealloc() or Talloc() on the same page.  If this happens,
   // it's an unsafe race in the application, and not technically our problem.
 
@@ -452,13 +692,16 @@ void Tdealloc(int xid, recordid rid) {
   // @todo application-level allocation races can lead to unrecoverable logs.
   unlock(p->rwlatch);
 
+  pthread_mutex_lock(&alloc->mut);
+  stasis_allocation_policy_dealloced_from_page(alloc->allocPolicy, xid, newrid.page);
+  stasis_alloc_arena_revoke(alloc, newrid.page);
+  pthread_mutex_unlock(&alloc->mut);
+
   Tupdate(xid, rid.page, preimage,
           sizeof(alloc_arg)+size, OPERATION_DEALLOC);
 
   releasePage(p);
 
-  pthread_mutex_unlock(&alloc->mut);
-
   if(type==BLOB_SLOT) {
     stasis_blob_dealloc(xid,(blob_record_t*)(preimage+sizeof(alloc_arg)));
   }
@@ -140,6 +140,14 @@ recordid stasis_array_list_dereference_recordid(int xid, Page * p, int offset) {
 
 }
 
+void TarrayListRead(int xid, stasis_buffer_manager_handle_t * h, recordid rid, void * dat) {
+  Page * p = loadPage(xid, rid.page);
+  rid = stasis_array_list_dereference_recordid(xid, p, rid.slot);
+  releasePage(p);
+  p = h ? loadPageWithHandle(h, xid, rid.page) : loadPage(xid, rid.page);
+  releasePage(TreadWithPage(xid, rid, p, dat));
+}
+
 /*----------------------------------------------------------------------------*/
 recordid TarrayListAlloc(int xid, pageid_t count, int multiplier, int recordSize) {
 
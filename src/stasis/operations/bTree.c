@@ -7,6 +7,9 @@
 #include<stasis/operations/bTree.h>
 
 #include <stasis/bufferManager.h>
+#include <stasis/page.h>
+
+#include <assert.h>
 
 static stasis_comparator_t * btree_comparators;
 
@@ -25,6 +28,22 @@ static int stasis_btree_byte_array_comparator(const void * a, size_t alen, const
   return ret;
 }
 
+/**
+   Writers latch nodes by hashing page ids onto this array of mutexes.
+   Readers rely on the page rwlatch instead, so they never wait for a
+   writer that is busy splitting a node.  No thread holds more than one
+   of these at once, so collisions cannot deadlock.
+ */
+#define BTREE_LATCH_COUNT 1024
+static pthread_mutex_t btree_latches[BTREE_LATCH_COUNT];
+
+static inline void btree_latch(pageid_t p) {
+  pthread_mutex_lock(&btree_latches[p % BTREE_LATCH_COUNT]);
+}
+static inline void btree_unlatch(pageid_t p) {
+  pthread_mutex_unlock(&btree_latches[p % BTREE_LATCH_COUNT]);
+}
+
 void BtreeInit() {
   // todo: register iterator
 
@@ -32,204 +51,558 @@ void BtreeInit() {
   btree_comparators = calloc(MAX_COMPARATOR, sizeof(stasis_comparator_t));
   btree_comparators[BYTE_ARRAY_COMPARATOR] = stasis_btree_byte_array_comparator;
 
+  for(int i = 0; i < BTREE_LATCH_COUNT; i++) {
+    pthread_mutex_init(&btree_latches[i], 0);
+  }
 }
 void BtreeDeinit() {
+  for(int i = 0; i < BTREE_LATCH_COUNT; i++) {
+    pthread_mutex_destroy(&btree_latches[i]);
+  }
   free(btree_comparators);
 }
+
+/*
+  Node layout.  Nodes are BLOB_PAGEs; the usable part of the page
+  starts with a btree_node header, followed by an array of slots
+  (offsets of cells) in key order.  Cells are allocated from the end of
+  the usable space, and hold a btree_cell header, the key and the value.
+
+  Leaf values are user data.  Internal values are child page ids; the
+  key of slot 0 of an internal node is ignored (it is treated as minus
+  infinity).  Every node other than the rightmost one at its level has
+  a high key, which is the lowest key that belongs to its right sibling.
+*/
 typedef struct {
-  int height;
-  pageid_t root;
+  pageid_t right;
+  int16_t level;
   stasis_comparator_id_t cmp_id;
-} stasis_op_btree_page_header;
+  uint16_t count;
+  uint16_t heap_start;
+  uint16_t garbage;
+  /** Offset of the high key's cell, or 0 for the rightmost node. */
+  uint16_t high;
+} btree_node;
+
+typedef struct {
+  uint16_t keylen;
+  uint16_t vallen;
+} btree_cell;
+
+typedef struct {
+  const byte * key;
+  size_t keylen;
+  const byte * val;
+  size_t vallen;
+} btree_entry;
 
+/** Arguments of the logical insert and remove operations.  Followed by key, then value. */
 typedef struct {
-  pageid_t page;
-} btree_internal_pair;
+  pageid_t root;
+  /** The caller's cmp_arg, so that logical undo compares keys the same way. */
+  uint64_t cmp_arg;
+  uint16_t keylen;
+  uint16_t vallen;
+} btree_arg;
 
+/** Arguments of the node insert and remove operations.  Followed by key, then value. */
 typedef struct {
+  uint16_t pos;
   uint16_t keylen;
-} btree_leaf_pair;
+  uint16_t vallen;
+} btree_node_arg;
 
-recordid TbtreeCreate(int xid, stasis_comparator_id_t cmp_id) {
-  stasis_op_btree_page_header header;
-  header.root = TpageAlloc(xid);
-  TinitializeSlottedPage(xid, header.root);
-
-  header.height = 1; // leaf
-  header.cmp_id = cmp_id;
-  recordid rid = Talloc(xid,  sizeof(header));
-  Tset(xid, rid, &header);
-  return rid;
+#define BTREE_MAX_HEIGHT 32
+
+static inline uint16_t * btree_slots(btree_node * n) {
+  return (uint16_t*)(n+1);
+}
+static inline btree_cell * btree_cell_at(btree_node * n, uint16_t off) {
+  return (btree_cell*)(((byte*)n) + off);
+}
+static inline size_t btree_cell_size(size_t keylen, size_t vallen) {
+  return sizeof(btree_cell) + keylen + vallen;
+}
+static inline size_t btree_node_free(btree_node * n) {
+  return n->heap_start - (sizeof(btree_node) + n->count * sizeof(uint16_t));
+}
+static inline void btree_node_entry(btree_node * n, int slot, btree_entry * e) {
+  btree_cell * c = btree_cell_at(n, btree_slots(n)[slot]);
+  e->key = (const byte*)(c+1);
+  e->keylen = c->keylen;
+  e->val = e->key + c->keylen;
+  e->vallen = c->vallen;
+}
+static inline pageid_t btree_node_child(btree_node * n, int slot) {
+  btree_entry e;
+  btree_node_entry(n, slot, &e);
+  pageid_t ret;
+  memcpy(&ret, e.val, sizeof(ret));
+  return ret;
 }
 
-static int cmp_slot(int xid, Page *p, slotid_t slot, byte * key, size_t keySize, int leaf, stasis_comparator_t cmp, void * cmp_arg) {
-  recordid rid = {p->id, slot, 0};
-  rid.size = stasis_record_length_read(xid, p, rid);
-  if(rid.size == INVALID_SLOT) { return 1; } // treat invalid slots as infinity.
-  byte * cur = malloc(rid.size);
-  stasis_record_read(xid, p, rid, cur);
-  byte * cur_ptr;
-  size_t cur_len;
-  if(leaf) {
-    cur_ptr = (byte*)(1+(btree_leaf_pair*)cur);
-    cur_len = ((btree_leaf_pair*)cur)->keylen;
-  } else {
-    cur_ptr = (byte*)(1+(btree_internal_pair*)cur);
-    cur_len = stasis_record_length_read(xid, p, rid)-sizeof(btree_internal_pair);
+static void btree_node_init(byte * buf, int level, stasis_comparator_id_t cmp_id) {
+  memset(buf, 0, USABLE_SIZE_OF_PAGE);
+  btree_node * n = (btree_node*)buf;
+  n->right = INVALID_PAGE;
+  n->level = level;
+  n->cmp_id = cmp_id;
+  n->heap_start = USABLE_SIZE_OF_PAGE;
+}
+/** Rewrite the cells so that the free space is contiguous. Deterministic, so it is safe to call from redo. */
+static void btree_node_compact(btree_node * n) {
+  byte * buf = malloc(USABLE_SIZE_OF_PAGE);
+  uint16_t heap = USABLE_SIZE_OF_PAGE;
+  uint16_t * slots = btree_slots(n);
+  for(int i = -1; i < n->count; i++) {
+    uint16_t * off = (i == -1) ? &n->high : &slots[i];
+    if(!*off) { continue; }
+    btree_cell * c = btree_cell_at(n, *off);
+    size_t sz = btree_cell_size(c->keylen, c->vallen);
+    heap -= sz;
+    memcpy(buf + heap, c, sz);
+    *off = heap;
   }
-  int res = cmp(key, keySize, cur_ptr, cur_len, cmp_arg);
-  free(cur);
-  return res;
+  memcpy(((byte*)n) + heap, buf + heap, USABLE_SIZE_OF_PAGE - heap);
+  n->heap_start = heap;
+  n->garbage = 0;
+  free(buf);
+}
+static int btree_node_fits(btree_node * n, size_t keylen, size_t vallen) {
+  return btree_node_free(n) + n->garbage >= btree_cell_size(keylen, vallen) + sizeof(uint16_t);
+}
+static uint16_t btree_node_alloc_cell(btree_node * n, const byte * key, size_t keylen, const byte * val, size_t vallen, size_t slot_bytes) {
+  size_t sz = btree_cell_size(keylen, vallen);
+  if(btree_node_free(n) < sz + slot_bytes) {
+    btree_node_compact(n);
+  }
+  assert(btree_node_free(n) >= sz + slot_bytes);
+  n->heap_start -= sz;
+  btree_cell * c = btree_cell_at(n, n->heap_start);
+  c->keylen = keylen;
+  c->vallen = vallen;
+  memcpy(c+1, key, keylen);
+  memcpy(((byte*)(c+1)) + keylen, val, vallen);
+  return n->heap_start;
+}
+static void btree_node_insert_at(btree_node * n, int pos, const byte * key, size_t keylen, const byte * val, size_t vallen) {
+  assert(pos <= n->count);
+  uint16_t off = btree_node_alloc_cell(n, key, keylen, val, vallen, sizeof(uint16_t));
+  uint16_t * slots = btree_slots(n);
+  memmove(&slots[pos+1], &slots[pos], (n->count - pos) * sizeof(uint16_t));
+  slots[pos] = off;
+  n->count++;
+}
+static void btree_node_remove_at(btree_node * n, int pos) {
+  assert(pos < n->count);
+  uint16_t * slots = btree_slots(n);
+  btree_cell * c = btree_cell_at(n, slots[pos]);
+  n->garbage += btree_cell_size(c->keylen, c->vallen);
+  memmove(&slots[pos], &slots[pos+1], (n->count - pos - 1) * sizeof(uint16_t));
+  n->count--;
+}
+static void btree_node_set_high(btree_node * n, const byte * key, size_t keylen) {
+  n->high = btree_node_alloc_cell(n, key, keylen, 0, 0, 0);
 }
 
-static slotid_t find_in_page(int xid, Page * p, byte * key, size_t keySize, int leaf, int* found, stasis_comparator_t cmp, void * cmp_arg) {
-  slotid_t slot;
-  int res = 1;
-  recordid lastrid = stasis_record_last(xid, p);
-  for(slot = 0; slot <= lastrid.slot; slot++) {
-    res = cmp_slot(xid, p, slot, key, keySize, leaf, cmp, cmp_arg);
-    if(res <= 0) { break; }  // if the key is less than or equal to the slot, then stop looking.
+/** @return true if key belongs to one of the node's right siblings. */
+static int btree_node_beyond_high(btree_node * n, stasis_comparator_t cmp, void * cmp_arg, const byte * key, size_t keylen) {
+  if(!n->high) { return 0; }
+  btree_cell * c = btree_cell_at(n, n->high);
+  return cmp(key, keylen, c+1, c->keylen, cmp_arg) >= 0;
+}
+/** @return the first slot whose key is >= key (n->count if there is no such slot). */
+static int btree_leaf_search(btree_node * n, stasis_comparator_t cmp, void * cmp_arg, const byte * key, size_t keylen, int * found) {
+  int lo = 0, hi = n->count;
+  *found = 0;
+  while(lo < hi) {
+    int mid = (lo + hi) / 2;
+    btree_entry e;
+    btree_node_entry(n, mid, &e);
+    int res = cmp(key, keylen, e.key, e.keylen, cmp_arg);
+    if(res > 0) {
+      lo = mid + 1;
+    } else {
+      if(!res) { *found = 1; }
+      hi = mid;
+    }
   }
-  if(res == 0) {
-    // have the right slot.
-    *found = 1;
-  } else {
-    // have the slot after the one we want, or are at edge of page.
-    *found = 0;
-    if(slot > lastrid.slot) {
-      DEBUG("end of page\n");
-      // ret is the slot we want.
-    } else if(slot == 0) {
-      DEBUG("start of page\n");
+  return lo;
+}
+/** @return the slot of the child that covers key, ignoring the key of slot 0. */
+static int btree_internal_search(btree_node * n, stasis_comparator_t cmp, void * cmp_arg, const byte * key, size_t keylen) {
+  int lo = 1, hi = n->count;
+  while(lo < hi) {
+    int mid = (lo + hi) / 2;
+    btree_entry e;
+    btree_node_entry(n, mid, &e);
+    if(cmp(key, keylen, e.key, e.keylen, cmp_arg) >= 0) {
+      lo = mid + 1;
     } else {
-      slot --;
-      DEBUG("too far\n");
+      hi = mid;
     }
   }
-  DEBUG("found = %d, res = %d, ret = %lld\n", *found, res, slot);
-  return slot;
+  return lo - 1;
 }
 
-static slotid_t stasis_btree_helper(int xid, stasis_op_btree_page_header h, byte* key, size_t keySize,
-    int * found, pageid_t ** path, stasis_comparator_t cmp, void * cmp_arg) {
-  pageid_t next = h.root;
-  *path = calloc(h.height, sizeof(pageid_t));
-  for(int i = 0; i < h.height-1; i++) {
-    Page *p = loadPage(xid, next);
-    (*path)[i] = next;
-    readlock(p->rwlatch,0);
-    int ignored;
-    next = find_in_page(xid, p, key, keySize, 0, &ignored, cmp, cmp_arg);
+static int op_btree_node_insert(const LogEntry * e, Page * p) {
+  const btree_node_arg * arg = stasis_log_entry_update_args_cptr(e);
+  const byte * key = (const byte*)(arg+1);
+  btree_node_insert_at((btree_node*)p->memAddr, arg->pos, key, arg->keylen, key + arg->keylen, arg->vallen);
+  return 0;
+}
+static int op_btree_node_remove(const LogEntry * e, Page * p) {
+  const btree_node_arg * arg = stasis_log_entry_update_args_cptr(e);
+  btree_node_remove_at((btree_node*)p->memAddr, arg->pos);
+  return 0;
+}
+stasis_operation_impl stasis_op_impl_btree_node_insert() {
+  stasis_operation_impl o = {
+    OPERATION_BTREE_NODE_INSERT,
+    BLOB_PAGE,
+    OPERATION_BTREE_NODE_INSERT,
+    OPERATION_BTREE_NODE_REMOVE,
+    op_btree_node_insert
+  };
+  return o;
+}
+stasis_operation_impl stasis_op_impl_btree_node_remove() {
+  stasis_operation_impl o = {
+    OPERATION_BTREE_NODE_REMOVE,
+    BLOB_PAGE,
+    OPERATION_BTREE_NODE_REMOVE,
+    OPERATION_BTREE_NODE_INSERT,
+    op_btree_node_remove
+  };
+  return o;
+}
+static void btree_node_update(int xid, Page * p, int op, int pos, const btree_entry * e) {
+  size_t sz = sizeof(btree_node_arg) + e->keylen + e->vallen;
+  btree_node_arg * arg = malloc(sz);
+  arg->pos = pos;
+  arg->keylen = e->keylen;
+  arg->vallen = e->vallen;
+  memcpy(arg+1, e->key, e->keylen);
+  memcpy(((byte*)(arg+1)) + e->keylen, e->val, e->vallen);
+  TupdateWithPage(xid, p->id, p, arg, sz, op);
+  free(arg);
+}
+static void * btree_begin_nta(int xid, int op, pageid_t root, void * cmp_arg, const btree_entry * e) {
+  if(op == OPERATION_NOOP) {
+    return TbeginNestedTopAction(xid, OPERATION_NOOP, 0, 0);
+  }
+  size_t sz = sizeof(btree_arg) + e->keylen + e->vallen;
+  btree_arg * arg = malloc(sz);
+  arg->root = root;
+  arg->cmp_arg = (uintptr_t)cmp_arg;
+  arg->keylen = e->keylen;
+  arg->vallen = e->vallen;
+  memcpy(arg+1, e->key, e->keylen);
+  memcpy(((byte*)(arg+1)) + e->keylen, e->val, e->vallen);
+  void * ret = TbeginNestedTopAction(xid, op, (byte*)arg, sz);
+  free(arg);
+  return ret;
+}
+
+/**
+   Find the node at the given level that covers key, without latching
+   more than one page at a time.  Records the rightmost node visited at
+   each internal level in path (if it is non-null).
+
+   @return the node, pinned and read latched.
+ */
+static Page * btree_descend(int xid, pageid_t root, int level, void * cmp_arg, const byte * key, size_t keylen, pageid_t * path) {
+  pageid_t pid = root;
+  while(1) {
+    Page * p = loadPage(xid, pid);
+    readlock(p->rwlatch, 0);
+    btree_node * n = (btree_node*)p->memAddr;
+    stasis_comparator_t cmp = btree_comparators[n->cmp_id];
+    assert(n->level >= level);
+    if(btree_node_beyond_high(n, cmp, cmp_arg, key, keylen)) {
+      pid = n->right;
+    } else if(n->level > level) {
+      if(path) { path[n->level] = pid; }
+      pid = btree_node_child(n, btree_internal_search(n, cmp, cmp_arg, key, keylen));
+    } else {
+      return p;
+    }
     unlock(p->rwlatch);
     releasePage(p);
   }
-  // leaf page
-  Page * p = loadPage(xid, next);
-  (*path)[h.height-1] = next;
-  DEBUG("leaf: %lld\n", next);
-  readlock(p->rwlatch, 0);
-  slotid_t slot = find_in_page(xid, p, key, keySize, 1, found, cmp, cmp_arg);
-  DEBUG("slot: %lld (found = %d)\n", slot, *found);
+}
+/**
+   Like btree_descend, but returns the node write latched, and starts at
+   an arbitrary node at or above the target level.  Since nodes are
+   never freed, stale page ids (from an earlier descent) are safe
+   starting points.
+ */
+static Page * btree_latch_node(int xid, pageid_t pid, int level, void * cmp_arg, const byte * key, size_t keylen) {
+  while(1) {
+    btree_latch(pid);
+    Page * p = loadPage(xid, pid);
+    btree_node * n = (btree_node*)p->memAddr;
+    stasis_comparator_t cmp = btree_comparators[n->cmp_id];
+    assert(n->level >= level);
+    if(btree_node_beyond_high(n, cmp, cmp_arg, key, keylen)) {
+      pid = n->right;
+    } else if(n->level > level) {
+      pid = btree_node_child(n, btree_internal_search(n, cmp, cmp_arg, key, keylen));
+    } else {
+      return p;
+    }
+    btree_unlatch(p->id);
+    releasePage(p);
+  }
+}
+static pageid_t btree_alloc_node(int xid) {
+  pageid_t ret = TpageAlloc(xid);
+  TinitializeBlobPageRange(xid, ret, 1);
+  return ret;
+}
+/**
+   Insert an entry at slot pos of a node that the caller has latched
+   with btree_latch_node(), splitting the node if it is full.
+
+   The caller's nested top action is completed before the node is
+   unlatched.  Therefore, if we crash before the action completes,
+   nobody else has touched the node, and physical undo of the node
+   images is safe.
+
+   @return 1 if the node was split and the parent needs a separator
+   (in which case sep, seplen and rightpid are set), 0 otherwise.
+ */
+static int btree_node_insert_latched(int xid, pageid_t root, Page * p, int pos, const btree_entry * ent, void * nta,
+                                     byte * sep, size_t * seplen, pageid_t * rightpid) {
+  btree_node * n = (btree_node*)p->memAddr;
+  int ret = 0;
+  if(btree_node_fits(n, ent->keylen, ent->vallen)) {
+    btree_node_update(xid, p, OPERATION_BTREE_NODE_INSERT, pos, ent);
+  } else {
+    // Split the node in half (by bytes), placing the new entry on the correct side.
+    int total = n->count + 1;
+    btree_entry * e = malloc(total * sizeof(*e));
+    size_t bytes = 0;
+    for(int i = 0, j = 0; i < total; i++) {
+      if(i == pos) {
+        e[i] = *ent;
+      } else {
+        btree_node_entry(n, j++, &e[i]);
+      }
+      bytes += btree_cell_size(e[i].keylen, e[i].vallen) + sizeof(uint16_t);
+    }
+    int mid = 0;
+    size_t left_bytes = 0;
+    while(mid < total - 1 && (mid == 0 || left_bytes < bytes / 2)) {
+      left_bytes += btree_cell_size(e[mid].keylen, e[mid].vallen) + sizeof(uint16_t);
+      mid++;
+    }
+    byte * left = malloc(USABLE_SIZE_OF_PAGE);
+    byte * right = malloc(USABLE_SIZE_OF_PAGE);
+    btree_node_init(left, n->level, n->cmp_id);
+    btree_node_init(right, n->level, n->cmp_id);
+    for(int i = 0; i < total; i++) {
+      btree_node * dst = (btree_node*)(i < mid ? left : right);
+      btree_node_insert_at(dst, dst->count, e[i].key, e[i].keylen, e[i].val, e[i].vallen);
+    }
+    // The first key of the right half separates the halves.  For internal
+    // nodes, it stays in the right node's slot 0, where it is ignored.
+    *seplen = e[mid].keylen;
+    memcpy(sep, e[mid].key, *seplen);
+    free(e);
+    btree_node_set_high((btree_node*)left, sep, *seplen);
+    if(n->high) {
+      btree_cell * c = btree_cell_at(n, n->high);
+      btree_node_set_high((btree_node*)right, (const byte*)(c+1), c->keylen);
+    }
+    ((btree_node*)right)->right = n->right;
+
+    if(p->id == root) {
+      // The root never moves; copy both halves into new nodes, and turn
+      // the root into their parent.
+      int level = n->level;
+      stasis_comparator_id_t cmp_id = n->cmp_id;
+      pageid_t lpid = btree_alloc_node(xid);
+      pageid_t rpid = btree_alloc_node(xid);
+      ((btree_node*)left)->right = rpid;
+      TpageSetRange(xid, rpid, 0, right, USABLE_SIZE_OF_PAGE);
+      TpageSetRange(xid, lpid, 0, left, USABLE_SIZE_OF_PAGE);
+      btree_node_init(left, level + 1, cmp_id);
+      btree_node_insert_at((btree_node*)left, 0, 0, 0, (byte*)&lpid, sizeof(lpid));
+      btree_node_insert_at((btree_node*)left, 1, sep, *seplen, (byte*)&rpid, sizeof(rpid));
+      TpageSetRange(xid, root, 0, left, USABLE_SIZE_OF_PAGE);
+    } else {
+      // Write the new sibling first; it becomes reachable when the left
+      // half (which links to it) is written.
+      *rightpid = btree_alloc_node(xid);
+      ((btree_node*)left)->right = *rightpid;
+      TpageSetRange(xid, *rightpid, 0, right, USABLE_SIZE_OF_PAGE);
+      TpageSetRange(xid, p->id, 0, left, USABLE_SIZE_OF_PAGE);
+      ret = 1;
+    }
+    free(left);
+    free(right);
+  }
+  TendNestedTopAction(xid, nta);
+  btree_unlatch(p->id);
+  releasePage(p);
+  return ret;
+}
+/**
+   Add the separator produced by a split of a node at level-1 to the
+   level above it, splitting ancestors as needed.  Each level is its own
+   nested top action, with no logical undo; if we crash in between,
+   the new node is still reachable through its left sibling's link.
+ */
+static void btree_insert_separator(int xid, pageid_t root, int level, pageid_t * path, void * cmp_arg,
+                                   const byte * firstsep, size_t seplen, pageid_t rightpid) {
+  byte * sep = malloc(BTREE_MAX_ENTRY_SIZE);
+  byte * nextsep = malloc(BTREE_MAX_ENTRY_SIZE);
+  memcpy(sep, firstsep, seplen);
+  int split = 1;
+  while(split) {
+    void * nta = TbeginNestedTopAction(xid, OPERATION_NOOP, 0, 0);
+    pageid_t start = (level < BTREE_MAX_HEIGHT && path[level] != INVALID_PAGE) ? path[level] : root;
+    Page * p = btree_latch_node(xid, start, level, cmp_arg, sep, seplen);
+    btree_node * n = (btree_node*)p->memAddr;
+    int pos = btree_internal_search(n, btree_comparators[n->cmp_id], cmp_arg, sep, seplen) + 1;
+    btree_entry e = { sep, seplen, (byte*)&rightpid, sizeof(rightpid) };
+    size_t nextseplen;
+    split = btree_node_insert_latched(xid, root, p, pos, &e, nta, nextsep, &nextseplen, &rightpid);
+    byte * tmp = sep;
+    sep = nextsep;
+    nextsep = tmp;
+    seplen = nextseplen;
+    level++;
+  }
+  free(sep);
+  free(nextsep);
+}
+
+static void btree_remove_latched(int xid, pageid_t root, void * cmp_arg, Page * p, int op, int pos) {
+  btree_entry e;
+  btree_node_entry((btree_node*)p->memAddr, pos, &e);
+  void * nta = btree_begin_nta(xid, op, root, cmp_arg, &e);
+  btree_node_update(xid, p, OPERATION_BTREE_NODE_REMOVE, pos, &e);
+  TendNestedTopAction(xid, nta);
+}
+
+/**
+   @param undoable if zero, the changes are logged with no logical undo
+   (used to apply logical undos during abort).
+*/
+static int btree_insert(int xid, pageid_t root, void * cmp_arg, const byte * key, size_t keySize,
+                        const byte * value, size_t valueSize, int undoable) {
+  pageid_t path[BTREE_MAX_HEIGHT];
+  for(int i = 0; i < BTREE_MAX_HEIGHT; i++) { path[i] = INVALID_PAGE; }
+  Page * p = btree_descend(xid, root, 0, cmp_arg, key, keySize, path);
+  pageid_t leaf = p->id;
   unlock(p->rwlatch);
   releasePage(p);
-  return slot;
+
+  p = btree_latch_node(xid, leaf, 0, cmp_arg, key, keySize);
+  btree_node * n = (btree_node*)p->memAddr;
+  int found;
+  int pos = btree_leaf_search(n, btree_comparators[n->cmp_id], cmp_arg, key, keySize, &found);
+  if(found) {
+    btree_remove_latched(xid, root, cmp_arg, p, undoable ? OPERATION_BTREE_REMOVE : OPERATION_NOOP, pos);
+  }
+  // The logical undo of an insert only needs the key.
+  btree_entry e = { key, keySize, value, 0 };
+  void * nta = btree_begin_nta(xid, undoable ? OPERATION_BTREE_INSERT : OPERATION_NOOP, root, cmp_arg, &e);
+  e.vallen = valueSize;
+
+  byte * sep = malloc(BTREE_MAX_ENTRY_SIZE);
+  size_t seplen;
+  pageid_t rightpid;
+  if(btree_node_insert_latched(xid, root, p, pos, &e, nta, sep, &seplen, &rightpid)) {
+    btree_insert_separator(xid, root, 1, path, cmp_arg, sep, seplen, rightpid);
+  }
+  free(sep);
+  return found;
 }
-int TbtreeLookup(int xid, recordid rid, void * cmp_arg, byte * key, size_t keySize, byte ** value, size_t* valueSize) {
-  stasis_op_btree_page_header h;
-  Tread(xid, rid, (byte*)&h);
-  pageid_t * path;
+static int btree_remove(int xid, pageid_t root, void * cmp_arg, const byte * key, size_t keySize, int undoable) {
+  Page * p = btree_descend(xid, root, 0, cmp_arg, key, keySize, 0);
+  pageid_t leaf = p->id;
+  unlock(p->rwlatch);
+  releasePage(p);
+
+  p = btree_latch_node(xid, leaf, 0, cmp_arg, key, keySize);
+  btree_node * n = (btree_node*)p->memAddr;
   int found;
-  slotid_t slot = stasis_btree_helper(xid, h, key, keySize, &found, &path, btree_comparators[h.cmp_id], cmp_arg);
-  recordid slotrid = { path[h.height-1], slot, 0 };
-  free(path);
+  int pos = btree_leaf_search(n, btree_comparators[n->cmp_id], cmp_arg, key, keySize, &found);
   if(found) {
-    Page * p = loadPage(xid, slotrid.page);
-    readlock(p->rwlatch, 0);
-    slotrid.size = stasis_record_length_read(xid, p, slotrid);
-    btree_leaf_pair * buf = malloc(slotrid.size);
-    stasis_record_read(xid, p, slotrid, (byte*)buf);
-    *valueSize = slotrid.size - (buf->keylen + sizeof(btree_leaf_pair));
-    *value = malloc(*valueSize);
-    memcpy(*value, ((byte*)(buf+1))+buf->keylen, *valueSize);
-    unlock(p->rwlatch);
-    releasePage(p);
-  } else {
-    *value = 0;
-    *valueSize = INVALID_SLOT;
+    btree_remove_latched(xid, root, cmp_arg, p, undoable ? OPERATION_BTREE_REMOVE : OPERATION_NOOP, pos);
   }
+  btree_unlatch(p->id);
+  releasePage(p);
   return found;
 }
-int TbtreeInsert(int xid, recordid rid, void *cmp_arg, byte *key, size_t keySize, byte *value, size_t valueSize) {
-  stasis_op_btree_page_header h;
-  Tread(xid, rid, (byte*)&h);
-  pageid_t * path;
+
+static int op_btree_insert(const LogEntry * e, Page * p) {
+  const btree_arg * arg = stasis_log_entry_update_args_cptr(e);
+  const byte * key = (const byte*)(arg+1);
+  btree_insert(e->xid, arg->root, (void*)(uintptr_t)arg->cmp_arg, key, arg->keylen, key + arg->keylen, arg->vallen, 0);
+  return 0;
+}
+static int op_btree_remove(const LogEntry * e, Page * p) {
+  const btree_arg * arg = stasis_log_entry_update_args_cptr(e);
+  btree_remove(e->xid, arg->root, (void*)(uintptr_t)arg->cmp_arg, (const byte*)(arg+1), arg->keylen, 0);
+  return 0;
+}
+stasis_operation_impl stasis_op_impl_btree_insert() {
+  stasis_operation_impl o = {
+    OPERATION_BTREE_INSERT,
+    UNKNOWN_TYPE_PAGE,
+    OPERATION_NOOP,
+    OPERATION_BTREE_REMOVE,
+    op_btree_insert
+  };
+  return o;
+}
+stasis_operation_impl stasis_op_impl_btree_remove() {
+  stasis_operation_impl o = {
+    OPERATION_BTREE_REMOVE,
+    UNKNOWN_TYPE_PAGE,
+    OPERATION_NOOP,
+    OPERATION_BTREE_INSERT,
+    op_btree_remove
+  };
+  return o;
+}
+
+recordid TbtreeCreate(int xid, stasis_comparator_id_t cmp_id) {
+  recordid rid = { btree_alloc_node(xid), 0, 0 };
+  byte * buf = malloc(USABLE_SIZE_OF_PAGE);
+  btree_node_init(buf, 0, cmp_id);
+  TpageSetRange(xid, rid.page, 0, buf, USABLE_SIZE_OF_PAGE);
+  free(buf);
+  return rid;
+}
+
+int TbtreeLookup(int xid, recordid rid, void * cmp_arg, byte * key, size_t keySize, byte ** value, size_t* valueSize) {
+  Page * p = btree_descend(xid, rid.page, 0, cmp_arg, key, keySize, 0);
+  btree_node * n = (btree_node*)p->memAddr;
   int found;
-  slotid_t slot = stasis_btree_helper(xid, h, key, keySize, &found, &path, btree_comparators[h.cmp_id], cmp_arg);
-  recordid slotrid = {path[h.height-1], slot, 0};
-  Page *p = loadPage(xid, slotrid.page);
-  writelock(p->rwlatch,0);
+  int pos = btree_leaf_search(n, btree_comparators[n->cmp_id], cmp_arg, key, keySize, &found);
   if(found) {
-    // delete old value
-    stasis_record_free(xid, p, slotrid);
-    stasis_record_compact_slotids(xid, p); // could do better with different api
-  }
-  size_t sz = sizeof(btree_leaf_pair) + keySize + valueSize;
-  btree_leaf_pair *buf = malloc(sz);
-  buf->keylen = keySize;
-  memcpy(buf+1, key, keySize);
-  memcpy(((byte*)(buf+1))+keySize, value, valueSize);
-  recordid newrid = stasis_record_alloc_begin(xid, p, sz);
-  if(newrid.size != sz) {
-    // split leaf into two halves (based on slot count)
-    //pageid_t leftpage = p->id;
-    pageid_t rightpage = TpageAlloc(xid);
-    TinitializeSlottedPage(xid, rightpage);
-    Page * rightp = loadPage(xid, rightpage);
-    writelock(rightp->rwlatch,0);
-    const recordid lastrid = stasis_record_last(xid, p);
-    for(slotid_t i = lastrid.slot / 2; i <= lastrid.slot; i++) {
-      recordid leftrid = {p->id, i, 0};
-      leftrid.size = stasis_record_length_read(xid, p, leftrid);
-      recordid rightrid = stasis_record_alloc_begin(xid, rightp, leftrid.size);
-      stasis_record_alloc_done(xid, rightp, rightrid);
-      byte * buf = stasis_record_write_begin(xid, rightp, rightrid);
-      stasis_record_read(xid, p, leftrid, buf);
-      stasis_record_write_done(xid, rightp, rightrid, buf);
-      stasis_record_free(xid, p, leftrid);
-    }
-    stasis_record_compact(p);
-    stasis_record_compact_slotids(xid, p);
-    if(slotrid.slot < lastrid.slot / 2) {
-      // put into left page (p)
-      newrid = stasis_record_alloc_begin(xid, p, sz);
-    } else {
-      // put into right page(rightp)
-      slotrid.slot -= (lastrid.slot/2);
-      Page * swpp = p;
-      p = rightp;
-      rightp = swpp;
-      slotrid.slot = p->id;
-      newrid = stasis_record_alloc_begin(xid, p, sz);
-    }
-    unlock(rightp->rwlatch);
-    releasePage(rightp);
-    int next_to_split = h.height - 2;  // h.height-1 is the offset of the leaf, which we just split.
-    while(next_to_split >= 0) {
-      // insert value into intermediate node.  Break out of loop if the value fit...
-    }
-    // need new root.
-    h.height++;
-    h.root = TpageAlloc(xid);
-    TinitializeSlottedPage(xid, h.root);
-    TallocFromPage(xid, h.root, -1/*oldsz*/);
-    // TODO now what?!?
-  }
-  stasis_record_alloc_done(xid, p, newrid);
-  stasis_record_write(xid, p, newrid, (byte*)buf);
-  stasis_record_splice(xid, p, slotrid.slot, newrid.slot);
-  DEBUG("created new record: %lld %d -> %d %d\n", newrid.page, newrid.slot, slotrid.slot, newrid.size);
-  free(path);
+    btree_entry e;
+    btree_node_entry(n, pos, &e);
+    *valueSize = e.vallen;
+    *value = malloc(e.vallen);
+    memcpy(*value, e.val, e.vallen);
+  } else {
+    *value = 0;
+    *valueSize = INVALID_SLOT;
+  }
   unlock(p->rwlatch);
   releasePage(p);
   return found;
 }
+int TbtreeInsert(int xid, recordid rid, void *cmp_arg, byte *key, size_t keySize, byte *value, size_t valueSize) {
+  assert(keySize + valueSize <= BTREE_MAX_ENTRY_SIZE);
+  return btree_insert(xid, rid.page, cmp_arg, key, keySize, value, valueSize, 1);
+}
+int TbtreeRemove(int xid, recordid rid, void *cmp_arg, byte *key, size_t keySize) {
+  return btree_remove(xid, rid.page, cmp_arg, key, keySize, 1);
+}
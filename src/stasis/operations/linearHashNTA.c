@@ -3,6 +3,7 @@
 #include <stasis/util/latches.h>
 #include <stasis/transactional.h>
 #include <stasis/util/hash.h>
+#include <stasis/util/lhtable.h>
 #include <assert.h>
 #include <string.h>
 // The next two #includes are for deprecated code.
@@ -14,7 +15,9 @@
 
    @file
 
-   @todo Improve concurrency of linearHashNTA and linkedListNTA by leveraging Page.impl on the data structure header page?
+   Operations on different buckets run concurrently; see linear_hash_latch_t.
+
+   @todo linkedListNTA (used for fixed length entries) still has a global mutex.
 */
 
 static void linearHashNTAIterator_close(int xid, void * it);
@@ -22,8 +25,6 @@ static int  linearHashNTAIterator_next (int xid, void * it);
 static int  linearHashNTAIterator_key  (int xid, void * it, byte **key);
 static int  linearHashNTAIterator_value(int xid, void * it, byte **value);
 
-static pthread_mutex_t linear_hash_mutex;// = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
-
 typedef struct {
   recordid buckets;
   int keySize;
@@ -33,15 +34,54 @@ typedef struct {
   long numEntries;
 } lladd_hash_header;
 
+/**
+   Latches for one hash table.  They live in memory, and are looked up
+   by the table's header rid.
+
+   Bucket operations latch the bucket's stripe, and hold it until their
+   nested top action completes, so that physical undo after a crash
+   never clobbers another thread's changes to the bucket.  Splits latch
+   both the bucket being split and the new bucket, so operations on
+   other buckets proceed while a split is in progress.  Since the
+   bucket a key maps to only changes while both of these are latched,
+   re-checking the mapping after latching a stripe is enough to detect
+   a concurrent split.
+
+   Lock order: bucket stripes (in ascending order), then header_mut.
+ */
+#define LINEAR_HASH_LATCH_COUNT 64
+typedef struct {
+  /** Serializes read-modify-write cycles on the header record. */
+  pthread_mutex_t header_mut;
+  /** Set while a split is in progress; protected by header_mut. */
+  int splitting;
+  /**
+     The number of entries in the table, or -1 if it has not been read
+     from the header yet.  Protected by header_mut.
+   */
+  long numEntries;
+  /**
+     The last known (bits, nextSplit) pair, packed by
+     linear_hash_mapping().  Only a hint; callers re-read the header once
+     they hold a bucket latch.
+   */
+  uint64_t mapping;
+  rwl * bucket_latches[LINEAR_HASH_LATCH_COUNT];
+} linear_hash_latch_t;
+
+static inline uint64_t linear_hash_mapping(const lladd_hash_header * lhh) {
+  return (((uint64_t)lhh->nextSplit) << 8) | lhh->bits;
+}
+
+/** Protects linear_hash_latches; held only while looking up a table's latches. */
+static pthread_mutex_t linear_hash_mutex;
+static struct LH_ENTRY(table) * linear_hash_latches;
+
 static void noopTupDone(int xid, void * foo) { }
 
 void LinearHashNTAInit() {
-  // only need this function since PTHREAD_RECURSIVE_MUTEX_INITIALIZER is really broken...
-  pthread_mutexattr_t attr;
-  pthread_mutexattr_init(&attr);
-  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
-  pthread_mutex_init(&linear_hash_mutex, &attr);
-  pthread_mutexattr_destroy(&attr);
+  pthread_mutex_init(&linear_hash_mutex, 0);
+  linear_hash_latches = LH_ENTRY(create)(16);
 
   lladdIterator_def_t linearHashNTA_def = {
     linearHashNTAIterator_close,
@@ -53,12 +93,106 @@ void LinearHashNTAInit() {
   };
   lladdIterator_register(LINEAR_HASH_NTA_ITERATOR, linearHashNTA_def);
 }
+void LinearHashNTAWriteBackCounts() {
+  int xid = INVALID_XID;
+  struct LH_ENTRY(list) l;
+  const struct LH_ENTRY(pair_t) * pair;
+  LH_ENTRY(openlist)(linear_hash_latches, &l);
+  while((pair = LH_ENTRY(readlist)(&l))) {
+    linear_hash_latch_t * latch = pair->value;
+    const pageid_t * key = pair->key;
+    recordid hashHeader = { key[0], key[1], sizeof(lladd_hash_header) };
+    pthread_mutex_lock(&latch->header_mut);
+    long numEntries = latch->numEntries;
+    pthread_mutex_unlock(&latch->header_mut);
+    if(numEntries == -1) { continue; }
+    if(xid == INVALID_XID) { xid = Tbegin(); }
+    // Skip tables whose creation was rolled back.
+    if(TrecordType(xid, hashHeader) == INVALID_SLOT
+       || TrecordSize(xid, hashHeader) != sizeof(lladd_hash_header)) {
+      continue;
+    }
+    lladd_hash_header lhh;
+    Tread(xid, hashHeader, &lhh);
+    if(lhh.numEntries != numEntries) {
+      void * handle = TbeginNestedTopAction(xid, OPERATION_NOOP, 0, 0);
+      lhh.numEntries = numEntries;
+      Tset(xid, hashHeader, &lhh);
+      TendNestedTopAction(xid, handle);
+    }
+  }
+  LH_ENTRY(closelist)(&l);
+  if(xid != INVALID_XID) { Tcommit(xid); }
+}
 void LinearHashNTADeinit() {
+  struct LH_ENTRY(list) l;
+  const struct LH_ENTRY(pair_t) * pair;
+  LH_ENTRY(openlist)(linear_hash_latches, &l);
+  while((pair = LH_ENTRY(readlist)(&l))) {
+    linear_hash_latch_t * latch = pair->value;
+    for(int i = 0; i < LINEAR_HASH_LATCH_COUNT; i++) {
+      deletelock(latch->bucket_latches[i]);
+    }
+    pthread_mutex_destroy(&latch->header_mut);
+    free(latch);
+  }
+  LH_ENTRY(closelist)(&l);
+  LH_ENTRY(destroy)(linear_hash_latches);
   pthread_mutex_destroy(&linear_hash_mutex);
 }
 
+static linear_hash_latch_t * linear_hash_latch_get(recordid hashHeader) {
+  pageid_t key[2] = { hashHeader.page, hashHeader.slot };
+  pthread_mutex_lock(&linear_hash_mutex);
+  linear_hash_latch_t * ret = LH_ENTRY(find)(linear_hash_latches, key, sizeof(key));
+  if(!ret) {
+    ret = malloc(sizeof(*ret));
+    pthread_mutex_init(&ret->header_mut, 0);
+    ret->splitting = 0;
+    ret->numEntries = -1;
+    ret->mapping = 0;
+    for(int i = 0; i < LINEAR_HASH_LATCH_COUNT; i++) {
+      ret->bucket_latches[i] = initlock();
+    }
+    LH_ENTRY(insert)(linear_hash_latches, key, sizeof(key), ret);
+  }
+  pthread_mutex_unlock(&linear_hash_mutex);
+  return ret;
+}
+/**
+   Latch the bucket that key maps to.
+
+   @return the bucket's rid.  lhh is set to a copy of the header that is
+   valid (as far as bucket mappings go) until the bucket is unlatched.
+ */
+static recordid linear_hash_latch_bucket(int xid, recordid hashHeader, linear_hash_latch_t * l,
+                                         const byte * key, int keySize, int write, lladd_hash_header * lhh) {
+  uint64_t mapping = ATOMIC_READ_64(&l->header_mut, &l->mapping);
+  if(!mapping) {
+    Tread(xid, hashHeader, lhh);
+    mapping = linear_hash_mapping(lhh);
+  }
+  while(1) {
+    uint64_t b = stasis_linear_hash(key, keySize, mapping & 0xFF, mapping >> 8);
+    rwl * latch = l->bucket_latches[b % LINEAR_HASH_LATCH_COUNT];
+    if(write) { writelock(latch, 0); } else { readlock(latch, 0); }
+    Tread(xid, hashHeader, lhh);
+    mapping = linear_hash_mapping(lhh);
+    if(stasis_linear_hash(key, keySize, lhh->bits, lhh->nextSplit) == b) {
+      recordid bucket = lhh->buckets;
+      bucket.slot = b;
+      return bucket;
+    }
+    ATOMIC_WRITE_64(&l->header_mut, &l->mapping, mapping);
+    unlock(latch);
+  }
+}
+static void linear_hash_unlatch_bucket(linear_hash_latch_t * l, recordid bucket) {
+  unlock(l->bucket_latches[bucket.slot % LINEAR_HASH_LATCH_COUNT]);
+}
+
 /* private methods... */
-static void ThashSplitBucket(int xid, recordid hashHeader, lladd_hash_header * lhh);
+static void ThashSplitBucket(int xid, recordid hashHeader, linear_hash_latch_t * l);
 /** @todo Remove defined HASH_INIT_ARRAY_LIST_COUNT */
 #define HASH_INIT_ARRAY_LIST_COUNT (stasis_util_two_to_the(HASH_INIT_BITS))
 #define HASH_INIT_ARRAY_LIST_MULT    2
@@ -112,8 +246,133 @@ void ThashDelete(int xid, recordid hash) {
   abort();
 }
 
-static int __ThashInsert(int xid, recordid hashHeader, const byte* key, int keySize, const byte* value, int valueSize);
-static int __ThashRemove(int xid, recordid hashHeader, const byte * key, int keySize);
+/**
+   Remove key from a bucket that the caller has latched.
+
+   @param op the logical undo of the removal: OPERATION_LINEAR_HASH_REMOVE,
+   or OPERATION_NOOP if we are applying a logical undo.
+ */
+static int linear_hash_bucket_remove(int xid, recordid hashHeader, lladd_hash_header * lhh, recordid bucket,
+                                     const byte * key, int keySize, int op) {
+  int variable = lhh->keySize == VARIABLE_LENGTH || lhh->valueSize == VARIABLE_LENGTH;
+  recordid bucketList;
+  if(variable) {
+    Tread(xid, bucket, &bucketList);
+  } else {
+    assert(lhh->keySize == keySize);
+  }
+  void * handle;
+  if(op == OPERATION_NOOP) {
+    handle = TbeginNestedTopAction(xid, OPERATION_NOOP, 0, 0);
+  } else {
+    byte * value;
+    int valueSize = variable ? TpagedListFind(xid, bucketList, key, keySize, &value)
+                             : TlinkedListFind(xid, bucket, key, keySize, &value);
+    if(valueSize == -1) {
+      return 0;
+    }
+    int argSize = sizeof(linearHash_remove_arg) + keySize + valueSize;
+    linearHash_remove_arg * arg = calloc(1,argSize);
+    arg->hashHeader = hashHeader;
+    arg->keySize = keySize;
+    arg->valueSize = valueSize;
+    memcpy(arg+1, key, keySize);
+    memcpy((byte*)(arg+1)+keySize, value, valueSize);
+    handle = TbeginNestedTopAction(xid, op, (byte*)arg, argSize);
+    free(arg);
+    free(value);
+  }
+  int ret = variable ? TpagedListRemove(xid, bucketList, key, keySize)
+                     : TlinkedListRemove(xid, bucket, key, keySize);
+  TendNestedTopAction(xid, handle);
+  return ret;
+}
+/** Insert key into a bucket that the caller has latched, and that does not contain key. */
+static void linear_hash_bucket_insert(int xid, recordid hashHeader, lladd_hash_header * lhh, recordid bucket,
+                                      const byte * key, int keySize, const byte * value, int valueSize, int op) {
+  void * handle;
+  if(op == OPERATION_NOOP) {
+    handle = TbeginNestedTopAction(xid, OPERATION_NOOP, 0, 0);
+  } else {
+    int argSize = sizeof(linearHash_insert_arg)+keySize;
+    linearHash_insert_arg * arg = calloc(1,argSize);
+    arg->hashHeader = hashHeader;
+    arg->keySize = keySize;
+    memcpy(arg+1, key, keySize);
+    handle = TbeginNestedTopAction(xid, op, (byte*)arg, argSize);
+    free(arg);
+  }
+  if(lhh->keySize == VARIABLE_LENGTH || lhh->valueSize == VARIABLE_LENGTH) {
+    recordid bucketList;
+    Tread(xid, bucket, &bucketList);
+    TpagedListInsert(xid, bucketList, key, keySize, value, valueSize);
+  } else {
+    assert(lhh->keySize == keySize); assert(lhh->valueSize == valueSize);
+    TlinkedListInsert(xid, bucket, key, keySize, value, valueSize);
+  }
+  TendNestedTopAction(xid, handle);
+}
+/**
+   Adjust the entry count, and split a bucket if the table is too full.
+
+   The count is only used to decide when to split, so it is kept in
+   memory, and written back to the header by splits (which update the
+   header anyway) and by LinearHashNTAWriteBackCounts() at Tdeinit().
+   This keeps inserts and removes from logging updates to the (shared)
+   header record.  After a crash, the header misses the changes since
+   the last write back, so the table is fuller than its count says
+   until later inserts push the count past the next split threshold.
+ */
+static void linear_hash_update_count(int xid, recordid hashHeader, linear_hash_latch_t * l, const lladd_hash_header * lhh, int delta) {
+  pthread_mutex_lock(&l->header_mut);
+  if(l->numEntries == -1) {
+    l->numEntries = lhh->numEntries;
+  }
+  l->numEntries += delta;
+  // lhh may be stale by now, but this is just a heuristic.
+  int split = delta > 0 && !l->splitting &&
+      l->numEntries > (int)((double)(lhh->nextSplit
+                        + stasis_util_two_to_the(lhh->bits-1)) * HASH_FILL_FACTOR);
+  if(split) { l->splitting = 1; }
+  pthread_mutex_unlock(&l->header_mut);
+  if(split) {
+    ThashSplitBucket(xid, hashHeader, l);
+  }
+}
+
+/**
+   @param undoable zero if this is a logical undo, which must not log
+   further logical undos.
+   @return 1 if the key was already present.
+*/
+static int linear_hash_insert(int xid, recordid hashHeader, const byte* key, int keySize, const byte* value, int valueSize, int undoable) {
+  hashHeader.size = sizeof(lladd_hash_header);
+  linear_hash_latch_t * l = linear_hash_latch_get(hashHeader);
+  lladd_hash_header lhh;
+  recordid bucket = linear_hash_latch_bucket(xid, hashHeader, l, key, keySize, 1, &lhh);
+  int ret = linear_hash_bucket_remove(xid, hashHeader, &lhh, bucket, key, keySize,
+                                      undoable ? OPERATION_LINEAR_HASH_REMOVE : OPERATION_NOOP);
+  linear_hash_bucket_insert(xid, hashHeader, &lhh, bucket, key, keySize, value, valueSize,
+                            undoable ? OPERATION_LINEAR_HASH_INSERT : OPERATION_NOOP);
+  linear_hash_unlatch_bucket(l, bucket);
+  if(!ret) {
+    linear_hash_update_count(xid, hashHeader, l, &lhh, 1);
+  }
+  return ret;
+}
+static int linear_hash_remove(int xid, recordid hashHeader, const byte * key, int keySize, int undoable) {
+  hashHeader.size = sizeof(lladd_hash_header);
+  linear_hash_latch_t * l = linear_hash_latch_get(hashHeader);
+  lladd_hash_header lhh;
+  recordid bucket = linear_hash_latch_bucket(xid, hashHeader, l, key, keySize, 1, &lhh);
+  int ret = linear_hash_bucket_remove(xid, hashHeader, &lhh, bucket, key, keySize,
+                                      undoable ? OPERATION_LINEAR_HASH_REMOVE : OPERATION_NOOP);
+  linear_hash_unlatch_bucket(l, bucket);
+  if(ret) {
+    linear_hash_update_count(xid, hashHeader, l, &lhh, -1);
+  }
+  return ret;
+}
 
 static int op_linear_hash_insert(const LogEntry* e, Page* p) {
   const linearHash_remove_arg * args = stasis_log_entry_update_args_cptr(e);
@@ -125,9 +384,7 @@ static int op_linear_hash_insert(const LogEntry* e, Page* p) {
 
   byte * key = (byte*)(args+1);
   byte * value = ((byte*)(args+1))+ keySize;
-  pthread_mutex_lock(&linear_hash_mutex);
-  __ThashInsert(e->xid, hashHeader, key, keySize, value, valueSize);
-  pthread_mutex_unlock(&linear_hash_mutex);
+  linear_hash_insert(e->xid, hashHeader, key, keySize, value, valueSize, 0);
   return 0;
 }
 static int op_linear_hash_remove(const LogEntry* e, Page* p) {
@@ -137,9 +394,7 @@ static int op_linear_hash_remove(const LogEntry* e, Page* p) {
 
   byte * key = (byte*)(args + 1);
 
-  pthread_mutex_lock(&linear_hash_mutex);
-  __ThashRemove(e->xid, hashHeader, key, keySize);
-  pthread_mutex_unlock(&linear_hash_mutex);
+  linear_hash_remove(e->xid, hashHeader, key, keySize, 0);
 
   return 0;
 }
@@ -165,124 +420,10 @@ stasis_operation_impl stasis_op_impl_linear_hash_remove() {
 }
 
 int ThashInsert(int xid, recordid hashHeader, const byte* key, int keySize, const byte* value, int valueSize) {
-  /* XXX slow, but doesn't generate any log entries unless the key exists */
-  int ret = ThashRemove(xid, hashHeader, key, keySize);
-  hashHeader.size = sizeof(lladd_hash_header);
-  pthread_mutex_lock(&linear_hash_mutex);
-  int argSize = sizeof(linearHash_insert_arg)+keySize;
-  linearHash_insert_arg * arg = calloc(1,argSize);
-  arg->hashHeader = hashHeader;
-  arg->keySize = keySize;
-  memcpy(arg+1, key, keySize);
-
-  void * handle;
-  handle = TbeginNestedTopAction(xid, OPERATION_LINEAR_HASH_INSERT, (byte*)arg, argSize);
-  free(arg);
-  __ThashInsert(xid, hashHeader, key, keySize, value, valueSize);
-
-  TendNestedTopAction(xid, handle);
-
-  pthread_mutex_unlock(&linear_hash_mutex);
-
-  return ret;
-}
-static int __ThashInsert(int xid, recordid hashHeader, const byte* key, int keySize, const byte* value, int valueSize) {
-  lladd_hash_header lhh;
-  Tread(xid, hashHeader, &lhh);
-
-  lhh.numEntries ++;
-
-  if(lhh.keySize == VARIABLE_LENGTH || lhh.valueSize == VARIABLE_LENGTH) {
-    if(lhh.numEntries > (int)((double)(lhh.nextSplit
-                        + stasis_util_two_to_the(lhh.bits-1)) * (HASH_FILL_FACTOR))) {
-  ThashSplitBucket(xid, hashHeader, &lhh);
-    }
-  } else {
-    if(lhh.numEntries > (int)((double)(lhh.nextSplit
-                        + stasis_util_two_to_the(lhh.bits-1)) * HASH_FILL_FACTOR)) {
-  ThashSplitBucket(xid, hashHeader, &lhh);
-    }
-  }
-
-  recordid bucket = lhh.buckets;
-  bucket.slot = stasis_linear_hash(key, keySize, lhh.bits, lhh.nextSplit);
-
-  int ret;
-
-  if(lhh.keySize == VARIABLE_LENGTH || lhh.valueSize == VARIABLE_LENGTH) {
-
-    recordid bucketList;
-
-    Tread(xid, bucket, &bucketList);
-
-    ret = TpagedListRemove(xid, bucketList, key, keySize);
-    TpagedListInsert(xid, bucketList, key, keySize, value, valueSize);
-
-  } else {
-    assert(lhh.keySize == keySize); assert(lhh.valueSize == valueSize);
-    ret = TlinkedListRemove(xid, bucket, key, keySize);
-    TlinkedListInsert(xid, bucket, key, keySize, value, valueSize);
-  }
-  if(ret) { lhh.numEntries--; }
-  Tset(xid, hashHeader, &lhh);
-
-  return ret;
+  return linear_hash_insert(xid, hashHeader, key, keySize, value, valueSize, 1);
 }
 int ThashRemove(int xid, recordid hashHeader, const byte * key, int keySize) {
-  hashHeader.size = sizeof(lladd_hash_header);
-  byte * value;
-  int valueSize;
-  int ret;
-
-  pthread_mutex_lock(&linear_hash_mutex);
-  valueSize = ThashLookup(xid, hashHeader, key, keySize, &value);
-
-  if(valueSize == -1) {
-    pthread_mutex_unlock(&linear_hash_mutex);
-    return 0;
-  }
-
-  int argSize = sizeof(linearHash_remove_arg) + keySize + valueSize;
-  linearHash_remove_arg * arg = calloc(1,argSize);
-  arg->hashHeader = hashHeader;
-  arg->keySize = keySize;
-  arg->valueSize = valueSize;
-  memcpy(arg+1, key, keySize);
-  memcpy((byte*)(arg+1)+keySize, value, valueSize);
-  void * handle;
-
-  handle = TbeginNestedTopAction(xid, OPERATION_LINEAR_HASH_REMOVE, (byte*)arg, argSize);
-  free(arg);
-  free(value);
-
-  ret = __ThashRemove(xid, hashHeader, key, keySize);
-  TendNestedTopAction(xid, handle);
-  pthread_mutex_unlock(&linear_hash_mutex);
-
-  return ret;
-}
-
-static int __ThashRemove(int xid, recordid hashHeader, const byte * key, int keySize) {
-  int ret;
-
-  lladd_hash_header lhh;
-  Tread(xid, hashHeader, &lhh);
-  lhh.numEntries--;
-  Tset(xid, hashHeader, &lhh);
-
-  recordid bucket = lhh.buckets;
-  bucket.slot = stasis_linear_hash(key, keySize, lhh.bits, lhh.nextSplit);
-
-  if(lhh.keySize == VARIABLE_LENGTH || lhh.valueSize == VARIABLE_LENGTH) {
-    recordid bucketList;
-    Tread(xid, bucket, &bucketList);
-    ret = TpagedListRemove(xid, bucketList, key, keySize);
-  } else {
-    assert(lhh.keySize == keySize);
-    ret = TlinkedListRemove(xid, bucket, key, keySize);
-  }
-
-  return ret;
+  return linear_hash_remove(xid, hashHeader, key, keySize, 1);
 }
 
 int ThashLookup(int xid, recordid hashHeader, const byte * key, int keySize, byte ** value) {
@@ -290,13 +431,8 @@ int ThashLookup(int xid, recordid hashHeader, const byte * key, int keySize, byt
   hashHeader.size = sizeof(lladd_hash_header);
   int ret;
 
-  // This whole thing is safe since the callee's do not modify global state...
-
-  pthread_mutex_lock(&linear_hash_mutex);
-  Tread(xid, hashHeader, &lhh);
-
-  recordid bucket = lhh.buckets;
-  bucket.slot = stasis_linear_hash(key, keySize, lhh.bits, lhh.nextSplit);
+  linear_hash_latch_t * l = linear_hash_latch_get(hashHeader);
+  recordid bucket = linear_hash_latch_bucket(xid, hashHeader, l, key, keySize, 0, &lhh);
 
   if(lhh.keySize == VARIABLE_LENGTH || lhh.valueSize == VARIABLE_LENGTH) {
     recordid bucketList;
@@ -306,41 +442,66 @@ int ThashLookup(int xid, recordid hashHeader, const byte * key, int keySize, byt
     assert(lhh.keySize == keySize);
     ret = TlinkedListFind(xid, bucket, key, keySize, value);
   }
-  pthread_mutex_unlock(&linear_hash_mutex);
+  linear_hash_unlatch_bucket(l, bucket);
 
   return ret;
 }
-static void ThashSplitBucket(int xid, recordid hashHeader, lladd_hash_header * lhh) {
+/**
+   Split the next bucket.  The caller must have set l->splitting.
+
+   The split is a nested top action with no logical undo; it is never
+   rolled back once it completes, even if the transaction that
+   triggered it aborts.
+ */
+static void ThashSplitBucket(int xid, recordid hashHeader, linear_hash_latch_t * l) {
+  lladd_hash_header lhh;
+  // Only splits change nextSplit and bits, and we are the only splitter.
+  pthread_mutex_lock(&l->header_mut);
+  Tread(xid, hashHeader, &lhh);
+  pthread_mutex_unlock(&l->header_mut);
+
+  long old_bucket = lhh.nextSplit;
+  long new_bucket = old_bucket + stasis_util_two_to_the(lhh.bits-1);
+  int old_latch = old_bucket % LINEAR_HASH_LATCH_COUNT;
+  int new_latch = new_bucket % LINEAR_HASH_LATCH_COUNT;
+  writelock(l->bucket_latches[old_latch < new_latch ? old_latch : new_latch], 0);
+  if(old_latch != new_latch) {
+    writelock(l->bucket_latches[old_latch < new_latch ? new_latch : old_latch], 0);
+  }
+  void * handle = TbeginNestedTopAction(xid, OPERATION_NOOP, 0, 0);
 
-  long old_bucket = lhh->nextSplit;
-  long new_bucket = old_bucket + stasis_util_two_to_the(lhh->bits-1);
-  recordid old_bucket_rid = lhh->buckets;
-  recordid new_bucket_rid = lhh->buckets;
+  recordid old_bucket_rid = lhh.buckets;
+  recordid new_bucket_rid = lhh.buckets;
   old_bucket_rid.slot = old_bucket;
   new_bucket_rid.slot = new_bucket;
   if(!(new_bucket % HASH_INIT_ARRAY_LIST_COUNT)) {
-    TarrayListExtend(xid, lhh->buckets, HASH_INIT_ARRAY_LIST_COUNT);
+    TarrayListExtend(xid, lhh.buckets, HASH_INIT_ARRAY_LIST_COUNT);
   }
   recordid new_bucket_list; // will be uninitialized if we have fixed length entries.
-  if(lhh->keySize == VARIABLE_LENGTH || lhh->valueSize == VARIABLE_LENGTH) {
+  if(lhh.keySize == VARIABLE_LENGTH || lhh.valueSize == VARIABLE_LENGTH) {
     new_bucket_list = TpagedListAlloc(xid);
     Tset(xid, new_bucket_rid, &new_bucket_list);
   } else {
 #ifdef ARRAY_LIST_OLD_ALLOC
-    byte * entry = calloc(1, lhh->buckets.size);
+    byte * entry = calloc(1, lhh.buckets.size);
     Tset(xid, new_bucket_rid, entry);
     free(entry);
 #endif
   }
-  if(lhh->nextSplit < stasis_util_two_to_the(lhh->bits-1)-1) {
-    lhh->nextSplit++;
+  pthread_mutex_lock(&l->header_mut);
+  lhh.numEntries = l->numEntries;
+  if(lhh.nextSplit < stasis_util_two_to_the(lhh.bits-1)-1) {
+    lhh.nextSplit++;
   } else {
-    lhh->nextSplit = 0;
-    lhh->bits++;
+    lhh.nextSplit = 0;
+    lhh.bits++;
   }
+  Tset(xid, hashHeader, &lhh);
+  ATOMIC_WRITE_64(&l->header_mut, &l->mapping, linear_hash_mapping(&lhh));
+  pthread_mutex_unlock(&l->header_mut);
 
   /** @todo linearHashNTA's split bucket should use the 'move' function call. */
-  if(lhh->keySize == VARIABLE_LENGTH || lhh->valueSize == VARIABLE_LENGTH) {
+  if(lhh.keySize == VARIABLE_LENGTH || lhh.valueSize == VARIABLE_LENGTH) {
     recordid old_bucket_list;
     Tread(xid, old_bucket_rid, &old_bucket_list);
 
@@ -349,7 +510,7 @@ static void ThashSplitBucket(int xid, recordid hashHeader, lladd_hash_header * l
     byte *key, *value;
     int keySize, valueSize;
     while(TpagedListNext(xid, pit, &key, &keySize, &value, &valueSize)) {
-      if(stasis_linear_hash(key, keySize, lhh->bits, lhh->nextSplit) != old_bucket) {
+      if(stasis_linear_hash(key, keySize, lhh.bits, lhh.nextSplit) != old_bucket) {
         TpagedListRemove(xid, old_bucket_list, key, keySize);
         TpagedListInsert(xid, new_bucket_list, key, keySize, value, valueSize);
       }
@@ -358,13 +519,13 @@ static void ThashSplitBucket(int xid, recordid hashHeader, lladd_hash_header * l
     }
     TpagedListClose(xid,pit);
   } else {
-    stasis_linkedList_iterator * it = TlinkedListIterator(xid, old_bucket_rid, lhh->keySize, lhh->valueSize);
+    stasis_linkedList_iterator * it = TlinkedListIterator(xid, old_bucket_rid, lhh.keySize, lhh.valueSize);
     byte * key, *value;
     int keySize, valueSize;
     while(TlinkedListNext(xid, it, &key, &keySize, &value, &valueSize)) {
-      assert(valueSize == lhh->valueSize);
-      assert(keySize == lhh->keySize);
-      if(stasis_linear_hash(key, keySize, lhh->bits, lhh->nextSplit) != old_bucket) {
+      assert(valueSize == lhh.valueSize);
+      assert(keySize == lhh.keySize);
+      if(stasis_linear_hash(key, keySize, lhh.bits, lhh.nextSplit) != old_bucket) {
         TlinkedListRemove(xid, old_bucket_rid, key, keySize);
         TlinkedListInsert(xid, new_bucket_rid, key, keySize, value, valueSize);
       }
@@ -374,7 +535,14 @@ static void ThashSplitBucket(int xid, recordid hashHeader, lladd_hash_header * l
     TlinkedListClose(xid, it);
   }
 
-  return;
+  TendNestedTopAction(xid, handle);
+  unlock(l->bucket_latches[old_latch]);
+  if(old_latch != new_latch) {
+    unlock(l->bucket_latches[new_latch]);
+  }
+  pthread_mutex_lock(&l->header_mut);
+  l->splitting = 0;
+  pthread_mutex_unlock(&l->header_mut);
 }
 lladd_hash_iterator * ThashIterator(int xid, recordid hashHeader, int keySize, int valueSize) {
   hashHeader.size = sizeof(lladd_hash_header);
@@ -394,7 +562,10 @@ lladd_hash_iterator * ThashIterator(int xid, recordid hashHeader, int keySize, i
     it->it = NULL;
     recordid bucketList;
     assert(it->bucket.size == sizeof(bucketList));
-    Tread(xid, it->bucket, &bucketList);
+    // The bucket array is read in order, so keep its pages out of the
+    // shared cache.  (The bucket lists are scattered, and are read with loadPage().)
+    it->h = stasis_buffer_manager_open_sequential_handle();
+    TarrayListRead(xid, it->h, it->bucket, &bucketList);
     it->pit= TpagedListIterator(xid, bucketList);
   } else {
     it->pit = NULL;
@@ -424,12 +595,16 @@ int ThashNext(int xid, lladd_hash_iterator * it, byte ** key, int * keySize, byt
       it->bucket.slot++;
       if(it->bucket.slot < it->numBuckets) {
         recordid bucketList;
-        Tread(xid, it->bucket, &bucketList);
+        TarrayListRead(xid, it->h, it->bucket, &bucketList);
         TpagedListClose(xid,it->pit);
         it->pit = TpagedListIterator(xid, bucketList);
       } else {
         TpagedListClose(xid,it->pit);
         it->pit = 0;
+        if(it->h) {
+          stasis_buffer_manager_close_handle(it->h);
+          it->h = 0;
+        }
         return 0;
       }
     }
@@ -444,6 +619,9 @@ void ThashDone(int xid, lladd_hash_iterator * it) {
   if(it->pit) {
     TpagedListClose(xid, it->pit);
   }
+  if(it->h) {
+    stasis_buffer_manager_close_handle(it->h);
+  }
   free(it);
 }
 
@@ -2,6 +2,8 @@
 #include <stasis/bufferManager.h>
 #include <stasis/operations.h>
 #include <stasis/logger/logger2.h>
+#include <stasis/util/redblack.h>
+#include <stasis/util/random.h>
 
 #include <assert.h>
 
@@ -19,6 +21,264 @@ static int  readBoundaryTag(int xid, pageid_t page, boundary_tag* tag);
 static void TsetBoundaryTag(int xid, pageid_t page, boundary_tag* tag);
 static void TdeallocBoundaryTag(int xid, pageid_t page);
 
+/*
+  Volatile index of the boundary tags.
+
+  The boundary tags form a doubly linked list that is embedded in the
+  page file, so walking it costs a page load per region.  The index
+  caches every tag in the list, and is kept up to date by
+  TallocBoundaryTag() and TsetBoundaryTag().  It is rebuilt from the
+  page file the first time it is needed after regionsInit(), which
+  happens after recovery is complete.  Like the boundary tags
+  themselves, it is protected by region_mutex.
+
+  It consists of:
+
+    - A treap of the tags, keyed by page, in which each node counts the
+      REGION_ZONED tags in its subtree.  This finds the nth active
+      region, and the next active region, in O(log n) time.
+
+    - A tree of the REGION_VACANT tags, ordered by (size, page), for
+      best fit allocation.
+
+    - The set of REGION_VACANT tags that may need to be coalesced with
+      their neighbors.  TregionAlloc() coalesces these before it picks a
+      region, instead of walking (and coalescing) the whole list.
+*/
+typedef struct region_index_node {
+  pageid_t page;
+  boundary_tag tag;
+  uint64_t prio;
+  pageid_t zoned;
+  struct region_index_node * left;
+  struct region_index_node * right;
+} region_index_node;
+
+typedef struct {
+  pageid_t size;
+  pageid_t page;
+} region_index_free_entry;
+
+static int region_index_valid = 0;
+static region_index_node * region_index_root = 0;
+static pageid_t region_index_count = 0;
+static struct rbtree * region_index_free = 0;
+static struct rbtree * region_index_pending = 0;
+
+#ifdef TSEARCH
+static int region_index_cmp_size_page(const void *ap, const void *bp) {
+#else
+static int region_index_cmp_size_page(const void *ap, const void *bp, const void *ign) {
+#endif
+  const region_index_free_entry *a = ap, *b = bp;
+  return (a->size < b->size) ? -1 :
+        ((a->size > b->size) ? 1 :
+        ((a->page < b->page) ? -1 :
+        ((a->page > b->page) ? 1 : 0)));
+}
+#ifdef TSEARCH
+static int region_index_cmp_page(const void *ap, const void *bp) {
+#else
+static int region_index_cmp_page(const void *ap, const void *bp, const void *ign) {
+#endif
+  const region_index_free_entry *a = ap, *b = bp;
+  return (a->page < b->page) ? -1 :
+        ((a->page > b->page) ? 1 : 0);
+}
+static void region_index_set_add(struct rbtree * t, pageid_t size, pageid_t page) {
+  region_index_free_entry * e = malloc(sizeof(*e));
+  e->size = size;
+  e->page = page;
+  const void * old = rbsearch(e, t);
+  if(old != e) { free(e); }
+}
+static void region_index_set_remove(struct rbtree * t, pageid_t size, pageid_t page) {
+  region_index_free_entry q = { size, page };
+  const void * old = rbdelete(&q, t);
+  if(old) { free((void*)old); }
+}
+static void region_index_set_clear(struct rbtree * t) {
+  region_index_free_entry q = { 0, 0 };
+  const region_index_free_entry * e;
+  while((e = rblookup(RB_LUGTEQ, &q, t))) {
+    rbdelete(e, t);
+    free((void*)e);
+  }
+  rbdestroy(t);
+}
+
+static pageid_t ri_zoned(region_index_node * n) {
+  return n ? n->zoned : 0;
+}
+static void ri_fix(region_index_node * n) {
+  n->zoned = ri_zoned(n->left) + ri_zoned(n->right) + (n->tag.status == REGION_ZONED);
+}
+static region_index_node * ri_rotate_right(region_index_node * n) {
+  region_index_node * l = n->left;
+  n->left = l->right;
+  l->right = n;
+  ri_fix(n);
+  ri_fix(l);
+  return l;
+}
+static region_index_node * ri_rotate_left(region_index_node * n) {
+  region_index_node * r = n->right;
+  n->right = r->left;
+  r->left = n;
+  ri_fix(n);
+  ri_fix(r);
+  return r;
+}
+/** Insert or overwrite a tag.  Sets *old, and returns true in *existed if the tag was already indexed. */
+static region_index_node * ri_put(region_index_node * n, pageid_t page, const boundary_tag * tag, boundary_tag * old, int * existed) {
+  if(!n) {
+    n = malloc(sizeof(*n));
+    n->page = page;
+    n->tag = *tag;
+    n->prio = stasis_util_random64(UINT64_MAX);
+    n->left = n->right = 0;
+    region_index_count++;
+    *existed = 0;
+  } else if(page == n->page) {
+    *old = n->tag;
+    n->tag = *tag;
+    *existed = 1;
+  } else if(page < n->page) {
+    n->left = ri_put(n->left, page, tag, old, existed);
+    if(n->left->prio > n->prio) { return ri_rotate_right(n); }
+  } else {
+    n->right = ri_put(n->right, page, tag, old, existed);
+    if(n->right->prio > n->prio) { return ri_rotate_left(n); }
+  }
+  ri_fix(n);
+  return n;
+}
+static region_index_node * ri_merge(region_index_node * l, region_index_node * r) {
+  if(!l) { return r; }
+  if(!r) { return l; }
+  if(l->prio > r->prio) {
+    l->right = ri_merge(l->right, r);
+    ri_fix(l);
+    return l;
+  } else {
+    r->left = ri_merge(l, r->left);
+    ri_fix(r);
+    return r;
+  }
+}
+static region_index_node * ri_remove(region_index_node * n, pageid_t page, boundary_tag * old, int * existed) {
+  if(!n) {
+    *existed = 0;
+    return 0;
+  }
+  if(page == n->page) {
+    region_index_node * ret = ri_merge(n->left, n->right);
+    *old = n->tag;
+    *existed = 1;
+    free(n);
+    region_index_count--;
+    return ret;
+  } else if(page < n->page) {
+    n->left = ri_remove(n->left, page, old, existed);
+  } else {
+    n->right = ri_remove(n->right, page, old, existed);
+  }
+  ri_fix(n);
+  return n;
+}
+static region_index_node * ri_find(pageid_t page) {
+  region_index_node * n = region_index_root;
+  while(n && n->page != page) {
+    n = page < n->page ? n->left : n->right;
+  }
+  return n;
+}
+/** @return the active tag with zero-based rank k, or NULL. */
+static region_index_node * ri_nth_zoned(pageid_t k) {
+  region_index_node * n = region_index_root;
+  while(n) {
+    pageid_t l = ri_zoned(n->left);
+    if(k < l) {
+      n = n->left;
+    } else {
+      k -= l;
+      if(n->tag.status == REGION_ZONED) {
+        if(!k) { return n; }
+        k--;
+      }
+      n = n->right;
+    }
+  }
+  return 0;
+}
+/** @return the first active tag stored after page, or NULL. */
+static region_index_node * ri_next_zoned(region_index_node * n, pageid_t page) {
+  if(!ri_zoned(n)) { return 0; }
+  if(n->page <= page) { return ri_next_zoned(n->right, page); }
+  region_index_node * ret = ri_next_zoned(n->left, page);
+  if(ret) { return ret; }
+  if(n->tag.status == REGION_ZONED) { return n; }
+  return ri_next_zoned(n->right, page);
+}
+static void ri_destroy(region_index_node * n) {
+  if(!n) { return; }
+  ri_destroy(n->left);
+  ri_destroy(n->right);
+  free(n);
+}
+
+static void region_index_clear() {
+  if(region_index_valid) {
+    ri_destroy(region_index_root);
+    region_index_set_clear(region_index_free);
+    region_index_set_clear(region_index_pending);
+  }
+  region_index_root = 0;
+  region_index_count = 0;
+  region_index_free = 0;
+  region_index_pending = 0;
+  region_index_valid = 0;
+}
+/** Record a new value for the boundary tag on page.  Caller holds region_mutex. */
+static void region_index_put(pageid_t page, const boundary_tag * tag) {
+  if(!region_index_valid) { return; }
+  boundary_tag old;
+  int existed;
+  if(tag->status == REGION_CONDEMNED) {
+    // Condemned tags have been unlinked from the list of regions.
+    region_index_root = ri_remove(region_index_root, page, &old, &existed);
+  } else {
+    region_index_root = ri_put(region_index_root, page, tag, &old, &existed);
+  }
+  if(existed && old.status == REGION_VACANT) {
+    region_index_set_remove(region_index_free, old.size, page);
+  }
+  if(tag->status == REGION_VACANT) {
+    region_index_set_add(region_index_free, tag->size, page);
+    if(!existed || old.status != REGION_VACANT) {
+      region_index_set_add(region_index_pending, 0, page);
+    }
+  }
+}
+/** Build the index from the page file if necessary.  Caller holds region_mutex. */
+static void region_index_ensure(int xid) {
+  if(region_index_valid) { return; }
+  region_index_free = rbinit(region_index_cmp_size_page, 0);
+  region_index_pending = rbinit(region_index_cmp_page, 0);
+  region_index_valid = 1;
+  pageid_t page = 0;
+  boundary_tag t;
+  int ret = readBoundaryTag(xid, page, &t);
+  assert(ret);
+  while(1) {
+    region_index_put(page, &t);
+    if(t.size == PAGEID_T_MAX) { break; }
+    page += t.size + 1;
+    ret = readBoundaryTag(xid, page, &t);
+    assert(ret);
+  }
+}
+
 static int alloc_boundary_tag(int xid, Page *p, const boundary_tag *arg) {
  stasis_page_slotted_initialize_page(p);
  recordid rid = {p->id, 0, sizeof(boundary_tag)};
@@ -87,6 +347,7 @@ static void TallocBoundaryTag(int xid, pageid_t page, boundary_tag* tag) {
   //printf("Alloc boundary tag at %d = { %d, %d, %d }\n", page, tag->size, tag->prev_size, tag->status);
   assert(holding_mutex == pthread_self());
   Tupdate(xid, page, tag, sizeof(boundary_tag), OPERATION_ALLOC_BOUNDARY_TAG);
+  region_index_put(page, tag);
 }
 
 int readBoundaryTag(int xid, pageid_t page, boundary_tag* tag) {
@@ -125,6 +386,7 @@ static void TsetBoundaryTag(int xid, pageid_t page, boundary_tag* tag) {
   // Now, set the record:
   recordid rid = { page, 0, sizeof(boundary_tag) };
   Tset(xid, rid, tag);
+  region_index_put(page, tag);
 }
 
 static void TdeallocBoundaryTag(int xid, pageid_t page) {
@@ -141,6 +403,11 @@ static void TdeallocBoundaryTag(int xid, pageid_t page) {
 }
 
 void regionsInit(stasis_log_t *log) {
+  // Recovery may have changed the boundary tags; rebuild the index on demand.
+  pthread_mutex_lock(&region_mutex);
+  region_index_clear();
+  pthread_mutex_unlock(&region_mutex);
+
   Page * p = loadPage(-1, 0);
 
   holding_mutex = pthread_self();
@@ -165,25 +432,28 @@ void regionsInit(stasis_log_t *log) {
   holding_mutex = 0;
   releasePage(p);
 }
+void regionsDeinit() {
+  pthread_mutex_lock(&region_mutex);
+  region_index_clear();
+  pthread_mutex_unlock(&region_mutex);
+}
 int TregionNextBoundaryTag(int xid, pageid_t* pid, boundary_tag * tag, int type) {
   pthread_mutex_lock(&region_mutex);
   assert(0 == holding_mutex);
   holding_mutex = pthread_self();
+  region_index_ensure(xid);
   // XXX can't distinguish between EOF and error (error could happen if the boundary tag is consolidated in race with our caller)
-  int ret = readBoundaryTag(xid, *pid-1, tag);
+  int ret = ri_find(*pid-1) || readBoundaryTag(xid, *pid-1, tag);
   if(ret) {
-    while(1) {
-      if(tag->size == PAGEID_T_MAX) {
-        ret = 0;
-        break;
-      }
-      *pid += tag->size+1;
-      int succ = readBoundaryTag(xid,*pid-1, tag);
-      assert(succ); // detect missing boundary tags
-      DEBUG("tag status = %d\n",tag->status);
-      if(tag->status == REGION_ZONED && ((!type) || (tag->allocation_manager == type))) {
-        break;
-      }
+    region_index_node * n = ri_next_zoned(region_index_root, *pid-1);
+    while(n && type && n->tag.allocation_manager != type) {
+      n = ri_next_zoned(region_index_root, n->page);
+    }
+    if(n) {
+      *pid = n->page + 1;
+      *tag = n->tag;
+    } else {
+      ret = 0;
     }
   }
   holding_mutex = 0;
@@ -207,11 +477,21 @@ void fsckRegions(int xid) {
   int ret =readBoundaryTag(xid, tagPage, &tag);
   assert(ret);
   assert(tag.prev_size == PAGEID_T_MAX);
+  pageid_t tagCount = 1;
 
   while(tag.size != PAGEID_T_MAX) {
     // Ignore region_xid, allocation_manager for now.
     assert(tag.status == REGION_VACANT || tag.status == REGION_ZONED);
     assert(prev_tag.size == tag.prev_size);
+    if(region_index_valid) {
+      // The index must agree with the page file.
+      region_index_node * n = ri_find(tagPage);
+      assert(n);
+      assert(n->tag.size == tag.size);
+      assert(n->tag.prev_size == tag.prev_size);
+      assert(n->tag.status == tag.status);
+      assert(n->tag.allocation_manager == tag.allocation_manager);
+    }
 
     for(pageid_t i = 0; i < tag.size; i++) {
       pageid_t thisPage = tagPage + 1 + i;
@@ -233,9 +513,11 @@ void fsckRegions(int xid) {
     tagPage = tagPage + 1 + prev_tag.size;
     int ret = readBoundaryTag(xid, tagPage, &tag);
     assert(ret);
+    tagCount++;
   }
 
   assert(tag.status == REGION_VACANT);  // space at EOF better be vacant!
+  assert(!region_index_valid || (ri_find(tagPage) && region_index_count == tagCount));
   holding_mutex = 0;
   pthread_mutex_unlock(&region_mutex);
 
@@ -437,42 +719,67 @@ void TregionDealloc(int xid, pageid_t firstPage) {
   pthread_mutex_unlock(&region_mutex);
 }
 
+/**
+   Coalesce the vacant regions that were freed since the last call,
+   unless the transactions that freed them are still active.  Caller
+   holds region_mutex.
+*/
+static void region_index_coalesce(int xid) {
+  pageid_t count = 0;
+  pageid_t * pages = 0;
+  region_index_free_entry q = { 0, 0 };
+  const region_index_free_entry * e;
+  while((e = rblookup(RB_LUGTEQ, &q, region_index_pending))) {
+    pages = realloc(pages, sizeof(pages[0]) * (count + 1));
+    pages[count] = e->page;
+    count++;
+    rbdelete(e, region_index_pending);
+    free((void*)e);
+  }
+  for(pageid_t i = 0; i < count; i++) {
+    region_index_node * n = ri_find(pages[i]);
+    if(!n || n->tag.status != REGION_VACANT) { continue; }
+    if(TisActiveTransaction(&n->tag.region_xid_fp)) {
+      region_index_set_add(region_index_pending, 0, pages[i]);
+      continue;
+    }
+    pageid_t page = pages[i];
+    boundary_tag t = n->tag;
+    consolidateRegions(xid, &page, &t);
+  }
+  free(pages);
+}
+/**
+   @return the boundary tag of the smallest vacant region that can hold
+   pageCount pages.  Caller holds region_mutex.
+*/
+static pageid_t region_index_best_fit(pageid_t pageCount) {
+  region_index_free_entry q = { pageCount, 0 };
+  const region_index_free_entry * e = rblookup(RB_LUGTEQ, &q, region_index_free);
+  while(e) {
+    region_index_node * n = ri_find(e->page);
+    assert(n && n->tag.status == REGION_VACANT && n->tag.size == e->size);
+    if(!TisActiveTransaction(&n->tag.region_xid_fp)) {
+      return e->page;
+    }
+    e = rblookup(RB_LUGREAT, e, region_index_free);
+  }
+  abort(); // the vacant region at the end of the page file is always free.
+}
+
 pageid_t TregionAlloc(int xid, pageid_t pageCount, int allocationManager) {
-  // Initial implementation.  Naive first fit.
+  // Best fit, using the in-memory index of vacant regions.
 
   pthread_mutex_lock(&region_mutex);
   assert(0 == holding_mutex);
   holding_mutex = pthread_self();
 
-  void * ntaHandle = TbeginNestedTopAction(xid, OPERATION_NOOP, 0, 0);
-
-  pageid_t pageid = 0;
-  boundary_tag t;
-
-  int ret = readBoundaryTag(xid, pageid, &t); // XXX need to check if there is a boundary tag there or not!
-  assert(ret);
-  //  printf("consolidateRegions pageid, t: %d, {%d, %d, %d} -> ", pageid, t.size, t.prev_size, t.status);
-
-  consolidateRegions(xid, &pageid, &t);
+  region_index_ensure(xid);
 
-  //  printf(" %d, {%d, %d, %d}\tpageCount=%d\n", pageid, t.size, t.prev_size, t.status, pageCount);
-
-  while(t.status != REGION_VACANT || t.size < pageCount || TisActiveTransaction(&t.region_xid_fp)) {
-    // TODO: This while loop and the boundary tag manipulation below should be factored into two submodules.
-
-    //    printf("t.status = %d, REGION_VACANT = %d, t.size = %d, pageCount = %d\n", t.status, REGION_VACANT, t.size, pageCount);
-    pageid += ( t.size + 1 );
-    ret = readBoundaryTag(xid, pageid, &t);
-    assert(ret);
-
-    //    printf("\tconsolidateRegions pageid, t: %d, {%d, %d, %d} -> ", pageid, t.size, t.prev_size, t.status);
-
-    consolidateRegions(xid, &pageid, &t);
-
-    //    printf(" %d, {%d, %d, %d}\tpageCount=%d\n", pageid, t.size, t.prev_size, t.status, pageCount);
+  void * ntaHandle = TbeginNestedTopAction(xid, OPERATION_NOOP, 0, 0);
 
-  }
-  //  printf("page = %d, t.status = %d, REGION_VACANT = %d, t.size = %d, pageCount = %d (alloced)\n", pageid, t.status, REGION_VACANT, t.size, pageCount);
+  region_index_coalesce(xid);
+  pageid_t pageid = region_index_best_fit(pageCount);
 
   TendNestedTopAction(xid, ntaHandle);
 
@@ -566,31 +873,13 @@ stasis_operation_impl stasis_op_impl_region_dealloc_inverse() {
 }
 
 void TregionFindNthActive(int xid, pageid_t regionNumber, pageid_t * firstPage, pageid_t * size) {
-  boundary_tag t;
-  recordid rid = {0, 0, sizeof(boundary_tag)};
   pthread_mutex_lock(&region_mutex);
   holding_mutex = pthread_self();
-  Tread(xid, rid, &t);
-  pageid_t prevSize = 0;
-  while(t.status == REGION_VACANT) {
-    rid.page += (t.size + 1);
-    Tread(xid, rid, &t);
-    assert(t.size != PAGEID_T_MAX);
-    assert(t.prev_size != PAGEID_T_MAX);
-    assert(prevSize == t.prev_size || !prevSize);
-    prevSize = t.size;
-  }
-  for(pageid_t i = 0; i < regionNumber; i++) {
-    rid.page += (t.size + 1);
-    Tread(xid, rid, &t);
-    if(t.status == REGION_VACANT) { i--; }
-    assert(t.size != PAGEID_T_MAX);
-    assert(t.prev_size != PAGEID_T_MAX || i == 0);
-    assert(prevSize == t.prev_size || !prevSize);
-    prevSize = t.size;
-  }
-  *firstPage = rid.page+1;
-  *size = t.size;
+  region_index_ensure(xid);
+  region_index_node * n = ri_nth_zoned(regionNumber);
+  assert(n);
+  *firstPage = n->page+1;
+  *size = n->tag.size;
   holding_mutex = 0;
   pthread_mutex_unlock(&region_mutex);
 }
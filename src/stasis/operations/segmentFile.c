@@ -24,14 +24,19 @@ static inline off_t stasis_next_page_boundary(off_t off) {
 static inline off_t stasis_min_offset(off_t a, off_t b) {
   return a < b ? a : b;
 }
+static inline Page * segment_load_page(stasis_buffer_manager_handle_t * h, int xid, pageid_t pid, pagetype_t type) {
+  return h ? loadPageOfTypeWithHandle(h, xid, pid, type) : loadPageOfType(xid, pid, type);
+}
 static ssize_t read_write_helper(int read, int xid, lsn_t lsn, byte* buf, size_t count, off_t offset) {
   // the first page that has at least one byte for us on it
   pageid_t start = stasis_page_from_offset(offset);
   // the last page that has such a byte
   pageid_t stop  = stasis_page_from_offset(offset + count - 1);
+  // Reads that span pages are scans; keep them out of the shared cache.
+  stasis_buffer_manager_handle_t * h = (read && stop > start) ? stasis_buffer_manager_open_sequential_handle() : 0;
 
   // copy the first page
-  Page * p = loadPageOfType(xid, start, SEGMENT_PAGE);
+  Page * p = segment_load_page(h, xid, start, SEGMENT_PAGE);
   if(read) { readlock(p->rwlatch, 0); } else { writelock(p->rwlatch,0); }
   off_t start_offset = stasis_page_offset_from_offset(offset);
   byte * page_buf = p->memAddr + start_offset;
@@ -52,8 +57,8 @@ static ssize_t read_write_helper(int read, int xid, lsn_t lsn, byte* buf, size_t
   off_t buf_phase = PAGE_SIZE - start_offset;
 
   // copy all pages except for the first and last
-  for(pageid_t i = start+1; i < stop-1; i++) {
-    p = loadPageOfType(xid, i, SEGMENT_PAGE);
+  for(pageid_t i = start+1; i < stop; i++) {
+    p = segment_load_page(h, xid, i, SEGMENT_PAGE);
     if(read) { readlock(p->rwlatch, 0); } else { writelock(p->rwlatch,0); }
     page_buf = p->memAddr;
     user_buf = buf + buf_phase + (n * PAGE_SIZE);
@@ -70,11 +75,11 @@ static ssize_t read_write_helper(int read, int xid, lsn_t lsn, byte* buf, size_t
 
   // copy the last page (if necessary)
   if(start != stop) {
-    p = loadPage(xid, stop);
+    p = segment_load_page(h, xid, stop, UNKNOWN_TYPE_PAGE);
     if(read) { readlock(p->rwlatch, 0); } else { writelock(p->rwlatch,0); }
     user_buf = buf + buf_phase + (n * PAGE_SIZE);
     page_buf = p->memAddr;
-    sz = count % PAGE_SIZE;
+    sz = stasis_page_offset_from_offset(offset + count - 1) + 1;
     if(read) {
       memcpy(user_buf, page_buf, sz);
     } else {
@@ -84,6 +89,7 @@ static ssize_t read_write_helper(int read, int xid, lsn_t lsn, byte* buf, size_t
     unlock(p->rwlatch);
     releasePage(p);
   }
+  if(h) { stasis_buffer_manager_close_handle(h); }
   return count;
 }
 
@@ -80,6 +80,8 @@ terms specified in this license.
 #include <stasis/operations/arrayList.h>
 #include <stasis/bufferPool.h>
 #include <stasis/truncation.h>
+#include <stasis/flags.h>
+#include <stasis/util/crc32.h>
 
 #include <assert.h>
 
@@ -286,8 +288,42 @@ void stasis_uninitialized_page_loaded(int xid, Page * p) {
   p->pageType = *stasis_page_type_ptr(p) = UNINITIALIZED_PAGE;
   if (page_impls[p->pageType].pageLoaded) page_impls[p->pageType].pageLoaded(p);
 }
+size_t stasis_page_checksum_size = 0;
+
+/**
+   Compute the checksum of a page, skipping the checksum itself.
+ */
+static uint32_t stasis_page_checksum(const Page * p) {
+  const byte * checksum = (const byte*)stasis_page_checksum_cptr(p);
+  const byte * end = p->memAddr + PAGE_SIZE;
+  uint32_t crc = stasis_crc32c(p->memAddr, checksum - p->memAddr, (uint32_t)-1);
+  return ~stasis_crc32c(checksum + sizeof(uint32_t), end - (checksum + sizeof(uint32_t)), crc);
+}
+/**
+   @return true if p's checksum matches its contents, or if p is all
+   zeros (a page that has never been written back).
+ */
+static int stasis_page_checksum_ok(const Page * p) {
+  if(*stasis_page_checksum_cptr(p) == stasis_page_checksum(p)) { return 1; }
+  for(int i = 0; i < PAGE_SIZE; i++) {
+    if(p->memAddr[i]) { return 0; }
+  }
+  return 1;
+}
 void stasis_page_loaded(Page * p, pagetype_t type){
   assert(type != UNINITIALIZED_PAGE);
+  // Check the page before we trust its type.  Pages without headers
+  // (whose type the caller must supply) have no checksum.
+  if(stasis_page_checksum_size
+     && (type == UNKNOWN_TYPE_PAGE || page_impls[type].has_header)) {
+    if(!stasis_page_checksum_ok(p)) {
+      uint32_t expected = stasis_page_checksum(p);
+      printf("Checksum mismatch reading page %lld: stored %08x computed %08x\n",
+             (long long)p->id, *stasis_page_checksum_cptr(p), expected);
+      fflush(stdout);
+      abort();
+    }
+  }
   p->pageType = (type == UNKNOWN_TYPE_PAGE) ? *stasis_page_type_ptr(p) : type;
   assert(page_impls[p->pageType].page_type == p->pageType);  // XXX unsafe; what if the page has no header?
   if(page_impls[p->pageType].has_header) {
@@ -303,6 +339,19 @@ void stasis_page_loaded(Page * p, pagetype_t type){
   }
   if (page_impls[p->pageType].pageLoaded) page_impls[p->pageType].pageLoaded(p);
 }
+int stasis_page_try_loaded(Page * p) {
+  pagetype_t type = *stasis_page_type_ptr(p);
+  if(type <= UNINITIALIZED_PAGE || type >= MAX_PAGE_TYPE
+     || page_impls[type].page_type != type
+     || !page_impls[type].has_header) {
+    return 0;
+  }
+  if(stasis_page_checksum_size && !stasis_page_checksum_ok(p)) {
+    return 0;
+  }
+  stasis_page_loaded(p, type);
+  return 1;
+}
 void stasis_page_flushed(Page * p){
 
   pagetype_t type = p->pageType;
@@ -316,6 +365,10 @@ void stasis_page_flushed(Page * p){
 
   }
   if(page_impls[type].pageFlushed) page_impls[type].pageFlushed(p);
+  if(stasis_page_checksum_size && page_impls[type].has_header) {
+    // Stamp the checksum last, since pageFlushed may update the page.
+    *stasis_page_checksum_ptr(p) = stasis_page_checksum(p);
+  }
 }
 void stasis_page_cleanup(Page * p) {
   short type = p->pageType;
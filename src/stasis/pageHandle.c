@@ -16,7 +16,7 @@ static void phWrite(stasis_page_handle_t * ph, Page * ret) {
   if(!ret->dirty) { return; }
   stasis_page_flushed(ret);
   if(ph->log) { stasis_log_force(ph->log, ret->LSN, LOG_FORCE_WAL); }
-  int err = ((stasis_handle_t*)ph->impl)->write(ph->impl, PAGE_SIZE * ret->id, ret->memAddr, PAGE_SIZE);
+  int err = ((stasis_handle_t*)ph->impl)->write(ph->impl, stasis_page_file_offset(ret->id), ret->memAddr, PAGE_SIZE);
   if(err) {
     printf("Couldn't write to page file: %s\n", strerror(err));
     fflush(stdout);
@@ -24,10 +24,39 @@ static void phWrite(stasis_page_handle_t * ph, Page * ret) {
   }
   stasis_dirty_page_table_set_clean(ph->dirtyPages, ret);
 }
+static void phWriteBatch(stasis_page_handle_t * ph, Page ** pages, int count) {
+  // As in phWrite(), the caller holds a writelock on each page.
+  stasis_handle_iov_t * iov = malloc(sizeof(*iov) * count);
+  lsn_t maxLSN = INVALID_LSN;
+  int n = 0;
+  for(int i = 0; i < count; i++) {
+    if(!pages[i]->dirty) { continue; }
+    stasis_page_flushed(pages[i]);
+    if(pages[i]->LSN > maxLSN) { maxLSN = pages[i]->LSN; }
+    iov[n].off = stasis_page_file_offset(pages[i]->id);
+    iov[n].buf = pages[i]->memAddr;
+    iov[n].len = PAGE_SIZE;
+    n++;
+  }
+  if(n) {
+    // One log force covers the whole batch.
+    if(ph->log) { stasis_log_force(ph->log, maxLSN, LOG_FORCE_WAL); }
+    int err = stasis_handle_write_batch(ph->impl, iov, n);
+    if(err) {
+      printf("Couldn't write to page file: %s\n", strerror(err));
+      fflush(stdout);
+      abort();
+    }
+    for(int i = 0; i < count; i++) {
+      stasis_dirty_page_table_set_clean(ph->dirtyPages, pages[i]);
+    }
+  }
+  free(iov);
+}
 static void phRead(stasis_page_handle_t * ph, Page * ret, pagetype_t type) {
   // The caller guarantees that we have exclusive access to the page, so
   // no further latching is necessary.
-  int err = ((stasis_handle_t*)ph->impl)->read(ph->impl, PAGE_SIZE * ret->id, ret->memAddr, PAGE_SIZE);
+  int err = ((stasis_handle_t*)ph->impl)->read(ph->impl, stasis_page_file_offset(ret->id), ret->memAddr, PAGE_SIZE);
   if(err) {
     if(err == EDOM) {
       // tried to read off end of file...
@@ -41,19 +70,49 @@ static void phRead(stasis_page_handle_t * ph, Page * ret, pagetype_t type) {
   assert(!ret->dirty);
   stasis_page_loaded(ret, type);
 }
-static void phPrefetchRange(stasis_page_handle_t *ph, pageid_t pageid, pageid_t count) {
+static void phReadBatch(stasis_page_handle_t * ph, Page ** pages, int count) {
+  stasis_handle_iov_t * iov = malloc(sizeof(*iov) * count);
+  for(int i = 0; i < count; i++) {
+    iov[i].off = stasis_page_file_offset(pages[i]->id);
+    iov[i].buf = pages[i]->memAddr;
+    iov[i].len = PAGE_SIZE;
+  }
+  int err = stasis_handle_read_batch(ph->impl, iov, count);
+  if(err) {
+    for(int i = 0; i < count; i++) {
+      if(iov[i].error == EDOM) {
+        // As in phRead(), the page is past the end of the file.
+        memset(pages[i]->memAddr, 0, PAGE_SIZE);
+      } else if(iov[i].error) {
+        printf("Couldn't read from page file: %s\n", strerror(iov[i].error));
+        fflush(stdout);
+        abort();
+      }
+    }
+  }
+  free(iov);
+}
+static void phPrefetchRanges(stasis_page_handle_t *ph, const pageid_t * pageids, const pageid_t * counts, int count) {
   // TODO RTFM and see if Linux provides a decent API for prefetch hints.
-  lsn_t off = pageid * PAGE_SIZE;
-  lsn_t len = count * PAGE_SIZE;
-
-  byte * buf = malloc(len);
-
-  ((stasis_handle_t*)ph->impl)->read(ph->impl, off, buf, len);
-
-  free(buf);
+  stasis_handle_iov_t * iov = malloc(sizeof(*iov) * count);
+  for(int i = 0; i < count; i++) {
+    iov[i].off = stasis_page_file_offset(pageids[i]);
+    iov[i].len = counts[i] * PAGE_SIZE;
+    iov[i].buf = malloc(iov[i].len);
+  }
+  // This is only a hint, so errors (such as EDOM, for ranges that
+  // extend past the end of the file) are ignored.
+  stasis_handle_read_batch(ph->impl, iov, count);
+  for(int i = 0; i < count; i++) {
+    free(iov[i].buf);
+  }
+  free(iov);
+}
+static void phPrefetchRange(stasis_page_handle_t *ph, pageid_t pageid, pageid_t count) {
+  phPrefetchRanges(ph, &pageid, &count, 1);
 }
 static int phPreallocateRange(stasis_page_handle_t * ph, pageid_t pageid, pageid_t count) {
-  lsn_t off = pageid * PAGE_SIZE;
+  lsn_t off = stasis_page_file_offset(pageid);
   lsn_t len = count * PAGE_SIZE;
 
  return ((stasis_handle_t*)ph->impl)->fallocate(ph->impl, off, len);
@@ -67,7 +126,7 @@ static void phAsyncForce(stasis_page_handle_t * ph) {
   assert(!err);
 }
 static void phForceRange(stasis_page_handle_t * ph, lsn_t start, lsn_t stop) {
-  int err = ((stasis_handle_t*)ph->impl)->force_range(ph->impl,start*PAGE_SIZE,stop*PAGE_SIZE);
+  int err = ((stasis_handle_t*)ph->impl)->force_range(ph->impl,stasis_page_file_offset(start),stasis_page_file_offset(stop));
   assert(!err);
 }
 static void phClose(stasis_page_handle_t * ph) {
@@ -94,13 +153,88 @@ static stasis_page_handle_t * phDup(stasis_page_handle_t * ph, int is_sequential
   }
   return ret;
 }
+pageid_t stasis_page_file_header_pages = 1;
+
+void stasis_page_file_header_init(stasis_page_file_header_t * h) {
+  if(stasis_page_size < STASIS_MIN_PAGE_SIZE || stasis_page_size > STASIS_MAX_PAGE_SIZE
+     || (stasis_page_size & (stasis_page_size - 1))) {
+    printf("Invalid page size %d; it must be a power of two between %d and %d\n",
+           stasis_page_size, STASIS_MIN_PAGE_SIZE, STASIS_MAX_PAGE_SIZE);
+    fflush(stdout);
+    abort();
+  }
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, STASIS_PAGE_FILE_MAGIC, sizeof(h->magic));
+  h->page_size = stasis_page_size;
+  h->version = STASIS_PAGE_FILE_VERSION;
+  h->flags = stasis_page_checksums ? STASIS_PAGE_FILE_CHECKSUMS : 0;
+  stasis_page_checksum_size = stasis_page_checksums ? sizeof(uint32_t) : 0;
+  stasis_page_file_header_pages = 1;
+}
+int stasis_page_file_header_load(const stasis_page_file_header_t * h, lsn_t file_len) {
+  if(memcmp(h->magic, STASIS_PAGE_FILE_MAGIC, sizeof(h->magic))) {
+    // A file that holds nothing but a blank page 0 is indistinguishable
+    // from a new one, and may safely be treated as one.
+    const byte * b = (const byte*)h;
+    int blank = 1;
+    for(int i = 0; blank && i < STASIS_MIN_PAGE_SIZE; i++) { blank = !b[i]; }
+    if(blank && file_len <= STASIS_MIN_PAGE_SIZE) { return 0; }
+    stasis_page_size = STASIS_PAGE_FILE_LEGACY_PAGE_SIZE;
+    stasis_page_checksum_size = 0;
+    stasis_page_file_header_pages = 0;
+    return 1;
+  }
+  if(h->version < 1 || h->version > STASIS_PAGE_FILE_VERSION
+     || (h->version > 1 && (h->flags & ~STASIS_PAGE_FILE_CHECKSUMS))
+     || h->page_size < STASIS_MIN_PAGE_SIZE || h->page_size > STASIS_MAX_PAGE_SIZE
+     || (h->page_size & (h->page_size - 1))) {
+    printf("Page file header is corrupt, or the page file was written by an incompatible version of Stasis\n");
+    fflush(stdout);
+    abort();
+  }
+  stasis_page_size = h->page_size;
+  int checksums = h->version == 1 || (h->flags & STASIS_PAGE_FILE_CHECKSUMS);
+  stasis_page_checksum_size = checksums ? sizeof(uint32_t) : 0;
+  stasis_page_file_header_pages = 1;
+  return 1;
+}
+/**
+   Read the page file's header, or write one if the file is new.  Since
+   we don't know the page size yet, we read the smallest legal page.
+ */
+static void phOpenHeader(stasis_handle_t * h) {
+  byte * buf;
+  int err = posix_memalign((void**)&buf, STASIS_MIN_PAGE_SIZE, STASIS_MAX_PAGE_SIZE);
+  assert(!err);
+  err = h->read(h, 0, buf, STASIS_MIN_PAGE_SIZE);
+  if(err == EDOM) {
+    memset(buf, 0, STASIS_MIN_PAGE_SIZE);
+    err = 0;
+  }
+  if(!err && !stasis_page_file_header_load((stasis_page_file_header_t*)buf, h->end_position(h))) {
+    stasis_page_file_header_init((stasis_page_file_header_t*)buf);
+    memset(buf + sizeof(stasis_page_file_header_t), 0, PAGE_SIZE - sizeof(stasis_page_file_header_t));
+    err = h->write(h, 0, buf, PAGE_SIZE);
+    if(!err) { err = h->force(h); }
+  }
+  if(err) {
+    printf("Couldn't access page file header: %s\n", strerror(err));
+    fflush(stdout);
+    abort();
+  }
+  free(buf);
+}
 stasis_page_handle_t * stasis_page_handle_open(stasis_handle_t * handle,
                                                stasis_log_t * log, stasis_dirty_page_table_t * dpt) {
   DEBUG("Using pageHandle implementation\n");
+  phOpenHeader(handle);
   stasis_page_handle_t * ret = malloc(sizeof(*ret));
   ret->write = phWrite;
+  ret->write_batch = phWriteBatch;
   ret->read  = phRead;
+  ret->read_batch = phReadBatch;
   ret->prefetch_range = phPrefetchRange;
+  ret->prefetch_ranges = phPrefetchRanges;
   ret->preallocate_range = phPreallocateRange;
   ret->force_file = phForce;
   ret->async_force_file = phAsyncForce;
@@ -6,7 +6,6 @@
 
 */
 #include <stasis/common.h>
-#include <stasis/util/lhtable.h>
 #include <stasis/recovery.h>
 
 #include <stasis/transactionTable.h>
@@ -18,21 +17,88 @@
 //#include <stasis/operations/prepare.h>
 
 #include <stasis/logger/logHandle.h>
-/** @todo Get rid of linkedlist */
-#include <stasis/util/linkedlist.h>
 #include <stasis/page.h> // Needed for pageReadLSN.
+#include <stasis/flags.h>
 
 #include <stdio.h>
 #include <assert.h>
 
-//static pblHashTable_t * transactionLSN;
-static struct lhtable * transactionLSN;
-static LinkedList * rollbackLSNs = NULL;
+/**
+   The last log entry analysis saw for each xid.  Indexed by xid, and
+   grown on demand, so that analysis does O(1) work per log entry.
+ */
+typedef struct {
+  lsn_t lastLSN;
+  /** Non-zero if the last entry for this xid means it must be rolled back. */
+  int rollback;
+} stasis_recovery_xact_t;
+
+static stasis_recovery_xact_t * transactionLSN = NULL;
+static int transactionLSN_count = 0;
+
+/**
+   A binary max-heap of the LSNs undo must start from.  Undo pops the
+   largest LSN first, so that transactions are rolled back in reverse
+   order of their last log entry.
+ */
+typedef struct {
+  lsn_t * lsns;
+  int count;
+  int size;
+} stasis_rollback_heap_t;
+
+static stasis_rollback_heap_t rollbackLSNs = { NULL, 0, 0 };
+
+/** The LSN of the last checkpoint analysis saw, or INVALID_LSN. */
+static lsn_t checkpointLSN = INVALID_LSN;
 /** @todo There is no real reason to have this mutex (which prevents
     concurrent aborts), except that we need to protect rollbackLSNs's
     from concurrent modifications. */
 static pthread_mutex_t rollback_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+static void rollback_heap_sift_down(stasis_rollback_heap_t * h, int i) {
+  while(1) {
+    int max = i;
+    int l = 2 * i + 1;
+    int r = l + 1;
+    if(l < h->count && h->lsns[l] > h->lsns[max]) { max = l; }
+    if(r < h->count && h->lsns[r] > h->lsns[max]) { max = r; }
+    if(max == i) { return; }
+    lsn_t tmp = h->lsns[i];
+    h->lsns[i] = h->lsns[max];
+    h->lsns[max] = tmp;
+    i = max;
+  }
+}
+/** Append an LSN without restoring the heap property; see rollback_heap_build(). */
+static void rollback_heap_append(stasis_rollback_heap_t * h, lsn_t lsn) {
+  if(h->count == h->size) {
+    h->size = h->size ? 2 * h->size : 16;
+    h->lsns = realloc(h->lsns, h->size * sizeof(lsn_t));
+  }
+  h->lsns[h->count++] = lsn;
+}
+/** Heapify the appended LSNs in linear time. */
+static void rollback_heap_build(stasis_rollback_heap_t * h) {
+  for(int i = h->count / 2 - 1; i >= 0; i--) {
+    rollback_heap_sift_down(h, i);
+  }
+}
+static lsn_t rollback_heap_pop(stasis_rollback_heap_t * h) {
+  assert(h->count);
+  lsn_t ret = h->lsns[0];
+  h->count--;
+  h->lsns[0] = h->lsns[h->count];
+  rollback_heap_sift_down(h, 0);
+  return ret;
+}
+static void rollback_heap_deinit(stasis_rollback_heap_t * h) {
+  free(h->lsns);
+  h->lsns = NULL;
+  h->count = 0;
+  h->size = 0;
+}
+
 /**
     Determines which transactions committed, and which need to be redone.
 
@@ -59,37 +125,28 @@ static void stasis_recovery_analysis(stasis_log_t* log, stasis_transaction_table
 
   while((e = nextInLog(lh))) {
 
-    lsn_t * xactLSN = (lsn_t*)lhfind(transactionLSN, &(e->xid), sizeof(int));
+    stasis_recovery_xact_t * xact = NULL;
 
-    /** Track LSN's in two data structures:
-         - map: xid -> max LSN
-	 - sorted list of maxLSN's
-    */
-
-    if(xactLSN == NULL) {
-      xactLSN = malloc(sizeof(lsn_t));
-      lhinsert(transactionLSN, &(e->xid), sizeof(int), xactLSN);
-    } else {
-      /* We've seen this xact before, and must have put a value in
-	 rollbackLSNs for it.  That value is now stale, so remove
-	 it. */
-
-      DEBUG("Removing %lld\n", *xactLSN);
-      removeVal(&rollbackLSNs, *xactLSN);
+    if(e->xid != INVALID_XID) {
+      assert(e->xid >= 0);
+      if(e->xid >= transactionLSN_count) {
+        int old_count = transactionLSN_count;
+        while(e->xid >= transactionLSN_count) {
+          transactionLSN_count = transactionLSN_count ? 2 * transactionLSN_count : MAX_TRANSACTIONS;
+        }
+        transactionLSN = realloc(transactionLSN, transactionLSN_count * sizeof(transactionLSN[0]));
+        memset(&transactionLSN[old_count], 0, (transactionLSN_count - old_count) * sizeof(transactionLSN[0]));
+      }
+      xact = &transactionLSN[e->xid];
+      /* Only the last entry for each xid matters; any earlier entry
+         that would have required a rollback is superseded by this one. */
+      xact->lastLSN = e->LSN;
+      xact->rollback = 0;
     }
 
-    /* Now, rollbackLSNs certainly does not contain an LSN for this
-       transaction, and *xactLSN points to a value in the hash, so
-       writing to it updates the hash.  This doesn't update the
-       rollbackLSN data structure, so it doesn't hurt to update this
-       value for all log entries.  */
-
-    *xactLSN = e->LSN;
-
     switch(e->type) {
     case XCOMMIT:
-      /* We've removed this XACT's last LSN from the list of LSN's to
-	 be rolled back, so we're done. */
+      /* The transaction committed, so it is not rolled back. */
       break;
     case XEND: {
         /*
@@ -108,33 +165,41 @@ static void stasis_recovery_analysis(stasis_log_t* log, stasis_transaction_table
 	 If the last record we see for a transaction is an update or clr,
 	 then the transaction must not have committed, so it must need
 	 to be rolled back.
-
-	 Add it to the list
-
       */
-      DEBUG("Adding %lld\n", e->LSN);
-
-      addSortedVal(&rollbackLSNs, e->LSN);
+      xact->rollback = 1;
       break;
     case XABORT:
       // If the last record we see for a transaction is an abort, then
       // the transaction didn't commit, and must be rolled back.
-      DEBUG("Adding %lld\n", e->LSN);
-      addSortedVal(&rollbackLSNs, e->LSN);
+      xact->rollback = 1;
       break;
     case XPREPARE:
-      addSortedVal(&rollbackLSNs, e->LSN);
+      xact->rollback = 1;
       break; // XXX check to see if the xact exists?
     case INTERNALLOG:
       // Created by the logger, just ignore it
       // Make sure the log entry doesn't interfere with real xacts.
       assert(e->xid == INVALID_XID);
       break;
+    case XCHECKPOINT:
+      // Redo uses the last one to skip updates that reached the page file.
+      assert(e->xid == INVALID_XID);
+      checkpointLSN = e->LSN;
+      break;
     default:
       abort();
     }
   }
   freeLogHandle(lh);
+
+  assert(!rollbackLSNs.count);
+  for(int xid = 0; xid < transactionLSN_count; xid++) {
+    if(transactionLSN[xid].rollback) {
+      DEBUG("Adding %lld\n", transactionLSN[xid].lastLSN);
+      rollback_heap_append(&rollbackLSNs, transactionLSN[xid].lastLSN);
+    }
+  }
+  rollback_heap_build(&rollbackLSNs);
 }
 
 /**
@@ -154,14 +219,195 @@ static void stasis_recovery_analysis(stasis_log_t* log, stasis_transaction_table
                                     Y  (NTA replaces physical undo)
  */
 
+/**
+   Replay an update, or the update compensated by a CLR, against the
+   page that it touches.
+*/
+static void stasis_recovery_redo_page(const LogEntry * e) {
+  if(e->type == UPDATELOG) {
+    Page * p = loadPageForOperation(e->xid, e->update.page, e->update.funcID);
+    if(p) writelock(p->rwlatch,0);
+    stasis_operation_redo(e,p);
+    if(p) {
+      unlock(p->rwlatch);
+      releasePage(p);
+    }
+  } else {
+    assert(e->type == CLRLOG);
+    const LogEntry * ce = getCLRCompensated((const CLRLogEntry*)e);
+    // need to grab latch page here so that Tabort() can be atomic
+    // below...
+
+    Page * p = loadPageForOperation(e->xid, ce->update.page, ce->update.funcID);
+    if(p) writelock(p->rwlatch,0);
+    stasis_operation_undo(ce, e->LSN, p);
+    if(p) {
+      unlock(p->rwlatch);
+      releasePage(p);
+    }
+  }
+}
+
+/**
+   Parallel redo.
+
+   The thread running recovery reads the log, and performs everything
+   other than page updates itself.  Page updates are copied into the
+   queue of the worker that owns the page (page % worker count), so
+   each page's updates are applied in log order, by a single thread,
+   while different pages are loaded and updated concurrently.
+
+   Segment and multi-page entries may touch pages owned by any worker,
+   so the reader waits for every queue to drain before applying them.
+   CLRs are handled the same way: they replay the undo of the entry
+   they compensate, and undo implementations are not bound to the
+   page partitioning.
+*/
+#define REDO_QUEUE_LENGTH 1024
+
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t mut;
+  /** Signalled when an entry is queued, or the worker should exit. */
+  pthread_cond_t ready;
+  /** Signalled when the worker finishes an entry while the reader is waiting. */
+  pthread_cond_t done;
+  LogEntry * queue[REDO_QUEUE_LENGTH];
+  int head;
+  int len;
+  int busy;
+  int running;
+  /** Non-zero while the reader waits on done. */
+  int waiting;
+} stasis_redo_worker_t;
+
+static void * stasis_recovery_redo_worker(void * arg) {
+  stasis_redo_worker_t * w = arg;
+  pthread_mutex_lock(&w->mut);
+  while(1) {
+    while(!w->len && w->running) {
+      pthread_cond_wait(&w->ready, &w->mut);
+    }
+    if(!w->len) { break; } // shutdown
+    LogEntry * e = w->queue[w->head];
+    w->head = (w->head + 1) % REDO_QUEUE_LENGTH;
+    w->len--;
+    w->busy = 1;
+    pthread_mutex_unlock(&w->mut);
+
+    stasis_recovery_redo_page(e);
+    free(e);
+
+    pthread_mutex_lock(&w->mut);
+    w->busy = 0;
+    if(w->waiting) { pthread_cond_signal(&w->done); }
+  }
+  pthread_mutex_unlock(&w->mut);
+  return 0;
+}
+static stasis_redo_worker_t * stasis_recovery_redo_workers_open(int count) {
+  stasis_redo_worker_t * workers = malloc(sizeof(*workers) * count);
+  for(int i = 0; i < count; i++) {
+    stasis_redo_worker_t * w = &workers[i];
+    pthread_mutex_init(&w->mut, 0);
+    pthread_cond_init(&w->ready, 0);
+    pthread_cond_init(&w->done, 0);
+    w->head = 0;
+    w->len = 0;
+    w->busy = 0;
+    w->running = 1;
+    w->waiting = 0;
+    pthread_create(&w->thread, 0, stasis_recovery_redo_worker, w);
+  }
+  return workers;
+}
+/** Hand a copy of e to the worker that owns page. */
+static void stasis_recovery_redo_dispatch(stasis_log_t * log, stasis_redo_worker_t * workers, int count, pageid_t page, const LogEntry * e) {
+  stasis_redo_worker_t * w = &workers[page % count];
+  lsn_t sz = sizeofLogEntry(log, e);
+  LogEntry * copy = malloc(sz);
+  memcpy(copy, e, sz);
+  pthread_mutex_lock(&w->mut);
+  while(w->len == REDO_QUEUE_LENGTH) {
+    w->waiting = 1;
+    pthread_cond_wait(&w->done, &w->mut);
+    w->waiting = 0;
+  }
+  w->queue[(w->head + w->len) % REDO_QUEUE_LENGTH] = copy;
+  w->len++;
+  // The worker only sleeps when its queue is empty.
+  if(w->len == 1) { pthread_cond_signal(&w->ready); }
+  pthread_mutex_unlock(&w->mut);
+}
+/** Block until every worker has applied everything it was handed. */
+static void stasis_recovery_redo_barrier(stasis_redo_worker_t * workers, int count) {
+  for(int i = 0; i < count; i++) {
+    stasis_redo_worker_t * w = &workers[i];
+    pthread_mutex_lock(&w->mut);
+    while(w->len || w->busy) {
+      w->waiting = 1;
+      pthread_cond_wait(&w->done, &w->mut);
+      w->waiting = 0;
+    }
+    pthread_mutex_unlock(&w->mut);
+  }
+}
+static void stasis_recovery_redo_workers_close(stasis_redo_worker_t * workers, int count) {
+  for(int i = 0; i < count; i++) {
+    stasis_redo_worker_t * w = &workers[i];
+    pthread_mutex_lock(&w->mut);
+    w->running = 0;
+    pthread_cond_signal(&w->ready);
+    pthread_mutex_unlock(&w->mut);
+  }
+  for(int i = 0; i < count; i++) {
+    stasis_redo_worker_t * w = &workers[i];
+    pthread_join(w->thread, 0);
+    pthread_mutex_destroy(&w->mut);
+    pthread_cond_destroy(&w->ready);
+    pthread_cond_destroy(&w->done);
+  }
+  free(workers);
+}
+
+/**
+   Returns true if the checkpoint shows that the update at lsn had
+   already reached page when the checkpoint was taken.
+
+   Every entry before the checkpoint's begin LSN had been applied to its
+   page.  If the page was clean, the update is on disk.  If it was dirty,
+   the update is on disk if it precedes the page's recLSN.  Later
+   entries, and pages that are not in the checkpoint's (page sorted)
+   dirty page table, are redone as usual.
+*/
+static int stasis_recovery_redo_is_durable(const LogEntry * ckpt, pageid_t page, lsn_t lsn) {
+  if(!ckpt || lsn >= getCheckpointBeginLSN(ckpt)) { return 0; }
+  const stasis_checkpoint_page_t * pages = stasis_log_entry_checkpoint_pages_cptr(ckpt);
+  pageid_t lo = 0, hi = getCheckpointPageCount(ckpt);
+  while(lo < hi) {
+    pageid_t mid = lo + (hi - lo) / 2;
+    if(pages[mid].page < page) { lo = mid + 1; } else { hi = mid; }
+  }
+  if(lo < getCheckpointPageCount(ckpt) && pages[lo].page == page) {
+    return lsn < pages[lo].recLSN;
+  }
+  return 1;
+}
+
 static void stasis_recovery_redo(stasis_log_t* log, stasis_transaction_table_t * tbl) {
   LogHandle* lh = getLogHandle(log);
   const LogEntry  * e;
+  const int worker_count = stasis_recovery_redo_threads;
+  stasis_redo_worker_t * workers = worker_count > 1
+      ? stasis_recovery_redo_workers_open(worker_count) : 0;
+  const LogEntry * ckpt = checkpointLSN == INVALID_LSN
+      ? 0 : log->read_entry(log, checkpointLSN);
+  assert(!ckpt || ckpt->type == XCHECKPOINT);
 
   DEBUG("Recovery: Redo\n");
 
   while((e = nextInLog(lh))) {
-    if(e->type != INTERNALLOG) {
+    if(e->type != INTERNALLOG && e->type != XCHECKPOINT) {
       stasis_transaction_table_roll_forward(tbl, e->xid, e->LSN, e->prevLSN);
     }
     // Check to see if this entry's action needs to be redone
@@ -170,15 +416,14 @@ static void stasis_recovery_redo(stasis_log_t* log, stasis_transaction_table_t *
       if(e->update.page == INVALID_PAGE) {
         // this entry specifies a logical undo operation; ignore it.
       } else if(e->update.page == SEGMENT_PAGEID || e->update.page == MULTI_PAGEID) {
+        if(workers) { stasis_recovery_redo_barrier(workers, worker_count); }
         stasis_operation_redo(e,0);
+      } else if(stasis_recovery_redo_is_durable(ckpt, e->update.page, e->LSN)) {
+        // already on disk; don't bother loading the page.
+      } else if(workers) {
+        stasis_recovery_redo_dispatch(log, workers, worker_count, e->update.page, e);
       } else {
-        Page * p = loadPageForOperation(e->xid, e->update.page, e->update.funcID);
-        if(p) writelock(p->rwlatch,0);
-        stasis_operation_redo(e,p);
-        if(p) {
-          unlock(p->rwlatch);
-          releasePage(p);
-        }
+        stasis_recovery_redo_page(e);
       }
     } break;
     case CLRLOG: {
@@ -189,17 +434,12 @@ static void stasis_recovery_redo(stasis_log_t* log, stasis_transaction_table_t *
       if(-1 != ce->LSN) {
         if(ce->update.page == INVALID_PAGE) {
           // logical redo of end of NTA; no-op
+        } else if(ce->update.page != SEGMENT_PAGEID && ce->update.page != MULTI_PAGEID
+                  && stasis_recovery_redo_is_durable(ckpt, ce->update.page, e->LSN)) {
+          // already on disk
         } else {
-          // need to grab latch page here so that Tabort() can be atomic
-          // below...
-
-          Page * p = loadPageForOperation(e->xid, ce->update.page, ce->update.funcID);
-          if(p) writelock(p->rwlatch,0);
-          stasis_operation_undo(ce, e->LSN, p);
-          if(p) {
-            unlock(p->rwlatch);
-            releasePage(p);
-          }
+          if(workers) { stasis_recovery_redo_barrier(workers, worker_count); }
+          stasis_recovery_redo_page(e);
         }
       }
     } break;
@@ -227,11 +467,19 @@ static void stasis_recovery_redo(stasis_log_t* log, stasis_transaction_table_t *
     } break;
     case XPREPARE: {
     } break;
+    case XCHECKPOINT: {
+    } break;
     default: {
       abort();
     }
     } // end switch
   } // end loop
+  if(workers) {
+    // Undo assumes that redo is complete.
+    stasis_recovery_redo_workers_close(workers, worker_count);
+  }
+  if(ckpt) { log->read_entry_done(log, ckpt); }
+  checkpointLSN = INVALID_LSN;
   freeLogHandle(lh);
 }
 static void stasis_recovery_undo(stasis_log_t* log, stasis_transaction_table_t * tbl, int recovery) {
@@ -239,9 +487,9 @@ static void stasis_recovery_undo(stasis_log_t* log, stasis_transaction_table_t *
 
   DEBUG("Recovery: Undo\n");
 
-  while(rollbackLSNs != NULL) {
+  while(rollbackLSNs.count) {
     const LogEntry * e;
-    lsn_t rollback = popMaxVal(&rollbackLSNs);
+    lsn_t rollback = rollback_heap_pop(&rollbackLSNs);
 
     DEBUG("Undoing LSN %ld\n", (long int)rollback);
 
@@ -343,7 +591,6 @@ static void stasis_recovery_undo(stasis_log_t* log, stasis_transaction_table_t *
 }
 void stasis_recovery_initiate(stasis_log_t* log, stasis_transaction_table_t * tbl, stasis_alloc_t * alloc) {
   stasis_buffer_manager_set_redo_mode(1);
-  transactionLSN = lhcreate(64);
   DEBUG("Analysis started\n");
   stasis_recovery_analysis(log, tbl);
   DEBUG("Redo started\n");
@@ -355,37 +602,30 @@ void stasis_recovery_initiate(stasis_log_t* log, stasis_transaction_table_t * tb
   DEBUG("Recovery complete.\n");
   stasis_transaction_post_recovery(tbl);
 
-  struct lhlist ll;
-  const struct lhpair_t * next;
-  lhopenlist(transactionLSN, &ll);
-  while(( next = lhreadlist(&ll) )) {
-    free(next->value);
-  }
-  lhcloselist(&ll);
-  lhdestroy(transactionLSN);
+  free(transactionLSN);
+  transactionLSN = NULL;
+  transactionLSN_count = 0;
 
-  destroyList(&rollbackLSNs);
-  assert(rollbackLSNs==0);
+  assert(!rollbackLSNs.count);
+  rollback_heap_deinit(&rollbackLSNs);
 }
 
 
 void undoTrans(stasis_log_t* log, stasis_transaction_table_t * tbl, stasis_transaction_table_entry_t transaction) {
 
   pthread_mutex_lock(&rollback_mutex);
-  assert(!rollbackLSNs);
+  assert(!rollbackLSNs.count);
 
   if(transaction.prevLSN > 0) {
     DEBUG("scheduling xid %d (lsn %lld) for undo.\n", transaction.xid, transaction.prevLSN);
-    addSortedVal(&rollbackLSNs, transaction.prevLSN);
+    rollback_heap_append(&rollbackLSNs, transaction.prevLSN);
   } else {
     /* Nothing to undo.  (Happens for read-only xacts.) */
   }
 
   stasis_recovery_undo(log, tbl, 0);
-  if(rollbackLSNs) {
-    destroyList(&rollbackLSNs);
-  }
-  assert(rollbackLSNs == 0);
+  assert(!rollbackLSNs.count);
+  rollback_heap_deinit(&rollbackLSNs);
   pthread_mutex_unlock(&rollback_mutex);
 
 }
@@ -0,0 +1,342 @@
+/**
+ * arc.c
+ *
+ * @file Implementation of the ARC (Adaptive Replacement Cache) policy.
+ *
+ * ARC splits the cache into two LRU queues.  T1 holds pages that have
+ * been referenced once recently, and T2 holds pages that have been
+ * referenced more than once.  It also remembers the ids of pages that
+ * were recently evicted from each queue (the "ghost" queues B1 and B2).
+ * A miss on a page in B1 means T1 was too small, and a miss on a page in
+ * B2 means T2 was too small; ARC adjusts "target", the desired size of
+ * T1, accordingly.  Pages that miss in a ghost queue go straight to T2.
+ *
+ * Since one pass over a large table only touches each page once, it only
+ * churns T1, and leaves the working set in T2 alone.
+ *
+ * Unlike the textbook version of ARC, this module only sees pin (remove)
+ * and unpin (insert) calls.  Loading a page and then releasing it produces
+ * several back-to-back unpins, so a page only moves from T1 to T2 if it
+ * is unpinned again after a "correlation window" of other references has
+ * elapsed (as in 2Q), or if it misses in a ghost queue.
+ *
+ * This module is not threadsafe.  Wrap it with
+ * replacementPolicyThreadsafeWrapperInit() or
+ * replacementPolicyConcurrentWrapperInit().  (The concurrent wrapper
+ * partitions pages by id, so each partition keeps its own ghost queues.)
+ *
+ * States (Stored in p->queue):
+ *
+ * [NONE] -> insert -> [T1] (or [T2] after a ghost hit)
+ * [T1] -> insert after the correlation window -> [T2]
+ * [T1] or [T2] -> get stale and remove -> [NONE], and the id goes to B1 or B2.
+ */
+#include <stasis/common.h>
+#include <stasis/flags.h>
+#include <stasis/replacementPolicy.h>
+#include <stasis/page.h>
+#include <assert.h>
+
+#define ARC_NONE 0
+#define ARC_T1   1
+#define ARC_T2   2
+
+#define ARC_B1   0
+#define ARC_B2   1
+
+/** An entry in one of the ghost queues. */
+typedef struct {
+  pageid_t id;
+  int prev;
+  int next;
+  /** The next entry in this entry's hash chain. */
+  int chain;
+  int list;
+} stasis_replacement_policy_arc_ghost_t;
+
+typedef struct {
+  int head;  // least recently evicted
+  int tail;  // most recently evicted
+  pageid_t count;
+} stasis_replacement_policy_arc_ghost_list_t;
+
+typedef struct {
+  Page t1;
+  Page t2;
+  pageid_t t1_count;
+  pageid_t t2_count;
+  /** The number of pages the cache (or this partition of it) holds. */
+  pageid_t capacity;
+  /** The desired size of T1. */
+  pageid_t target;
+  /** The number of calls to insert() so far. */
+  uint64_t references;
+  /** Pages that are unpinned sooner than this after entering T1 stay in T1. */
+  uint64_t correlation_window;
+
+  stasis_replacement_policy_arc_ghost_t * ghosts;
+  stasis_replacement_policy_arc_ghost_list_t b[2];
+  int free_ghost;
+  int * ghost_hash;
+  int ghost_hash_mask;
+} stasis_replacement_policy_arc_t;
+
+static inline void arcListInit(Page * list) {
+  list->next = list->prev = list;
+}
+static inline void arcListPush(Page * list, Page * p) {
+  p->next = list;
+  p->prev = list->prev;
+  p->next->prev = p;
+  p->prev->next = p;
+}
+static inline void arcListRemove(Page * p) {
+  p->prev->next = p->next;
+  p->next->prev = p->prev;
+  p->prev = NULL;
+  p->next = NULL;
+}
+static inline Page * arcListHead(Page * list) {
+  return list->next == list ? NULL : list->next;
+}
+
+static inline int arcGhostHash(stasis_replacement_policy_arc_t * a, pageid_t id) {
+  uint64_t h = (uint64_t)id * 0x9E3779B97F4A7C15ULL;
+  return (int)(h >> 32) & a->ghost_hash_mask;
+}
+static int arcGhostFind(stasis_replacement_policy_arc_t * a, pageid_t id) {
+  for(int i = a->ghost_hash[arcGhostHash(a, id)]; i != -1; i = a->ghosts[i].chain) {
+    if(a->ghosts[i].id == id) { return i; }
+  }
+  return -1;
+}
+static void arcGhostRemove(stasis_replacement_policy_arc_t * a, int i) {
+  stasis_replacement_policy_arc_ghost_t * g = &a->ghosts[i];
+  stasis_replacement_policy_arc_ghost_list_t * l = &a->b[g->list];
+
+  int * link = &a->ghost_hash[arcGhostHash(a, g->id)];
+  while(*link != i) { link = &a->ghosts[*link].chain; }
+  *link = g->chain;
+
+  if(g->prev == -1) { l->head = g->next; } else { a->ghosts[g->prev].next = g->next; }
+  if(g->next == -1) { l->tail = g->prev; } else { a->ghosts[g->next].prev = g->prev; }
+  l->count--;
+
+  g->next = a->free_ghost;
+  a->free_ghost = i;
+}
+/** Add id to the most recently evicted end of list.  There must be a free entry. */
+static void arcGhostAppend(stasis_replacement_policy_arc_t * a, pageid_t id, int list) {
+  int i = a->free_ghost;
+  assert(i != -1);
+  stasis_replacement_policy_arc_ghost_t * g = &a->ghosts[i];
+  stasis_replacement_policy_arc_ghost_list_t * l = &a->b[list];
+  a->free_ghost = g->next;
+
+  g->id = id;
+  g->list = list;
+  g->next = -1;
+  g->prev = l->tail;
+  if(l->tail == -1) { l->head = i; } else { a->ghosts[l->tail].next = i; }
+  l->tail = i;
+  l->count++;
+
+  int h = arcGhostHash(a, id);
+  g->chain = a->ghost_hash[h];
+  a->ghost_hash[h] = i;
+}
+static void arcGhostAdd(stasis_replacement_policy_arc_t * a, pageid_t id, int list) {
+  int i = arcGhostFind(a, id);
+  if(i != -1) { arcGhostRemove(a, i); }
+  // Keep |T1| + |B1| <= capacity and |B1| + |B2| <= capacity.
+  if(list == ARC_B1) {
+    while(a->b[ARC_B1].count && a->t1_count + a->b[ARC_B1].count >= a->capacity) {
+      arcGhostRemove(a, a->b[ARC_B1].head);
+    }
+  }
+  while(a->b[ARC_B1].count + a->b[ARC_B2].count >= a->capacity) {
+    int victim = a->b[ARC_B2].count ? ARC_B2 : ARC_B1;
+    arcGhostRemove(a, a->b[victim].head);
+  }
+  arcGhostAppend(a, id, list);
+}
+/** Allocate ghost entries for a cache of the given capacity; the queues start out empty. */
+static void arcGhostInit(stasis_replacement_policy_arc_t * a, pageid_t capacity) {
+  // arcGhostAdd() trims the ghost queues to capacity-1 entries before adding one.
+  a->ghosts = malloc(sizeof(a->ghosts[0]) * capacity);
+  for(pageid_t i = 0; i < capacity; i++) {
+    a->ghosts[i].next = i + 1 < capacity ? i + 1 : -1;
+  }
+  a->free_ghost = 0;
+  for(int i = 0; i < 2; i++) {
+    a->b[i].head = a->b[i].tail = -1;
+    a->b[i].count = 0;
+  }
+  int hash_size = 1;
+  while(hash_size < 2 * capacity) { hash_size *= 2; }
+  a->ghost_hash = malloc(sizeof(a->ghost_hash[0]) * hash_size);
+  for(int i = 0; i < hash_size; i++) {
+    a->ghost_hash[i] = -1;
+  }
+  a->ghost_hash_mask = hash_size - 1;
+}
+
+/** Decide which queue p belongs in now that it has been (re)loaded. */
+static void arcAdmit(stasis_replacement_policy_arc_t * a, Page * p) {
+  int i = arcGhostFind(a, p->id);
+  if(i == -1) {
+    p->queue = ARC_T1;
+  } else {
+    pageid_t b1 = a->b[ARC_B1].count;
+    pageid_t b2 = a->b[ARC_B2].count;
+    if(a->ghosts[i].list == ARC_B1) {
+      pageid_t delta = b2 > b1 ? b2 / b1 : 1;
+      a->target = a->target + delta > a->capacity ? a->capacity : a->target + delta;
+    } else {
+      pageid_t delta = b1 > b2 ? b1 / b2 : 1;
+      a->target = a->target > delta ? a->target - delta : 0;
+    }
+    arcGhostRemove(a, i);
+    p->queue = ARC_T2;
+  }
+  p->queueId = p->id;
+  p->queueStamp = a->references;
+}
+
+static void  arcDeinit  (struct replacementPolicy* r) {
+  stasis_replacement_policy_arc_t * a = r->impl;
+  free(a->ghosts);
+  free(a->ghost_hash);
+  free(a);
+  free(r);
+}
+static void  arcHit     (struct replacementPolicy* r, Page* p) {
+  stasis_replacement_policy_arc_t * a = r->impl;
+  if(p->next == NULL) {
+    // ignore attempts to hit pages not in the policy
+    return;
+  }
+  arcListRemove(p);
+  arcListPush(p->queue == ARC_T1 ? &a->t1 : &a->t2, p);
+}
+static Page* arcGetStale(struct replacementPolicy* r) {
+  stasis_replacement_policy_arc_t * a = r->impl;
+  Page * t1 = arcListHead(&a->t1);
+  Page * t2 = arcListHead(&a->t2);
+  if(t1 && (a->t1_count > a->target || !t2)) {
+    return t1;
+  }
+  return t2 ? t2 : t1;
+}
+static Page* arcRemove  (struct replacementPolicy* r, Page* p) {
+  stasis_replacement_policy_arc_t * a = r->impl;
+  Page *ret = NULL;
+
+  if(!p->pinCount) {
+    if(p->next) {
+      arcListRemove(p);
+      if(p->queue == ARC_T1) { a->t1_count--; } else { a->t2_count--; }
+    } else {
+      assert(p->dirty);
+    }
+    ret = p;
+  }
+  p->pinCount++;
+
+  return ret;
+}
+static Page* arcGetStaleAndRemove(struct replacementPolicy* r) {
+  stasis_replacement_policy_arc_t * a = r->impl;
+  Page * ret = arcGetStale(r);
+  if(ret) {
+    assert(!ret->pinCount);
+    arcRemove(r, ret);
+    arcGhostAdd(a, ret->id, ret->queue == ARC_T1 ? ARC_B1 : ARC_B2);
+    ret->queue = ARC_NONE;
+  }
+  return ret;
+}
+static void  arcInsert  (struct replacementPolicy* r, Page* p) {
+  stasis_replacement_policy_arc_t * a = r->impl;
+  p->pinCount--;
+  assert(p->pinCount >= 0);
+  a->references++;
+
+  if(p->queue == ARC_NONE || p->queueId != p->id) {
+    if(p->queue != ARC_NONE) {
+      // The page was evicted with getStale() and remove(), so we did not
+      // notice.  Remember the page that used to be here.
+      arcGhostAdd(a, p->queueId, p->queue == ARC_T1 ? ARC_B1 : ARC_B2);
+    }
+    arcAdmit(a, p);
+  } else if(p->queue == ARC_T1 && a->references - p->queueStamp > a->correlation_window) {
+    p->queue = ARC_T2;
+  }
+
+  if(p->pinCount) { return; }
+  // As in lruFast, dirty pages stay out of the policy in sequential mode,
+  // so that only the writeback thread evicts them.
+  if(stasis_buffer_manager_hint_writes_are_sequential &&
+     !stasis_buffer_manager_debug_stress_latching &&
+     p->dirty) {
+    return;
+  }
+  if(p->queue == ARC_T1) {
+    arcListPush(&a->t1, p);
+    a->t1_count++;
+  } else {
+    arcListPush(&a->t2, p);
+    a->t2_count++;
+  }
+}
+static void  arcSetCapacity(struct replacementPolicy* r, pageid_t capacity) {
+  stasis_replacement_policy_arc_t * a = r->impl;
+  if(capacity < 1) { capacity = 1; }
+  // Forget the least recently evicted ids until the rest fit, as arcGhostAdd() would.
+  while(a->b[ARC_B1].count + a->b[ARC_B2].count >= capacity) {
+    int victim = a->b[ARC_B2].count ? ARC_B2 : ARC_B1;
+    arcGhostRemove(a, a->b[victim].head);
+  }
+  // Ghost entries are addressed by index, so rebuild the queues in the new arrays.
+  stasis_replacement_policy_arc_ghost_t * old = a->ghosts;
+  int * old_hash = a->ghost_hash;
+  stasis_replacement_policy_arc_ghost_list_t old_b[2] = { a->b[0], a->b[1] };
+  arcGhostInit(a, capacity);
+  for(int list = 0; list < 2; list++) {
+    for(int i = old_b[list].head; i != -1; i = old[i].next) {
+      arcGhostAppend(a, old[i].id, list);
+    }
+  }
+  free(old);
+  free(old_hash);
+
+  a->capacity = capacity;
+  if(a->target > capacity) { a->target = capacity; }
+  a->correlation_window = capacity / 4;
+}
+
+replacementPolicy* replacementPolicyArcInit(pageid_t capacity) {
+  replacementPolicy *ret = malloc(sizeof(*ret));
+  stasis_replacement_policy_arc_t * a = malloc(sizeof(*a));
+  if(capacity < 1) { capacity = 1; }
+  arcListInit(&a->t1);
+  arcListInit(&a->t2);
+  a->t1_count = 0;
+  a->t2_count = 0;
+  a->capacity = capacity;
+  a->target = 0;
+  a->references = 0;
+  a->correlation_window = capacity / 4;
+  arcGhostInit(a, capacity);
+
+  ret->init = NULL;
+  ret->deinit = arcDeinit;
+  ret->hit = arcHit;
+  ret->getStale = arcGetStale;
+  ret->getStaleAndRemove = arcGetStaleAndRemove;
+  ret->remove = arcRemove;
+  ret->insert = arcInsert;
+  ret->setCapacity = arcSetCapacity;
+  ret->impl = a;
+  return ret;
+}
@@ -127,6 +127,7 @@ replacementPolicy* replacementPolicyClockInit(Page * pageArray, int page_count)
   ret->getStaleAndRemove = clockGetStaleAndRemove;
   ret->remove = clockRemove;
   ret->insert = clockInsert;
+  ret->setCapacity = NULL;
   ret->impl = clock;
   return ret;
 }
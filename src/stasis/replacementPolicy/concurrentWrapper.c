@@ -142,6 +142,15 @@ static void  cwInsert  (struct replacementPolicy* impl, Page* page) {
   rp->impl[bucket]->insert(rp->impl[bucket], page);
   pthread_mutex_unlock(&rp->mut[bucket]);
 }
+/** Split the new capacity evenly across the partitions. */
+static void  cwSetCapacity(struct replacementPolicy* impl, pageid_t capacity) {
+  stasis_replacement_policy_concurrent_wrapper_t * rp = impl->impl;
+  for(int i = 0; i < rp->num_buckets; i++) {
+    pthread_mutex_lock(&rp->mut[i]);
+    rp->impl[i]->setCapacity(rp->impl[i], capacity / rp->num_buckets);
+    pthread_mutex_unlock(&rp->mut[i]);
+  }
+}
 
 replacementPolicy* replacementPolicyConcurrentWrapperInit(replacementPolicy** rp, int count) {
   replacementPolicy *ret = malloc(sizeof(*ret));
@@ -170,6 +179,7 @@ replacementPolicy* replacementPolicyConcurrentWrapperInit(replacementPolicy** rp
   ret->getStaleAndRemove = cwGetStaleAndRemove;
   ret->remove = cwRemove;
   ret->insert = cwInsert;
+  ret->setCapacity = rpw->impl[0]->setCapacity ? cwSetCapacity : NULL;
   ret->impl = rpw;
   return ret;
 }
@@ -99,6 +99,7 @@ replacementPolicy * stasis_replacement_policy_lru_init() {
   ret->remove = stasis_replacement_policy_lru_remove;
   ret->getStaleAndRemove = stasis_replacement_policy_lru_get_stale_and_remove;
   ret->insert = stasis_replacement_policy_lru_insert;
+  ret->setCapacity = NULL;
   ret->impl = l;
   return ret;
 }
@@ -117,6 +117,7 @@ replacementPolicy * lruFastInit() {
   ret->remove = stasis_lru_fast_remove;
   ret->getStaleAndRemove = stasis_lru_fast_getStaleAndRemove;
   ret->insert = stasis_lru_fast_insert;
+  ret->setCapacity = NULL;
   lruFast * l = malloc(sizeof(lruFast));
   llInit(&l->list);
   ret->impl = l;
@@ -50,6 +50,12 @@ static void  tsInsert  (struct replacementPolicy* impl, Page* page) {
   rp->impl->insert(rp->impl, page);
   pthread_mutex_unlock(&rp->mut);
 }
+static void  tsSetCapacity(struct replacementPolicy* impl, pageid_t capacity) {
+  stasis_replacement_policy_threadsafe_wrapper_t * rp = impl->impl;
+  pthread_mutex_lock(&rp->mut);
+  rp->impl->setCapacity(rp->impl, capacity);
+  pthread_mutex_unlock(&rp->mut);
+}
 
 replacementPolicy* replacementPolicyThreadsafeWrapperInit(replacementPolicy* rp) {
   replacementPolicy *ret = malloc(sizeof(*ret));
@@ -63,6 +69,7 @@ replacementPolicy* replacementPolicyThreadsafeWrapperInit(replacementPolicy* rp)
   ret->getStaleAndRemove = tsGetStaleAndRemove;
   ret->remove = tsRemove;
   ret->insert = tsInsert;
+  ret->setCapacity = rp->setCapacity ? tsSetCapacity : NULL;
   ret->impl = rpw;
   return ret;
 }
@@ -12,6 +12,39 @@
 #include <assert.h>
 #include <sys/syscall.h>                // SYS_gettid
 
+/**
+   The table is stored as a list of segments whose sizes double, so that it
+   can grow without moving (or latching) existing entries.  Segment k holds
+   xids [FIRST_SEGMENT * (2^k - 1), FIRST_SEGMENT * (2^(k+1) - 1)), and is
+   published with a compare and swap once it is fully initialized; after
+   that, its pointer never changes.  Each entry is padded out to a multiple
+   of a cache line, so that threads running adjacent xids do not contend.
+
+   The recLSNs of the active transactions are kept in a min-heap, which is
+   split into independently latched shards (see dirtyPageTable.c), so
+   minRecLSN() does not need to look at every transaction.
+ */
+#define STASIS_TRANSACTION_TABLE_FIRST_SEGMENT_BITS 10
+#define STASIS_TRANSACTION_TABLE_FIRST_SEGMENT (1 << STASIS_TRANSACTION_TABLE_FIRST_SEGMENT_BITS)
+#define STASIS_TRANSACTION_TABLE_SEGMENT_COUNT 20
+#define STASIS_TRANSACTION_TABLE_SHARD_COUNT 16
+#define STASIS_CACHE_LINE_SIZE 64
+
+typedef union {
+  stasis_transaction_table_entry_t e;
+  char pad[(sizeof(stasis_transaction_table_entry_t) + STASIS_CACHE_LINE_SIZE - 1)
+           & ~(STASIS_CACHE_LINE_SIZE - 1)];
+} stasis_transaction_table_slot_t;
+
+typedef struct {
+  pthread_mutex_t mutex;
+  stasis_transaction_table_entry_t ** heap;
+  int count;
+  int heap_size;
+  // Keep shards on separate cache lines; the table is allocated with
+  // posix_memalign() so that this holds.
+} __attribute__((aligned(STASIS_CACHE_LINE_SIZE))) stasis_transaction_table_shard_t;
+
 struct stasis_transaction_table_t {
   int active_count;
 #ifndef HAVE_GCC_ATOMICS
@@ -25,11 +58,42 @@ struct stasis_transaction_table_t {
       This key points to thread local state, including fast-path access to RESERVED_XIDs.
    */
   pthread_key_t   key;
-  stasis_transaction_table_entry_t table[MAX_TRANSACTIONS];
+  stasis_transaction_table_slot_t * segments[STASIS_TRANSACTION_TABLE_SEGMENT_COUNT];
+  stasis_transaction_table_shard_t shards[STASIS_TRANSACTION_TABLE_SHARD_COUNT];
   stasis_transaction_table_callback_t * commitCallbacks[3];
   int commitCallbackCount[3];
 };
 
+static inline int segment_size(int k) {
+  return STASIS_TRANSACTION_TABLE_FIRST_SEGMENT << k;
+}
+/** @return the first xid stored in segment k */
+static inline int segment_start(int k) {
+  return segment_size(k) - STASIS_TRANSACTION_TABLE_FIRST_SEGMENT;
+}
+/** @return the entry for xid, or NULL if its segment has not been allocated. */
+static inline stasis_transaction_table_entry_t * get_slot(stasis_transaction_table_t * tbl, int xid) {
+  assert(xid >= 0);
+  unsigned int i = (unsigned int)xid + STASIS_TRANSACTION_TABLE_FIRST_SEGMENT;
+  int k = (31 - __builtin_clz(i)) - STASIS_TRANSACTION_TABLE_FIRST_SEGMENT_BITS;
+  if(k >= STASIS_TRANSACTION_TABLE_SEGMENT_COUNT) { return NULL; }
+  stasis_transaction_table_slot_t * seg = tbl->segments[k];
+  if(seg == NULL) { return NULL; }
+  return &seg[i - (unsigned int)segment_size(k)].e;
+}
+/** Install a newly initialized segment, unless another thread beat us to it. */
+static inline int publish_segment(stasis_transaction_table_t * tbl, int k, stasis_transaction_table_slot_t * seg) {
+#ifdef HAVE_GCC_ATOMICS
+  return __sync_bool_compare_and_swap(&tbl->segments[k], NULL, seg);
+#else
+  pthread_mutex_lock(&tbl->mut);
+  int ret = tbl->segments[k] == NULL;
+  if(ret) { tbl->segments[k] = seg; }
+  pthread_mutex_unlock(&tbl->mut);
+  return ret;
+#endif
+}
+
 static inline int test_and_set_entry(stasis_transaction_table_entry_t* e, int old, int new) {
 #ifdef HAVE_GCC_ATOMICS
   return __sync_bool_compare_and_swap(&(e->xid), old, new);
@@ -121,9 +185,87 @@ static void stasis_transaction_table_thread_destructor(void * p) {
 
 }
 
+static inline stasis_transaction_table_shard_t * shard_for(stasis_transaction_table_t * tbl,
+                                                            stasis_transaction_table_entry_t * l) {
+  return &tbl->shards[(((uintptr_t)l) / sizeof(stasis_transaction_table_slot_t))
+                      % STASIS_TRANSACTION_TABLE_SHARD_COUNT];
+}
+static inline void heap_set(stasis_transaction_table_shard_t * shard, int i, stasis_transaction_table_entry_t * l) {
+  shard->heap[i] = l;
+  l->recLSNIndex = i;
+}
+static void heap_sift_up(stasis_transaction_table_shard_t * shard, int i) {
+  stasis_transaction_table_entry_t * l = shard->heap[i];
+  while(i > 0) {
+    int parent = (i - 1) / 2;
+    if(shard->heap[parent]->recLSN <= l->recLSN) { break; }
+    heap_set(shard, i, shard->heap[parent]);
+    i = parent;
+  }
+  heap_set(shard, i, l);
+}
+static void heap_sift_down(stasis_transaction_table_shard_t * shard, int i) {
+  stasis_transaction_table_entry_t * l = shard->heap[i];
+  while(1) {
+    int child = 2 * i + 1;
+    if(child >= shard->count) { break; }
+    if(child + 1 < shard->count && shard->heap[child+1]->recLSN < shard->heap[child]->recLSN) {
+      child++;
+    }
+    if(l->recLSN <= shard->heap[child]->recLSN) { break; }
+    heap_set(shard, i, shard->heap[child]);
+    i = child;
+  }
+  heap_set(shard, i, l);
+}
+/** Must be called with the shard's mutex held. */
+static void heap_remove(stasis_transaction_table_shard_t * shard, stasis_transaction_table_entry_t * l) {
+  int i = l->recLSNIndex;
+  assert(shard->heap[i] == l);
+  l->recLSNIndex = -1;
+  shard->count--;
+  if(i != shard->count) {
+    stasis_transaction_table_entry_t * last = shard->heap[shard->count];
+    heap_set(shard, i, last);
+    if(i > 0 && shard->heap[(i-1)/2]->recLSN > last->recLSN) {
+      heap_sift_up(shard, i);
+    } else {
+      heap_sift_down(shard, i);
+    }
+  }
+}
+void stasis_transaction_table_set_recLSN(stasis_transaction_table_entry_t * l, lsn_t recLSN) {
+  if(l->tbl == NULL) {
+    l->recLSN = recLSN;
+    return;
+  }
+  stasis_transaction_table_shard_t * shard = shard_for(l->tbl, l);
+  pthread_mutex_lock(&shard->mutex);
+  if(l->recLSNIndex != -1) { heap_remove(shard, l); }
+  l->recLSN = recLSN;
+  if(recLSN != INVALID_LSN) {
+    if(shard->count == shard->heap_size) {
+      shard->heap_size *= 2;
+      shard->heap = realloc(shard->heap, sizeof(shard->heap[0]) * shard->heap_size);
+    }
+    shard->heap[shard->count] = l;
+    shard->count++;
+    heap_sift_up(shard, shard->count - 1);
+  }
+  pthread_mutex_unlock(&shard->mutex);
+}
+/** Stop tracking the recLSN of a transaction that is about to end. */
+static void stop_tracking_recLSN(stasis_transaction_table_t * tbl, stasis_transaction_table_entry_t * l) {
+  stasis_transaction_table_shard_t * shard = shard_for(tbl, l);
+  pthread_mutex_lock(&shard->mutex);
+  if(l->recLSNIndex != -1) { heap_remove(shard, l); }
+  pthread_mutex_unlock(&shard->mutex);
+}
+
 int stasis_transaction_table_is_active(stasis_transaction_table_t *tbl, int xid) {
-  assert(xid < MAX_TRANSACTIONS);
-  return xid >= 0 && tbl->table[xid].xid == xid;
+  if(xid < 0) { return 0; }
+  stasis_transaction_table_entry_t * l = get_slot(tbl, xid);
+  return l && l->xid == xid;
 }
 
 int stasis_transaction_table_register_callback(stasis_transaction_table_t *tbl,
@@ -135,11 +277,14 @@ int stasis_transaction_table_register_callback(stasis_transaction_table_t *tbl,
 
   *list = realloc(*list, (1+*count) * sizeof(*list[0]));
   (*list)[*count] = cb;
-  for(int i = 0; i < MAX_TRANSACTIONS; i++) {
-    void *** args;
-    args = &tbl->table[i].commitArgs[type];
-    *args = realloc(*args, (1+*count) * sizeof(*args[0]));
-    (*args)[*count] = 0;
+  // Callbacks are registered at startup, so this cannot race with segment allocation.
+  for(int k = 0; k < STASIS_TRANSACTION_TABLE_SEGMENT_COUNT && tbl->segments[k]; k++) {
+    for(int i = 0; i < segment_size(k); i++) {
+      void *** args;
+      args = &tbl->segments[k][i].e.commitArgs[type];
+      *args = realloc(*args, (1+*count) * sizeof(*args[0]));
+      (*args)[*count] = 0;
+    }
   }
   return (*count)++;
 }
@@ -165,7 +310,9 @@ int stasis_transaction_table_set_argument(stasis_transaction_table_t *tbl, int x
                                           stasis_transaction_table_callback_type_t type, void *arg) {
   assert(type >= 0 && type < 3);
   int count = tbl->commitCallbackCount[type];
-  void ** args = tbl->table[xid].commitArgs[type];
+  stasis_transaction_table_entry_t * l = get_slot(tbl, xid);
+  assert(l);
+  void ** args = l->commitArgs[type];
   assert(count > callback_id);
   args[callback_id] = arg;
   return 0;
@@ -175,43 +322,83 @@ int* stasis_transaction_table_list_active(stasis_transaction_table_t *tbl, int *
   int * ret = malloc(sizeof(*ret));
   ret[0] = INVALID_XID;
   *count = 0;
-  for(int i = 0; i < MAX_TRANSACTIONS; i++) {
-    int e_xid = get_entry_xid(&tbl->table[i]);
-    if(e_xid >= 0) {
-      ret[*count] = e_xid;
-      (*count)++;
-      ret = realloc(ret, ((*count)+1) * sizeof(*ret));
-      ret[*count] = INVALID_XID;
+  for(int k = 0; k < STASIS_TRANSACTION_TABLE_SEGMENT_COUNT && tbl->segments[k]; k++) {
+    for(int i = 0; i < segment_size(k); i++) {
+      int e_xid = get_entry_xid(&tbl->segments[k][i].e);
+      if(e_xid >= 0) {
+        ret[*count] = e_xid;
+        (*count)++;
+        ret = realloc(ret, ((*count)+1) * sizeof(*ret));
+        ret[*count] = INVALID_XID;
+      }
     }
   }
   return ret;
 }
 
+static stasis_transaction_table_slot_t * alloc_segment(stasis_transaction_table_t * tbl, int k) {
+  stasis_transaction_table_slot_t * seg;
+  int err = posix_memalign((void**)&seg, STASIS_CACHE_LINE_SIZE, sizeof(*seg) * segment_size(k));
+  if(err) { return NULL; }
+  for(int i = 0; i < segment_size(k); i++) {
+    stasis_transaction_table_entry_t * l = &seg[i].e;
+    l->xid = INVALID_XTABLE_XID;
+    l->xidWhenFree = INVALID_XTABLE_XID;
+    l->prevLSN = INVALID_LSN;
+    l->recLSN = INVALID_LSN;
+    for(int j = 0; j < 3; j++) {
+      int count = tbl->commitCallbackCount[j];
+      l->commitArgs[j] = count ? calloc(count, sizeof(l->commitArgs[j][0])) : 0;
+    }
+    l->tid = -1;
+    l->recLSNIndex = -1;
+    l->tbl = tbl;
+#ifndef HAVE_GCC_ATOMICS
+    pthread_mutex_init(&(l->mut),0);
+#endif
+  }
+  return seg;
+}
+static void free_segment(stasis_transaction_table_slot_t * seg, int k) {
+  for(int i = 0; i < segment_size(k); i++) {
+#ifndef HAVE_GCC_ATOMICS
+    pthread_mutex_destroy(&seg[i].e.mut);
+#endif
+    for(int j = 0; j < 3; j++) {
+      if(seg[i].e.commitArgs[j]) { free(seg[i].e.commitArgs[j]); }
+    }
+  }
+  free(seg);
+}
+
 stasis_transaction_table_t *  stasis_transaction_table_init() {
-  stasis_transaction_table_t * tbl = malloc(sizeof(*tbl));
+  stasis_transaction_table_t * tbl;
+  int err = posix_memalign((void**)&tbl, STASIS_CACHE_LINE_SIZE, sizeof(*tbl));
+  if(err) { errno = err; perror("Couldn't allocate transaction table"); abort(); }
   tbl->active_count = 0;
 
 #ifndef HAVE_GCC_ATOMICS
   pthread_mutex_init(&tbl->mut, NULL);
 #endif
 
-  for(int i = 0; i < MAX_TRANSACTIONS; i++) {
-    tbl->table[i].xid = INVALID_XTABLE_XID;
-    tbl->table[i].xidWhenFree = INVALID_XTABLE_XID;
-    tbl->table[i].commitArgs[0] = 0;
-    tbl->table[i].commitArgs[1] = 0;
-    tbl->table[i].commitArgs[2] = 0;
-    tbl->table[i].tid = -1;
-#ifndef HAVE_GCC_ATOMICS
-    pthread_mutex_init(&(tbl->table[i].mut),0);
-#endif
-  }
-
   for(int i = 0; i < 3; i++) {
     tbl->commitCallbacks[i] = 0;
     tbl->commitCallbackCount[i] = 0;
   }
 
+  for(int k = 0; k < STASIS_TRANSACTION_TABLE_SEGMENT_COUNT; k++) {
+    tbl->segments[k] = NULL;
+  }
+  tbl->segments[0] = alloc_segment(tbl, 0);
+  assert(tbl->segments[0]);
+
+  for(int i = 0; i < STASIS_TRANSACTION_TABLE_SHARD_COUNT; i++) {
+    pthread_mutex_init(&tbl->shards[i].mutex, 0);
+    tbl->shards[i].count = 0;
+    tbl->shards[i].heap_size = 16;
+    tbl->shards[i].heap = malloc(sizeof(tbl->shards[i].heap[0]) * tbl->shards[i].heap_size);
+  }
+
   DEBUG("initted xact table!\n");
 
   pthread_key_create(&tbl->key, stasis_transaction_table_thread_destructor);
@@ -229,10 +416,12 @@ void stasis_transaction_post_recovery(stasis_transaction_table_t *tbl) {
      * In particular there should be no entries being initialized or
      * reserved by a thread
      */
-    for(int i = 0; i < MAX_TRANSACTIONS; i++) {
-        assert(tbl->table[i].xid == INVALID_XTABLE_XID ||
-               tbl->table[i].xid >= 0);
-        assert(tbl->table[i].tid == -1);
+    for(int k = 0; k < STASIS_TRANSACTION_TABLE_SEGMENT_COUNT && tbl->segments[k]; k++) {
+      for(int i = 0; i < segment_size(k); i++) {
+        assert(tbl->segments[k][i].e.xid == INVALID_XTABLE_XID ||
+               tbl->segments[k][i].e.xid >= 0);
+        assert(tbl->segments[k][i].e.tid == -1);
+      }
     }
 }
 
@@ -241,13 +430,12 @@ void stasis_transaction_table_deinit(stasis_transaction_table_t *tbl) {
   pthread_mutex_destroy(&tbl->mut);
 #endif
 
-  for(int i = 0; i < MAX_TRANSACTIONS; i++) {
-#ifndef HAVE_GCC_ATOMICS
-    pthread_mutex_destroy(&tbl->table[i].mut);
-#endif
-    for(int j = 0; j < 3; j++) {
-      if(tbl->table[i].commitArgs[j]) { free(tbl->table[i].commitArgs[j]); }
-    }
+  for(int k = 0; k < STASIS_TRANSACTION_TABLE_SEGMENT_COUNT && tbl->segments[k]; k++) {
+    free_segment(tbl->segments[k], k);
+  }
+  for(int i = 0; i < STASIS_TRANSACTION_TABLE_SHARD_COUNT; i++) {
+    pthread_mutex_destroy(&tbl->shards[i].mutex);
+    free(tbl->shards[i].heap);
   }
   for(int j = 0; j < 3; j++) {
     if(tbl->commitCallbacks[j]) { free(tbl->commitCallbacks[j]); }
@@ -258,25 +446,30 @@ void stasis_transaction_table_deinit(stasis_transaction_table_t *tbl) {
 }
 lsn_t stasis_transaction_table_minRecLSN(stasis_transaction_table_t *tbl) {
   lsn_t minRecLSN = LSN_T_MAX;
-  DEBUG("Looping for minRecLSN");
-  for(int i = 0; i < MAX_TRANSACTIONS; i++) {
-    int e_xid = get_entry_xid(&(tbl->table[i]));
-    if(e_xid >= 0) {
-//      pthread_mutex_lock(&tbl->table[i].mut);
-      //XXX assumes reading LSNs is an atomic memory operation.
-      lsn_t recLSN = tbl->table[i].recLSN;
-      if(recLSN != -1 && recLSN < minRecLSN) {
-        minRecLSN = recLSN;
-      }
-//      pthread_mutex_unlock(&tbl->table[i].mut);
+  for(int i = 0; i < STASIS_TRANSACTION_TABLE_SHARD_COUNT; i++) {
+    stasis_transaction_table_shard_t * shard = &tbl->shards[i];
+    pthread_mutex_lock(&shard->mutex);
+    if(shard->count && shard->heap[0]->recLSN < minRecLSN) {
+      minRecLSN = shard->heap[0]->recLSN;
     }
+    pthread_mutex_unlock(&shard->mutex);
   }
   return minRecLSN;
 }
 
 int stasis_transaction_table_roll_forward(stasis_transaction_table_t *tbl, int xid, lsn_t lsn, lsn_t prevLSN) {
-  assert(xid >= 0 && xid < MAX_TRANSACTIONS);
-  stasis_transaction_table_entry_t * l = &tbl->table[xid];
+  stasis_transaction_table_entry_t * l = get_slot(tbl, xid);
+  if(l == NULL) {
+    // Recovery is single threaded, so the table can be grown in place.
+    for(int k = 0; k < STASIS_TRANSACTION_TABLE_SEGMENT_COUNT && !l; k++) {
+      if(!tbl->segments[k]) {
+        tbl->segments[k] = alloc_segment(tbl, k);
+        assert(tbl->segments[k]);
+      }
+      l = get_slot(tbl, xid);
+    }
+    assert(l);
+  }
   if(test_and_set_entry(l, xid, xid)) {
 //  if(l->xid == xid) {
     // rolling forward CLRs / NTAs makes prevLSN decrease.
@@ -285,7 +478,7 @@ int stasis_transaction_table_roll_forward(stasis_transaction_table_t *tbl, int x
     int b2 = test_and_set_entry(l, RESERVED_XTABLE_XID, xid);
     int b1 = test_and_set_entry(l, INVALID_XTABLE_XID, xid);
     assert(b1 || b2);
-    l->recLSN = lsn;
+    stasis_transaction_table_set_recLSN(l, lsn);
   }
   l->prevLSN = lsn;
   return 0;
@@ -293,11 +486,39 @@ int stasis_transaction_table_roll_forward(stasis_transaction_table_t *tbl, int x
 int stasis_transaction_table_roll_forward_with_reclsn(stasis_transaction_table_t *tbl, int xid, lsn_t lsn,
                                                       lsn_t prevLSN,
                                                       lsn_t recLSN) {
-  assert(xid >= 0 && xid < MAX_TRANSACTIONS);
-  assert(tbl->table[xid].recLSN == recLSN);
+  assert(get_slot(tbl, xid) && get_slot(tbl, xid)->recLSN == recLSN);
   return stasis_transaction_table_roll_forward(tbl, xid, lsn, prevLSN);
 }
 
+/**
+   Claim a free entry from the global pool, growing the table if every
+   allocated entry is in use.
+
+   @return the claimed xid, or INVALID_XID if the table is full.
+ */
+static int claim_free_entry(stasis_transaction_table_t * tbl) {
+  for(int k = 0; k < STASIS_TRANSACTION_TABLE_SEGMENT_COUNT; k++) {
+    stasis_transaction_table_slot_t * seg = tbl->segments[k];
+    if(seg == NULL) {
+      seg = alloc_segment(tbl, k);
+      if(seg == NULL) { return INVALID_XID; }
+      if(!publish_segment(tbl, k, seg)) {
+        // Another thread grew the table first; use its segment instead.
+        free_segment(seg, k);
+        seg = tbl->segments[k];
+      }
+    }
+    for(int i = 0; i < segment_size(k); i++) {
+      // Check before the compare and swap, which would take the cache line exclusive.
+      if(seg[i].e.xid == INVALID_XTABLE_XID
+         && test_and_set_entry(&seg[i].e, INVALID_XTABLE_XID, PENDING_XTABLE_XID)) {
+        return segment_start(k) + i;
+      }
+    }
+  }
+  return INVALID_XID;
+}
+
 stasis_transaction_table_entry_t * stasis_transaction_table_begin(stasis_transaction_table_t *tbl, int * xid) {
 
   stasis_transaction_table_entry_t * ret;
@@ -338,19 +559,16 @@ stasis_transaction_table_entry_t * stasis_transaction_table_begin(stasis_transac
   // Slow path - allocate from the global pool
 
   if(index == INVALID_XID) {
-
-    for(int i = 0; i < MAX_TRANSACTIONS; i++ ) {
-      if(test_and_set_entry(&tbl->table[i], INVALID_XTABLE_XID, PENDING_XTABLE_XID)) {
-        index = i;
-        tls->num_entries++;
-        tls->entries = realloc(tls->entries, sizeof(sizeof(ret)) * tls->num_entries);
-        tls->entries[tls->num_entries-1] = &tbl->table[index];
-        tls->indexes = realloc(tls->indexes, sizeof(int) * tls->num_entries);
-        tls->indexes[tls->num_entries-1] = index;
-        tbl->table[index].xidWhenFree = RESERVED_XTABLE_XID;
-        tbl->table[index].tid = tls->tid;
-        break;
-      }
+    index = claim_free_entry(tbl);
+    if(index != INVALID_XID) {
+      ret = get_slot(tbl, index);
+      tls->num_entries++;
+      tls->entries = realloc(tls->entries, sizeof(sizeof(ret)) * tls->num_entries);
+      tls->entries[tls->num_entries-1] = ret;
+      tls->indexes = realloc(tls->indexes, sizeof(int) * tls->num_entries);
+      tls->indexes[tls->num_entries-1] = index;
+      ret->xidWhenFree = RESERVED_XTABLE_XID;
+      ret->tid = tls->tid;
     }
   }
   if(index == INVALID_XID) {
@@ -360,31 +578,37 @@ stasis_transaction_table_entry_t * stasis_transaction_table_begin(stasis_transac
     DEBUG("begin xid %d\n", index);
     *xid = index;
     tls->last_entry = index;
-    ret = &tbl->table[index];
   }
 
   return ret;
 }
 stasis_transaction_table_entry_t * stasis_transaction_table_get(stasis_transaction_table_t *tbl, int xid) {
-  assert(xid >= 0 && xid < MAX_TRANSACTIONS);
-  if(tbl->table[xid].xid == xid) {
-    return &tbl->table[xid];
+  assert(xid >= 0);
+  stasis_transaction_table_entry_t * l = get_slot(tbl, xid);
+  if(l && l->xid == xid) {
+    return l;
   } else {
     return NULL;
   }
 }
 int stasis_transaction_table_commit(stasis_transaction_table_t *tbl, int xid) {
-  assert(xid >= 0 && xid < MAX_TRANSACTIONS);
+  stasis_transaction_table_entry_t * l = get_slot(tbl, xid);
+  assert(l);
 
-  set_entry(&(tbl->table[xid]), tbl->table[xid].xidWhenFree);
+  stop_tracking_recLSN(tbl, l);
+  set_entry(l, l->xidWhenFree);
 
   return 0;
 }
 int stasis_transaction_table_forget(stasis_transaction_table_t *tbl, int xid) {
-  assert(xid >= 0 && xid < MAX_TRANSACTIONS);
-  stasis_transaction_table_entry_t * l = &tbl->table[xid];
+  stasis_transaction_table_entry_t * l = get_slot(tbl, xid);
+  if(l == NULL) {
+    // during recovery, we might forget something we've never heard of.
+    return 0;
+  }
 
-  if(test_and_set_entry(&tbl->table[xid], xid, tbl->table[xid].xidWhenFree)) {
+  if(l->xid == xid) { stop_tracking_recLSN(tbl, l); }
+  if(test_and_set_entry(l, xid, l->xidWhenFree)) {
     // success
   } else {
     // during recovery, we might forget something we've never heard of.
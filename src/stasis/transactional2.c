@@ -63,7 +63,7 @@ stasis_log_t* stasis_log_default_factory() {
                                            stasis_log_file_permissions,
                                            stasis_log_softcommit);
     log_file->group_force =
-      stasis_log_group_force_init(log_file, 10 * 1000 * 1000); // timeout in nsec; want 10msec.
+      stasis_log_group_force_init(log_file, stasis_log_group_commit_max_wait_nsec);
   } else if(LOG_TO_MEMORY == stasis_log_type) {
     log_file = stasis_log_impl_in_memory_open();
     log_file->group_force = 0;
@@ -239,7 +239,7 @@ lsn_t TwritebackUpdate(int xid, pageid_t page,
   stasis_transaction_table_entry_t* l = stasis_transaction_table_get(stasis_transaction_table, xid);
   stasis_log_file->write_entry(stasis_log_file, e);
 
-  if(l->prevLSN == -1) { l->recLSN = e->LSN; }
+  if(l->prevLSN == INVALID_LSN) { stasis_transaction_table_set_recLSN(l, e->LSN); }
   l->prevLSN = e->LSN;
 
   stasis_log_file->write_entry_done(stasis_log_file, e);
@@ -387,6 +387,8 @@ int Tdeinit() {
   }
   free(active);
 
+  LinearHashNTAWriteBackCounts();
+
   active = stasis_transaction_table_list_active(stasis_transaction_table, &count);
   assert( count == 0 );
   free(active);
@@ -398,6 +400,7 @@ int Tdeinit() {
   TlinkedListNTADeinit();
   stasis_alloc_deinit(stasis_alloc);
   stasis_allocation_policy_deinit(stasis_allocation_policy);
+  regionsDeinit();
   stasis_buffer_manager->stasis_buffer_manager_close(stasis_buffer_manager);
   DEBUG("Closing page file tdeinit\n");
   stasis_page_deinit();
@@ -422,6 +425,7 @@ int TuncleanShutdown() {
   TlinkedListNTADeinit();
   stasis_alloc_deinit(stasis_alloc);
   stasis_allocation_policy_deinit(stasis_allocation_policy);
+  regionsDeinit();
 
   stasis_buffer_manager->stasis_buffer_manager_simulate_crash(stasis_buffer_manager);
   // XXX: close_file?
@@ -449,6 +453,9 @@ int TdurabilityLevel() {
 void TtruncateLog() {
   stasis_truncation_truncate(stasis_truncation, 1);
 }
+lsn_t Tcheckpoint() {
+  return stasis_truncation_checkpoint(stasis_truncation);
+}
 typedef struct {
   lsn_t prev_lsn;
   lsn_t compensated_lsn;
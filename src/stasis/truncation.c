@@ -1,6 +1,7 @@
 #include <stasis/transactional.h>
 #include <stasis/truncation.h>
 #include <stasis/bufferManager.h>
+#include <stasis/flags.h>
 #include <stdio.h>
 #include <assert.h>
 
@@ -14,6 +15,8 @@ struct stasis_truncation_t {
   stasis_transaction_table_t * transaction_table;
   stasis_buffer_manager_t * buffer_manager;
   stasis_log_t * log;
+  /** The LSN of the last checkpoint we wrote, or INVALID_LSN. */
+  lsn_t checkpoint_lsn;
 };
 
 #ifdef LONG_TEST
@@ -36,6 +39,7 @@ stasis_truncation_t * stasis_truncation_init(stasis_dirty_page_table_t * dpt, st
   ret->transaction_table = tbl;
   ret->buffer_manager = buffer_manager;
   ret->log = log;
+  ret->checkpoint_lsn = INVALID_LSN;
   return ret;
 }
 
@@ -64,6 +68,14 @@ static void* stasis_truncation_thread_worker(void* truncp) {
        > TARGET_LOG_SIZE) {
       stasis_truncation_truncate(trunc, 0);
     }
+    if(stasis_truncation_checkpoint_interval) {
+      lsn_t last = trunc->log->truncation_point(trunc->log);
+      if(trunc->checkpoint_lsn > last) { last = trunc->checkpoint_lsn; }
+      if(trunc->log->first_unstable_lsn(trunc->log, LOG_FORCE_WAL) - last
+         > stasis_truncation_checkpoint_interval) {
+        stasis_truncation_checkpoint(trunc);
+      }
+    }
     struct timeval now;
     struct timespec timeout;
     int timeret = gettimeofday(&now, 0);
@@ -124,7 +136,12 @@ int stasis_truncation_truncate(stasis_truncation_t* trunc, int force) {
       if(force || flushed - log_trunc > 2 * TARGET_LOG_SIZE) {
         DEBUG("Flushing dirty buffers: rec_lsn = %lld log_trunc = %lld flushed = %lld\n", rec_lsn, log_trunc, flushed);
         applied_lsn  = trunc->log->first_pending_lsn(trunc->log);
-        if(EAGAIN == stasis_dirty_page_table_flush(trunc->dirty_pages)) {
+        if(!force) {
+          // Rather than flushing the whole buffer pool, write back the
+          // pages that pin the oldest part of the log.  Fuzzy checkpoints
+          // keep redo from having to look at the rest.
+          stasis_dirty_page_table_try_flush_with_target(trunc->dirty_pages, flushed - TARGET_LOG_SIZE);
+        } else if(EAGAIN == stasis_dirty_page_table_flush(trunc->dirty_pages)) {
           applied_lsn  = trunc->log->first_pending_lsn(trunc->log);
           stasis_dirty_page_table_flush(trunc->dirty_pages); // can ignore ret val, since some other thread successfully initiated + completed a flush since our first call.
         }
@@ -148,3 +165,28 @@ int stasis_truncation_truncate(stasis_truncation_t* trunc, int force) {
     return 0;
   }
 }
+
+lsn_t stasis_truncation_checkpoint(stasis_truncation_t* trunc) {
+  // Every entry before begin_lsn has been applied to its page (see
+  // Tupdate()), so each page it touched is either in the dirty page
+  // table below, or was written back before we looked.
+  lsn_t begin_lsn = trunc->log->first_pending_lsn(trunc->log);
+  pageid_t count;
+  stasis_checkpoint_page_t * pages = stasis_dirty_page_table_checkpoint(trunc->dirty_pages, &count);
+
+  // The checkpoint says the pages it leaves out are clean, so they must
+  // reach disk before it does.
+  trunc->buffer_manager->forcePages(trunc->buffer_manager, 0);
+
+  LogEntry * e = allocCheckpointLogEntry(trunc->log, begin_lsn, count);
+  memcpy(stasis_log_entry_checkpoint_pages_ptr(e), pages, count * sizeof(pages[0]));
+  trunc->log->write_entry(trunc->log, e);
+  lsn_t ret = e->LSN;
+  trunc->log->write_entry_done(trunc->log, e);
+  free(pages);
+
+  stasis_log_force(trunc->log, ret, LOG_FORCE_WAL);
+  DEBUG("Checkpoint at %lld: %lld dirty pages, begin_lsn = %lld\n", ret, count, begin_lsn);
+  trunc->checkpoint_lsn = ret;
+  return ret;
+}
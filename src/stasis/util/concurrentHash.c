@@ -1,7 +1,7 @@
 /**
   concurrenthash.c
 
-  @file implementation of a concurrent, fixed-size hashtable
+  @file implementation of a concurrent, resizable hashtable
 
 
 ============================
@@ -15,9 +15,9 @@ the hashtable (or haven't yet looked at it), you should read concurrentHash.h
 for a discussion of this data structure's API, and non-standard concurrency
 primitives.
 
-This concurrent hash table implementation completely avoids the need for
-global latches, but is incapable of resizing itself at runtime.  It is based
-upon three ideas:
+This concurrent hash table implementation avoids the need for global latches
+during normal operation.  (Resizing, described at the end of this comment,
+briefly stops the world.)  It is based upon three ideas:
 
  - Islands, which we use to implement the NEAR primitive from navigational
    databases of lore.
@@ -332,6 +332,42 @@ unsafe usages of the hashtable API, and not the underlying implementation.
 Most should be detectable by ranking all locks and assigning the same rank to
 all hashtable locks.
 
+Resizing
+========
+
+The argument above relies on the table never being more than 50% full.
+Each insertion that leaves the table more than 25% full sets a flag, and
+the next operation to begin grows the table before it latches anything.
+Operations that see the flag queue up on a mutex, so no new operation
+starts until the resize finishes.  Operations that were already in flight
+hold at least one bucket latch from the moment they latch their first
+bucket until they return (or, for the _lock() variants, until
+hashtable_unlock()).
+
+The resizer latches every bucket of the old bucket array, rehashes its
+contents into an array twice as large, marks the old array "retired",
+publishes the new array, and unlatches the old buckets.  An operation
+that latched its first bucket before the resize started finishes
+normally, and the resizer waits for it.  One that latches its first
+bucket after the resize finishes sees that the array is retired, and
+starts over against the new array.
+
+The resizer cannot simply latch the buckets in order: an in-flight crab
+may hold the last bucket and wait on the first one (or, more generally,
+wrap around into buckets the resizer already holds).  Instead, it uses
+trylatch, and if a bucket is busy, releases everything, waits for the
+bucket to become free, and starts over.  Since no new operations start,
+this terminates once the in-flight operations drain.
+
+Retired arrays are not freed until hashtable_deinit(), since operations
+may still be about to latch (and then discard) one of their buckets.
+The arrays double in size, so this at most doubles the table's memory
+footprint.
+
+Each bucket latch is a single word, rather than a (recursive) pthread
+mutex.  Uncontended latches are acquired with one compare and swap; on
+Linux, contended latches sleep on a futex.
+
 Conclusion
 ==========
 
@@ -352,32 +388,87 @@ History:
 -r1475 14 Feb 2011  Slava found the mod bug, and wrote version 1 of the extensive
                     documentation above.  I expanded it into v2, and committed it.
  */
-#define _XOPEN_SOURCE 600
 #include <config.h>
 #include <stasis/util/concurrentHash.h>
 #include <stasis/util/hashFunctions.h>
 #include <assert.h>
 #include <stdio.h>
+#include <sched.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 //#define STASIS_HASHTABLE_FSCK_THREAD
 
+/**
+   Bucket latches are 0 if free, 1 if latched, and 2 if latched and
+   (possibly) contended.
+ */
+typedef int hashtable_latch_t;
+
 struct bucket_t {
   pageid_t key;
-  pthread_mutex_t mut;
   void * val;
+  hashtable_latch_t latch;
 };
 
-struct hashtable_t {
+struct hashtable_buckets_t {
   bucket_t* buckets;
   pageid_t maxbucketid;
+  /** Set, with every bucket latched, once the contents move to a larger array. */
+  int retired;
+  struct hashtable_buckets_t * next_retired;
+};
+
+struct hashtable_t {
+  hashtable_buckets_t * cur;
+  /** Set when the table is more than 25% full. */
+  int grow;
+  pthread_mutex_t resize_mut;
+  hashtable_buckets_t * retired;
+  /** Keep the counter off of the (read mostly) cache line above. */
+  char pad[64];
+  pageid_t count;
 #ifdef STASIS_HASHTABLE_FSCK_THREAD
   int is_open;
   pthread_t fsck_thread;
 #endif
 };
 
-static inline pageid_t hashtable_wrap(hashtable_t *ht, pageid_t p) {
-  return p & ht->maxbucketid;
+static inline int hashtable_trylatch(hashtable_latch_t * l) {
+  return __sync_bool_compare_and_swap(l, 0, 1);
+}
+static void hashtable_latch_slow(hashtable_latch_t * l) {
+  for(int i = 0; i < 100; i++) {
+    if(*(volatile hashtable_latch_t*)l == 0 && hashtable_trylatch(l)) { return; }
+  }
+#ifdef __linux__
+  while(__sync_lock_test_and_set(l, 2) != 0) {
+    syscall(SYS_futex, l, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+  }
+#else
+  while(!hashtable_trylatch(l)) { sched_yield(); }
+#endif
+}
+static inline void hashtable_latch(hashtable_latch_t * l) {
+  if(!hashtable_trylatch(l)) { hashtable_latch_slow(l); }
+}
+static inline void hashtable_unlatch(hashtable_latch_t * l) {
+#ifdef __linux__
+  if(__sync_fetch_and_sub(l, 1) != 1) {
+    __sync_synchronize();
+    *(volatile hashtable_latch_t*)l = 0;
+    syscall(SYS_futex, l, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+  }
+#else
+  __sync_lock_release(l);
+#endif
+}
+
+static inline pageid_t hashtable_wrap(hashtable_buckets_t *a, pageid_t p) {
+  return p & a->maxbucketid;
 }
 static inline pageid_t hash6432shift(pageid_t key)
 {
@@ -408,33 +499,52 @@ static inline pageid_t hash6432shift(pageid_t key)
   //return key * 13;
 #endif
 }
-static inline pageid_t hashtable_func(hashtable_t *ht, pageid_t key) {
-  return hashtable_wrap(ht, hash6432shift(key));
+static inline pageid_t hashtable_func(hashtable_buckets_t *a, pageid_t key) {
+  return hashtable_wrap(a, hash6432shift(key));
 }
 
 #ifdef STASIS_HASHTABLE_FSCK_THREAD
 void * hashtable_fsck_worker(void * htp);
 #endif
 
+static hashtable_buckets_t * hashtable_buckets_init(pageid_t newsize) {
+  hashtable_buckets_t * a = malloc(sizeof(*a));
+  a->maxbucketid = (newsize) - 1;
+  a->buckets = calloc(a->maxbucketid+1, sizeof(bucket_t));
+  for(pageid_t i = 0; i <= a->maxbucketid; i++) {
+    a->buckets[i].key = -1;
+  }
+  a->retired = 0;
+  a->next_retired = NULL;
+  return a;
+}
+static void hashtable_buckets_deinit(hashtable_buckets_t * a) {
+  free(a->buckets);
+  free(a);
+}
+
+/**
+   The smallest bucket array hashtable_init() allocates.  The table grows
+   once it is 25% full, so this leaves room for operations that are in
+   flight when that happens, and guarantees that every probe sequence
+   ends at an empty bucket.
+ */
+#define HASHTABLE_MIN_BUCKETS 64
+
 hashtable_t * hashtable_init(pageid_t size) {
   pageid_t newsize = 1;
   for(int i = 0; size; i++) {
     size /= 2;
     newsize *= 2;
   }
+  if(newsize < HASHTABLE_MIN_BUCKETS) { newsize = HASHTABLE_MIN_BUCKETS; }
   hashtable_t *ht = malloc(sizeof(*ht));
 
-  ht->maxbucketid = (newsize) - 1;
-  ht->buckets = calloc(ht->maxbucketid+1, sizeof(bucket_t));
-  for(int i = 0; i <= ht->maxbucketid; i++) {
-    ht->buckets[i].key = -1;
-  }
-  pthread_mutexattr_t attr;
-  pthread_mutexattr_init(&attr);
-  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
-  for(pageid_t i = 0; i <= ht->maxbucketid; i++) {
-    pthread_mutex_init(&(ht->buckets[i].mut), &attr);
-  }
+  ht->cur = hashtable_buckets_init(newsize);
+  ht->grow = 0;
+  pthread_mutex_init(&ht->resize_mut, 0);
+  ht->retired = NULL;
+  ht->count = 0;
 #ifdef STASIS_HASHTABLE_FSCK_THREAD
   ht->is_open = 1;
   pthread_create(&ht->fsck_thread,0, hashtable_fsck_worker, ht);
@@ -446,51 +556,108 @@ void hashtable_deinit(hashtable_t * ht) {
   ht->is_open = 0;
   pthread_join(ht->fsck_thread, 0);
 #endif
-  for(pageid_t i = 0; i <= ht->maxbucketid; i++) {
-    pthread_mutex_destroy(&ht->buckets[i].mut);
+  while(ht->retired) {
+    hashtable_buckets_t * next = ht->retired->next_retired;
+    hashtable_buckets_deinit(ht->retired);
+    ht->retired = next;
   }
-  free(ht->buckets);
+  hashtable_buckets_deinit(ht->cur);
+  pthread_mutex_destroy(&ht->resize_mut);
   free(ht);
 }
 
+pageid_t hashtable_size(hashtable_t * ht) {
+  return ht->cur->maxbucketid + 1;
+}
+
+/**
+   Latch every bucket of a.  See "Resizing", above.
+ */
+static void hashtable_latch_all(hashtable_buckets_t * a) {
+  pageid_t i = 0;
+  while(i <= a->maxbucketid) {
+    if(hashtable_trylatch(&a->buckets[i].latch)) {
+      i++;
+    } else {
+      for(pageid_t j = 0; j < i; j++) {
+        hashtable_unlatch(&a->buckets[j].latch);
+      }
+      while(*(volatile hashtable_latch_t*)&a->buckets[i].latch) {
+        sched_yield();
+      }
+      i = 0;
+    }
+  }
+}
+static void hashtable_grow(hashtable_t * ht) {
+  pthread_mutex_lock(&ht->resize_mut);
+  if(ht->grow) {
+    hashtable_buckets_t * old = ht->cur;
+    hashtable_latch_all(old);
+    pageid_t newsize = 2 * (old->maxbucketid + 1);
+    while(4 * ht->count > newsize) { newsize *= 2; }
+    hashtable_buckets_t * a = hashtable_buckets_init(newsize);
+    for(pageid_t i = 0; i <= old->maxbucketid; i++) {
+      if(old->buckets[i].val) {
+        pageid_t idx = hashtable_func(a, old->buckets[i].key);
+        while(a->buckets[idx].val) { idx = hashtable_wrap(a, idx+1); }
+        a->buckets[idx].key = old->buckets[i].key;
+        a->buckets[idx].val = old->buckets[i].val;
+      }
+    }
+    old->retired = 1;
+    old->next_retired = ht->retired;
+    ht->retired = old;
+    __sync_synchronize();
+    ht->cur = a;
+    ht->grow = 0;
+    for(pageid_t i = 0; i <= old->maxbucketid; i++) {
+      hashtable_unlatch(&old->buckets[i].latch);
+    }
+  }
+  pthread_mutex_unlock(&ht->resize_mut);
+}
+
 int hashtable_debug_number_of_key_copies(hashtable_t *ht, pageid_t pageid) {
+  hashtable_buckets_t * a = ht->cur;
   int count = 0;
-  for(int i = 0; i <= ht->maxbucketid; i++) {
-    if(ht->buckets[i].key == pageid) { count ++; }
+  for(int i = 0; i <= a->maxbucketid; i++) {
+    if(a->buckets[i].key == pageid) { count ++; }
   }
   if(count > 0) { fprintf(stderr, "%d copies of key %lld in hashtable!", count, (unsigned long long) pageid); }
   return count;
 }
 
 void hashtable_fsck(hashtable_t *ht) {
-  pthread_mutex_lock(&ht->buckets[0].mut);
-  for(int i = 1; i <= ht->maxbucketid; i++) {
-    pthread_mutex_lock(&ht->buckets[i].mut);
-    if(ht->buckets[i].key != -1) {
-      pageid_t this_hash_code = hashtable_func(ht, ht->buckets[i].key);
+  hashtable_buckets_t * a = ht->cur;
+  hashtable_latch(&a->buckets[0].latch);
+  for(int i = 1; i <= a->maxbucketid; i++) {
+    hashtable_latch(&a->buckets[i].latch);
+    if(a->buckets[i].key != -1) {
+      pageid_t this_hash_code = hashtable_func(a, a->buckets[i].key);
       if(this_hash_code != i) {
-        assert(ht->buckets[i-1].key != -1);
-        assert(ht->buckets[i-1].val != 0);
-        assert(this_hash_code < i || (this_hash_code > i + (ht->maxbucketid/2)));
+        assert(a->buckets[i-1].key != -1);
+        assert(a->buckets[i-1].val != 0);
+        assert(this_hash_code < i || (this_hash_code > i + (a->maxbucketid/2)));
       }
     } else {
-      assert(ht->buckets[i].val == NULL);
+      assert(a->buckets[i].val == NULL);
     }
-    pthread_mutex_unlock(&ht->buckets[i-1].mut);
+    hashtable_unlatch(&a->buckets[i-1].latch);
   }
-  pthread_mutex_lock(&ht->buckets[0].mut);
-  if(ht->buckets[0].key != -1) {
-    pageid_t this_hash_code = hashtable_func(ht, ht->buckets[0].key);
+  hashtable_latch(&a->buckets[0].latch);
+  if(a->buckets[0].key != -1) {
+    pageid_t this_hash_code = hashtable_func(a, a->buckets[0].key);
     if(this_hash_code != 0) {
-      assert(ht->buckets[ht->maxbucketid].key != -1);
-      assert(ht->buckets[ht->maxbucketid].val != 0);
-      assert(this_hash_code < 0 || (this_hash_code > 0 + (ht->maxbucketid/2)));
+      assert(a->buckets[a->maxbucketid].key != -1);
+      assert(a->buckets[a->maxbucketid].val != 0);
+      assert(this_hash_code < 0 || (this_hash_code > 0 + (a->maxbucketid/2)));
     }
   } else {
-    assert(ht->buckets[ht->maxbucketid].val == NULL);
+    assert(a->buckets[a->maxbucketid].val == NULL);
   }
-  pthread_mutex_unlock(&ht->buckets[ht->maxbucketid].mut);
-  pthread_mutex_unlock(&ht->buckets[0].mut);
+  hashtable_unlatch(&a->buckets[a->maxbucketid].latch);
+  hashtable_unlatch(&a->buckets[0].latch);
 }
 typedef enum {
   LOOKUP,
@@ -501,10 +668,20 @@ typedef enum {
 static inline void * hashtable_begin_op(hashtable_mode mode, hashtable_t *ht, pageid_t p, void *val, hashtable_bucket_handle_t *h) {
   static int warned = 0;
   assert(p != -1);
-  pageid_t idx = hashtable_func(ht, p);
+  hashtable_buckets_t * a;
+  pageid_t idx;
   void * ret;
-  bucket_t *b1 = &ht->buckets[idx], *b2 = NULL;
-  pthread_mutex_lock(&b1->mut); // start crabbing
+  bucket_t *b1, *b2 = NULL;
+  while(1) {
+    if(ht->grow) { hashtable_grow(ht); }
+    a = ht->cur;
+    idx = hashtable_func(a, p);
+    b1 = &a->buckets[idx];
+    hashtable_latch(&b1->latch); // start crabbing
+    if(!a->retired) { break; }
+    // We raced with a resize; try again against the new bucket array.
+    hashtable_unlatch(&b1->latch);
+  }
 
   int num_incrs = 0;
 
@@ -515,16 +692,18 @@ static inline void * hashtable_begin_op(hashtable_mode mode, hashtable_t *ht, pa
       warned = 1;
       printf("The hashtable is seeing lots of collisions.  Increase its size?\n");
     }
-    assert(num_incrs < (ht->maxbucketid/4));
+    // Probes never wrap all the way around; see HASHTABLE_MIN_BUCKETS.
+    assert(num_incrs <= a->maxbucketid);
     num_incrs++;
     if(b1->key == p) { assert(b1->val); ret = b1->val; break; }
     if(b1->val == NULL) { assert(b1->key == -1); ret = NULL; break; }
-    idx = hashtable_wrap(ht, idx+1);
+    idx = hashtable_wrap(a, idx+1);
     b2 = b1;
-    b1 = &ht->buckets[idx];
-    pthread_mutex_lock(&b1->mut);
-    pthread_mutex_unlock(&b2->mut);
+    b1 = &a->buckets[idx];
+    hashtable_latch(&b1->latch);
+    hashtable_unlatch(&b2->latch);
   }
+  h->a = a;
   h->b1 = b1; // at this point, b1 is latched.
   h->key = p;
   h->idx = idx;
@@ -546,19 +725,35 @@ void * hashtable_fsck_worker(void * htp) {
 #endif
 
 
-void hashtable_end_op(hashtable_mode mode, hashtable_t *ht, void *val, hashtable_bucket_handle_t *h) {
+/**
+   Complete an operation started by hashtable_begin_op().
+
+   @param unlatch If zero, leave h->b1 latched for the caller.  (Used by
+                  the _lock() variants; not supported for REMOVE.)
+ */
+static void hashtable_end_op(hashtable_mode mode, hashtable_t *ht, void *val, hashtable_bucket_handle_t *h, int unlatch) {
+  hashtable_buckets_t * a = h->a;
   pageid_t idx = h->idx;
   bucket_t * b1 = h->b1;
   bucket_t * b2 = NULL;
   if(mode == INSERT || (mode == TRYINSERT && h->ret == NULL)) {
     b1->key = h->key;
     b1->val = val;
+    if(h->ret == NULL) {
+      pageid_t count = __sync_add_and_fetch(&ht->count, 1);
+      if(4 * count > a->maxbucketid + 1) {
+        // The next operation to begin will grow the table.
+        ht->grow = 1;
+      }
+    }
   } else if(mode == REMOVE && h->ret != NULL)  {
+    assert(unlatch);
+    __sync_fetch_and_sub(&ht->count, 1);
     pageid_t idx2 = idx;
-    idx = hashtable_wrap(ht, idx+1);
+    idx = hashtable_wrap(a, idx+1);
     b2 = b1;
-    b1 = &ht->buckets[idx];
-    pthread_mutex_lock(&b1->mut);
+    b1 = &a->buckets[idx];
+    hashtable_latch(&b1->latch);
     while(1) {
       // Loop invariants: b2 needs to be overwritten.
       //                  b1 and b2 are latched
@@ -575,55 +770,55 @@ void hashtable_end_op(hashtable_mode mode, hashtable_t *ht, void *val, hashtable
       } else {
         // Case 2: b1 belongs "after" b2
 
-        pageid_t newidx = hashtable_func(ht, b1->key);
+        pageid_t newidx = hashtable_func(a, b1->key);
 
         // If newidx is past idx2, lookup will never find b1->key in position
         // idx2. Taking wraparound into account, and noticing that we never
         // have more than maxbucketid/4 elements in hash table, the following
         // expression detects if newidx is past idx2:
-        if(((idx2 - newidx) & ht->maxbucketid) > ht->maxbucketid/2) {
+        if(((idx2 - newidx) & a->maxbucketid) > a->maxbucketid/2) {
           // skip this b1.
   //        printf("s\n"); fflush(0);
-          idx = hashtable_wrap(ht, idx+1);
-          bucket_t * b0 = &ht->buckets[idx];
+          idx = hashtable_wrap(a, idx+1);
+          bucket_t * b0 = &a->buckets[idx];
           // Here we have to hold three buckets momentarily.  If we released b1 before latching its successor, then
           // b1 could be deleted by another thread, and the successor could be compacted before we latched it.
-          pthread_mutex_lock(&b0->mut);
-          pthread_mutex_unlock(&b1->mut);
+          hashtable_latch(&b0->latch);
+          hashtable_unlatch(&b1->latch);
           b1 = b0;
         } else {
           // Case 3: we can compact b1 into b2's slot.
 
-//        printf("c %lld %lld %lld  %lld\n", startidx, idx2, newidx, ht->maxbucketid); fflush(0);
+//        printf("c %lld %lld %lld  %lld\n", startidx, idx2, newidx, a->maxbucketid); fflush(0);
           b2->key = b1->key;
           b2->val = b1->val;
-          pthread_mutex_unlock(&b2->mut);
+          hashtable_unlatch(&b2->latch);
           // now we need to overwrite b1, so it is the new b2.
           idx2 = idx;
-          idx = hashtable_wrap(ht, idx+1);
+          idx = hashtable_wrap(a, idx+1);
           b2 = b1;
-          b1 = &ht->buckets[idx];
-          pthread_mutex_lock(&b1->mut);
+          b1 = &a->buckets[idx];
+          hashtable_latch(&b1->latch);
         }
       }
     }
-    pthread_mutex_unlock(&b2->mut);
+    hashtable_unlatch(&b2->latch);
+  }
+  if(unlatch) {
+    hashtable_unlatch(&b1->latch);  // stop crabbing
   }
-  pthread_mutex_unlock(&b1->mut);  // stop crabbing
 }
 static inline void * hashtable_op(hashtable_mode mode, hashtable_t *ht, pageid_t p, void *val) {
   hashtable_bucket_handle_t h;
   void * ret = hashtable_begin_op(mode, ht, p, val, &h);
-  hashtable_end_op(mode, ht, val, &h);
+  hashtable_end_op(mode, ht, val, &h, 1);
   return ret;
 }
 static inline void * hashtable_op_lock(hashtable_mode mode, hashtable_t *ht, pageid_t p, void *val, hashtable_bucket_handle_t *h) {
   void * ret = hashtable_begin_op(mode, ht, p, val, h);
-  // Nasty for a few reasons.  This forces us to use (slow) recursive mutexes.
-  // Also, if someone tries to crab over this bucket in order to get to an
-  // unrelated key, then it will block.
-  pthread_mutex_lock(&h->b1->mut);
-  hashtable_end_op(mode, ht, val, h);
+  // If someone tries to crab over this bucket in order to get to an
+  // unrelated key, then it will block until the caller unlocks it.
+  hashtable_end_op(mode, ht, val, h, 0);
   return ret;
 }
 
@@ -635,9 +830,9 @@ void * hashtable_test_and_set(hashtable_t *ht, pageid_t p, void * val) {
   hashtable_bucket_handle_t h;
   void * ret = hashtable_begin_op(TRYINSERT, ht, p, val, &h);
   if(ret) {
-    hashtable_end_op(LOOKUP, ht, val, &h);
+    hashtable_end_op(LOOKUP, ht, val, &h, 1);
   } else {
-    hashtable_end_op(INSERT, ht, val, &h);
+    hashtable_end_op(INSERT, ht, val, &h, 1);
   }
   return ret;
 }
@@ -660,7 +855,7 @@ void * hashtable_lookup_lock(hashtable_t *ht, pageid_t p, hashtable_bucket_handl
   return hashtable_op_lock(LOOKUP, ht, p, NULL, h);
 }
 void hashtable_unlock(hashtable_bucket_handle_t *h) {
-  pthread_mutex_unlock(&h->b1->mut);
+  hashtable_unlatch(&h->b1->latch);
 }
 
 void * hashtable_remove_begin(hashtable_t *ht, pageid_t p, hashtable_bucket_handle_t *h) {
@@ -668,9 +863,9 @@ void * hashtable_remove_begin(hashtable_t *ht, pageid_t p, hashtable_bucket_hand
 }
 void hashtable_remove_finish(hashtable_t *ht, hashtable_bucket_handle_t *h) {
  // when begin_remove_lock returns, it leaves the remove half done.  we then call this to decide if the remove should happen.  Other than hashtable_unlock, this is the only method you can safely call while holding a latch.
-  hashtable_end_op(REMOVE, ht, NULL, h);
+  hashtable_end_op(REMOVE, ht, NULL, h, 1);
 }
 void hashtable_remove_cancel(hashtable_t *ht, hashtable_bucket_handle_t *h) {
  // when begin_remove_lock returns, it leaves the remove half done.  we then call this to decide if the remove should happen.  Other than hashtable_unlock, this is the only method you can safely call while holding a latch.
-  hashtable_end_op(LOOKUP, ht, NULL, h);  // hack
+  hashtable_end_op(LOOKUP, ht, NULL, h, 1);  // hack
 }
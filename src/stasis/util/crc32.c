@@ -1,56 +1,136 @@
-// Calculate a CRC 32 checksum.
+// Calculate CRC 32 checksums.
 #include <stasis/util/crc32.h>  /*Added 10-6-04 */
 
-// LAST MODIFIED:[7-28-93]
+#include <pthread.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define STASIS_CRC32C_SSE42
+#include <nmmintrin.h>
+#endif
 
 // Usage:
 // unsigned long crc = -1L
 // crc = crc32(buffer, length, crc)
 
-uint32_t stasis_crc32(const void *buffer, unsigned int count, uint32_t crc);
-static int BuildCRCTable(void);
+#define CRC32_POLYNOMIAL	0xEDB88320
+#define CRC32C_POLYNOMIAL	0x82F63B78
 
-static unsigned int CRCTable[256];	// Table constructed for fast lookup.
+/*
+   Both checksums are computed eight bytes at a time ("slicing by 8").
+   table[0] is the classic byte-at-a-time table; table[k][i] is the CRC
+   of byte i followed by k zero bytes, so that eight independent lookups
+   can be XORed together to advance the CRC by eight bytes.
+*/
+static uint32_t crc32_table[8][256];
+static uint32_t crc32c_table[8][256];
 
-#define CRC32_POLYNOMIAL	0xEDB88320
+static pthread_once_t crc_tables_once = PTHREAD_ONCE_INIT;
+
+static void build_table(uint32_t table[8][256], uint32_t polynomial) {
+  for(int i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for(int j = 8; j > 0; j--) {
+      crc = (crc & 1) ? (crc >> 1) ^ polynomial : (crc >> 1);
+    }
+    table[0][i] = crc;
+  }
+  for(int i = 0; i < 256; i++) {
+    uint32_t crc = table[0][i];
+    for(int k = 1; k < 8; k++) {
+      crc = table[0][crc & 0xFF] ^ (crc >> 8);
+      table[k][i] = crc;
+    }
+  }
+}
+static void build_tables(void) {
+  build_table(crc32_table, CRC32_POLYNOMIAL);
+  build_table(crc32c_table, CRC32C_POLYNOMIAL);
+}
+
+static uint32_t crc_sliced(uint32_t table[8][256], const void *buffer, size_t count, uint32_t crc) {
+  const unsigned char *p = (const unsigned char *)buffer;
 
-// Initialize the CRC calculation table
-//
-static int BuildCRCTable(void)
-{
-	int i, j;
-	unsigned int crc;
-
-	for (i = 0; i <= 255; i++)
-	{
-		crc = i;
-		for (j = 8; j > 0; j--)
-			if (crc & 1)
-				crc = (crc >> 1) ^ CRC32_POLYNOMIAL;
-			else
-				crc >>= 1;
-		CRCTable[i] = crc;
-	}
-	return 0;
+  // Align p so that the eight byte loads below are aligned.
+  while(count && ((intptr_t)p & 7)) {
+    crc = table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    count--;
+  }
+  while(count >= 8) {
+    // Assemble the words byte by byte, so that this is endian-neutral.
+    uint32_t lo = crc ^ ((uint32_t)p[0] | ((uint32_t)p[1] << 8)
+                      | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+    uint32_t hi = ((uint32_t)p[4] | ((uint32_t)p[5] << 8)
+                | ((uint32_t)p[6] << 16) | ((uint32_t)p[7] << 24));
+    crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF]
+        ^ table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24]
+        ^ table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF]
+        ^ table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
+    p += 8;
+    count -= 8;
+  }
+  while(count--) {
+    crc = table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
 }
+
 /* changed long to int, void to const void - rusty. */
-uint32_t stasis_crc32(const void *buffer, unsigned int count, uint32_t crc)
-{
-	uint32_t temp1, temp2;
-	static int firsttime = 1;
-	unsigned char *p = (unsigned char *)buffer;
-
-	if (firsttime)
-	{
-		BuildCRCTable();
-		firsttime = 0;
-	}
-
-	while (count-- != 0)
-	{
-		temp1 = (crc >> 8) & 0x00FFFFFF;
-		temp2 = CRCTable[((int)crc ^ *p++) & 0xFF];
-		crc = temp1 ^ temp2;
-	}
-	return crc;
+uint32_t stasis_crc32(const void *buffer, unsigned int count, uint32_t crc) {
+  pthread_once(&crc_tables_once, build_tables);
+  return crc_sliced(crc32_table, buffer, count, crc);
+}
+
+uint32_t stasis_crc32c_table(const void *buffer, size_t count, uint32_t crc) {
+  pthread_once(&crc_tables_once, build_tables);
+  return crc_sliced(crc32c_table, buffer, count, crc);
+}
+
+#ifdef STASIS_CRC32C_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(const void *buffer, size_t count, uint32_t crc) {
+  const unsigned char *p = (const unsigned char *)buffer;
+  uint64_t crc64;
+
+  while(count && ((intptr_t)p & 7)) {
+    crc = _mm_crc32_u8(crc, *p++);
+    count--;
+  }
+  crc64 = crc;
+  while(count >= 8) {
+    crc64 = _mm_crc32_u64(crc64, *(const uint64_t*)p);
+    p += 8;
+    count -= 8;
+  }
+  crc = (uint32_t)crc64;
+  while(count--) {
+    crc = _mm_crc32_u8(crc, *p++);
+  }
+  return crc;
+}
+#endif
+
+int stasis_crc32c_hardware(void) {
+#ifdef STASIS_CRC32C_SSE42
+  return __builtin_cpu_supports("sse4.2");
+#else
+  return 0;
+#endif
+}
+
+static uint32_t (*crc32c_impl)(const void *, size_t, uint32_t);
+static pthread_once_t crc32c_impl_once = PTHREAD_ONCE_INIT;
+
+static void choose_crc32c_impl(void) {
+#ifdef STASIS_CRC32C_SSE42
+  if(stasis_crc32c_hardware()) {
+    crc32c_impl = crc32c_sse42;
+    return;
+  }
+#endif
+  crc32c_impl = stasis_crc32c_table;
+}
+
+uint32_t stasis_crc32c(const void *buffer, size_t count, uint32_t crc) {
+  pthread_once(&crc32c_impl_once, choose_crc32c_impl);
+  return crc32c_impl(buffer, count, crc);
 }
@@ -90,6 +90,11 @@ const void * stl_rblookup(int m, const void * key, rbtree *tp) {
 const void * stl_rbmin(rbtree *tp) {
   return *reinterpret_cast<rb*>(tp)->begin();
 }
+const void * stl_rbmax(rbtree *tp) {
+  rb* t = reinterpret_cast<rb*>(tp);
+  if(t->empty()) { return NULL; }
+  return *t->rbegin();
+}
 void stl_rbdestroy(rbtree * tp) {
   delete reinterpret_cast<rb*>(tp);
 }
@@ -14,6 +14,30 @@ void stasis_allocation_policy_transaction_completed(stasis_allocation_policy_t *
 void stasis_allocation_policy_update_freespace(stasis_allocation_policy_t * ap, pageid_t pageid, size_t freespace);
 void stasis_allocation_policy_dealloced_from_page(stasis_allocation_policy_t * ap, int xid, pageid_t page);
 void stasis_allocation_policy_alloced_from_page(stasis_allocation_policy_t * ap, int xid, pageid_t page);
+/**
+   Take a page out of the pool of available pages, so that the caller
+   may allocate from it without consulting the allocation policy.
+
+   Checked out pages are never returned by
+   stasis_allocation_policy_pick_suitable_page() or handed to another
+   caller, though transactions may still deallocate from them, or
+   allocate from them with TallocFromPage().  Callers that need to
+   know about such deallocations must track them separately.
+
+   @param ap The allocation policy managing the space in question
+   @param freespace The minimum amount of free space the page must have.
+   @param pageFreespace Set to the free space of the page that was checked out.
+   @return the page that was checked out, or INVALID_PAGE if no available
+           page has enough free space.
+ */
+pageid_t stasis_allocation_policy_checkout_page(stasis_allocation_policy_t * ap, size_t freespace, size_t * pageFreespace);
+/**
+   Return a page obtained from stasis_allocation_policy_checkout_page()
+   to the allocation policy.
+
+   @param freespace The amount of free space left on the page.
+ */
+void stasis_allocation_policy_checkin_page(stasis_allocation_policy_t * ap, pageid_t page, size_t freespace);
 /**
    Check to see if it is safe to allocate from a particular page.
 
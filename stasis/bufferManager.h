@@ -116,6 +116,20 @@ void releasePage(Page *p);
  * Switch the buffer manager into / out of redo mode.  Redo mode forces loadUnintializedPage() to behave like loadPage().
  */
 void stasis_buffer_manager_set_redo_mode(int in_redo);
+/**
+ * Grow or shrink the buffer manager while transactions are running.
+ *
+ * Shrinking evicts pages through the replacement policy, writing dirty
+ * pages back first, and blocks until enough frames are unpinned.  The
+ * caller must not hold the pins that it would be waiting for.
+ * stasis_buffer_manager_size and the dirty page limits are scaled to
+ * match the new size.
+ *
+ * @param size The new number of pages in the buffer manager.
+ * @return 0 on success, EINVAL if size is less than one, or ENOTSUP if
+ *         the buffer manager (or its replacement policy) cannot be resized.
+ */
+int stasis_buffer_manager_resize(pageid_t size);
 
 typedef struct stasis_buffer_manager_t stasis_buffer_manager_t;
 typedef void* stasis_buffer_manager_handle_t;
@@ -153,6 +167,15 @@ struct stasis_buffer_manager_t {
    *  FORCE mode transactions.
    */
   int    (*tryToWriteBackPage)(stasis_buffer_manager_t*, pageid_t p);
+  /**
+   *  Call tryToWriteBackPage on each page in pids, but pass the writes
+   *  to the page handle as a single batch.  Optional; this is NULL if
+   *  the buffer manager does not support batched writeback.
+   *
+   *  @return the number of pages that were skipped because they were
+   *          pinned (ie: tryToWriteBackPage would have returned EBUSY).
+   */
+  int    (*tryToWriteBackPages)(stasis_buffer_manager_t*, const pageid_t * pids, int count);
   /**
       Force any written back pages to disk.
 
@@ -186,6 +209,14 @@ struct stasis_buffer_manager_t {
   */
   void   (*forcePageRange)(struct stasis_buffer_manager_t*, stasis_buffer_manager_handle_t *h, pageid_t start, pageid_t stop);
   void   (*stasis_buffer_manager_simulate_crash)(struct stasis_buffer_manager_t*);
+  /**
+   *  Change the number of frames in the buffer manager.  Optional; this
+   *  is NULL if the buffer manager has a fixed size.  Callers must not
+   *  resize concurrently; use stasis_buffer_manager_resize() instead.
+   *
+   *  @return 0 on success, or an error code.
+   */
+  int    (*resize)(struct stasis_buffer_manager_t*, pageid_t size);
   /**
    * Write out any dirty pages.  Assumes that there are no running transactions
    */
@@ -202,6 +233,36 @@ struct stasis_buffer_manager_t {
   void * impl;
 };
 
+/**
+   Open a buffer manager handle for a sequential scan.
+
+   Pages that the scan brings into memory are kept in a small ring of
+   frames that belongs to the handle, and are not promoted in the
+   shared replacement policy, so a large scan does not evict the rest
+   of the cache.  Misses read ahead (@see
+   stasis_buffer_manager_scan_readahead).  Buffer managers that do not
+   implement scan rings simply return a handle that hints to the
+   operating system that I/O will be sequential.
+
+   @return a handle for loadPageWithHandle(), or NULL on failure.  Close
+   it with stasis_buffer_manager_close_handle() before Tdeinit().
+ */
+stasis_buffer_manager_handle_t * stasis_buffer_manager_open_sequential_handle(void);
+void stasis_buffer_manager_close_handle(stasis_buffer_manager_handle_t * h);
+/**
+   Like loadPage(), but use a handle from
+   stasis_buffer_manager_open_sequential_handle().  Release the page with
+   releasePage() as usual.
+ */
+Page * loadPageWithHandle(stasis_buffer_manager_handle_t * h, int xid, pageid_t pageid);
+/**
+   Like loadPageOfType(), but use a handle from
+   stasis_buffer_manager_open_sequential_handle().  Scans only read ahead
+   when type is UNKNOWN_TYPE_PAGE, since that is the only case where the
+   pages that follow can be checked against their headers.
+ */
+Page * loadPageOfTypeWithHandle(stasis_buffer_manager_handle_t * h, int xid, pageid_t pageid, pagetype_t type);
+
 #ifdef PROFILE_LATCHES_WRITE_ONLY
 #define loadPage(x,y) __profile_loadPage((x), (y), __FILE__, __LINE__)
 #define releasePage(x) __profile_releasePage((x))
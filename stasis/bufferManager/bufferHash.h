@@ -6,5 +6,11 @@ BEGIN_C_DECLS
 #include <stasis/pageHandle.h>
 stasis_buffer_manager_t* stasis_buffer_manager_hash_open(stasis_page_handle_t *ph, stasis_log_t *log, stasis_dirty_page_table_t *dpt);
 stasis_buffer_manager_t* stasis_buffer_manager_hash_factory(stasis_log_t *log, stasis_dirty_page_table_t *dpt);
+/**
+   @return the number of threads that are blocked because every frame is
+   pinned.  Used by the test suite to check that resize() waits for pages
+   to be released.
+ */
+int stasis_buffer_manager_hash_frame_waiters(stasis_buffer_manager_t *bm);
 END_C_DECLS
 #endif //STASIS_BUFFERMANAGER_BUFFERHASH_H
@@ -65,6 +65,22 @@ Page* stasis_buffer_pool_malloc_page(stasis_buffer_pool_t* pool);
     @see stasis_buffer_pool_malloc_page()
 */
 void  stasis_buffer_pool_free_page(stasis_buffer_pool_t* pool, Page * p, pageid_t id);
+/**
+    Make sure that the next count calls to stasis_buffer_pool_malloc_page()
+    will succeed, allocating more memory if necessary.  Used to grow the
+    buffer manager while it is running.
+*/
+void stasis_buffer_pool_reserve(stasis_buffer_pool_t* pool, pageid_t count);
+/**
+    Give a frame back to the pool, and return its memory to the operating
+    system.  The frame must be clean, and no longer reachable from the
+    buffer manager.  stasis_buffer_pool_malloc_page() may hand it out again.
+*/
+void stasis_buffer_pool_release_page(stasis_buffer_pool_t* pool, Page * p);
+/**
+    @return the frames that the pool was initialized with.  Frames added by
+    stasis_buffer_pool_reserve() are not part of this array.
+*/
 Page * stasis_buffer_pool_get_underlying_array(stasis_buffer_pool_t *ret);
 #endif // STASIS_BUFFER_POOL_H
 
@@ -71,7 +71,21 @@ terms specified in this license.
  */
 #define LLADD_EXCEED_MAX_TRANSACTIONS -5
 
-#define PAGE_SIZE 4096
+/**
+   The size of each page, in bytes.  This used to be a compile-time
+   constant; it is now chosen when a page file is created.
+
+   @see stasis_page_size
+ */
+#define PAGE_SIZE stasis_page_size
+#define STASIS_DEFAULT_PAGE_SIZE 4096
+#define STASIS_MIN_PAGE_SIZE     4096
+/** Slotted pages store offsets in 16-bit signed integers. */
+#define STASIS_MAX_PAGE_SIZE     (32 * 1024)
+
+BEGIN_C_DECLS
+extern int stasis_page_size;
+END_C_DECLS
 
 #define LOG_TO_FILE   0
 #define LOG_TO_MEMORY 1
@@ -88,6 +102,7 @@ terms specified in this license.
 #define STASIS_REPLACEMENT_POLICY_THREADSAFE_LRU 1
 #define STASIS_REPLACEMENT_POLICY_CONCURRENT_LRU 2
 #define STASIS_REPLACEMENT_POLICY_CLOCK 3
+#define STASIS_REPLACEMENT_POLICY_ARC 4
 
 #define MAX_TRANSACTIONS 1000
 
@@ -112,10 +127,10 @@ terms specified in this license.
 #define OPERATION_SEGMENT_FILE_PWRITE 12
 #define OPERATION_SEGMENT_FILE_PWRITE_INVERSE 13
 
-// 14
-// 15
-// 16
-// 17
+#define OPERATION_BTREE_NODE_INSERT 14
+#define OPERATION_BTREE_NODE_REMOVE 15
+#define OPERATION_BTREE_INSERT 16
+#define OPERATION_BTREE_REMOVE 17
 // 18
 
 #define OPERATION_NOOP        19
@@ -209,6 +224,13 @@ static const short SLOT_TYPE_LENGTHS[] = { -1, -1, sizeof(blob_record_t), -1};
 #define CLRLOG 7
 
 #define XPREPARE 8
+/**
+   A fuzzy checkpoint.  It records the dirty page table, so that redo can
+   skip updates that had already reached the page file.
+
+   @see stasis_truncation_checkpoint()
+*/
+#define XCHECKPOINT 9
 
 /* Page types */
 #define UNKNOWN_TYPE_PAGE (-1)
@@ -13,6 +13,7 @@ BEGIN_C_DECLS
 typedef struct stasis_dirty_page_table_t stasis_dirty_page_table_t;
 
 #include <stasis/bufferManager.h>
+#include <stasis/logger/logEntry.h>
 stasis_dirty_page_table_t * stasis_dirty_page_table_init(void);
 // XXX circular dependency
 void stasis_dirty_page_table_set_buffer_manager(stasis_dirty_page_table_t* dpt, stasis_buffer_manager_t* bm);
@@ -31,6 +32,23 @@ pageid_t stasis_dirty_page_table_dirty_count(stasis_dirty_page_table_t * dirtyPa
 int  stasis_dirty_page_table_flush(stasis_dirty_page_table_t * dirtyPages);
 int  stasis_dirty_page_table_flush_with_target(stasis_dirty_page_table_t * dirtyPages, lsn_t targetLsn);
 lsn_t stasis_dirty_page_table_minRecLSN(stasis_dirty_page_table_t* dirtyPages);
+/**
+   Make one pass over the pages with recLSN < targetLsn, oldest first, and
+   write back the ones that are not pinned.  Unlike flush_with_target(),
+   this does not wait for pinned pages, so it is safe to call from
+   background threads that must not block indefinitely.
+
+   @return 0 if every such page was written back, EAGAIN otherwise.
+*/
+int stasis_dirty_page_table_try_flush_with_target(stasis_dirty_page_table_t * dirtyPages, lsn_t targetLsn);
+/**
+   Copy the dirty page table for a fuzzy checkpoint.
+
+   @param count Set to the number of dirty pages.
+   @return a malloc()ed array of the dirty pages and their recLSNs, sorted
+           by page id.
+*/
+stasis_checkpoint_page_t * stasis_dirty_page_table_checkpoint(stasis_dirty_page_table_t * dirtyPages, pageid_t * count);
 
 /**
   This method returns a (mostly) contiguous range of the dirty page table for writeback.
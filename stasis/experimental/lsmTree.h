@@ -17,6 +17,7 @@
 */
 #include <stasis/common.h>
 #include <stasis/iterator.h>
+#include <stasis/bufferManager.h>
 #include <assert.h>
 
 BEGIN_C_DECLS
@@ -117,6 +118,8 @@ typedef struct lsmIteratorImpl {
   recordid current;
   lsmTreeNodeRecord *t;
   int justOnePage;
+  /** A sequential buffer manager handle for the leaves, or NULL. */
+  stasis_buffer_manager_handle_t * h;
 } lsmIteratorImpl;
 
 /**
@@ -25,6 +25,18 @@ extern stasis_log_t* (*stasis_log_factory)(void);
  */
 extern stasis_buffer_manager_t* (*stasis_buffer_manager_factory)(stasis_log_t*, stasis_dirty_page_table_t*);
 
+/**
+   The size of each page, in bytes.  Must be a power of two between
+   STASIS_MIN_PAGE_SIZE and STASIS_MAX_PAGE_SIZE.
+
+   This is used when Tinit() creates a new page file, and is recorded
+   in the file's header.  When Tinit() opens an existing page file, it
+   replaces this value with the one from the header.
+
+   Note that the buffer manager size and dirty page limits are counted
+   in pages, not bytes.
+ */
+extern int stasis_page_size;
 extern pageid_t stasis_buffer_manager_size;
 /**
  * The number of pages that must be dirty for the writeback thread to
@@ -92,9 +104,25 @@ extern stasis_handle_t* (*stasis_handle_factory)();
    This factory is invoked by the default stasis_handle_factory, and takes
    additional file system parameters as arguments.
 
-   Valid options: stasis_handle_open_file(), stasis_handle_open_pfile(), and stasis_handle_non_blocking_factory.
+   Valid options: stasis_handle_open_file(), stasis_handle_open_pfile(), stasis_handle_open_uring() and stasis_handle_non_blocking_factory.
  */
 extern stasis_handle_t* (*stasis_handle_file_factory)(const char* filename, int open_mode, int creat_perms);
+/**
+   The maximum number of requests that an io_uring handle will have in
+   flight at once.  Set at compile time by defining
+   STASIS_HANDLE_URING_QUEUE_DEPTH.
+
+   @see stasis_handle_open_uring()
+ */
+extern int stasis_handle_uring_queue_depth;
+/**
+   If true (the default), file handles merge adjacent requests passed to
+   read_batch() and write_batch() into a single preadv() or pwritev()
+   call.  Since writeback passes each quantum of dirty pages to the page
+   file as one batch, runs of contiguous dirty pages are written with one
+   system call.  Set this to zero to issue one call per request.
+ */
+extern int stasis_handle_coalesce_batches;
 /**
  * The default stripe size for Stasis' user space raid0 implementation.
  *
@@ -102,6 +130,12 @@ extern stasis_handle_t* (*stasis_handle_file_factory)(const char* filename, int
  */
 extern uint32_t stasis_handle_raid0_stripe_size;
 extern char ** stasis_handle_raid0_filenames;
+/**
+ * How long (in milliseconds) a raid1 handle waits for a mirror that has
+ * fallen behind the other one before it stops using that mirror, and
+ * carries on with a single copy.  Zero means wait forever.
+ */
+extern uint32_t stasis_handle_raid1_stall_timeout;
 /**
    The factory that non_blocking handles will use for slow handles.  (Only
    used if stasis_buffer_manager_io_handle_default_factory is set to
@@ -129,7 +163,9 @@ extern int stasis_buffer_manager_preallocate_mode;
    The default replacement policy.
 
    Valid values are STASIS_REPLACEMENT_POLICY_THREADSAFE_LRU,
-   STASIS_REPLACEMENT_POLICY_CONCURRENT_LRU and STASIS_REPLACEMENT_POLICY_CLOCK
+   STASIS_REPLACEMENT_POLICY_CONCURRENT_LRU, STASIS_REPLACEMENT_POLICY_CLOCK
+   and STASIS_REPLACEMENT_POLICY_ARC.  ARC resists scans: a large
+   sequential read will not evict pages that are referenced repeatedly.
  */
 extern int stasis_replacement_policy;
 /**
@@ -168,6 +204,13 @@ extern int stasis_suppress_unclean_shutdown_warnings;
    truncates the log.
  */
 extern int stasis_truncation_automatic;
+/**
+   The number of bytes of log that the truncation thread lets accumulate
+   between fuzzy checkpoints.  Zero disables periodic checkpoints.
+
+   @see stasis_truncation_checkpoint()
+ */
+extern lsn_t stasis_truncation_checkpoint_interval;
 
 /**
     This is the log implementation that is being used.
@@ -197,6 +240,12 @@ extern int    stasis_log_softcommit;
 extern char * stasis_store_file_name;
 extern char * stasis_store_file_1_name;
 extern char * stasis_store_file_2_name;
+/**
+   Records which raid1 mirror (stasis_store_file_1_name or
+   stasis_store_file_2_name) was dropped after an error or stall, so that
+   it is not trusted after a restart.  @see stasis_handle_open_raid1_durable
+ */
+extern char * stasis_store_file_raid1_degraded_name;
 
 
 /**
@@ -204,6 +253,28 @@ extern char * stasis_store_file_2_name;
  * which currently causes the pages to be read synchronously.
  */
 extern int stasis_buffer_manager_hash_prefetch_count;
+/**
+ * Maximum number of outstanding prefetch requests queued for the prefetch
+ * threads.  Adjacent and overlapping requests are coalesced into a single
+ * entry; once the queue is full, callers of prefetchPages() block until a
+ * prefetch thread dequeues a request.
+ */
+extern int stasis_buffer_manager_hash_prefetch_queue_length;
+/**
+ * The number of frames in the private ring used by each sequential
+ * buffer manager handle.  Pages that a sequential scan reads into
+ * memory live in the ring, instead of the shared replacement policy, so
+ * that scans do not evict the rest of the cache.  The ring is capped at
+ * one eighth of the buffer manager, and zero disables scan rings.
+ *
+ * @see stasis_buffer_manager_open_sequential_handle()
+ */
+extern int stasis_buffer_manager_scan_ring_size;
+/**
+ * The number of pages a sequential handle reads at once when the scan
+ * misses.  This is capped at half of the ring size.
+ */
+extern int stasis_buffer_manager_scan_readahead;
 
 extern const char * stasis_log_dir_name;
 extern const char * stasis_log_chunk_name;
@@ -221,10 +292,49 @@ extern lsn_t stasis_log_file_pool_chunk_min_size;
    Number of characters in log file names devoted to storing the LSN.
  */
 extern const int    stasis_log_file_pool_lsn_chars;
+/**
+   If true (the default), the file pool's writeback thread checksums
+   log entries with CRC32C just before writing them, instead of making
+   each writer compute a CRC32 while it holds its log reservation.
+   Entries record which checksum they use, so logs written in either
+   mode can be read in the other.
+ */
+extern int   stasis_log_file_pool_background_crc;
 /**
    Number of bytes that stasis' log may buffer before writeback.
  */
 extern lsn_t stasis_log_file_write_buffer_size;
+/**
+   If true, new LOG_TO_FILE logs store entries in the compact encoding
+   (see stasis_log_entry_compact()).  The encoding is recorded in the log
+   file, so existing logs keep the encoding they were created with.
+ */
+extern int   stasis_log_file_compact_entries;
+/**
+   Number of bytes that forward log scans (nextInLog()) read at a time.
+   Zero makes scans read one entry at a time with read_entry().
+ */
+extern lsn_t stasis_log_scan_buffer_size;
+/**
+   If true, group commit chooses how long to wait for other committing
+   transactions from the measured latency of recent log forces and the
+   rate at which commits arrive.  Otherwise, it waits the full
+   stasis_log_group_commit_max_wait_nsec whenever other transactions are
+   active.
+ */
+extern int stasis_log_group_commit_adaptive;
+/**
+   Upper bound on the time (in nanoseconds) that a commit waits for other
+   transactions to join its log force.
+ */
+extern uint64_t stasis_log_group_commit_max_wait_nsec;
+/**
+   How long (in nanoseconds) a lock request may wait before the lock
+   manager's deadlock detector looks for a cycle in the waits-for graph.
+   Once any transaction is waiting, the detector checks this often until
+   every waiter has been granted its lock or chosen as a victim.
+ */
+extern uint64_t stasis_lock_manager_deadlock_check_nsec;
 /**
    Set to 1 if segment based recovery is enabled.  This disables some
    optimizations that assume all operations are page based.
@@ -232,4 +342,32 @@ extern lsn_t stasis_log_file_write_buffer_size;
    @todo Stasis' segment implementation is a work in progress; therefore this is set to zero by default.
  */
 extern int stasis_segments_enabled;
+/**
+   If true when Tinit() creates a page file, each page in the file
+   reserves a word for a CRC32C checksum.  Stasis stamps the checksum as
+   pages are written back, and verifies it whenever a page is read from
+   disk.  A page that fails verification aborts the process.
+
+   The setting is recorded in the page file's header.  Existing page
+   files keep the setting they were created with, whatever this flag
+   says.
+ */
+extern int stasis_page_checksums;
+/**
+   The number of threads that replay page updates during the redo phase
+   of recovery.  One thread reads the log, and hands each update to the
+   thread responsible for the page it touches, so updates to any given
+   page are still applied in log order.  If this is 1, the log reader
+   applies every update itself.
+ */
+extern int stasis_recovery_redo_threads;
+/**
+   The number of partially free pages that each thread checks out of the
+   allocation policy for Talloc() to allocate from.  Threads only take
+   the allocator's mutex to refill or return their pages, so concurrent
+   allocations do not serialize on page loads and log writes.  If this
+   is 0, every Talloc() consults the allocation policy while holding the
+   mutex, as it did before arenas were introduced.
+ */
+extern int stasis_alloc_arena_pages;
 #endif
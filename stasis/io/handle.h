@@ -80,6 +80,17 @@ BEGIN_C_DECLS
 
  */
 
+/**
+   One request in a batch passed to read_batch() or write_batch().
+   The handle sets error to 0 or to the error code for this request.
+*/
+typedef struct stasis_handle_iov_t {
+  lsn_t off;
+  byte * buf;
+  lsn_t len;
+  int error;
+} stasis_handle_iov_t;
+
 /**
    This struct contains the function pointers that define handle
    implementations.  Implementations of the handle interface should
@@ -199,6 +210,19 @@ typedef struct stasis_handle_t {
   int (*async_force)(struct stasis_handle_t * h);
   int (*force_range)(struct stasis_handle_t * h, lsn_t start, lsn_t stop);
   int (*fallocate)(struct stasis_handle_t * h, lsn_t off, lsn_t len);
+  /**
+     Read a set of non-overlapping regions.  Implementations may issue
+     the requests concurrently, and in any order.  This method is
+     optional; callers should use stasis_handle_read_batch(), which
+     falls back on read() if it is NULL.
+
+     @return 0 if every request succeeded, or the first error encountered.
+  */
+  int (*read_batch)(struct stasis_handle_t * h, stasis_handle_iov_t * iov, int count);
+  /**
+     Write a set of non-overlapping regions.  Optional; see read_batch().
+  */
+  int (*write_batch)(struct stasis_handle_t * h, stasis_handle_iov_t * iov, int count);
   /**
      The handle's error flag; this passes errors to the caller when
      they can't be returned directly.
@@ -267,6 +291,23 @@ stasis_handle_t * stasis_handle(open_file)
 */
 stasis_handle_t * stasis_handle(open_pfile)
      (const char * path, int flags, int perm);
+/**
+   Open a handle that is backed by a file, and that uses Linux's
+   io_uring interface to perform read_batch(), write_batch(),
+   force_range() and async_force().  Each batch is submitted with a
+   single system call, and up to stasis_handle_uring_queue_depth
+   requests (from all threads that share the handle) may be in flight
+   at once.  Individual reads and writes use pread() and pwrite().
+
+   If this build or the running kernel does not support io_uring, this
+   prints a warning and returns stasis_handle_open_pfile(path, flags, perm).
+
+   @param path The name of the file to be opened.
+   @param flags Flags to be passed to open(). (eg O_CREAT)
+   @param perm The file permissions to be passed to open()
+*/
+stasis_handle_t * stasis_handle(open_uring)
+     (const char * path, int flags, int perm);
 /**
    Given a factory for creating "fast" and "slow" handles, provide a
    handle that never makes callers wait for write requests to
@@ -334,7 +375,23 @@ stasis_handle_t * stasis_handle(open_verifying)(stasis_handle_t * h);
    @param h All handle operations will be forwarded to h.
 */
 stasis_handle_t * stasis_handle(open_debug)(stasis_handle_t * h);
+/**
+   Open a raid1 handle that mirrors a and b.  If one mirror fails or
+   stalls while the other keeps working, the handle carries on with the
+   working mirror alone.  That decision only lasts until the handle is
+   closed; use open_raid1_durable for mirrors that outlive the handle.
+ */
 stasis_handle_t * stasis_handle(open_raid1)(stasis_handle_t *a, stasis_handle_t *b);
+/**
+   Open a raid1 handle that records dropped mirrors in degraded_file.
+
+   A mirror is only dropped once degraded_file has been forced to disk;
+   otherwise the error is returned to the caller.  If degraded_file
+   exists when the handle is opened, the mirror it names is neither read
+   nor written.  Once the mirrors have been resynchronized by copying the
+   working one over the stale one, delete degraded_file.
+ */
+stasis_handle_t * stasis_handle(open_raid1_durable)(stasis_handle_t *a, stasis_handle_t *b, const char * degraded_file);
 /**
  * Open a raid0 handle
  *
@@ -350,6 +407,16 @@ stasis_handle_t * stasis_handle_raid0_factory();
  * Open a Stasis file handle using default arguments.
  */
 stasis_handle_t * stasis_handle_default_factory();
+/**
+   Call h->read_batch(), or h->read() once per request if the handle
+   does not implement batches.
+ */
+int stasis_handle_read_batch(stasis_handle_t * h, stasis_handle_iov_t * iov, int count);
+/**
+   Call h->write_batch(), or h->write() once per request if the handle
+   does not implement batches.
+ */
+int stasis_handle_write_batch(stasis_handle_t * h, stasis_handle_iov_t * iov, int count);
 
 
 END_C_DECLS
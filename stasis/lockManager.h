@@ -2,6 +2,7 @@
 
 typedef struct {
   void (*init)();
+  void (*deinit)();
   int (*readLockPage)   (int xid, pageid_t page);
   int (*writeLockPage)  (int xid, pageid_t page);
   int (*unlockPage)     (int xid, pageid_t page);
@@ -17,12 +18,28 @@ extern LockManagerSetup globalLockManager;
 
 void lockManagerInit();
 
+/**
+   Record locks also take an intention lock (IS or IX) on the record's
+   page, so they conflict with page locks held by other transactions.
+
+   @return 0 on success, or LLADD_DEADLOCK if the deadlock detector
+           chose this transaction as a victim.  The caller should abort
+           the transaction, which releases its locks.
+*/
 int lockManagerReadLockRecord(int xid, recordid rid);
 int lockManagerWriteLockRecord(int xid, recordid rid);
 
 int lockManagerUnlockRecord(int xid, recordid rid);
 int lockManagerCommit(int xid);
 
+int lockManagerReadLockPage(int xid, pageid_t p);
+int lockManagerWriteLockPage(int xid, pageid_t p);
+int lockManagerUnlockPage(int xid, pageid_t p);
+
+/**
+   Install a lock manager.  These shut down the lock manager that was
+   previously installed (if any) first.
+ */
 void setupLockManagerCallbacksRecord();
 void setupLockManagerCallbacksPage();
 void setupLockManagerCallbacksNil();
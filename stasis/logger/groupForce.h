@@ -11,8 +11,34 @@
 #include <stasis/common.h>
 #include <stasis/logger/logger2.h>
 
+#define STASIS_LOG_GROUP_FORCE_BATCH_BUCKETS 32
+
+typedef struct {
+  /** Number of calls to stasis_log_group_force(). */
+  uint64_t commits;
+  /** Number of calls to force_tail(). */
+  uint64_t forces;
+  /** Number of commits that waited for others to join their force. */
+  uint64_t waits;
+  double total_wait_sec;
+  double forces_per_sec;
+  /** Moving average of force_tail() latency. */
+  double force_latency_sec;
+  /** Moving average of the time between commits. */
+  double commit_interarrival_sec;
+  /** batch_size[i] counts forces that covered 2^i to 2^(i+1)-1 commits. */
+  uint64_t batch_size[STASIS_LOG_GROUP_FORCE_BATCH_BUCKETS];
+} stasis_log_group_force_stats_t;
+
+/**
+   @param wait_nsec The longest a commit will wait for other transactions
+          to join its force.
+   @see stasis_log_group_commit_adaptive
+ */
 stasis_log_group_force_t * stasis_log_group_force_init(stasis_log_t * log, uint64_t wait_nsec);
 void stasis_log_group_force_deinit(stasis_log_group_force_t * lh);
 void stasis_log_group_force(stasis_log_group_force_t* lh, lsn_t lsn);
+void stasis_log_group_force_stats(stasis_log_group_force_t * lh, stasis_log_group_force_stats_t * stats);
+void stasis_log_group_force_print_stats(stasis_log_group_force_t * lh);
 
 #endif /* GROUPFORCE_H_ */
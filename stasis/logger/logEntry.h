@@ -62,6 +62,11 @@ BEGIN_C_DECLS
 typedef struct UpdateLogEntry UpdateLogEntry;
 typedef struct LogEntry LogEntry;
 typedef struct __raw_log_entry CLRLogEntry;
+/** A dirty page and its recLSN, as recorded by an XCHECKPOINT entry. */
+typedef struct {
+  pageid_t page;
+  lsn_t recLSN;
+} stasis_checkpoint_page_t;
 
 #include <stasis/logger/logger2.h>
 struct UpdateLogEntry {
@@ -98,6 +103,15 @@ LogEntry * mallocScratchCommonLogEntry(lsn_t lsn, lsn_t prevLSN, int xid, unsign
 LogEntry * allocCommonLogEntry(stasis_log_t *log, lsn_t prevLSN, int xid, unsigned int type);
 
 LogEntry * allocPrepareLogEntry(stasis_log_t *log, lsn_t prevLSN, int xid, lsn_t recLSN);
+
+/**
+   Allocate a checkpoint entry with room for page_count dirty pages.  The
+   caller fills them in with stasis_log_entry_checkpoint_pages_ptr().
+
+   @param beginLSN The LSN of the first entry that the recorded dirty page
+                   table may not reflect.
+*/
+LogEntry * allocCheckpointLogEntry(stasis_log_t *log, lsn_t beginLSN, pageid_t page_count);
 /**
    Allocate a log entry associated with an operation implemention.  This
    is usually called inside of Tupdate().
@@ -123,6 +137,36 @@ LogEntry * allocCLRLogEntry(stasis_log_t *log, const LogEntry * e);
    @return the length, in bytes, of e.
 */
 lsn_t sizeofLogEntry(stasis_log_t * log, const LogEntry * e);
+/**
+   The compact encoding of an entry is never more than this many bytes
+   longer than sizeofLogEntry().  (Only CLRs of non-update entries grow.)
+*/
+#define STASIS_LOG_ENTRY_COMPACT_SLACK 8
+/**
+   Encode a log entry in the compact on-disk format.  The entry's own
+   LSN is not stored; its prevLSN (and the LSN of a CLR's compensated
+   entry) is stored as a delta from it, and the remaining header fields
+   are stored as varints.  Payloads are copied unchanged.
+
+   @param log May be NULL unless e is of type INTERNALLOG.
+   @param buf Must have room for sizeofLogEntry(log, e) +
+          STASIS_LOG_ENTRY_COMPACT_SLACK bytes.
+   @return the number of bytes written to buf.
+*/
+lsn_t stasis_log_entry_compact(stasis_log_t * log, const LogEntry * e, byte * buf);
+/**
+   @return the number of bytes that stasis_log_entry_compact() would
+           write for e.
+*/
+lsn_t stasis_log_entry_compact_size(stasis_log_t * log, const LogEntry * e);
+/**
+   Decode an entry written by stasis_log_entry_compact().
+
+   @param lsn The LSN of the entry.
+   @return a LogEntry that should be freed with free(), or NULL if buf does
+           not hold a well-formed entry.
+*/
+LogEntry * stasis_log_entry_uncompact(lsn_t lsn, const byte * buf, lsn_t len);
 /**
  *    @return the operation's arguments, or NULL if there are no arguments.
 */
@@ -140,6 +184,14 @@ static inline const LogEntry * getCLRCompensated(const CLRLogEntry * e) {
 
 lsn_t getPrepareRecLSN(const LogEntry *e);
 
+lsn_t getCheckpointBeginLSN(const LogEntry *e);
+pageid_t getCheckpointPageCount(const LogEntry *e);
+/**
+   @return the dirty pages recorded by an XCHECKPOINT entry.
+ */
+stasis_checkpoint_page_t * stasis_log_entry_checkpoint_pages_ptr(LogEntry * e);
+const stasis_checkpoint_page_t * stasis_log_entry_checkpoint_pages_cptr(const LogEntry * e);
+
 END_C_DECLS
 
 #endif /* __LOGENTRY_H */
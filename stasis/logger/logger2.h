@@ -258,6 +258,30 @@ struct stasis_log_t {
    * @return true if this log implementation is durable, zero otherwise.
    */
   int (*is_durable)(struct stasis_log_t* log);
+  /**
+     Begin a sequential scan of the log.
+
+     Scans read the log in large blocks, and return entries from their
+     buffers, rather than reading and allocating each entry separately.
+     This method is optional; if it is NULL, LogHandle falls back on
+     read_entry().
+
+     @param log "this" log object
+     @param lsn The LSN of the first entry that scan_next() should return.
+     @return an implementation-specific scan, to be passed to scan_next()
+             and scan_close().
+  */
+  void* (*scan_open)(struct stasis_log_t* log, lsn_t lsn);
+  /**
+     @return the next entry in the scan, or NULL at the end of the log.
+             The entry belongs to the scan, and is only valid until the
+             next call to scan_next() or scan_close().
+  */
+  const LogEntry* (*scan_next)(struct stasis_log_t* log, void* scan);
+  /**
+     Free the resources associated with a scan.
+  */
+  void (*scan_close)(struct stasis_log_t* log, void* scan);
   /**
    * @see groupForce.c
    */
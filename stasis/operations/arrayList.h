@@ -76,6 +76,7 @@ terms specified in this license.
 #ifndef __ARRAY_LIST_H
 #define __ARRAY_LIST_H
 #include <stasis/operations.h>
+#include <stasis/bufferManager.h>
 /** Allocate a new array list.
 
     @param xid The transaction allocating the new arrayList.
@@ -112,6 +113,17 @@ int TarrayListExtend(int xid, recordid rid, int slots);
  */
 int TarrayListLength(int xid, recordid rid);
 
+/**
+   Like Tread(), but load the page that holds the entry with h.  Walks over
+   an ArrayList visit its pages in order, so callers that read many entries
+   should pass a handle from stasis_buffer_manager_open_sequential_handle(),
+   which keeps those pages out of the shared cache.
+
+   @param h A buffer manager handle, or NULL to use loadPage().
+   @param rid An ArrayList recordid, with rid.slot set to the index to read.
+ */
+void TarrayListRead(int xid, stasis_buffer_manager_handle_t * h, recordid rid, void * dat);
+
 /** Used by Tread() and Tset() to map from arrayList index to recordid. */
 recordid stasis_array_list_dereference_recordid(int xid, Page * p, int offset);
 
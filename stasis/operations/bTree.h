@@ -10,13 +10,60 @@
 
 #include <stasis/operations.h>
 
+/**
+   @file
+
+   A transactional B-link tree (a B+-tree whose nodes are linked to
+   their right siblings).
+
+   Readers hold at most one page latch at a time and move right along
+   the sibling links if they arrive at a node after a concurrent split.
+   Writers serialize per node, but never hold more than one node latch,
+   so threads working in different parts of the tree do not block each
+   other.
+
+   Inserts and removes are nested top actions with logical undo.
+   Splits are never undone, so a tree may contain more nodes than it
+   strictly needs after an abort.  Nodes are not merged when they
+   become sparse (like most B-link trees, we trade space utilization
+   for simpler concurrency control).
+
+   The root of the tree never moves; TbtreeCreate() returns a recordid
+   whose page field is the root page.
+*/
+
+/**
+   Compares two keys.  The last argument is the cmp_arg passed to
+   TbtreeInsert() and friends.  Inserts and removes write cmp_arg to the
+   log, and their logical undos (during abort and recovery) pass it back
+   to the comparator.  It must therefore be a value that means the same
+   thing in another process, such as the byte array comparator's prefix
+   length, not a pointer.
+ */
 typedef int(*stasis_comparator_t)(const void*, size_t, const void*, size_t, void*);
 typedef int16_t stasis_comparator_id_t;
 
+/** The largest key + value that can be stored in a B-tree. */
+#define BTREE_MAX_ENTRY_SIZE (USABLE_SIZE_OF_PAGE / 8)
+
 void BtreeDeinit(void);
 void BtreeInit();
 recordid TbtreeCreate(int xid, stasis_comparator_id_t cmp_id);
 int TbtreeLookup(int xid, recordid rid, void * cmp_arg, byte * key, size_t keySize, byte ** value, size_t* valueSize);
+/**
+   Insert a key into the tree, replacing the old value if the key exists.
+
+   @return 1 if the key was already present, 0 otherwise.
+ */
 int TbtreeInsert(int xid, recordid rid, void *cmp_arg, byte *key, size_t keySize, byte *value, size_t valueSize);
+/**
+   @return 1 if the key was present (and has been removed), 0 otherwise.
+ */
+int TbtreeRemove(int xid, recordid rid, void *cmp_arg, byte *key, size_t keySize);
+
+stasis_operation_impl stasis_op_impl_btree_insert();
+stasis_operation_impl stasis_op_impl_btree_remove();
+stasis_operation_impl stasis_op_impl_btree_node_insert();
+stasis_operation_impl stasis_op_impl_btree_node_remove();
 
 #endif /* BTREE_H_ */
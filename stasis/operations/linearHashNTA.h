@@ -23,6 +23,7 @@
 */
 
 #include <stasis/iterator.h>
+#include <stasis/bufferManager.h>
 
 #ifndef __LINEAR_HASH_NTA_H
 #define __LINEAR_HASH_NTA_H
@@ -88,6 +89,12 @@ stasis_operation_impl stasis_op_impl_linear_hash_insert();
 stasis_operation_impl stasis_op_impl_linear_hash_remove();
 
 void LinearHashNTAInit();
+/**
+   Write the in-memory entry counts back to the tables' headers.  Tdeinit()
+   calls this before it shuts down; without it, the inserts since each
+   table's last split would be forgotten, and the table would split late.
+ */
+void LinearHashNTAWriteBackCounts();
 void LinearHashNTADeinit();
 /** @} */
 
@@ -102,6 +109,8 @@ typedef struct {
   int valueSize;
   stasis_linkedList_iterator * it;
   lladd_pagedList_iterator * pit;
+  /** A sequential handle for reading the bucket array, or NULL. */
+  stasis_buffer_manager_handle_t * h;
 } lladd_hash_iterator;
 
 /** Currently, only used in the type field of the iterators. */
@@ -27,6 +27,8 @@ typedef struct boundary_tag {
 #define REGION_CONDEMNED (REGION_BASE + 3)
 
 void regionsInit(stasis_log_t *log);
+/** Free the in-memory index of the boundary tags. */
+void regionsDeinit();
 
 pageid_t TregionAlloc(int xid, pageid_t pageCount, int allocationManager);
 void TregionDealloc(int xid, pageid_t firstPage);
@@ -47,7 +49,11 @@ pageid_t TregionSize(int xid, pageid_t firstPage);
 void TregionForce(int xid, stasis_buffer_manager_t* bm, stasis_buffer_manager_handle_t* h, pageid_t pid);
 void TregionPrefetch(int xid, pageid_t firstPage);
 
-/** Currently, this function is O(n) in the number of regions, so be careful! */
+/**
+   Find the nth active region in the page file (counting from zero).
+   This is O(log n) in the number of regions, except for the first
+   region operation after Tinit(), which reads every boundary tag.
+ */
 void TregionFindNthActive(int xid, pageid_t n, pageid_t * firstPage, pageid_t * size);
 /**
  * Read the active boundary tag that follows the given region.
@@ -84,6 +84,12 @@ struct Page_s {
   struct Page_s *next;
   /** The previous item in the replacement policy's queue. */
   struct Page_s *prev;
+  /** Which of the replacement policy's queues the page belongs to (used by ARC) */
+  int queue;
+  /** The page's id when it was added to queue (used by ARC) */
+  pageid_t queueId;
+  /** When the page was added to queue, in replacement policy specific units (used by ARC) */
+  uint64_t queueStamp;
   /** How many times has the page been pinned? */
   int pinCount;
   /** Is the page pending I/O? (Used by some buffer managers) */
@@ -179,10 +185,15 @@ struct Page_s {
  |                                                                      |
  |                                                                      |
  |                                                                      |
- |                                                    +-----------+-----+
- |                                                    | page type | LSN |
- +----------------------------------------------------+-----------+-----+
+ |                                         +----------+-----------+-----+
+ |                                         | checksum | page type | LSN |
+ +-----------------------------------------+----------+-----------+-----+
 </pre>
+
+   The checksum is a CRC32C of the rest of the page.  It is only
+   present in page files that were created with stasis_page_checksums
+   set; otherwise the page type is followed directly by the page's
+   contents, and USABLE_SIZE_OF_PAGE is four bytes larger.
   */
 
 /**
@@ -231,7 +242,15 @@ void stasis_page_deinit();
 
 */
 /*@{*/
-static const size_t USABLE_SIZE_OF_PAGE = (PAGE_SIZE - sizeof(lsn_t) - sizeof(int));
+/**
+   The number of bytes that each page reserves for its checksum: zero,
+   or sizeof(uint32_t) if the page file was created with checksums.  Set
+   when the page file is opened.
+
+   @see stasis_page_checksums
+ */
+extern size_t stasis_page_checksum_size;
+#define USABLE_SIZE_OF_PAGE ((size_t)(PAGE_SIZE - sizeof(lsn_t) - sizeof(int) - stasis_page_checksum_size))
 
 /**
    Stasis records carry type information with them.  The type either
@@ -302,6 +321,14 @@ void stasis_record_compact(Page * p);
 void stasis_record_compact_slotids(int xid, Page * p);
 void stasis_uninitialized_page_loaded(int xid, Page * p);
 void stasis_page_loaded(Page * p, pagetype_t type);
+/**
+   Like stasis_page_loaded(p, UNKNOWN_TYPE_PAGE), but for pages that the
+   caller read speculatively, and that might not contain Stasis pages at
+   all.  If p is not an initialized page with a header (or its checksum
+   does not match), this returns zero without loading the page, instead
+   of aborting.
+ */
+int stasis_page_try_loaded(Page * p);
 void stasis_page_flushed(Page * p);
 void stasis_page_cleanup(Page * p);
 /**
@@ -94,6 +94,26 @@ static inline int* stasis_page(type_ptr)(PAGE *p) {
 static inline const int* stasis_page(type_cptr)(const PAGE *p) {
   return ((const int*)stasis_page(lsn_cptr)(p))-1;
 }
+/**
+   Returns a pointer to the page's checksum, which is stored immediately
+   before the page type.  Only valid if stasis_page_checksum_size is
+   non-zero.
+
+   @see stasis_page_checksums
+ */
+static inline uint32_t* stasis_page(checksum_ptr)(PAGE *p) {
+  return ((uint32_t*)stasis_page(type_ptr)(p))-1;
+}
+static inline const uint32_t* stasis_page(checksum_cptr)(const PAGE *p) {
+  return ((const uint32_t*)stasis_page(type_cptr)(p))-1;
+}
+/**
+   Returns a pointer to the start of the page's trailer (the checksum, if
+   the page file has them, then the page type and LSN).
+ */
+static inline byte* stasis_page(trailer_ptr)(PAGE *p) {
+  return ((byte*)stasis_page(type_ptr)(p)) - stasis_page_checksum_size;
+}
 
 /**
  * assumes that the page is already loaded in memory.  It takes as a
@@ -200,7 +220,7 @@ stasis_page(byte_ptr_from_start)(PAGE *p, int count) {
 }
 static inline byte*
 stasis_page(byte_ptr_from_end)(PAGE *p, int count) {
-  return ((byte*)stasis_page(type_ptr)(p))-count;
+  return stasis_page(trailer_ptr)(p)-count;
 }
 
 static inline int16_t*
@@ -210,7 +230,7 @@ stasis_page(int16_ptr_from_start)(PAGE *p, int count) {
 
 static inline int16_t*
 stasis_page(int16_ptr_from_end)(PAGE *p, int count) {
-  return ((int16_t*)stasis_page(type_ptr)(p))-count;
+  return ((int16_t*)stasis_page(trailer_ptr)(p))-count;
 }
 static inline int32_t*
 stasis_page(int32_ptr_from_start)(PAGE *p, int count) {
@@ -219,7 +239,7 @@ stasis_page(int32_ptr_from_start)(PAGE *p, int count) {
 
 static inline int32_t*
 stasis_page(int32_ptr_from_end)(PAGE *p, int count) {
-  return ((int32_t*)stasis_page(type_ptr)(p))-count;
+  return ((int32_t*)stasis_page(trailer_ptr)(p))-count;
 }
 static inline pageid_t*
 stasis_page(pageid_t_ptr_from_start)(PAGE *p, int count) {
@@ -228,7 +248,7 @@ stasis_page(pageid_t_ptr_from_start)(PAGE *p, int count) {
 
 static inline pageid_t*
 stasis_page(pageid_t_ptr_from_end)(PAGE *p, int count) {
-  return ((pageid_t*)stasis_page(type_ptr)(p))-count;
+  return ((pageid_t*)stasis_page(trailer_ptr)(p))-count;
 }
 // Const methods
 static inline const byte*
@@ -247,7 +267,7 @@ stasis_page(int16_cptr_from_start)(const PAGE *p, int count) {
 
 static inline const int16_t*
 stasis_page(int16_cptr_from_end)(const PAGE *p, int count) {
-  return ((int16_t*)stasis_page(type_cptr)(p))-count;
+  return (const int16_t*)stasis_page(int16_ptr_from_end)((PAGE*)p,count);
 }
 static inline const int32_t*
 stasis_page(int32_cptr_from_start)(const PAGE *p, int count) {
@@ -265,7 +285,7 @@ stasis_page(pageid_t_cptr_from_start)(const PAGE *p, int count) {
 
 static inline const pageid_t*
 stasis_page(pageid_t_cptr_from_end)(const PAGE *p, int count) {
-  return (const pageid_t*)stasis_page(pageid_t_cptr_from_end)(p,count);
+  return (const pageid_t*)stasis_page(pageid_t_ptr_from_end)((PAGE*)p,count);
 }
 /*@}*/
 
@@ -51,9 +51,9 @@ static inline void stasis_page(slotted_check)(const PAGE * page) {
 
   const long slotListStart = (const byte*)stasis_page(slotted_slot_length_cptr)(page, numslots-1)
                                   - (const byte*)stasis_page(memaddr)(page);
-  assert(slotListStart < PAGE_SIZE && slotListStart >= 0);
+  assert(slotListStart < (long)PAGE_SIZE && slotListStart >= 0);
   assert(numslots >= 0);
-  assert(numslots * SLOTTED_PAGE_OVERHEAD_PER_RECORD < PAGE_SIZE);
+  assert(numslots * (long)SLOTTED_PAGE_OVERHEAD_PER_RECORD < (long)PAGE_SIZE);
   assert(freespace >= 0);
   assert(freespace <= slotListStart);
   assert(freelist >= INVALID_SLOT);
@@ -112,7 +112,7 @@ static inline void stasis_page(slotted_check)(const PAGE * page) {
 
   const unsigned short S_SLOT_LIST = 0xFCFC;
 
-  byte image[PAGE_SIZE];
+  byte image[STASIS_MAX_PAGE_SIZE];
   for(unsigned short i = 0; i < PAGE_SIZE; i++) {
     image[i] = UNUSED;
   }
@@ -185,7 +185,7 @@ static inline ssize_t stasis_page(slotted_freespace_for_slot)(PAGE * page, sloti
 }
 
 static inline void stasis_page(slotted_compact)(PAGE * page) {
-  byte buffer[PAGE_SIZE];
+  byte buffer[STASIS_MAX_PAGE_SIZE];
 
   // Copy external headers into bufPage.
 
@@ -34,6 +34,18 @@ struct stasis_page_handle_t {
    *
    */
   void (*write)(struct stasis_page_handle_t* ph, Page * dat);
+  /**
+   * Write back a set of pages.  This is equivalent to calling write()
+   * on each page, but forces the log at most once, and passes the pages
+   * to the file handle as a single batch, so that handles that support
+   * batches (@see stasis_handle_open_uring) can have all of the writes
+   * in flight at once.
+   *
+   * @param dat The pages to be flushed.  The caller must hold a
+   * writelock on each page's loadlatch.
+   * @param count The number of pages in dat.
+   */
+  void (*write_batch)(struct stasis_page_handle_t* ph, Page ** dat, int count);
 
   /**
      Read a page from disk. This bypasses the cache, and should only be
@@ -50,12 +62,32 @@ struct stasis_page_handle_t {
      @see bufferManager.c for the implementation of read_page.
   */
   void (*read)(struct stasis_page_handle_t* ph, Page * ret, pagetype_t type);
+  /**
+     Read a set of pages with a single batch of requests.  Pages past
+     the end of the file are zero filled.
+
+     Unlike read(), this only copies the pages' bytes from disk; it does
+     not call stasis_page_loaded().  The caller must do so (or discard
+     the page) before the page is used.  This lets the buffer manager
+     read ahead without knowing the types of the pages it reads.
+
+     @param dat The pages to read, with ids set correctly.  As in read(),
+     no concurrent calls may be passed the same pages.
+     @param count The number of pages in dat.
+  */
+  void (*read_batch)(struct stasis_page_handle_t* ph, Page ** dat, int count);
   /**
      This function is a performance hint.  It tells the page handle to
      bring the page range into cache.  The hope is that this hint can be passed
      directly to the OS.
    */
   void  (*prefetch_range)(struct stasis_page_handle_t* ph, pageid_t pageid, pageid_t count);
+  /**
+     Prefetch several ranges of pages with a single batch of requests.
+     Range i is counts[i] pages long, and starts at pageids[i].
+     @see prefetch_range
+   */
+  void  (*prefetch_ranges)(struct stasis_page_handle_t* ph, const pageid_t * pageids, const pageid_t * counts, int count);
   /**
      Force the page file to disk.  Pages that have had pageWrite()
      called on them are guaranteed to be on disk after this returns.
@@ -110,4 +142,58 @@ stasis_page_handle_t * stasis_page_handle_open(struct stasis_handle_t * handle,
                                                stasis_log_t * log, stasis_dirty_page_table_t * dirtyPages);
 
 stasis_page_handle_t* stasis_page_handle_default_factory(stasis_log_t *log, stasis_dirty_page_table_t *dpt);
+
+/**
+   Each page file begins with a header page that records the size of
+   the file's pages, and whether they carry checksums.  The header
+   occupies a whole page so that the remaining pages stay aligned; page
+   p is stored at stasis_page_file_offset(p).
+
+   Version 1 page files always reserved a checksum word, and had no
+   flags.
+
+   Page files written before the header was introduced have no magic
+   number.  They are opened in the legacy layout: 4KB pages without
+   checksums, with page p stored at p * 4KB.  Stasis never adds a
+   header to such a file.
+ */
+#define STASIS_PAGE_FILE_MAGIC   "STASISPF"
+#define STASIS_PAGE_FILE_VERSION 2
+/** Each page reserves a checksum word.  @see stasis_page_checksums */
+#define STASIS_PAGE_FILE_CHECKSUMS 0x1
+/** The page size of page files that predate the header. */
+#define STASIS_PAGE_FILE_LEGACY_PAGE_SIZE 4096
+
+typedef struct {
+  char     magic[8];
+  uint32_t page_size;
+  uint32_t version;
+  uint32_t flags;
+} stasis_page_file_header_t;
+
+/** The number of pages before page 0; 0 in legacy page files. */
+extern pageid_t stasis_page_file_header_pages;
+
+static inline lsn_t stasis_page_file_offset(pageid_t pid) {
+  return (pid + stasis_page_file_header_pages) * (lsn_t)PAGE_SIZE;
+}
+/**
+   Populate the header for a new page file, using stasis_page_size and
+   stasis_page_checksums, and lay out pages accordingly.  Aborts if
+   stasis_page_size is not a legal page size.
+ */
+void stasis_page_file_header_init(stasis_page_file_header_t * h);
+/**
+   Inspect a header read from the start of a page file.
+
+   @param h The first STASIS_MIN_PAGE_SIZE bytes of the file, zero
+   filled past the end of the file.
+   @param file_len The length of the page file, in bytes.
+
+   @return 0 if the page file is new: it is empty, or holds a single
+   blank page.  Otherwise, adopt the file's layout (the legacy layout
+   if h has no magic number), and return 1.  Aborts if the magic
+   number is present, but the rest of the header is corrupt.
+ */
+int stasis_page_file_header_load(const stasis_page_file_header_t * h, lsn_t file_len);
 #endif //STASIS_PAGEHANDLE_H
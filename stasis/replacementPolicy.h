@@ -39,6 +39,10 @@ typedef struct replacementPolicy {
    *  consider (unless it has a non-zero pincount).
    */
   void (*insert)  (struct replacementPolicy* impl, Page* page);
+  /** The buffer manager now holds capacity pages.  NULL if the policy does
+   *  not depend on the size of the cache.
+   */
+  void (*setCapacity)(struct replacementPolicy* impl, pageid_t capacity);
   void * impl;
 } replacementPolicy;
 
@@ -47,3 +51,12 @@ replacementPolicy * lruFastInit();
 replacementPolicy* replacementPolicyThreadsafeWrapperInit(replacementPolicy* rp);
 replacementPolicy* replacementPolicyConcurrentWrapperInit(replacementPolicy** rp, int count);
 replacementPolicy* replacementPolicyClockInit(Page * pageArray, int page_count);
+/**
+   Create an ARC (adaptive replacement cache) policy.  This policy is not
+   threadsafe.
+
+   @param capacity The number of pages that will be inserted into this
+                   policy.  ARC remembers the ids of about this many
+                   recently evicted pages.
+ */
+replacementPolicy* replacementPolicyArcInit(pageid_t capacity);
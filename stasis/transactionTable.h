@@ -36,6 +36,17 @@ struct stasis_transaction_table_entry_t {
      or -1 if not owned by any thread
   */
   pid_t tid;
+  /**
+     Position of this entry in the table's recLSN heap, or -1 if the
+     entry's recLSN is not being tracked.  Protected by the heap's mutex.
+  */
+  int recLSNIndex;
+  /**
+     The transaction table that owns this entry, or NULL if the entry is
+     not part of a transaction table (e.g., it lives on the stack of a
+     unit test).
+  */
+  stasis_transaction_table_t * tbl;
 #ifndef HAVE_GCC_ATOMICS
   pthread_mutex_t mut;
 #endif
@@ -59,9 +70,19 @@ int stasis_transaction_table_roll_forward_with_reclsn(stasis_transaction_table_t
                                                       lsn_t prevLSN,
                                                       lsn_t recLSN);
 /**
-    This is used by log truncation.
+    This is used by log truncation.  It runs in time proportional to
+    the number of recLSN heap shards, not the number of transactions.
 */
 lsn_t stasis_transaction_table_minRecLSN(stasis_transaction_table_t*);
+/**
+   Set the recLSN of a transaction.  The logger calls this when a
+   transaction writes its first log entry, so that the transaction
+   table can maintain minRecLSN incrementally.
+
+   @param l The transaction.  If it does not belong to a transaction
+            table, this simply sets l->recLSN.
+*/
+void stasis_transaction_table_set_recLSN(stasis_transaction_table_entry_t * l, lsn_t recLSN);
 
 stasis_transaction_table_entry_t * stasis_transaction_table_begin(stasis_transaction_table_t*,int * xid);
 stasis_transaction_table_entry_t * stasis_transaction_table_get(stasis_transaction_table_t*,int xid);
@@ -800,6 +800,14 @@ int TdurabilityLevel(void);
  * transactions can prevent it from completely emptying the log).
  */
 void TtruncateLog(void);
+/**
+ * Write a fuzzy checkpoint to the log.  Unlike TtruncateLog(), this
+ * does not write back any dirty pages, but it lets recovery skip
+ * updates that had already reached disk.
+ *
+ * @return the LSN of the checkpoint.
+ */
+lsn_t Tcheckpoint(void);
 /**
  * Default log factory.
  */
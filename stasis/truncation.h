@@ -78,5 +78,17 @@ void stasis_truncation_thread_start(stasis_truncation_t* trunc);
    Initiate a round of log truncation.
 */
 int stasis_truncation_truncate(stasis_truncation_t* trunc, int force);
+/**
+   Write a fuzzy checkpoint to the log.
+
+   The checkpoint records the dirty page table without writing any dirty
+   pages back.  During recovery, redo skips updates to pages that the
+   checkpoint shows had already reached the page file, so restart time
+   is bounded by the work done since the checkpoint, rather than by the
+   length of the log.
+
+   @return the LSN of the checkpoint entry.
+*/
+lsn_t stasis_truncation_checkpoint(stasis_truncation_t* trunc);
 END_C_DECLS
 #endif
@@ -1,8 +1,9 @@
 /**
  * concurrentHash.h
  *
- * @file A concurrent, fixed-size hashtable that allows users to obtain latches
- *       on its keys.
+ * @file A concurrent hashtable that allows users to obtain latches on its keys.
+ *       The table grows as entries are inserted, so the size passed to
+ *       hashtable_init() is only a hint.
  *
  * Operations against this hashtable proceed in two phases.  In the first phase,
  * the bucket that contains (or will contain) the requested key is located.  At
@@ -29,8 +30,10 @@
 
 typedef struct hashtable_t hashtable_t;
 typedef struct bucket_t bucket_t;
+typedef struct hashtable_buckets_t hashtable_buckets_t;
 
 typedef struct hashtable_bucket_handle_t {
+  hashtable_buckets_t * a;
   bucket_t * b1;
   pageid_t key;
   pageid_t idx;
@@ -46,6 +49,8 @@ void * hashtable_insert(hashtable_t *ht, pageid_t p, void * val);
 void * hashtable_test_and_set(hashtable_t *ht, pageid_t p, void * val);
 void * hashtable_lookup(hashtable_t *ht, pageid_t p);
 void * hashtable_remove(hashtable_t *ht, pageid_t p);
+/** @return the number of buckets currently allocated by the hashtable. */
+pageid_t hashtable_size(hashtable_t *ht);
 
 
 void * hashtable_test_and_set_lock(hashtable_t *ht, pageid_t p, void * val, hashtable_bucket_handle_t *h);
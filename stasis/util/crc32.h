@@ -1,12 +1,12 @@
 #ifndef STASIS_CRC32_H
 #define STASIS_CRC32_H
 
-/* This CRC code was taken from: http://www.axlradius.com/freestuff/crc2.c
+/* This CRC code was originally taken from: http://www.axlradius.com/freestuff/crc2.c
 
    (It is presumably in the public domain.  Other files under /freestuff/ are...)
 
-   ( Added a #include for this .h file.  Otherwise, crc32 is a verbatim copy of the file from the internet.)
-
+   It has since been rewritten to process eight bytes per iteration,
+   and extended with CRC32C, which modern x86 CPUs compute in hardware.
 */
 
 
@@ -20,7 +20,26 @@
 
 BEGIN_C_DECLS
 
+/**
+   The IEEE 802.3 CRC32 (the polynomial used by zlib and ethernet).
+   Stasis' log format uses this checksum.
+ */
 uint32_t stasis_crc32(const void *buffer, unsigned int count, uint32_t crc);
+/**
+   The Castagnoli CRC32C.  Uses the SSE4.2 crc32 instruction if the
+   CPU supports it, and falls back on stasis_crc32c_table() otherwise.
+   Usage is the same as for stasis_crc32().
+ */
+uint32_t stasis_crc32c(const void *buffer, size_t count, uint32_t crc);
+/**
+   Software implementation of stasis_crc32c().  Exposed for testing
+   and benchmarking.
+ */
+uint32_t stasis_crc32c_table(const void *buffer, size_t count, uint32_t crc);
+/**
+   @return non-zero if stasis_crc32c() is computed in hardware.
+ */
+int stasis_crc32c_hardware(void);
 
 END_C_DECLS
 #endif // STASIS_CRC32_H
@@ -17,6 +17,7 @@ const void * stl_rbfind(const void * key, rbtree * tp);
 const void * stl_rbsearch(const void * key, rbtree * tp);
 const void * stl_rblookup(int m, const void * k, rbtree *tp);
 const void * stl_rbmin(rbtree *tp);
+const void * stl_rbmax(rbtree *tp);
 void stl_rbdestroy(rbtree * tp);
 
 #ifdef STLSEARCH
@@ -27,6 +28,8 @@ void stl_rbdestroy(rbtree * tp);
 #define rbfind stl_rbfind
 #undef rbmin
 #define rbmin stl_rbmin
+#undef rbmax
+#define rbmax stl_rbmax
 #define rblookup stl_rblookup
 #endif
 
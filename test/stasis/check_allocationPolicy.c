@@ -116,6 +116,43 @@ START_TEST(allocationPolicy_smokeTest)
 
 } END_TEST
 
+/**
+   @test
+   Checked out pages are invisible to the allocation policy until they
+   are checked back in.
+*/
+START_TEST(allocationPolicy_checkoutTest)
+{
+  stasis_allocation_policy_t * ap = stasis_allocation_policy_init();
+  stasis_allocation_policy_register_new_page(ap, 0, 100);
+  stasis_allocation_policy_register_new_page(ap, 1, 50);
+  stasis_allocation_policy_register_new_page(ap, 2, 25);
+
+  size_t freespace;
+  pageid_t pageid1 = stasis_allocation_policy_checkout_page(ap, 10, &freespace);
+  assert(pageid1 == 0);
+  assert(freespace == 100);
+
+  assert(stasis_allocation_policy_pick_suitable_page(ap, 1, 51) == INVALID_PAGE);
+  assert(stasis_allocation_policy_checkout_page(ap, 51, &freespace) == INVALID_PAGE);
+
+  pageid_t pageid2 = stasis_allocation_policy_checkout_page(ap, 10, &freespace);
+  assert(pageid2 == 1);
+  assert(freespace == 50);
+
+  // Deallocations and transaction completion leave checked out pages alone.
+  stasis_allocation_policy_dealloced_from_page(ap, 1, pageid2);
+  stasis_allocation_policy_transaction_completed(ap, 1);
+  assert(stasis_allocation_policy_pick_suitable_page(ap, 2, 26) == INVALID_PAGE);
+
+  stasis_allocation_policy_checkin_page(ap, pageid1, 75);
+  assert(stasis_allocation_policy_pick_suitable_page(ap, 2, 51) == pageid1);
+  stasis_allocation_policy_checkin_page(ap, pageid2, 40);
+  assert(stasis_allocation_policy_pick_suitable_page(ap, 2, 26) == pageid2);
+
+  stasis_allocation_policy_deinit(ap);
+} END_TEST
+
 #define AVAILABLE_PAGE_COUNT_A 1000
 #define AVAILABLE_PAGE_COUNT_B 10
 #define FREE_MUL 100
@@ -254,6 +291,7 @@ Suite * check_suite(void) {
   /* Sub tests are added, one per line, here */
   // XXX this test might be flawed.
   tcase_add_test(tc, allocationPolicy_smokeTest);
+  tcase_add_test(tc, allocationPolicy_checkoutTest);
   tcase_add_test(tc, allocationPolicy_randomTest);
 
   /* --------------------------------------------- */
@@ -70,6 +70,7 @@ START_TEST(bTreeTest) {
   assert(thevalsize == sizeof(val));
   assert(*theval == val);
   Tcommit(xid);
+  xid = Tbegin();
 
   for(int j = 250; j > 0; j--) {
     int i;
@@ -87,10 +88,235 @@ START_TEST(bTreeTest) {
     assert(scratchsize == sizeof(i));
     free(scratch);
   }
+  Tcommit(xid);
   Tdeinit();
 
 }END_TEST
 
+static void bTreeKey(int i, char * buf, size_t * len) {
+  // Variable length keys, so that splits happen at uneven points.
+  *len = sprintf(buf, "key-%d-%.*s", i, i % 50, "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx") + 1;
+}
+static int bTreeHasKey(int xid, recordid rid, int i, int * val) {
+  char key[100];
+  size_t keylen;
+  bTreeKey(i, key, &keylen);
+  int * scratch;
+  size_t scratchsize;
+  int found = TbtreeLookup(xid, rid, NULL, (byte*)key, keylen, (byte**)&scratch, &scratchsize);
+  if(found) {
+    assert(scratchsize == sizeof(int));
+    *val = *scratch;
+    free(scratch);
+  }
+  return found;
+}
+static void bTreeInsertKey(int xid, recordid rid, int i, int val) {
+  char key[100];
+  size_t keylen;
+  bTreeKey(i, key, &keylen);
+  TbtreeInsert(xid, rid, NULL, (byte*)key, keylen, (byte*)&val, sizeof(val));
+}
+static int bTreeRemoveKey(int xid, recordid rid, int i) {
+  char key[100];
+  size_t keylen;
+  bTreeKey(i, key, &keylen);
+  return TbtreeRemove(xid, rid, NULL, (byte*)key, keylen);
+}
+/** @test
+    Insert enough entries to split internal nodes, then overwrite, remove, and abort.
+*/
+START_TEST(bTreeSplitTest) {
+  Tinit();
+  int xid = Tbegin();
+  recordid rid = TbtreeCreate(xid, BYTE_ARRAY_COMPARATOR);
+  for(int i = 0; i < NUM_ENTRIES_XACT; i++) {
+    bTreeInsertKey(xid, rid, (i * 7919) % NUM_ENTRIES_XACT, i);
+  }
+  Tcommit(xid);
+
+  xid = Tbegin();
+  for(int i = 0; i < NUM_ENTRIES_XACT; i++) {
+    int val;
+    assert(bTreeHasKey(xid, rid, (i * 7919) % NUM_ENTRIES_XACT, &val));
+    assert(val == i);
+  }
+  // Overwrite the even keys, remove the ones divisible by three.
+  for(int i = 0; i < NUM_ENTRIES_XACT; i+=2) {
+    bTreeInsertKey(xid, rid, i, -i);
+  }
+  for(int i = 0; i < NUM_ENTRIES_XACT; i+=3) {
+    assert(bTreeRemoveKey(xid, rid, i));
+    assert(!bTreeRemoveKey(xid, rid, i));
+  }
+  // Add new keys (that will split nodes) and roll everything back.
+  for(int i = NUM_ENTRIES_XACT; i < 2 * NUM_ENTRIES_XACT; i++) {
+    bTreeInsertKey(xid, rid, i, i);
+  }
+  Tabort(xid);
+
+  xid = Tbegin();
+  for(int i = 0; i < 2 * NUM_ENTRIES_XACT; i++) {
+    int val;
+    int found = bTreeHasKey(xid, rid, i, &val);
+    if(i < NUM_ENTRIES_XACT) {
+      assert(found);
+      assert((val * 7919) % NUM_ENTRIES_XACT == i);
+    } else {
+      assert(!found);
+    }
+  }
+  for(int i = 0; i < NUM_ENTRIES_XACT; i+=3) {
+    assert(bTreeRemoveKey(xid, rid, i));
+  }
+  Tcommit(xid);
+
+  Tdeinit();
+  Tinit();
+
+  xid = Tbegin();
+  for(int i = 0; i < NUM_ENTRIES_XACT; i++) {
+    int val;
+    assert(bTreeHasKey(xid, rid, i, &val) == !!(i % 3));
+  }
+  Tcommit(xid);
+  Tdeinit();
+} END_TEST
+
+/** @test
+    Abort updates that were made with a comparator argument (the byte
+    array comparator's prefix length), which logical undo must reuse.
+*/
+START_TEST(bTreeCmpArgAbortTest) {
+  Tinit();
+  void * prefix = (void*)(uintptr_t)4;
+  int xid = Tbegin();
+  recordid rid = TbtreeCreate(xid, BYTE_ARRAY_COMPARATOR);
+  int one = 1, two = 2;
+  assert(!TbtreeInsert(xid, rid, prefix, (byte*)"abcd-1", 7, (byte*)&one, sizeof(one)));
+  Tcommit(xid);
+
+  xid = Tbegin();
+  // Same four byte prefix, so this replaces abcd-1.
+  assert(TbtreeInsert(xid, rid, prefix, (byte*)"abcd-2", 7, (byte*)&two, sizeof(two)));
+  int * val;
+  size_t len;
+  assert(TbtreeLookup(xid, rid, prefix, (byte*)"abcd-9", 7, (byte**)&val, &len));
+  assert(*val == 2);
+  free(val);
+  Tabort(xid);
+
+  xid = Tbegin();
+  assert(TbtreeLookup(xid, rid, NULL, (byte*)"abcd-1", 7, (byte**)&val, &len));
+  assert(*val == 1);
+  free(val);
+  assert(!TbtreeLookup(xid, rid, NULL, (byte*)"abcd-2", 7, (byte**)&val, &len));
+
+  assert(TbtreeRemove(xid, rid, prefix, (byte*)"abcd-3", 7));
+  Tabort(xid);
+
+  xid = Tbegin();
+  assert(TbtreeLookup(xid, rid, NULL, (byte*)"abcd-1", 7, (byte**)&val, &len));
+  assert(*val == 1);
+  free(val);
+  Tcommit(xid);
+  Tdeinit();
+} END_TEST
+
+/** @test
+    Crash with a transaction in progress, and make sure recovery undoes
+    its inserts, even though they split nodes that committed entries
+    live in.
+*/
+START_TEST(bTreeRecoveryTest) {
+  Tinit();
+  int xid = Tbegin();
+  recordid rid = TbtreeCreate(xid, BYTE_ARRAY_COMPARATOR);
+  for(int i = 0; i < NUM_ENTRIES_XACT; i+=2) {
+    bTreeInsertKey(xid, rid, i, i);
+  }
+  Tcommit(xid);
+
+  int loser = Tbegin();
+  xid = Tbegin();
+  for(int i = 1; i < NUM_ENTRIES_XACT; i+=2) {
+    bTreeInsertKey(loser, rid, i, i);
+    bTreeInsertKey(xid, rid, i + NUM_ENTRIES_XACT, i);
+  }
+  Tcommit(xid);
+  TuncleanShutdown();
+
+  Tinit();
+  xid = Tbegin();
+  for(int i = 0; i < 2 * NUM_ENTRIES_XACT; i++) {
+    int val;
+    int found = bTreeHasKey(xid, rid, i, &val);
+    if(i < NUM_ENTRIES_XACT) {
+      assert(found == !(i % 2));
+    } else {
+      assert(found == (i % 2));
+    }
+  }
+  Tcommit(xid);
+  Tdeinit();
+} END_TEST
+
+#define THREAD_COUNT 10
+static recordid bTreeThreadRid;
+static void * bTreeWorker(void * arg) {
+  int k = *(int*)arg;
+  int xid = Tbegin();
+  for(int i = k; i < NUM_ENTRIES_XACT; i += THREAD_COUNT) {
+    bTreeInsertKey(xid, bTreeThreadRid, i, i);
+    int val;
+    assert(bTreeHasKey(xid, bTreeThreadRid, i, &val));
+    assert(val == i);
+    if((i / THREAD_COUNT) % 8 == 3) {
+      Tcommit(xid);
+      xid = Tbegin();
+    }
+  }
+  // Roll back the last few keys, to exercise concurrent undo.
+  Tabort(xid);
+  return 0;
+}
+/** @test
+    Concurrent inserts and lookups.
+*/
+START_TEST(bTreeThreadTest) {
+  Tinit();
+  int xid = Tbegin();
+  bTreeThreadRid = TbtreeCreate(xid, BYTE_ARRAY_COMPARATOR);
+  Tcommit(xid);
+
+  pthread_t workers[THREAD_COUNT];
+  int ks[THREAD_COUNT];
+  for(int k = 0; k < THREAD_COUNT; k++) {
+    ks[k] = k;
+    pthread_create(&workers[k], 0, bTreeWorker, &ks[k]);
+  }
+  for(int k = 0; k < THREAD_COUNT; k++) {
+    pthread_join(workers[k], 0);
+  }
+
+  xid = Tbegin();
+  for(int i = 0; i < NUM_ENTRIES_XACT; i++) {
+    int val;
+    // The entries inserted after each thread's last commit were aborted.
+    int k = i % THREAD_COUNT;
+    int last = (NUM_ENTRIES_XACT - 1 - k) / THREAD_COUNT;
+    while(last % 8 != 3) { last--; }
+    if(i / THREAD_COUNT <= last) {
+      assert(bTreeHasKey(xid, bTreeThreadRid, i, &val));
+      assert(val == i);
+    } else {
+      assert(!bTreeHasKey(xid, bTreeThreadRid, i, &val));
+    }
+  }
+  Tcommit(xid);
+  Tdeinit();
+} END_TEST
+
 
 Suite * check_suite(void) {
   Suite *s = suite_create("bTree");
@@ -101,6 +327,10 @@ Suite * check_suite(void) {
 
   /* Sub tests are added, one per line, here */
    tcase_add_test(tc, bTreeTest);
+   tcase_add_test(tc, bTreeSplitTest);
+   tcase_add_test(tc, bTreeCmpArgAbortTest);
+   tcase_add_test(tc, bTreeRecoveryTest);
+   tcase_add_test(tc, bTreeThreadTest);
 
    //  tcase_add_test(tc, simpleLinearHashTest); // put back in if playing with hashtable
 
@@ -66,11 +66,11 @@ static int arryCmp(int * a, int * b) {
 }
 
 const int NUM_BLOBS = 1000;
-const int BLOB_SIZE = PAGE_SIZE * 4;
+#define BLOB_SIZE (PAGE_SIZE * 4)
 const int NUM_OPS = 5000;
 
 static byte * gen_blob(int i) {
-  static uint16_t buf[4096*4/sizeof(uint16_t)];
+  static uint16_t buf[STASIS_MAX_PAGE_SIZE*4/sizeof(uint16_t)];
 
   for(int j = 0; j < BLOB_SIZE/sizeof(uint16_t); j++) {
     buf[j] = i+j;
@@ -80,7 +80,7 @@ static byte * gen_blob(int i) {
 }
 
 START_TEST(recoverBlob__randomized) {
-  static uint16_t buf[4096*4/sizeof(uint16_t)];
+  static uint16_t buf[STASIS_MAX_PAGE_SIZE*4/sizeof(uint16_t)];
 
   recordid * blobs = malloc(sizeof(recordid) * NUM_BLOBS);
 
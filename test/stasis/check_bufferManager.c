@@ -338,6 +338,293 @@ START_TEST(pageBlindThreadTest) {
   Tdeinit();
 } END_TEST
 
+static pageid_t resize_page_count;
+static volatile int resize_done;
+static void checkResizePages(void) {
+  for(pageid_t k = 0; k < resize_page_count; k++) {
+    recordid rid = { PAGE_MULT * (k+1), 0, sizeof(int) };
+    int j;
+    Page * p = loadPage(-1, rid.page);
+    readlock(p->rwlatch,0);
+    stasis_record_read(1, p, rid, (byte*)&j);
+    unlock(p->rwlatch);
+    releasePage(p);
+    assert(k == j);
+  }
+}
+static void * resizeWorker(void * arg) {
+  while(!resize_done) {
+    recordid rid;
+    int j;
+    int k = stasis_util_random64(resize_page_count);
+    rid.page = PAGE_MULT * (k+1);
+    rid.slot = 0;
+    rid.size = sizeof(int);
+
+    Page * p = loadPage(-1, rid.page);
+    readlock(p->rwlatch,0);
+    stasis_record_read(1, p, rid, (byte*)&j);
+    unlock(p->rwlatch);
+    releasePage(p);
+
+    assert(k == j);
+  }
+  return 0;
+}
+/**
+    Shrink and grow the buffer manager while other threads are loading
+    pages, and make sure that dirty pages that were evicted by the
+    shrink made it to disk.
+*/
+static void pageResizeTestImpl(stasis_buffer_manager_t * (*fact)(stasis_log_t*, stasis_dirty_page_table_t*), int policy) {
+  stasis_buffer_manager_t * (*old_fact)(stasis_log_t*, stasis_dirty_page_table_t*) = stasis_buffer_manager_factory;
+  int old_policy = stasis_replacement_policy;
+  pageid_t size = stasis_buffer_manager_size;
+  pageid_t soft_limit = stasis_dirty_page_count_soft_limit;
+  pageid_t hard_limit = stasis_dirty_page_count_hard_limit;
+  pageid_t low_water_mark = stasis_dirty_page_low_water_mark;
+  pthread_t workers[THREAD_COUNT];
+  stasis_buffer_manager_factory = fact;
+  stasis_replacement_policy = policy;
+
+  Tinit();
+  initializePages();  // Leaves a buffer manager full of dirty pages.
+  resize_page_count = NUM_PAGES;
+  resize_done = 0;
+
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    pthread_create(&workers[i], NULL, resizeWorker, NULL);
+  }
+  pageid_t sizes[] = { size / 4, size / 2, size * 2, size };
+  for(int i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+    if(policy == STASIS_REPLACEMENT_POLICY_CLOCK && sizes[i] > size) {
+      // The clock can only shrink, and then grow back to its original size.
+      assert(ENOTSUP == stasis_buffer_manager_resize(sizes[i]));
+      continue;
+    }
+    assert(!stasis_buffer_manager_resize(sizes[i]));
+    assert(stasis_buffer_manager_size == sizes[i]);
+    // Allow for rounding as the limits are repeatedly rescaled.
+    pageid_t expected = (soft_limit * sizes[i]) / size;
+    assert(stasis_dirty_page_count_soft_limit <= expected + expected / 100 + 1);
+    assert(stasis_dirty_page_count_soft_limit + expected / 100 + 1 >= expected);
+  }
+  assert(EINVAL == stasis_buffer_manager_resize(0));
+  resize_done = 1;
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  assert(!stasis_buffer_manager_resize(size / 2));
+  checkResizePages();
+  Tdeinit();
+
+  // Everything that was evicted had to be written back.
+  stasis_buffer_manager_size = size;
+  stasis_dirty_page_count_soft_limit = soft_limit;
+  stasis_dirty_page_count_hard_limit = hard_limit;
+  stasis_dirty_page_low_water_mark = low_water_mark;
+  Tinit();
+  checkResizePages();
+  Tdeinit();
+  stasis_replacement_policy = old_policy;
+  stasis_buffer_manager_factory = old_fact;
+}
+START_TEST(pageResizeTest) {
+  pageResizeTestImpl(stasis_buffer_manager_concurrent_hash_factory, STASIS_REPLACEMENT_POLICY_CONCURRENT_LRU);
+} END_TEST
+START_TEST(pageResizeClockTest) {
+  pageResizeTestImpl(stasis_buffer_manager_concurrent_hash_factory, STASIS_REPLACEMENT_POLICY_CLOCK);
+} END_TEST
+START_TEST(pageResizeArcTest) {
+  pageResizeTestImpl(stasis_buffer_manager_concurrent_hash_factory, STASIS_REPLACEMENT_POLICY_ARC);
+} END_TEST
+START_TEST(pageResizeBufferHashTest) {
+  pageResizeTestImpl(stasis_buffer_manager_hash_factory, STASIS_REPLACEMENT_POLICY_THREADSAFE_LRU);
+} END_TEST
+
+static volatile int pinned_resize_done;
+static void * pinnedResizeWorker(void * arg) {
+  *(int*)arg = stasis_buffer_manager_resize(4);
+  pinned_resize_done = 1;
+  return 0;
+}
+/**
+    Shrink the buffer manager while most of its frames are pinned.  The
+    shrink has to wait until the pages are released.
+*/
+START_TEST(pageResizePinnedBufferHashTest) {
+  stasis_buffer_manager_t * (*old_fact)(stasis_log_t*, stasis_dirty_page_table_t*) = stasis_buffer_manager_factory;
+  int old_policy = stasis_replacement_policy;
+  pageid_t size = stasis_buffer_manager_size;
+  pageid_t soft_limit = stasis_dirty_page_count_soft_limit;
+  pageid_t hard_limit = stasis_dirty_page_count_hard_limit;
+  pageid_t low_water_mark = stasis_dirty_page_low_water_mark;
+  stasis_buffer_manager_factory = stasis_buffer_manager_hash_factory;
+  stasis_replacement_policy = STASIS_REPLACEMENT_POLICY_THREADSAFE_LRU;
+  stasis_buffer_manager_size = 20;
+
+  Tinit();
+  Page * pinned[16];
+  for(int i = 0; i < 16; i++) {
+    pinned[i] = loadPage(-1, 100 + i);
+  }
+  int ret = -1;
+  pinned_resize_done = 0;
+  pthread_t worker;
+  pthread_create(&worker, NULL, pinnedResizeWorker, &ret);
+  // Wait for the resize to block on a pinned frame.
+  stasis_buffer_manager_t * bm = stasis_runtime_buffer_manager();
+  while(!stasis_buffer_manager_hash_frame_waiters(bm)) {
+    assert(!pinned_resize_done);
+    struct timespec ts = { 0, 1000 * 1000 };
+    nanosleep(&ts, 0);
+  }
+  assert(!pinned_resize_done);
+  for(int i = 0; i < 16; i++) {
+    releasePage(pinned[i]);
+  }
+  pthread_join(worker, NULL);
+  assert(ret == 0);
+  assert(stasis_buffer_manager_size == 4);
+  Tdeinit();
+
+  stasis_buffer_manager_size = size;
+  stasis_dirty_page_count_soft_limit = soft_limit;
+  stasis_dirty_page_count_hard_limit = hard_limit;
+  stasis_dirty_page_low_water_mark = low_water_mark;
+  stasis_replacement_policy = old_policy;
+  stasis_buffer_manager_factory = old_fact;
+} END_TEST
+
+static void initializeScanPages(pageid_t first, pageid_t count) {
+  for(pageid_t k = 0; k < count; k++) {
+    recordid rid = { first + k, 0, sizeof(pageid_t) };
+    Page * p = loadPage(-1, rid.page);
+    writelock(p->rwlatch,0);
+    stasis_page_slotted_initialize_page(p);
+    stasis_record_alloc_done(-1, p, rid);
+    stasis_record_write(-1, p, rid, (byte*)&rid.page);
+    stasis_page_lsn_write(-1, p, 0);
+    unlock(p->rwlatch);
+    releasePage(p);
+  }
+}
+/** Scan the pages with a sequential handle, and check their contents. */
+static void scanPages(pageid_t first, pageid_t count) {
+  stasis_buffer_manager_handle_t * h = stasis_buffer_manager_open_sequential_handle();
+  assert(h);
+  for(pageid_t k = 0; k < count; k++) {
+    recordid rid = { first + k, 0, sizeof(pageid_t) };
+    pageid_t j;
+    Page * p = loadPageWithHandle(h, -1, rid.page);
+    assert(p->id == rid.page);
+    readlock(p->rwlatch,0);
+    stasis_record_read(-1, p, rid, (byte*)&j);
+    unlock(p->rwlatch);
+    releasePage(p);
+    assert(j == rid.page);
+  }
+  stasis_buffer_manager_close_handle(h);
+}
+static int countCachedPages(pageid_t first, pageid_t count) {
+  int ret = 0;
+  for(pageid_t k = 0; k < count; k++) {
+    Page * p = getCachedPage(-1, first + k);
+    if(p) {
+      releasePage(p);
+      ret++;
+    }
+  }
+  return ret;
+}
+/**
+    Scan a table that is twice the size of the buffer manager with a
+    sequential handle, and make sure that the scan did not evict a hot
+    set that fits in cache, and that the scan only kept a ring's worth
+    of pages.
+*/
+START_TEST(scanRingTest) {
+  int old_policy = stasis_replacement_policy;
+  stasis_replacement_policy = STASIS_REPLACEMENT_POLICY_CONCURRENT_LRU;
+  pageid_t hot_count = stasis_buffer_manager_size / 4;
+  pageid_t scan_count = stasis_buffer_manager_size * 2;
+  pageid_t hot_first = 1;
+  pageid_t scan_first = hot_first + hot_count;
+
+  Tinit();
+  initializeScanPages(hot_first, hot_count + scan_count);
+  Tdeinit();
+
+  Tinit();
+  for(pageid_t k = 0; k < hot_count; k++) {
+    Page * p = loadPage(-1, hot_first + k);
+    releasePage(p);
+  }
+  assert(countCachedPages(hot_first, hot_count) == hot_count);
+
+  stasis_buffer_manager_handle_t * h = stasis_buffer_manager_open_sequential_handle();
+  for(pageid_t k = 0; k < scan_count; k++) {
+    recordid rid = { scan_first + k, 0, sizeof(pageid_t) };
+    pageid_t j;
+    Page * p = loadPageWithHandle(h, -1, rid.page);
+    readlock(p->rwlatch,0);
+    stasis_record_read(-1, p, rid, (byte*)&j);
+    unlock(p->rwlatch);
+    releasePage(p);
+    assert(j == rid.page);
+  }
+  assert(countCachedPages(scan_first, scan_count) <= stasis_buffer_manager_scan_ring_size);
+  stasis_buffer_manager_close_handle(h);
+
+  assert(countCachedPages(hot_first, hot_count) == hot_count);
+  // Reading past the end of the file works as it does with loadPage().
+  scanPages(scan_first, scan_count);
+  h = stasis_buffer_manager_open_sequential_handle();
+  for(pageid_t k = 0; k < 100; k++) {
+    Page * p = loadPageWithHandle(h, -1, scan_first + scan_count + k);
+    releasePage(p);
+  }
+  stasis_buffer_manager_close_handle(h);
+  Tdeinit();
+  stasis_replacement_policy = old_policy;
+} END_TEST
+
+static pageid_t scan_thread_first;
+static pageid_t scan_thread_count;
+static void * scanWorker(void * arg) {
+  scanPages(scan_thread_first, scan_thread_count);
+  return 0;
+}
+/**
+    Run scans in parallel with random reads (which pin the scans' pages),
+    with the default replacement policy.
+*/
+START_TEST(scanRingThreadTest) {
+  Tinit();
+  initializePages();
+  Tdeinit();
+  Tinit();
+  // Put the table after the pages that initializePages() uses.
+  scan_thread_first = PAGE_MULT * (NUM_PAGES + 1) + 1;
+  scan_thread_count = stasis_buffer_manager_size / 2;
+  initializeScanPages(scan_thread_first, scan_thread_count);
+  resize_page_count = NUM_PAGES;
+  resize_done = 0;
+  pthread_t workers[THREAD_COUNT];
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    pthread_create(&workers[i], NULL, i % 2 ? scanWorker : resizeWorker, NULL);
+  }
+  for(int i = 1; i < THREAD_COUNT; i += 2) {
+    pthread_join(workers[i], NULL);
+  }
+  resize_done = 1;
+  for(int i = 0; i < THREAD_COUNT; i += 2) {
+    pthread_join(workers[i], NULL);
+  }
+  checkResizePages();
+  Tdeinit();
+} END_TEST
+
 static void stalePinTestImpl(stasis_buffer_manager_t * (*fact)(stasis_log_t*, stasis_dirty_page_table_t*)) {
   stasis_buffer_manager_t * (*old_fact)(stasis_log_t*, stasis_dirty_page_table_t*) = stasis_buffer_manager_factory;
   stasis_buffer_manager_factory = fact;
@@ -364,6 +651,136 @@ START_TEST(prefetchTest) {
   prefetchPages(100, 100);
   Tdeinit();
 } END_TEST
+#define PREFETCH_MAX_BATCHES 10000
+static pthread_mutex_t prefetch_record_mut = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prefetch_record_cond = PTHREAD_COND_INITIALIZER;
+static int prefetch_gate_open;
+static int prefetch_batch_count;
+#define PREFETCH_RECORDED_RANGES 4
+static pageid_t prefetch_batch_pages[PREFETCH_MAX_BATCHES][PREFETCH_RECORDED_RANGES];
+static pageid_t prefetch_batch_counts[PREFETCH_MAX_BATCHES][PREFETCH_RECORDED_RANGES];
+static int prefetch_batch_len[PREFETCH_MAX_BATCHES];
+static void (*default_prefetch_ranges)(stasis_page_handle_t*, const pageid_t*, const pageid_t*, int);
+
+/**
+   Record each batch of prefetch requests that reaches the page handle, and
+   check that the buffer manager never hands it overlapping or adjacent
+   ranges.  Blocks until prefetch_gate_open is set.
+ */
+static void recordingPrefetchRanges(stasis_page_handle_t * ph, const pageid_t * pageids, const pageid_t * counts, int count) {
+  for(int i = 0; i < count; i++) {
+    assert(counts[i] > 0);
+    for(int j = 0; j < i; j++) {
+      assert(pageids[i] + counts[i] < pageids[j] || pageids[j] + counts[j] < pageids[i]);
+    }
+  }
+  pthread_mutex_lock(&prefetch_record_mut);
+  int b = prefetch_batch_count++;
+  assert(b < PREFETCH_MAX_BATCHES);
+  prefetch_batch_len[b] = count;
+  for(int i = 0; i < count && i < PREFETCH_RECORDED_RANGES; i++) {
+    prefetch_batch_pages[b][i] = pageids[i];
+    prefetch_batch_counts[b][i] = counts[i];
+  }
+  pthread_cond_broadcast(&prefetch_record_cond);
+  while(!prefetch_gate_open) {
+    pthread_cond_wait(&prefetch_record_cond, &prefetch_record_mut);
+  }
+  pthread_mutex_unlock(&prefetch_record_mut);
+  default_prefetch_ranges(ph, pageids, counts, count);
+}
+static stasis_buffer_manager_t* recordingPrefetchFactory(stasis_log_t * log, stasis_dirty_page_table_t * dpt) {
+  stasis_page_handle_t * ph = stasis_page_handle_default_factory(log, dpt);
+  default_prefetch_ranges = ph->prefetch_ranges;
+  ph->prefetch_ranges = recordingPrefetchRanges;
+  return stasis_buffer_manager_hash_open(ph, log, dpt);
+}
+static void waitForPrefetchBatches(int count) {
+  pthread_mutex_lock(&prefetch_record_mut);
+  while(prefetch_batch_count < count) {
+    pthread_cond_wait(&prefetch_record_cond, &prefetch_record_mut);
+  }
+  pthread_mutex_unlock(&prefetch_record_mut);
+}
+static void setPrefetchGate(int open) {
+  pthread_mutex_lock(&prefetch_record_mut);
+  prefetch_gate_open = open;
+  pthread_cond_broadcast(&prefetch_record_cond);
+  pthread_mutex_unlock(&prefetch_record_mut);
+}
+static void * prefetchQueueWorker(void * arg) {
+  pageid_t base = *(pageid_t*)arg;
+  // Overlapping, adjacent and duplicate requests exercise coalescing.
+  for(pageid_t i = 0; i < 200; i += 5) {
+    prefetchPages(base + i, 10);
+    prefetchPages(base + i + 10, 3);
+  }
+  for(pageid_t i = 0; i < 200; i++) {
+    Page * p = loadPage(-1, base + i);
+    releasePage(p);
+  }
+  return 0;
+}
+START_TEST(prefetchQueueTest) {
+  stasis_buffer_manager_t * (*old_fact)(stasis_log_t*, stasis_dirty_page_table_t*) = stasis_buffer_manager_factory;
+  int old_len = stasis_buffer_manager_hash_prefetch_queue_length;
+  int old_count = stasis_buffer_manager_hash_prefetch_count;
+  stasis_buffer_manager_factory = recordingPrefetchFactory;
+  stasis_buffer_manager_hash_prefetch_queue_length = 4;
+
+  // Concurrent, overlapping scans.  recordingPrefetchRanges checks that
+  // each batch was coalesced.
+  prefetch_batch_count = 0;
+  setPrefetchGate(1);
+  Tinit();
+  pthread_t workers[THREAD_COUNT];
+  pageid_t bases[THREAD_COUNT];
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    bases[i] = (i % 2) * 100; // threads share (and overlap) ranges
+    pthread_create(&workers[i], 0, prefetchQueueWorker, &bases[i]);
+  }
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    pthread_join(workers[i], 0);
+  }
+  Tdeinit();
+  assert(prefetch_batch_count > 0);
+
+  // With one prefetch thread stuck on the first request, the rest queue up,
+  // coalesce and reach the page handle as a single batch.
+  stasis_buffer_manager_hash_prefetch_count = 1;
+  prefetch_batch_count = 0;
+  setPrefetchGate(0);
+  Tinit();
+  prefetchPages(1000, 1);
+  waitForPrefetchBatches(1);
+
+  prefetchPages(100, 10);
+  prefetchPages(110, 5);   // abuts [100, 110)
+  prefetchPages(105, 3);   // inside [100, 115)
+  prefetchPages(200, 10);
+  prefetchPages(300, 4);
+  releasePage(loadPage(-1, 400));
+  releasePage(loadPage(-1, 409));
+  prefetchPages(400, 10);  // both ends are cached; trimmed to [401, 409)
+  prefetchPages(400, 1);   // entirely cached; dropped
+
+  setPrefetchGate(1);
+  waitForPrefetchBatches(2);
+  Tdeinit();
+
+  assert(prefetch_batch_count == 2);
+  assert(prefetch_batch_len[0] == 1);
+  assert(prefetch_batch_pages[0][0] == 1000 && prefetch_batch_counts[0][0] == 1);
+  assert(prefetch_batch_len[1] == 4);
+  assert(prefetch_batch_pages[1][0] == 100 && prefetch_batch_counts[1][0] == 15);
+  assert(prefetch_batch_pages[1][1] == 200 && prefetch_batch_counts[1][1] == 10);
+  assert(prefetch_batch_pages[1][2] == 300 && prefetch_batch_counts[1][2] == 4);
+  assert(prefetch_batch_pages[1][3] == 401 && prefetch_batch_counts[1][3] == 8);
+
+  stasis_buffer_manager_hash_prefetch_count = old_count;
+  stasis_buffer_manager_hash_prefetch_queue_length = old_len;
+  stasis_buffer_manager_factory = old_fact;
+} END_TEST
 START_TEST(stalePinTest) {
   stalePinTestImpl(stasis_buffer_manager_hash_factory);
 } END_TEST
@@ -383,6 +800,7 @@ Suite * check_suite(void) {
   /* Sub tests are added, one per line, here */
   tcase_add_test(tc, stalePinTest);
   tcase_add_test(tc, prefetchTest);
+  tcase_add_test(tc, prefetchQueueTest);
   //  tcase_add_test(tc, stalePinTestDeprecatedBufferManager); // Fails; do not intend to fix.
   tcase_add_test(tc, pageSingleThreadTest);
   tcase_add_test(tc, pageSingleThreadWriterTest);
@@ -395,6 +813,13 @@ Suite * check_suite(void) {
   tcase_add_test(tc, pageThreadedWritersTest);
   tcase_add_test(tc, pageBlindRandomTest);
   tcase_add_test(tc, stalePinTestConcurrentBufferManager);
+  tcase_add_test(tc, pageResizeTest);
+  tcase_add_test(tc, pageResizeClockTest);
+  tcase_add_test(tc, pageResizeArcTest);
+  tcase_add_test(tc, pageResizeBufferHashTest);
+  tcase_add_test(tc, pageResizePinnedBufferHashTest);
+  tcase_add_test(tc, scanRingTest);
+  tcase_add_test(tc, scanRingThreadTest);
   tcase_add_test(tc, pageBlindThreadTest);
 #endif
   /* --------------------------------------------- */
@@ -175,6 +175,46 @@ START_TEST(concurrentHashTest) {
   hashtable_deinit(ht);
 } END_TEST
 
+/** Start with a tiny table, so that it grows while the workers run. */
+START_TEST(growingHashTest) {
+  ht = hashtable_init(4);
+  pageid_t initial_size = hashtable_size(ht);
+  pthread_t workers[NUM_THREADS];
+  for(int i = 0 ; i < NUM_THREADS; i++) {
+    pageid_t *data = malloc(sizeof(pageid_t) * THREAD_ENTRIES);
+
+    for(int j = 1; j <= THREAD_ENTRIES; j++) {
+      data[j-1] = -1 * (i + (j * NUM_THREADS));
+    }
+    pthread_create(&workers[i], 0, worker, data);
+  }
+  for(int i = 0 ; i < NUM_THREADS; i++) {
+    pthread_join(workers[i],0);
+  }
+  assert(hashtable_size(ht) > initial_size);
+  hashtable_deinit(ht);
+} END_TEST
+
+/** Tables created with tiny size hints still fill past their initial size. */
+START_TEST(tinyHashTest) {
+  for(pageid_t hint = 0; hint < 3; hint++) {
+    ht = hashtable_init(hint);
+    for(pageid_t i = 0; i < 1000; i++) {
+      assert(!hashtable_insert(ht, i, (void*)(intptr_t)(i + 1)));
+    }
+    for(pageid_t i = 0; i < 1000; i++) {
+      assert(hashtable_lookup(ht, i) == (void*)(intptr_t)(i + 1));
+    }
+    for(pageid_t i = 0; i < 1000; i += 2) {
+      assert(hashtable_remove(ht, i) == (void*)(intptr_t)(i + 1));
+    }
+    for(pageid_t i = 0; i < 1000; i++) {
+      assert(hashtable_lookup(ht, i) == ((i % 2) ? (void*)(intptr_t)(i + 1) : NULL));
+    }
+    hashtable_deinit(ht);
+  }
+} END_TEST
+
 Suite * check_suite(void) {
   Suite *s = suite_create("lhtable");
   /* Begin a new test */
@@ -186,9 +226,11 @@ Suite * check_suite(void) {
 
   /* Sub tests are added, one per line, here */
   tcase_add_test(tc, singleThreadHashTest);
+  tcase_add_test(tc, tinyHashTest);
 #ifndef DBUG_TEST // TODO should run exactly one of these two tests under dbug.  Need good way to choose which one.
   tcase_add_test(tc, wraparoundHashTest);
   tcase_add_test(tc, concurrentHashTest);
+  tcase_add_test(tc, growingHashTest);
 #endif
 
   /* --------------------------------------------- */
@@ -136,6 +136,62 @@ START_TEST(dirtyPageTable_threadTest) {
   Tdeinit();
 } END_TEST
 
+static Page * dirty_page(stasis_dirty_page_table_t * dpt, pageid_t page) {
+  Page * p = loadPage(-1, page);
+  writelock(p->rwlatch, 0);
+  stasis_dirty_page_table_set_dirty(dpt, p);
+  unlock(p->rwlatch);
+  return p;
+}
+/**
+   @test get_flush_candidates() merges the shards in page order, coalesces
+   adjacent pages, and stops after count pages.
+*/
+START_TEST(dirtyPageTable_flushCandidatesTest) {
+  stasis_buffer_manager_factory = stasis_buffer_manager_mem_array_factory;
+  Tinit();
+  stasis_dirty_page_table_t * dpt = stasis_runtime_dirty_page_table();
+  // The page array cleans pages when they are released, so keep them pinned.
+  // Dirty them in reverse so that insertion order does not help.
+  Page * pages[24];
+  int n = 0;
+  pages[n++] = dirty_page(dpt, 1300);
+  for(pageid_t i = 1104; i >= 1100; i--) { pages[n++] = dirty_page(dpt, i); }
+  for(pageid_t i = 1019; i >= 1010; i--) { pages[n++] = dirty_page(dpt, i); }
+  // These all land in the same shard, so its run has to be truncated.
+  for(pageid_t i = 7; i >= 0; i--) { pages[n++] = dirty_page(dpt, 2048 + i * 64); }
+
+  pageid_t range_starts[20], range_ends[20];
+  int blocks = stasis_dirty_page_table_get_flush_candidates(dpt, 1012, 0, 11, range_starts, range_ends);
+  assert(blocks == 2);
+  assert(range_starts[0] == 1012 && range_ends[0] == 1020);
+  assert(range_starts[1] == 1100 && range_ends[1] == 1103);
+
+  blocks = stasis_dirty_page_table_get_flush_candidates(dpt, 1012, 0, 5, range_starts, range_ends);
+  assert(blocks == 1);
+  assert(range_starts[0] == 1012 && range_ends[0] == 1017);
+
+  blocks = stasis_dirty_page_table_get_flush_candidates(dpt, 1000, 1101, 20, range_starts, range_ends);
+  assert(blocks == 2);
+  assert(range_starts[0] == 1010 && range_ends[0] == 1020);
+  assert(range_starts[1] == 1100 && range_ends[1] == 1101);
+
+  blocks = stasis_dirty_page_table_get_flush_candidates(dpt, 1105, 2000, 20, range_starts, range_ends);
+  assert(blocks == 1);
+  assert(range_starts[0] == 1300 && range_ends[0] == 1301);
+
+  blocks = stasis_dirty_page_table_get_flush_candidates(dpt, 2000, 0, 3, range_starts, range_ends);
+  assert(blocks == 3);
+  for(int i = 0; i < 3; i++) {
+    assert(range_starts[i] == 2048 + i * 64 && range_ends[i] == 2049 + i * 64);
+  }
+
+  for(int i = 0; i < n; i++) { releasePage(pages[i]); }
+  blocks = stasis_dirty_page_table_get_flush_candidates(dpt, 1000, 0, 20, range_starts, range_ends);
+  assert(blocks == 0);
+  Tdeinit();
+} END_TEST
+
 Suite * check_suite(void) {
   Suite *s = suite_create("allocationPolicy");
   /* Begin a new test */
@@ -145,6 +201,7 @@ Suite * check_suite(void) {
   /* Sub tests are added, one per line, here */
   tcase_add_test(tc, dirtyPageTable_randomTest);
   tcase_add_test(tc, dirtyPageTable_threadTest);
+  tcase_add_test(tc, dirtyPageTable_flushCandidatesTest);
 
   /* --------------------------------------------- */
 
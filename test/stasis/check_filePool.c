@@ -49,6 +49,7 @@ terms specified in this license.
 #include "../check_includes.h"
 
 #include <stasis/logger/filePool.h>
+#include <stasis/logger/logHandle.h>
 #include <stasis/flags.h>
 #include <assert.h>
 #include <sys/time.h>
@@ -126,6 +127,74 @@ START_TEST(filePoolDirTest){
   log->close(log);
 } END_TEST
 
+static void filePoolCrcWrite(int background_crc, int first, int count, int rec_len) {
+  stasis_log_file_pool_background_crc = background_crc;
+  stasis_log_t * log = stasis_log_file_pool_open(
+      stasis_log_dir_name,
+      stasis_log_file_mode,
+      stasis_log_file_permissions);
+  for(int i = first; i < first + count; i++) {
+    LogEntry * e = log->reserve_entry(log, rec_len);
+    e->type = UPDATELOG;
+    e->update.arg_size = rec_len - sizeof(struct __raw_log_entry) - sizeof(UpdateLogEntry);
+    memset(stasis_log_entry_update_args_ptr(e), i & 0xff, e->update.arg_size);
+    log->write_entry(log, e);
+    log->write_entry_done(log, e);
+    if(!(i & 1023)) { log->force_tail(log, 0); }
+  }
+  log->close(log);
+}
+static void filePoolCrcCheck(const LogEntry * e, int i) {
+  assert(e->type == UPDATELOG);
+  const byte * arg = stasis_log_entry_update_args_cptr(e);
+  for(int j = 0; j < e->update.arg_size; j++) {
+    assert(arg[j] == (byte)(i & 0xff));
+  }
+}
+/**
+   @test
+   Write a log in both checksum modes, and make sure that point reads
+   and scans can read it back.  The log is larger than the writeback
+   thread's spans, so some entries straddle two spans.
+*/
+START_TEST(filePoolCrcModeTest){
+  int old_background_crc = stasis_log_file_pool_background_crc;
+  const int rec_len = 1000;
+  const int rec_count = 10000;
+
+  filePoolCrcWrite(0, 0, rec_count, rec_len);
+  filePoolCrcWrite(1, rec_count, 2 * rec_count, rec_len);
+  filePoolCrcWrite(0, 3 * rec_count, rec_count, rec_len);
+
+  stasis_log_file_pool_background_crc = old_background_crc;
+  stasis_log_t * log = stasis_log_file_pool_open(
+      stasis_log_dir_name,
+      stasis_log_file_mode,
+      stasis_log_file_permissions);
+
+  const LogEntry * e;
+  lsn_t l = log->truncation_point(log);
+  int i = 0;
+  while((e = log->read_entry(log, l))) {
+    filePoolCrcCheck(e, i);
+    l = log->next_entry(log, e);
+    i++;
+    log->read_entry_done(log, e);
+  }
+  assert(i == 4 * rec_count);
+
+  LogHandle * lh = getLogHandle(log);
+  i = 0;
+  while((e = nextInLog(lh))) {
+    filePoolCrcCheck(e, i);
+    i++;
+  }
+  freeLogHandle(lh);
+  assert(i == 4 * rec_count);
+
+  log->close(log);
+} END_TEST
+
 
 Suite * check_suite(void) {
   Suite *s = suite_create("filePool");
@@ -135,6 +204,7 @@ Suite * check_suite(void) {
   /* Sub tests are added, one per line, here */
 
   tcase_add_test(tc, filePoolDirTest);
+  tcase_add_test(tc, filePoolCrcModeTest);
 
   /* --------------------------------------------- */
 
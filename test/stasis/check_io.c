@@ -45,10 +45,12 @@ terms specified in this license.
 #include <stasis/constants.h>
 #include <stasis/flags.h>
 #include <stasis/util/random.h>
+#include <stasis/util/time.h>
 #include <assert.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
 
 #define LOG_NAME   "check_io.log"
 
@@ -252,6 +254,95 @@ void handle_concurrencytest(stasis_handle_t * h) {
   free(threads);
   free(handles);
 }
+#define BATCH_THREADS 8
+#define BATCH_SLOTS   300
+#define BATCH_ROUNDS  50
+
+static void* batch_worker(void* argp) {
+  thread_arg * t = argp;
+  stasis_handle_t * h = t->h;
+  lsn_t base = t->count * BATCH_SLOTS * sizeof(int);
+  int * vals = malloc(BATCH_SLOTS * sizeof(int));
+  int * check = malloc(BATCH_SLOTS * sizeof(int));
+  stasis_handle_iov_t * iov = malloc(BATCH_SLOTS * sizeof(*iov));
+  for(int r = 0; r < BATCH_ROUNDS; r++) {
+    // Write every slot (in a random order) as one batch.
+    for(int i = 0; i < BATCH_SLOTS; i++) {
+      int j = stasis_util_random64(i+1);
+      iov[i] = iov[j];
+      iov[j].off = base + i * sizeof(int);
+      vals[i] = r * BATCH_SLOTS + i;
+    }
+    for(int i = 0; i < BATCH_SLOTS; i++) {
+      iov[i].buf = (byte*)&vals[(iov[i].off - base) / sizeof(int)];
+      iov[i].len = sizeof(int);
+    }
+    assert(!stasis_handle_write_batch(h, iov, BATCH_SLOTS));
+    if(r % 10 == 0) {
+      assert(!h->force_range(h, base, base + BATCH_SLOTS * sizeof(int)));
+    }
+    // Read them back as a second batch.
+    for(int i = 0; i < BATCH_SLOTS; i++) {
+      iov[i].buf = (byte*)&check[(iov[i].off - base) / sizeof(int)];
+      check[i] = -1;
+    }
+    assert(!stasis_handle_read_batch(h, iov, BATCH_SLOTS));
+    for(int i = 0; i < BATCH_SLOTS; i++) {
+      assert(!iov[i].error);
+      assert(check[i] == vals[i]);
+    }
+  }
+  free(iov);
+  free(check);
+  free(vals);
+  return 0;
+}
+/**
+   Have several threads issue read and write batches against one handle.
+   Each batch is larger than the default io_uring queue depth.
+*/
+static void handle_batchload(stasis_handle_t * h) {
+  pthread_t threads[BATCH_THREADS];
+  thread_arg args[BATCH_THREADS];
+  for(int i = 0; i < BATCH_THREADS; i++) {
+    args[i].values = 0;
+    args[i].count = i;
+    args[i].h = h;
+    pthread_create(&threads[i], 0, batch_worker, &args[i]);
+  }
+  for(int i = 0; i < BATCH_THREADS; i++) {
+    pthread_join(threads[i], 0);
+  }
+  assert(!h->async_force(h));
+  assert(!h->force(h));
+}
+void handle_batchtest(stasis_handle_t * h) {
+  handle_batchload(h);
+
+  // Reads past the end of the file fail with EDOM, without
+  // affecting the rest of the batch.
+  int a = -1, b = -1;
+  stasis_handle_iov_t iov[2] = {
+    { 0, (byte*)&a, sizeof(int), 0 },
+    { h->end_position(h) + PAGE_SIZE, (byte*)&b, sizeof(int), 0 }
+  };
+  assert(stasis_handle_read_batch(h, iov, 2) == EDOM);
+  assert(!iov[0].error);
+  assert(a == (BATCH_ROUNDS - 1) * BATCH_SLOTS);
+  assert(iov[1].error == EDOM);
+
+  // The same goes for adjacent requests that straddle the end of the file.
+  lsn_t end = h->end_position(h);
+  a = -1; b = -1;
+  stasis_handle_iov_t iov2[2] = {
+    { end, (byte*)&b, sizeof(int), 0 },
+    { end - sizeof(int), (byte*)&a, sizeof(int), 0 }
+  };
+  assert(stasis_handle_read_batch(h, iov2, 2) == EDOM);
+  assert(iov2[0].error == EDOM);
+  assert(!iov2[1].error);
+  assert(a == BATCH_ROUNDS * BATCH_SLOTS - 1);
+}
 /**
    @test
    Check the memory I/O handle.
@@ -322,6 +413,51 @@ START_TEST(io_pfileTest) {
 
   remove("logfile.txt");
 
+  h = stasis_handle(open_pfile)("logfile.txt", O_CREAT | O_RDWR, FILE_PERM);
+  handle_batchtest(h);
+  h->close(h);
+
+  remove("logfile.txt");
+
+  // Issue one pread() / pwrite() per request instead of merging them.
+  stasis_handle_coalesce_batches = 0;
+  h = stasis_handle(open_pfile)("logfile.txt", O_CREAT | O_RDWR, FILE_PERM);
+  handle_batchtest(h);
+  h->close(h);
+  stasis_handle_coalesce_batches = 1;
+
+  remove("logfile.txt");
+
+} END_TEST
+
+START_TEST(io_uringTest) {
+  printf("io_uringTest\n"); fflush(stdout);
+
+  stasis_handle_t * h;
+  h = stasis_handle(open_uring)("logfile.txt", O_CREAT | O_RDWR, FILE_PERM);
+  handle_smoketest(h);
+  h->close(h);
+
+  remove("logfile.txt");
+
+  h = stasis_handle(open_uring)("logfile.txt", O_CREAT | O_RDWR, FILE_PERM);
+  handle_batchtest(h);
+  h->close(h);
+
+  remove("logfile.txt");
+
+  h = stasis_handle(open_uring)("logfile.txt", O_CREAT | O_RDWR, FILE_PERM);
+  handle_concurrencytest(h);
+  h->close(h);
+
+  remove("logfile.txt");
+
+  // Handles without batch support fall back on read() and write().
+  h = stasis_handle(open_file)("logfile.txt", O_CREAT | O_RDWR, FILE_PERM);
+  handle_batchtest(h);
+  h->close(h);
+
+  remove("logfile.txt");
 } END_TEST
 
 START_TEST(io_raid1pfileTest) {
@@ -414,6 +550,259 @@ START_TEST(io_raid0pfileTest) {
   remove(A);
   remove(B);
 
+  hp[0] = stasis_handle(open_pfile)(A, O_CREAT | O_RDWR, FILE_PERM);
+  hp[1] = stasis_handle(open_pfile)(B, O_CREAT | O_RDWR, FILE_PERM);
+  h = stasis_handle_open_raid0(2, hp, stripe_size);
+
+  // raid0's end_position is approximate, so skip handle_batchtest's
+  // end of file checks, and read the batches back one at a time instead.
+  handle_batchload(h);
+  for(int t = 0; t < BATCH_THREADS; t++) {
+    for(int i = 0; i < BATCH_SLOTS; i++) {
+      int val = -1;
+      assert(!h->read(h, (t * BATCH_SLOTS + i) * sizeof(int), (byte*)&val, sizeof(int)));
+      assert(val == (BATCH_ROUNDS - 1) * BATCH_SLOTS + i);
+    }
+  }
+  h->close(h);
+
+  remove(A);
+  remove(B);
+
+} END_TEST
+
+#define FORCE_RANGE_MEMBERS 3
+static stasis_handle_t * force_range_member[FORCE_RANGE_MEMBERS];
+static lsn_t force_range_seen[FORCE_RANGE_MEMBERS][2];
+static int (*memory_force_range)(stasis_handle_t *, lsn_t, lsn_t);
+
+static int recording_force_range(stasis_handle_t * h, lsn_t start, lsn_t stop) {
+  for(int i = 0; i < FORCE_RANGE_MEMBERS; i++) {
+    if(force_range_member[i] == h) {
+      force_range_seen[i][0] = start;
+      force_range_seen[i][1] = stop;
+    }
+  }
+  return memory_force_range(h, start, stop);
+}
+static void raid0_check_force_range(stasis_handle_t * h, lsn_t start, lsn_t stop,
+                                    lsn_t expected[FORCE_RANGE_MEMBERS][2]) {
+  for(int i = 0; i < FORCE_RANGE_MEMBERS; i++) {
+    force_range_seen[i][0] = force_range_seen[i][1] = -1;
+  }
+  assert(!h->force_range(h, start, stop));
+  for(int i = 0; i < FORCE_RANGE_MEMBERS; i++) {
+    assert(force_range_seen[i][0] == expected[i][0]);
+    assert(force_range_seen[i][1] == expected[i][1]);
+  }
+}
+/**
+   @test
+   Check that raid0 only asks each member to force the part of its file
+   that backs the range being forced.
+*/
+START_TEST(io_raid0forceRangeTest) {
+  printf("io_raid0forceRangeTest\n"); fflush(stdout);
+  const lsn_t S = 100;
+  for(int i = 0; i < FORCE_RANGE_MEMBERS; i++) {
+    force_range_member[i] = stasis_handle(open_memory)();
+    memory_force_range = force_range_member[i]->force_range;
+    force_range_member[i]->force_range = recording_force_range;
+  }
+  stasis_handle_t * h = stasis_handle_open_raid0(FORCE_RANGE_MEMBERS, force_range_member, S);
+
+  // Within a single stripe.
+  lsn_t one[FORCE_RANGE_MEMBERS][2] = { { -1, -1 }, { 10, 20 }, { -1, -1 } };
+  raid0_check_force_range(h, S + 10, S + 20, one);
+
+  // Two partial stripes on adjacent members.
+  lsn_t two[FORCE_RANGE_MEMBERS][2] = { { -1, -1 }, { 50, 100 }, { 0, 30 } };
+  raid0_check_force_range(h, S + 50, 2 * S + 30, two);
+
+  // Wraps around the members.  Member 0 backs logical stripes 3 and 6.
+  lsn_t wrap[FORCE_RANGE_MEMBERS][2] = { { 100, 205 }, { 50, 200 }, { 0, 200 } };
+  raid0_check_force_range(h, S + 50, 6 * S + 5, wrap);
+
+  // An empty range forces nothing.
+  lsn_t none[FORCE_RANGE_MEMBERS][2] = { { -1, -1 }, { -1, -1 }, { -1, -1 } };
+  raid0_check_force_range(h, 5 * S, 5 * S, none);
+
+  h->close(h);
+} END_TEST
+
+enum { MIRROR_OK, MIRROR_SLOW_READS, MIRROR_FAILING_READS, MIRROR_FAILING_WRITES, MIRROR_STALLED_FORCE };
+static int mirror_mode;
+static int mirror_reads;
+static int mirror_writes;
+static int (*memory_read)(stasis_handle_t *, lsn_t, byte *, lsn_t);
+static int (*memory_write)(stasis_handle_t *, lsn_t, const byte *, lsn_t);
+static int (*memory_force)(stasis_handle_t *);
+
+static int mirror_read(stasis_handle_t * h, lsn_t off, byte * buf, lsn_t len) {
+  __sync_fetch_and_add(&mirror_reads, 1);
+  if(mirror_mode == MIRROR_SLOW_READS) { usleep(2000); }
+  if(mirror_mode == MIRROR_FAILING_READS) { return EIO; }
+  return memory_read(h, off, buf, len);
+}
+static int mirror_write(stasis_handle_t * h, lsn_t off, const byte * dat, lsn_t len) {
+  __sync_fetch_and_add(&mirror_writes, 1);
+  if(mirror_mode == MIRROR_FAILING_WRITES) { return EIO; }
+  return memory_write(h, off, dat, len);
+}
+static int mirror_force(stasis_handle_t * h) {
+  if(mirror_mode == MIRROR_STALLED_FORCE) { sleep(2); }
+  return memory_force(h);
+}
+/** Make b misbehave, and count the reads and writes sent to it. */
+static void wrap_bad_mirror(stasis_handle_t * b, int mode) {
+  memory_read = b->read;
+  memory_write = b->write;
+  memory_force = b->force;
+  b->read = mirror_read;
+  b->write = mirror_write;
+  b->force = mirror_force;
+  mirror_mode = mode;
+  mirror_reads = 0;
+  mirror_writes = 0;
+}
+/** Open a raid1 handle over two memory handles, mirror bad of which misbehaves. */
+static stasis_handle_t * open_raid1_bad_mirror(int mode, int bad) {
+  stasis_handle_t * h[2];
+  h[0] = stasis_handle(open_memory)();
+  h[1] = stasis_handle(open_memory)();
+  wrap_bad_mirror(h[bad], mode);
+  return stasis_handle_open_raid1(h[0], h[1]);
+}
+static void raid1_check_values(stasis_handle_t * h, int count) {
+  for(int i = 0; i < count; i++) {
+    int val = -1;
+    assert(!h->read(h, i * sizeof(int), (byte*)&val, sizeof(int)));
+    assert(val == i);
+  }
+}
+/**
+   @test
+   Check that raid1 sends reads to the faster mirror, and keeps working
+   with one mirror when the other fails or stalls.
+*/
+START_TEST(io_raid1degradedTest) {
+  printf("io_raid1degradedTest\n"); fflush(stdout);
+  const int COUNT = 256;
+
+  stasis_handle_t * h = open_raid1_bad_mirror(MIRROR_SLOW_READS, 1);
+  for(int i = 0; i < COUNT; i++) {
+    assert(!h->write(h, i * sizeof(int), (byte*)&i, sizeof(int)));
+  }
+  assert(mirror_writes == COUNT);
+  raid1_check_values(h, COUNT);
+  // The slow mirror only sees the occasional probe.
+  assert(mirror_reads < COUNT / 8);
+  h->close(h);
+
+  h = open_raid1_bad_mirror(MIRROR_FAILING_WRITES, 1);
+  for(int i = 0; i < COUNT; i++) {
+    assert(!h->write(h, i * sizeof(int), (byte*)&i, sizeof(int)));
+  }
+  // The failing mirror was dropped after its first error.
+  assert(mirror_writes == 1);
+  raid1_check_values(h, COUNT);
+  assert(mirror_reads == 0);
+  h->close(h);
+
+  // A mirror is only dropped for a failed read if the other mirror
+  // serves the read.  Past the end of the data, neither can.
+  h = open_raid1_bad_mirror(MIRROR_FAILING_READS, 1);
+  for(int i = 0; i < COUNT; i++) {
+    assert(!h->write(h, i * sizeof(int), (byte*)&i, sizeof(int)));
+  }
+  for(int i = 0; i < 8; i++) {
+    int val;
+    assert(h->read(h, (COUNT + i) * sizeof(int), (byte*)&val, sizeof(int)));
+  }
+  assert(mirror_reads > 0);
+  int zero = 0;
+  assert(!h->write(h, 0, (byte*)&zero, sizeof(int)));
+  assert(mirror_writes == COUNT + 1);
+  raid1_check_values(h, COUNT);
+  // The failing mirror was dropped once the other one served its read.
+  assert(!h->write(h, 0, (byte*)&zero, sizeof(int)));
+  assert(mirror_writes == COUNT + 1);
+  h->close(h);
+
+  // Either mirror may stall, including the one that has been faster.
+  uint32_t old_timeout = stasis_handle_raid1_stall_timeout;
+  stasis_handle_raid1_stall_timeout = 100;
+  for(int bad = 0; bad < 2; bad++) {
+    h = open_raid1_bad_mirror(MIRROR_STALLED_FORCE, bad);
+    struct timeval start, stop;
+    gettimeofday(&start, 0);
+    assert(!h->force(h));
+    gettimeofday(&stop, 0);
+    // We gave up on the stalled mirror instead of waiting two seconds for it.
+    assert(stasis_timeval_to_double(stasis_subtract_timeval(stop, start)) < 1.5);
+    for(int i = 0; i < COUNT; i++) {
+      assert(!h->write(h, i * sizeof(int), (byte*)&i, sizeof(int)));
+    }
+    assert(mirror_writes == 0);
+    raid1_check_values(h, COUNT);
+    assert(mirror_reads == 0);
+    h->close(h);
+  }
+  stasis_handle_raid1_stall_timeout = old_timeout;
+} END_TEST
+/**
+   @test
+   Check that a dropped mirror stays dropped after the raid1 handle is
+   reopened, until the degraded file is removed.
+*/
+START_TEST(io_raid1durableTest) {
+  printf("io_raid1durableTest\n"); fflush(stdout);
+  const int COUNT = 256;
+  const char * A = "vol1.txt";
+  const char * B = "vol2.txt";
+  const char * D = "degraded.txt";
+  remove(A);
+  remove(B);
+  remove(D);
+
+  stasis_handle_t * a = stasis_handle(open_pfile)(A, O_CREAT | O_RDWR, FILE_PERM);
+  stasis_handle_t * b = stasis_handle(open_pfile)(B, O_CREAT | O_RDWR, FILE_PERM);
+  wrap_bad_mirror(b, MIRROR_FAILING_WRITES);
+  stasis_handle_t * h = stasis_handle_open_raid1_durable(a, b, D);
+  for(int i = 0; i < COUNT; i++) {
+    assert(!h->write(h, i * sizeof(int), (byte*)&i, sizeof(int)));
+  }
+  assert(mirror_writes == 1);
+  h->close(h);
+  struct stat st;
+  assert(!stat(D, &st));
+
+  // B is empty, so reading it would return EDOM.  It is not touched.
+  a = stasis_handle(open_pfile)(A, O_CREAT | O_RDWR, FILE_PERM);
+  b = stasis_handle(open_pfile)(B, O_CREAT | O_RDWR, FILE_PERM);
+  wrap_bad_mirror(b, MIRROR_OK);
+  h = stasis_handle_open_raid1_durable(a, b, D);
+  raid1_check_values(h, COUNT);
+  int i = COUNT;
+  assert(!h->write(h, i * sizeof(int), (byte*)&i, sizeof(int)));
+  raid1_check_values(h, COUNT + 1);
+  assert(mirror_reads == 0);
+  assert(mirror_writes == 0);
+  h->close(h);
+
+  // Once the degraded file is gone, both mirrors are in use again.
+  remove(D);
+  a = stasis_handle(open_pfile)(A, O_CREAT | O_RDWR, FILE_PERM);
+  b = stasis_handle(open_pfile)(B, O_CREAT | O_RDWR, FILE_PERM);
+  wrap_bad_mirror(b, MIRROR_OK);
+  h = stasis_handle_open_raid1_durable(a, b, D);
+  assert(!h->write(h, 0, (byte*)&i, sizeof(int)));
+  assert(mirror_writes == 1);
+  h->close(h);
+  assert(stat(D, &st));
+
+  remove(A);
+  remove(B);
 } END_TEST
   /*
 static stasis_handle_t * fast_factory(lsn_t off, lsn_t len, void * ignored) {
@@ -539,8 +928,12 @@ Suite * check_suite(void) {
   tcase_add_test(tc, io_memoryTest);
   tcase_add_test(tc, io_fileTest);
   tcase_add_test(tc, io_pfileTest);
+  tcase_add_test(tc, io_uringTest);
   tcase_add_test(tc, io_raid1pfileTest);
   tcase_add_test(tc, io_raid0pfileTest);
+  tcase_add_test(tc, io_raid0forceRangeTest);
+  tcase_add_test(tc, io_raid1degradedTest);
+  tcase_add_test(tc, io_raid1durableTest);
   //tcase_add_test(tc, io_nonBlockingTest_file);
   //tcase_add_test(tc, io_nonBlockingTest_pfile);
   /* --------------------------------------------- */
@@ -309,10 +309,10 @@ void * worker(void* arg) {
   Tcommit(xid);
   return NULL;
 }
-START_TEST(linearHashNTAThreadedTest) {
+static void linearHashNTAThreadedTestImpl(int keySize, int valueSize) {
   Tinit();
   int xid = Tbegin();
-  recordid rid = ThashCreate(xid, sizeof(recordid), sizeof(int));
+  recordid rid = ThashCreate(xid, keySize, valueSize);
   int i;
   Tcommit(xid);
   pthread_t threads[NUM_THREADS];
@@ -327,6 +327,17 @@ START_TEST(linearHashNTAThreadedTest) {
     pthread_join(threads[i], &ret);
   }
   Tdeinit();
+}
+START_TEST(linearHashNTAThreadedTest) {
+  linearHashNTAThreadedTestImpl(sizeof(recordid), sizeof(int));
+} END_TEST
+/**
+   @test Variable length tables don't share the linked list mutex, so
+   this exercises concurrent operations on different buckets (and
+   concurrent splits).
+*/
+START_TEST(linearHashNTAVariableLengthThreadedTest) {
+  linearHashNTAThreadedTestImpl(VARIABLE_LENGTH, VARIABLE_LENGTH);
 } END_TEST
 #ifdef LONG_TEST
 START_TEST(linearHashNTAThreadedTestRandomized) {
@@ -652,6 +663,47 @@ START_TEST(lookupPrefix) {
 
 } END_TEST
 
+/** The layout of the hash table header, from linearHashNTA.c. */
+typedef struct {
+  recordid buckets;
+  int keySize;
+  int valueSize;
+  pageid_t nextSplit;
+  int bits;
+  long numEntries;
+} test_hash_header;
+/**
+   The entry count is kept in memory between splits; make sure that a
+   clean shutdown writes it back.
+*/
+START_TEST(linearHashNTACountTest) {
+  Tinit();
+  int xid = Tbegin();
+  recordid hash = ThashCreate(xid, sizeof(int), sizeof(int));
+  Tcommit(xid);
+  Tdeinit();
+  const int SESSIONS = 20;
+  const int PER_SESSION = 5;
+  for(int i = 0; i < SESSIONS; i++) {
+    Tinit();
+    xid = Tbegin();
+    for(int j = 0; j < PER_SESSION; j++) {
+      int k = i * PER_SESSION + j;
+      ThashInsert(xid, hash, (byte*)&k, sizeof(k), (byte*)&k, sizeof(k));
+    }
+    Tcommit(xid);
+    Tdeinit();
+  }
+  Tinit();
+  xid = Tbegin();
+  test_hash_header lhh;
+  hash.size = sizeof(lhh);
+  Tread(xid, hash, &lhh);
+  assert(lhh.numEntries == SESSIONS * PER_SESSION);
+  Tcommit(xid);
+  Tdeinit();
+} END_TEST
+
 Suite * check_suite(void) {
   Suite *s = suite_create("linearHashNTA");
   /* Begin a new test */
@@ -661,6 +713,7 @@ Suite * check_suite(void) {
   /* Sub tests are added, one per line, here */
   tcase_add_test(tc, linearHashNTAabortTest);
   tcase_add_test(tc, lookupPrefix);
+  tcase_add_test(tc, linearHashNTACountTest);
   tcase_add_test(tc, emptyHashIterator);
   tcase_add_test(tc, emptyHashIterator2);
   tcase_add_test(tc, linearHashNTAVariableSizetest);
@@ -668,6 +721,7 @@ Suite * check_suite(void) {
   tcase_add_test(tc, linearHashNTAVariableLengthIteratortest);
   tcase_add_test(tc, linearHashNTAtest);
   tcase_add_test(tc, linearHashNTAThreadedTest);
+  tcase_add_test(tc, linearHashNTAVariableLengthThreadedTest);
   tcase_add_test(tc, linearHashNTABlobTest);
 #ifdef LONG_TEST
   tcase_add_test(tc, linearHashNTAThreadedTestRandomized);
@@ -2,8 +2,10 @@
 
 #include <stasis/transactional.h>
 #include <stasis/lockManager.h>
+#include <stasis/util/time.h>
 
 #include <pthread.h>
+#include <unistd.h>
 #include <assert.h>
 #include <stdlib.h>
 
@@ -17,9 +19,6 @@
 void * pageWorkerThread(void * j) {
   int xid = *(int*)j;
   globalLockManager.begin(xid);
-  recordid rid;
-  rid.page = 0;
-  rid.size = 0;
   int k;
   int deadlocks = 0;
   for(k = 0; k < RIDS_PER_THREAD; k++) {
@@ -28,14 +27,10 @@ void * pageWorkerThread(void * j) {
 
     if(rw) {
       // readlock
-      int locked = 0;
       if(LLADD_DEADLOCK == globalLockManager.readLockPage(xid, m)) {
 	k = 0;
-	assert(compensation_error() == LLADD_DEADLOCK);
-	compensation_clear_error();
 	globalLockManager.abort(xid);
 	deadlocks++;
-	locked = 1;
       }
     } else {
 
@@ -43,9 +38,6 @@ void * pageWorkerThread(void * j) {
 	k = 0;
 	globalLockManager.abort(xid);
 	deadlocks++;
-	int err = compensation_error();
-	assert(err == LLADD_DEADLOCK);
-	compensation_clear_error();
       }
     }
   }
@@ -137,18 +129,109 @@ START_TEST(pageLockManagerTest) {
 
 } END_TEST
 
+static pthread_barrier_t deadlock_barrier;
+static recordid deadlock_rids[2];
+
+static void * deadlockWorkerThread(void * arg) {
+  int xid = *(int*)arg;
+  globalLockManager.begin(xid);
+  int ret = globalLockManager.writeLockRecord(xid, deadlock_rids[xid]);
+  assert(!ret);
+  pthread_barrier_wait(&deadlock_barrier);
+  // Each transaction now waits for the other's record.
+  ret = globalLockManager.writeLockRecord(xid, deadlock_rids[!xid]);
+  if(ret) {
+    assert(ret == LLADD_DEADLOCK);
+    globalLockManager.abort(xid);
+  } else {
+    globalLockManager.commit(xid);
+  }
+  return (void*)(intptr_t)ret;
+}
+
+START_TEST(deadlockDetectionTest) {
+  setupLockManagerCallbacksRecord();
+
+  deadlock_rids[0].page = 1; deadlock_rids[0].slot = 0; deadlock_rids[0].size = sizeof(int);
+  deadlock_rids[1].page = 2; deadlock_rids[1].slot = 0; deadlock_rids[1].size = sizeof(int);
+
+  for(int i = 0; i < 10; i++) {
+    pthread_barrier_init(&deadlock_barrier, NULL, 2);
+    pthread_t workers[2];
+    int xids[2] = { 0, 1 };
+    struct timeval start, stop;
+    gettimeofday(&start, NULL);
+    for(int j = 0; j < 2; j++) {
+      pthread_create(&workers[j], NULL, deadlockWorkerThread, &xids[j]);
+    }
+    void * ret[2];
+    for(int j = 0; j < 2; j++) {
+      pthread_join(workers[j], &ret[j]);
+    }
+    gettimeofday(&stop, NULL);
+    pthread_barrier_destroy(&deadlock_barrier);
+    // Exactly one of the transactions should have been chosen as the victim.
+    assert((ret[0] == 0) != (ret[1] == 0));
+    // ...and it should not take anywhere near as long as the old one second timeout.
+    assert(stasis_timeval_to_double(stasis_subtract_timeval(stop, start)) < 0.5);
+  }
+  setupLockManagerCallbacksNil();
+} END_TEST
+
+static int intention_granted;
+static void * pageWriterThread(void * arg) {
+  int xid = *(int*)arg;
+  int ret = lockManagerWriteLockPage(xid, 1);
+  assert(!ret);
+  __sync_fetch_and_add(&intention_granted, 1);
+  lockManagerUnlockPage(xid, 1);
+  globalLockManager.commit(xid);
+  return NULL;
+}
+
+START_TEST(intentionLockTest) {
+  setupLockManagerCallbacksRecord();
+  recordid a = { 1, 1, sizeof(int) };
+  recordid b = { 1, 2, sizeof(int) };
+  // Readers and writers of different records on the same page do not conflict.
+  assert(!lockManagerReadLockRecord(1, a));
+  assert(!lockManagerWriteLockRecord(2, b));
+  assert(!lockManagerReadLockRecord(3, a));
+
+  // ...but a page lock conflicts with all of them.
+  intention_granted = 0;
+  int xid = 4;
+  pthread_t writer;
+  pthread_create(&writer, NULL, pageWriterThread, &xid);
+  usleep(100 * 1000);
+  assert(!intention_granted);
+  globalLockManager.commit(1);
+  globalLockManager.commit(2);
+  usleep(100 * 1000);
+  assert(!intention_granted);
+  globalLockManager.commit(3);
+  pthread_join(writer, NULL);
+  assert(intention_granted);
+
+  // A shared page lock still admits readers of its records.
+  assert(!lockManagerReadLockPage(5, 1));
+  assert(!lockManagerReadLockRecord(6, a));  // IS is compatible with S
+  globalLockManager.commit(6);
+  globalLockManager.commit(5);
+  setupLockManagerCallbacksNil();
+} END_TEST
+
 Suite * check_suite(void) {
   Suite *s = suite_create("lockManager");
   /* Begin a new test */
   TCase *tc = tcase_create("multithreaded");
   tcase_set_timeout(tc, 0); // disable timeouts
-  // kinda hacky, but here it is:
-  compensations_init();
-
   /* Sub tests are added, one per line, here */
 
   tcase_add_test(tc, recordidLockManagerTest);
   tcase_add_test(tc, pageLockManagerTest);
+  tcase_add_test(tc, deadlockDetectionTest);
+  tcase_add_test(tc, intentionLockTest);
 
   /* --------------------------------------------- */
 
@@ -135,7 +135,63 @@ START_TEST(updateLogEntryAllocNoExtras)
 }
 END_TEST
 
+static void compactRoundTrip(const LogEntry * e) {
+  lsn_t size = sizeofLogEntry(0, e);
+  byte * buf = malloc(size + STASIS_LOG_ENTRY_COMPACT_SLACK);
+  lsn_t len = stasis_log_entry_compact(0, e, buf);
+  assert(len == stasis_log_entry_compact_size(0, e));
+  assert(len <= size + STASIS_LOG_ENTRY_COMPACT_SLACK);
+  LogEntry * f = stasis_log_entry_uncompact(e->LSN, buf, len);
+  assert(f);
+  assert(sizeofLogEntry(0, f) == size);
+  assert(!memcmp(e, f, size));
+  free(f);
+  if(e->type == UPDATELOG) {
+    // Truncated updates must be rejected, not decoded.
+    assert(!stasis_log_entry_uncompact(e->LSN, buf, len - 1));
+  }
+  free(buf);
+}
+
+/** @test
+
+    Check that the compact encoding round trips, and that it shrinks
+    small updates.
+*/
+START_TEST(compactLogEntry)
+{
+  char args[] = {'a', 'b', 'c'};
 
+  LogEntry * e = mallocScratchCommonLogEntry(1000, INVALID_LSN, 1, XBEGIN);
+  compactRoundTrip(e);
+  free(e);
+
+  e = mallocScratchCommonLogEntry(1LL << 40, 100, INVALID_XID, XCOMMIT);
+  compactRoundTrip(e);
+  free(e);
+
+  e = mallocScratchUpdateLogEntry(1000, 900, 1, OPERATION_SET, 3, 3);
+  memcpy(stasis_log_entry_update_args_ptr(e), args, 3);
+  compactRoundTrip(e);
+  byte buf[sizeof(LogEntry) + 3];
+  assert(stasis_log_entry_compact(0, e, buf) < 16);
+
+  e->LSN = 2000;
+  LogEntry * clr = malloc(sizeof(struct __raw_log_entry) + sizeofLogEntry(0, e));
+  clr->LSN = 3000;
+  clr->prevLSN = e->prevLSN;
+  clr->xid = e->xid;
+  clr->type = CLRLOG;
+  memcpy((void*)getCLRCompensated((CLRLogEntry*)clr), e, sizeofLogEntry(0, e));
+  compactRoundTrip(clr);
+  free(clr);
+  free(e);
+
+  e = mallocScratchUpdateLogEntry(5000, 4000, 7, OPERATION_NOOP, -1, 0);
+  compactRoundTrip(e);
+  free(e);
+}
+END_TEST
 
 
 Suite * check_suite(void) {
@@ -148,6 +204,7 @@ Suite * check_suite(void) {
   tcase_add_test(tc, rawLogEntryAlloc);
   tcase_add_test(tc, updateLogEntryAlloc);
   tcase_add_test(tc, updateLogEntryAllocNoExtras);
+  tcase_add_test(tc, compactLogEntry);
 
   /* --------------------------------------------- */
 
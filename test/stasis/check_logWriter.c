@@ -304,6 +304,44 @@ START_TEST(loggerMemTruncate) {
 	loggerTruncate(LOG_TO_MEMORY);
 } END_TEST
 
+/**
+    @test
+
+    Check that forward scans return the same entries as read_entry(),
+    including when the scan buffer is smaller than the entries.
+*/
+static void loggerScan(int logType) {
+  stasis_log_type = logType;
+  lsn_t buffer_sizes[] = { 64, 1000, stasis_log_scan_buffer_size };
+  lsn_t default_size = stasis_log_scan_buffer_size;
+  stasis_log_t * stasis_log_file = setup_log();
+  for(int j = 0; j < sizeof(buffer_sizes)/sizeof(buffer_sizes[0]); j++) {
+    stasis_log_scan_buffer_size = buffer_sizes[j];
+    LogHandle * h = getLogHandle(stasis_log_file);
+    const LogEntry * e;
+    int i = 0;
+    while((e = nextInLog(h))) {
+      const LogEntry * f = stasis_log_file->read_entry(stasis_log_file, e->LSN);
+      assert(f);
+      assert(sizeofLogEntry(stasis_log_file, e) == sizeofLogEntry(stasis_log_file, f));
+      assert(!memcmp(e, f, sizeofLogEntry(stasis_log_file, e)));
+      stasis_log_file->read_entry_done(stasis_log_file, f);
+      if(e->type != INTERNALLOG) { i++; }
+    }
+    freeLogHandle(h);
+    assert(i == 3000);
+  }
+  stasis_log_scan_buffer_size = default_size;
+  stasis_log_safe_writes_delete(stasis_log_file_name);
+  Tdeinit();
+}
+START_TEST(loggerFileScan) {
+  loggerScan(LOG_TO_FILE);
+} END_TEST
+START_TEST(loggerDirScan) {
+  loggerScan(LOG_TO_DIR);
+} END_TEST
+
 #define ENTRIES_PER_THREAD 200
 
 pthread_mutex_t random_mutex;
@@ -472,7 +510,7 @@ void reopenLogWorkload(int truncating) {
   }
 
   int xid = 1;
-  stasis_transaction_table_entry_t l;
+  stasis_transaction_table_entry_t l = { 0 };
 //  pthread_mutex_init(&l.mut,0);
   stasis_log_begin_transaction(stasis_log_file, xid, &l);
   lsn_t startLSN = 0;
@@ -594,6 +632,46 @@ START_TEST(loggerTruncateReopenTest) {
   reopenLogWorkload(1);
 } END_TEST
 
+/**
+    @test
+
+    Run the LOG_TO_FILE tests against a log that uses the compact entry
+    encoding, then check that reopening the log with the flag off still
+    reads it back.
+*/
+START_TEST(loggerFileCompactTest) {
+  int old_compact = stasis_log_file_compact_entries;
+  stasis_log_file_compact_entries = 1;
+  loggerTest(LOG_TO_FILE);
+  loggerTruncate(LOG_TO_FILE);
+  loggerScan(LOG_TO_FILE);
+  stasis_log_type = LOG_TO_FILE;
+  stasis_log_safe_writes_delete(stasis_log_file_name);
+  reopenLogWorkload(1);
+
+  stasis_log_file_compact_entries = 0;
+  stasis_log_t * log = stasis_log_safe_writes_open(stasis_log_file_name,
+                                                   stasis_log_file_mode,
+                                                   stasis_log_file_permissions,
+                                                   stasis_log_softcommit);
+  LogHandle * h = getLogHandle(log);
+  const LogEntry * e;
+  int i = 0;
+  while((e = nextInLog(h))) {
+    if(e->type != INTERNALLOG) {
+      assert(e->type == UPDATELOG);
+      assert(e->update.funcID == OPERATION_NOOP);
+      i++;
+    }
+  }
+  freeLogHandle(h);
+  assert(i > 1000);
+  log->close(log);
+
+  stasis_log_file_compact_entries = old_compact;
+  stasis_log_safe_writes_delete(stasis_log_file_name);
+} END_TEST
+
 static void loggerEmptyForce_helper() {
   Tinit();
   int xid = Tbegin();
@@ -609,6 +687,62 @@ START_TEST(loggerEmptyMemForceTest) {
   stasis_log_type = LOG_TO_MEMORY;
   loggerEmptyForce_helper();
 } END_TEST
+#define GROUP_COMMIT_THREADS 10
+#define GROUP_COMMIT_XACTS 100
+static void* groupCommitWorker(void* arg) {
+  recordid rid = *(recordid*)arg;
+  for(int i = 0; i < GROUP_COMMIT_XACTS; i++) {
+    int xid = Tbegin();
+    Tset(xid, rid, &i);
+    Tcommit(xid);
+  }
+  return 0;
+}
+static void loggerGroupCommit_helper(int adaptive) {
+  stasis_log_type = LOG_TO_FILE;
+  stasis_log_group_commit_adaptive = adaptive;
+  Tinit();
+  pthread_t workers[GROUP_COMMIT_THREADS];
+  recordid rids[GROUP_COMMIT_THREADS];
+  int xid = Tbegin();
+  for(int i = 0; i < GROUP_COMMIT_THREADS; i++) {
+    rids[i] = Talloc(xid, sizeof(int));
+  }
+  Tcommit(xid);
+  stasis_log_t * log = stasis_log();
+  stasis_log_group_force_stats_t before, after;
+  stasis_log_group_force_stats(log->group_force, &before);
+  for(int i = 0; i < GROUP_COMMIT_THREADS; i++) {
+    pthread_create(&workers[i], 0, groupCommitWorker, &rids[i]);
+  }
+  for(int i = 0; i < GROUP_COMMIT_THREADS; i++) {
+    pthread_join(workers[i], 0);
+  }
+  stasis_log_group_force_stats(log->group_force, &after);
+  assert(after.commits - before.commits == GROUP_COMMIT_THREADS * GROUP_COMMIT_XACTS);
+  assert(after.forces - before.forces <= GROUP_COMMIT_THREADS * GROUP_COMMIT_XACTS);
+  uint64_t batches = 0;
+  for(int i = 0; i < STASIS_LOG_GROUP_FORCE_BATCH_BUCKETS; i++) {
+    batches += after.batch_size[i];
+  }
+  assert(batches == after.forces);
+  assert(after.waits <= after.commits);
+  assert(after.total_wait_sec >= 0);
+
+  for(int i = 0; i < GROUP_COMMIT_THREADS; i++) {
+    int j;
+    xid = Tbegin();
+    Tread(xid, rids[i], &j);
+    assert(j == GROUP_COMMIT_XACTS - 1);
+    Tcommit(xid);
+  }
+  Tdeinit();
+  stasis_log_group_commit_adaptive = 1;
+}
+START_TEST(loggerGroupCommitTest) {
+  loggerGroupCommit_helper(0);
+  loggerGroupCommit_helper(1);
+} END_TEST
 Suite * check_suite(void) {
   Suite *s = suite_create("logWriter");
   /* Begin a new test */
@@ -623,6 +757,9 @@ Suite * check_suite(void) {
   tcase_add_test(tc, logHandleMemColdReverseIterator);
   tcase_add_test(tc, loggerFileTruncate);
   tcase_add_test(tc, loggerMemTruncate);
+  tcase_add_test(tc, loggerFileScan);
+  tcase_add_test(tc, loggerDirScan);
+  tcase_add_test(tc, loggerFileCompactTest);
   tcase_add_test(tc, loggerFileCheckWorker);
   tcase_add_test(tc, loggerMemCheckWorker);
   tcase_add_test(tc, loggerFileCheckThreaded);
@@ -630,6 +767,7 @@ Suite * check_suite(void) {
   if(stasis_log_type != LOG_TO_MEMORY) {
     tcase_add_test(tc, loggerReopenTest);
     tcase_add_test(tc, loggerTruncateReopenTest);
+    tcase_add_test(tc, loggerGroupCommitTest);
   }
 
   /* --------------------------------------------- */
@@ -558,6 +558,15 @@ START_TEST(operation_array_list) {
     assert(i == j);
   }
 
+  stasis_buffer_manager_handle_t * h = stasis_buffer_manager_open_sequential_handle();
+  for(int i = 0; i < ARRAY_LIST_CHECK_ITER; i++) {
+    rid2.slot = i;
+    int j;
+    TarrayListRead(xid, h, rid2, &j);
+    assert(i == j);
+  }
+  stasis_buffer_manager_close_handle(h);
+
   TarrayListDealloc(xid, rid);
   Tcommit(xid);
 
@@ -759,6 +768,44 @@ START_TEST(operation_segment) {
 
 } END_TEST
 
+/**
+   @test Read and write ranges that span several pages, and do not start
+   or end on page boundaries.
+*/
+START_TEST(operation_segment_multipage) {
+  const int SEGMENT_TEST = 42;
+  Tinit();
+  int xid = Tbegin();
+  pageid_t region_start = TregionAlloc(xid, 10, SEGMENT_TEST);
+  Tcommit(xid);
+
+  const size_t len = 3 * PAGE_SIZE + 100;
+  const off_t off = region_start * PAGE_SIZE + 10;
+  byte * buf = malloc(len);
+  byte * buf2 = malloc(len);
+  for(size_t i = 0; i < len; i++) { buf[i] = (byte)(i % 251); }
+
+  xid = Tbegin();
+  assert(Tpwrite(xid, buf, len, off) == (ssize_t)len);
+  assert(Tpread(xid, buf2, len, off) == (ssize_t)len);
+  assert(!memcmp(buf, buf2, len));
+  Tcommit(xid);
+
+  xid = Tbegin();
+  memset(buf2, 0, len);
+  Tpwrite(xid, buf2, len, off);
+  Tabort(xid);
+
+  xid = Tbegin();
+  assert(Tpread(xid, buf2, len, off) == (ssize_t)len);
+  assert(!memcmp(buf, buf2, len));
+  Tcommit(xid);
+
+  free(buf);
+  free(buf2);
+  Tdeinit();
+} END_TEST
+
 #define OPERATION_TEST_LOGICAL_REDO OPERATION_USER_DEFINED(1)
 #define OPERATION_TEST_LOGICAL_UNDO OPERATION_USER_DEFINED(2)
 
@@ -861,6 +908,7 @@ Suite * check_suite(void) {
   tcase_add_test(tc, operation_lsn_free);
   tcase_add_test(tc, operation_reorderable);
   tcase_add_test(tc, operation_segment);
+  tcase_add_test(tc, operation_segment_multipage);
 
   tcase_add_test(tc, operation_logical_redo_many_pages);
  /* --------------------------------------------- */
@@ -52,9 +52,12 @@ terms specified in this license.
 #include <stasis/experimental/latchFree/lfSlotted.h>
 #include <stasis/operations/blobs.h>
 #include <stasis/bufferManager.h>
+#include <stasis/pageHandle.h>
 #include <stasis/transactional.h>
 #include <stasis/util/latches.h>
 #include <stasis/util/random.h>
+#include <stasis/util/crc32.h>
+#include <stasis/flags.h>
 
 #include <sched.h>
 #include <assert.h>
@@ -713,6 +716,202 @@ START_TEST(pageTreeOpTest) {
   Tdeinit();
 } END_TEST
 
+START_TEST(pageChecksumCrcTest) {
+  const char * check = "123456789";
+  // The standard check values for the two polynomials.
+  assert(~stasis_crc32(check, 9, (uint32_t)-1) == 0xCBF43926);
+  assert(~stasis_crc32c(check, 9, (uint32_t)-1) == 0xE3069283);
+  assert(~stasis_crc32c_table(check, 9, (uint32_t)-1) == 0xE3069283);
+
+  // The hardware and software paths must agree for all alignments and
+  // lengths, including the unaligned prefix and suffix.
+  byte buf[PAGE_SIZE + 16];
+  for(int i = 0; i < sizeof(buf); i++) { buf[i] = stasis_util_random64(256); }
+  for(int off = 0; off < 16; off++) {
+    for(int len = 0; len < 100; len++) {
+      assert(stasis_crc32c(buf + off, len, 0x1234) == stasis_crc32c_table(buf + off, len, 0x1234));
+    }
+    assert(stasis_crc32c(buf + off, PAGE_SIZE, (uint32_t)-1)
+           == stasis_crc32c_table(buf + off, PAGE_SIZE, (uint32_t)-1));
+  }
+  // Checksums can be computed incrementally.
+  uint32_t whole = stasis_crc32c(buf, PAGE_SIZE, (uint32_t)-1);
+  uint32_t part = stasis_crc32c(buf, 1001, (uint32_t)-1);
+  assert(whole == stasis_crc32c(buf + 1001, PAGE_SIZE - 1001, part));
+  whole = stasis_crc32(buf, PAGE_SIZE, (uint32_t)-1);
+  part = stasis_crc32(buf, 1001, (uint32_t)-1);
+  assert(whole == stasis_crc32(buf + 1001, PAGE_SIZE - 1001, part));
+} END_TEST
+
+START_TEST(pageChecksumRoundTripTest) {
+  stasis_page_checksums = 1;
+  Tinit();
+  assert(stasis_page_checksum_size == sizeof(uint32_t));
+  int xid = Tbegin();
+  recordid rids[10];
+  for(int i = 0; i < 10; i++) {
+    rids[i] = Talloc(xid, sizeof(int));
+    Tset(xid, rids[i], &i);
+  }
+  Tcommit(xid);
+  Tdeinit();
+
+  // The page file remembers that it has checksums, whatever the flag says.
+  // Reading the pages back verifies them.
+  stasis_page_checksums = 0;
+  Tinit();
+  assert(stasis_page_checksum_size == sizeof(uint32_t));
+  xid = Tbegin();
+  for(int i = 0; i < 10; i++) {
+    int j;
+    Tread(xid, rids[i], &j);
+    assert(i == j);
+  }
+  // Corrupt pages fail verification, including pages whose checksum was
+  // zeroed.
+  Page * p = loadPage(xid, rids[0].page);
+  Page copy;
+  memset(&copy, 0, sizeof(copy));
+  copy.id = p->id;
+  copy.memAddr = malloc(PAGE_SIZE);
+  memcpy(copy.memAddr, p->memAddr, PAGE_SIZE);
+  releasePage(p);
+  uint32_t stamped = *stasis_page_checksum_cptr(&copy);
+  *stasis_page_checksum_ptr(&copy) = 0;
+  assert(!stasis_page_try_loaded(&copy));
+  *stasis_page_checksum_ptr(&copy) = stamped;
+  copy.memAddr[0] ^= 1;
+  assert(!stasis_page_try_loaded(&copy));
+  free(copy.memAddr);
+  Tcommit(xid);
+  Tdeinit();
+
+  // Page files created without checksums do not reserve space for them.
+  setup();
+  Tinit();
+  assert(stasis_page_checksum_size == 0);
+  assert(USABLE_SIZE_OF_PAGE == PAGE_SIZE - sizeof(lsn_t) - sizeof(int));
+  xid = Tbegin();
+  int j = 42;
+  recordid rid = Talloc(xid, sizeof(int));
+  Tset(xid, rid, &j);
+  Tcommit(xid);
+  Tdeinit();
+
+  stasis_page_checksums = 1;
+  Tinit();
+  assert(stasis_page_checksum_size == 0);
+  xid = Tbegin();
+  j = 0;
+  Tread(xid, rid, &j);
+  assert(j == 42);
+  Tcommit(xid);
+  Tdeinit();
+  stasis_page_checksums = 0;
+} END_TEST
+START_TEST(pageSizeTest) {
+  stasis_page_size = 16 * 1024;
+  Tinit();
+  assert(PAGE_SIZE == 16 * 1024);
+  int xid = Tbegin();
+  // Records that would be blobs on 4KB pages.
+  size_t len = 8 * 1024;
+  byte * buf = malloc(len);
+  recordid rids[10];
+  for(int i = 0; i < 10; i++) {
+    memset(buf, i, len);
+    rids[i] = Talloc(xid, len);
+    assert(rids[i].size == len);
+    Tset(xid, rids[i], buf);
+  }
+  Tcommit(xid);
+  Tdeinit();
+
+  // The page size is recorded in the page file, and overrides the flag.
+  stasis_page_size = STASIS_DEFAULT_PAGE_SIZE;
+  Tinit();
+  assert(PAGE_SIZE == 16 * 1024);
+  xid = Tbegin();
+  byte * expected = malloc(len);
+  for(int i = 0; i < 10; i++) {
+    memset(expected, i, len);
+    Tread(xid, rids[i], buf);
+    assert(!memcmp(buf, expected, len));
+  }
+  Tcommit(xid);
+  Tdeinit();
+  free(buf);
+  free(expected);
+  stasis_page_size = STASIS_DEFAULT_PAGE_SIZE;
+} END_TEST
+
+/**
+   Page files that predate the page file header have no magic number,
+   and are opened in the legacy layout, whatever the flags say.
+ */
+START_TEST(pageFileLegacyLayoutTest) {
+  Tinit();
+  int xid = Tbegin();
+  recordid rids[10];
+  for(int i = 0; i < 10; i++) {
+    rids[i] = Talloc(xid, sizeof(int));
+    Tset(xid, rids[i], &i);
+  }
+  Tcommit(xid);
+  Tdeinit();
+
+  // Strip the header page, leaving a page file in the legacy layout.
+  FILE * f = fopen(stasis_store_file_name, "r");
+  assert(f);
+  fseek(f, 0, SEEK_END);
+  long len = ftell(f) - STASIS_PAGE_FILE_LEGACY_PAGE_SIZE;
+  assert(len > 0);
+  byte * buf = malloc(len);
+  fseek(f, STASIS_PAGE_FILE_LEGACY_PAGE_SIZE, SEEK_SET);
+  assert(fread(buf, 1, len, f) == (size_t)len);
+  fclose(f);
+  f = fopen(stasis_store_file_name, "w");
+  assert(fwrite(buf, 1, len, f) == (size_t)len);
+  fclose(f);
+  free(buf);
+
+  stasis_page_size = 2 * STASIS_DEFAULT_PAGE_SIZE;
+  stasis_page_checksums = 1;
+  for(int round = 0; round < 2; round++) {
+    Tinit();
+    assert(PAGE_SIZE == STASIS_PAGE_FILE_LEGACY_PAGE_SIZE);
+    assert(stasis_page_checksum_size == 0);
+    assert(stasis_page_file_header_pages == 0);
+    xid = Tbegin();
+    for(int i = 0; i < 10; i++) {
+      int j;
+      Tread(xid, rids[i], &j);
+      assert(i + round == j);
+      j++;
+      Tset(xid, rids[i], &j);
+    }
+    Tcommit(xid);
+    Tdeinit();
+  }
+
+  // No header was added.
+  char magic[sizeof(STASIS_PAGE_FILE_MAGIC)];
+  f = fopen(stasis_store_file_name, "r");
+  assert(fread(magic, 1, sizeof(magic) - 1, f) == sizeof(magic) - 1);
+  fclose(f);
+  assert(memcmp(magic, STASIS_PAGE_FILE_MAGIC, sizeof(magic) - 1));
+
+  // New page files get a header again.  (Opening the legacy file
+  // overwrote the page size flag.)
+  setup();
+  stasis_page_size = 2 * STASIS_DEFAULT_PAGE_SIZE;
+  Tinit();
+  assert(PAGE_SIZE == 2 * STASIS_DEFAULT_PAGE_SIZE);
+  assert(stasis_page_file_header_pages == 1);
+  Tdeinit();
+  stasis_page_size = STASIS_DEFAULT_PAGE_SIZE;
+  stasis_page_checksums = 0;
+} END_TEST
 
 Suite * check_suite(void) {
   Suite *s = suite_create("page");
@@ -731,6 +930,10 @@ Suite * check_suite(void) {
   tcase_add_test(tc, pageThreadTest);
   tcase_add_test(tc, fixedPageThreadTest);
   tcase_add_test(tc, latchFreeThreadTest);
+  tcase_add_test(tc, pageChecksumCrcTest);
+  tcase_add_test(tc, pageChecksumRoundTripTest);
+  tcase_add_test(tc, pageSizeTest);
+  tcase_add_test(tc, pageFileLegacyLayoutTest);
 
   /* --------------------------------------------- */
 
@@ -506,6 +506,144 @@ START_TEST (recovery_multiple_xacts) {
   Tdeinit();
 } END_TEST
 
+#define PARALLEL_REDO_RECORDS 2000
+#define PARALLEL_REDO_ROUNDS  5
+
+typedef struct {
+  int round;
+  int i;
+  char pad[248];
+} parallel_redo_record;
+/**
+   @test
+
+   Crash with committed, aborted and in-progress updates to many pages,
+   then recover with several redo threads.
+*/
+START_TEST (recovery_parallelRedo) {
+  recordid rids[PARALLEL_REDO_RECORDS];
+  parallel_redo_record r;
+  memset(&r, 0, sizeof(r));
+
+  Tinit();
+  int xid = Tbegin();
+  for(int i = 0; i < PARALLEL_REDO_RECORDS; i++) {
+    rids[i] = Talloc(xid, sizeof(r));
+    r.round = 0;
+    r.i = i;
+    Tset(xid, rids[i], &r);
+  }
+  Tcommit(xid);
+  for(int round = 1; round < PARALLEL_REDO_ROUNDS; round++) {
+    xid = Tbegin();
+    for(int i = 0; i < PARALLEL_REDO_RECORDS; i++) {
+      r.round = round;
+      r.i = i;
+      Tset(xid, rids[i], &r);
+    }
+    Tcommit(xid);
+  }
+  // An aborted transaction leaves CLRs in the log...
+  xid = Tbegin();
+  for(int i = 0; i < PARALLEL_REDO_RECORDS; i += 3) {
+    r.round = -1;
+    Tset(xid, rids[i], &r);
+  }
+  Tabort(xid);
+  // ...and this one will be rolled back by recovery.
+  xid = Tbegin();
+  for(int i = 0; i < PARALLEL_REDO_RECORDS; i += 7) {
+    r.round = -2;
+    Tset(xid, rids[i], &r);
+  }
+  TuncleanShutdown();
+
+  stasis_recovery_redo_threads = 4;
+  Tinit();
+  stasis_recovery_redo_threads = 1;
+
+  xid = Tbegin();
+  for(int i = 0; i < PARALLEL_REDO_RECORDS; i++) {
+    Tread(xid, rids[i], &r);
+    assert(r.round == PARALLEL_REDO_ROUNDS - 1);
+    assert(r.i == i);
+  }
+  Tcommit(xid);
+  Tdeinit();
+} END_TEST
+
+/**
+   Recover from a log with fuzzy checkpoints.  The first checkpoint
+   finds no dirty pages, and the second is taken while the pages are
+   dirty, so redo has to apply some of the updates before it, and none
+   of the ones before the first.  An in-progress transaction keeps the
+   log from being truncated past the start of the test.
+*/
+START_TEST (recovery_checkpoint) {
+  recordid rids[PARALLEL_REDO_RECORDS];
+  parallel_redo_record r;
+  memset(&r, 0, sizeof(r));
+
+  Tinit();
+  int xid = Tbegin();
+  recordid loser_rid = Talloc(xid, sizeof(r));
+  for(int i = 0; i < PARALLEL_REDO_RECORDS; i++) {
+    rids[i] = Talloc(xid, sizeof(r));
+  }
+  Tcommit(xid);
+
+  int loser = Tbegin();
+  r.round = -1;
+  Tset(loser, loser_rid, &r);
+
+  xid = Tbegin();
+  for(int i = 0; i < PARALLEL_REDO_RECORDS; i++) {
+    r.round = 0;
+    r.i = i;
+    Tset(xid, rids[i], &r);
+  }
+  Tcommit(xid);
+
+  TtruncateLog();
+  lsn_t first = Tcheckpoint();
+
+  xid = Tbegin();
+  for(int i = 0; i < PARALLEL_REDO_RECORDS; i += 2) {
+    r.round = 1;
+    r.i = i;
+    Tset(xid, rids[i], &r);
+  }
+  Tcommit(xid);
+
+  lsn_t second = Tcheckpoint();
+  assert(second > first);
+
+  xid = Tbegin();
+  for(int i = 0; i < PARALLEL_REDO_RECORDS; i += 3) {
+    r.round = 2;
+    r.i = i;
+    Tset(xid, rids[i], &r);
+  }
+  Tcommit(xid);
+
+  r.round = -2;
+  for(int i = 0; i < PARALLEL_REDO_RECORDS; i += 5) {
+    Tset(loser, rids[i], &r);
+  }
+  TuncleanShutdown();
+
+  Tinit();
+
+  xid = Tbegin();
+  for(int i = 0; i < PARALLEL_REDO_RECORDS; i++) {
+    Tread(xid, rids[i], &r);
+    int expected = !(i % 3) ? 2 : !(i % 2) ? 1 : 0;
+    assert(r.round == expected);
+    assert(r.i == i);
+  }
+  Tcommit(xid);
+  Tdeinit();
+} END_TEST
 
 /**
   Add suite declarations here
@@ -529,6 +667,8 @@ Suite * check_suite(void) {
     tcase_add_test(tc, recovery_clr);
     tcase_add_test(tc, recovery_crash);
     tcase_add_test(tc, recovery_multiple_xacts);
+    tcase_add_test(tc, recovery_parallelRedo);
+    tcase_add_test(tc, recovery_checkpoint);
 
     tcase_add_test(tc, recovery_softCommit);
   }
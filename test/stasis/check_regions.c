@@ -205,6 +205,83 @@ START_TEST(regions_randomizedTest) {
 
 } END_TEST
 
+/**
+   Check TregionFindNthActive() against TregionNextBoundaryTag().  Both
+   are served from the in-memory index of boundary tags.
+*/
+static void checkActiveRegions(int xid, pageid_t * pages, pageid_t * sizes, pageid_t count) {
+  pageid_t pid = REGION_FIRST_TAG;
+  boundary_tag t;
+  pageid_t n = 0;
+  for(int succ = TregionReadBoundaryTag(xid, pid, &t); succ; succ = TregionNextBoundaryTag(xid, &pid, &t, 0)) {
+    if(t.status != REGION_ZONED) { continue; }
+    pageid_t firstPage, size;
+    TregionFindNthActive(xid, n, &firstPage, &size);
+    assert(firstPage == pid);
+    assert(size == t.size);
+    assert(n < count);
+    assert(pages[n] == pid);
+    assert(sizes[n] == size);
+    n++;
+  }
+  assert(n == count);
+}
+
+static int pageid_cmp(const void * a, const void * b) {
+  pageid_t x = *(const pageid_t*)a, y = *(const pageid_t*)b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+START_TEST(regions_indexTest) {
+  Tinit();
+  const int NUM_REGIONS = 2000;
+  pageid_t * pages = malloc(sizeof(pageid_t) * NUM_REGIONS);
+  pageid_t * sizes = malloc(sizeof(pageid_t) * NUM_REGIONS);
+
+  int xid = Tbegin();
+  for(int i = 0; i < NUM_REGIONS; i++) {
+    pages[i] = TregionAlloc(xid, i % 7 + 1, 0);
+  }
+  Tcommit(xid);
+
+  xid = Tbegin();
+  pageid_t count = 0;
+  for(int i = 0; i < NUM_REGIONS; i++) {
+    if(i % 3) {
+      pages[count++] = pages[i];
+    } else {
+      TregionDealloc(xid, pages[i]);
+    }
+  }
+  // Reuse some of the freed space, and extend the page file.
+  for(int i = 0; i < NUM_REGIONS / 10; i++) {
+    pages[count++] = TregionAlloc(xid, i % 11 + 1, 0);
+  }
+  Tcommit(xid);
+
+  qsort(pages, count, sizeof(pageid_t), pageid_cmp);
+  for(pageid_t i = 0; i < count; i++) {
+    sizes[i] = TregionSize(-1, pages[i]);
+  }
+
+  xid = Tbegin();
+  checkActiveRegions(xid, pages, sizes, count);
+  fsckRegions(xid);
+  Tcommit(xid);
+  Tdeinit();
+
+  // The index is rebuilt from the page file.
+  Tinit();
+  xid = Tbegin();
+  checkActiveRegions(xid, pages, sizes, count);
+  fsckRegions(xid);
+  Tcommit(xid);
+  Tdeinit();
+
+  free(pages);
+  free(sizes);
+} END_TEST
+
 START_TEST(regions_lockSmokeTest) {
   Tinit();
   int xid = Tbegin();
@@ -362,6 +439,7 @@ Suite * check_suite(void) {
   /* Sub tests are added, one per line, here */
   tcase_add_test(tc, regions_smokeTest);
   tcase_add_test(tc, regions_randomizedTest);
+  tcase_add_test(tc, regions_indexTest);
   tcase_add_test(tc, regions_lockSmokeTest);
   tcase_add_test(tc, regions_lockRandomizedTest);
   tcase_add_test(tc, regions_recoveryTest);
@@ -186,6 +186,14 @@ START_TEST(replacementPolicyClockRandomTest) {
   lru->deinit(lru);
   randomTeardown();
 } END_TEST
+START_TEST(replacementPolicyArcRandomTest) {
+  replacementPolicy * lru = replacementPolicyArcInit(OBJECT_COUNT);
+  threaded = 0;
+  randomSetup();
+  randomTest(lru, LONG_COUNT);
+  lru->deinit(lru);
+  randomTeardown();
+} END_TEST
 replacementPolicy * worker_lru;
 unsigned long worker_count;
 void * randomTestWorker(void * arg) {
@@ -250,6 +258,117 @@ START_TEST(replacementPolicyClockThreadTest) {
   randomTeardown();
 } END_TEST
 
+START_TEST(replacementPolicyConcurrentArcThreadTest) {
+  int LRU_COUNT = OBJECT_COUNT / 51;
+  replacementPolicy * lru[LRU_COUNT];
+  for(int i = 0; i < LRU_COUNT; i++) {
+    lru[i] = replacementPolicyArcInit(OBJECT_COUNT / LRU_COUNT);
+  }
+  replacementPolicy * cwLru = replacementPolicyConcurrentWrapperInit(lru, LRU_COUNT);
+  threaded = 1;
+  worker_lru = cwLru;
+  worker_count = LONG_COUNT / THREAD_COUNT;
+  pthread_t threads[THREAD_COUNT];
+  randomSetup();
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    pthread_create(&threads[i], 0, randomTestWorker, 0);
+  }
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    pthread_join(threads[i], 0);
+  }
+
+  cwLru->deinit(cwLru);
+  randomTeardown();
+} END_TEST
+/**
+   Pin and unpin page id, the way the buffer manager would, loading it into
+   one of the OBJECT_COUNT frames if necessary.
+
+   @return 1 if the page was already cached.
+ */
+static int cacheAccess(replacementPolicy * rp, Page ** map, pageid_t id) {
+  static int frames_used = 0;
+  if(!map) { frames_used = 0; return 0; }
+  Page * p = map[id];
+  int hit = p != NULL;
+  if(hit) {
+    rp->remove(rp, p);
+  } else {
+    if(frames_used < OBJECT_COUNT) {
+      p = &pages[frames_used++];
+    } else {
+      p = rp->getStaleAndRemove(rp);
+      assert(p);
+      map[p->id] = NULL;
+    }
+    p->id = id;
+    map[id] = p;
+    rp->insert(rp, p);
+    rp->remove(rp, p);
+  }
+  rp->insert(rp, p);
+  return hit;
+}
+/**
+   Build up a working set, then scan many more pages than fit in cache.
+   The working set should survive.
+*/
+START_TEST(replacementPolicyArcScanTest) {
+  const pageid_t HOT = OBJECT_COUNT / 4;
+  const pageid_t COLD = 100 * OBJECT_COUNT;
+  randomSetup();
+  replacementPolicy * rp = replacementPolicyArcInit(OBJECT_COUNT);
+  Page ** map = calloc(HOT + 2 * COLD, sizeof(Page*));
+  cacheAccess(rp, NULL, 0);
+
+  for(int i = 0; i < 20; i++) {
+    for(pageid_t j = 0; j < HOT; j++) {
+      cacheAccess(rp, map, j);
+      cacheAccess(rp, map, HOT + stasis_util_random64(COLD)); // random point lookups
+    }
+  }
+  for(pageid_t j = 0; j < COLD; j++) {
+    cacheAccess(rp, map, HOT + COLD + j);
+  }
+  for(pageid_t j = 0; j < HOT; j++) {
+    assert(cacheAccess(rp, map, j));
+  }
+  rp->deinit(rp);
+  free(map);
+  randomTeardown();
+} END_TEST
+/**
+   Shrink and then grow an ARC policy that holds pages and remembers
+   evicted ones.  The most recently evicted ids should survive both.
+*/
+START_TEST(replacementPolicyArcCapacityTest) {
+  randomSetup();
+  replacementPolicy * rp = replacementPolicyArcInit(OBJECT_COUNT);
+  for(int i = 0; i < OBJECT_COUNT; i++) {
+    rp->insert(rp, &pages[i]);
+  }
+  // Everything is in T1, so pages come out in insertion order.
+  for(int i = 0; i < OBJECT_COUNT / 2; i++) {
+    Page * p = rp->getStaleAndRemove(rp);
+    assert(p == &pages[i]);
+  }
+  rp->setCapacity(rp, 10);
+  // Only the last 9 evicted ids fit in the ghost queues now.
+  rp->insert(rp, &pages[OBJECT_COUNT / 2 - 1]);
+  assert(pages[OBJECT_COUNT / 2 - 1].queue == 2); // T2, after a ghost hit.
+  rp->insert(rp, &pages[0]);
+  assert(pages[0].queue == 1); // T1; forgotten by the shrink.
+
+  rp->setCapacity(rp, 2 * OBJECT_COUNT);
+  rp->insert(rp, &pages[OBJECT_COUNT / 2 - 2]);
+  assert(pages[OBJECT_COUNT / 2 - 2].queue == 2);
+
+  int count = 0;
+  while(rp->getStaleAndRemove(rp)) { count++; }
+  assert(count == OBJECT_COUNT / 2 + 3);
+  rp->deinit(rp);
+  randomTeardown();
+} END_TEST
 
 START_TEST(replacementPolicyEmptyFastLRUTest) {
   randomSetup();
@@ -278,6 +397,13 @@ START_TEST(replacementPolicyEmptyConcurrentTest) {
   rp->deinit(rp);
   randomTeardown();
 } END_TEST
+START_TEST(replacementPolicyEmptyArcTest) {
+  randomSetup();
+  replacementPolicy *rp  = replacementPolicyArcInit(OBJECT_COUNT);
+  fillThenEmptyTest(rp);
+  rp->deinit(rp);
+  randomTeardown();
+} END_TEST
 START_TEST(replacementPolicyEmptyClockTest) {
   randomSetup();
   replacementPolicy *rp  = replacementPolicyClockInit(pages, OBJECT_COUNT);
@@ -295,14 +421,19 @@ Suite * check_suite(void) {
   tcase_add_test(tc, replacementPolicyEmptyThreadsafeTest);
   tcase_add_test(tc, replacementPolicyEmptyConcurrentTest);
   tcase_add_test(tc, replacementPolicyEmptyClockTest);
+  tcase_add_test(tc, replacementPolicyEmptyArcTest);
   tcase_add_test(tc, replacementPolicyLRURandomTest);
   tcase_add_test(tc, replacementPolicyLRUFastRandomTest);
   tcase_add_test(tc, replacementPolicyThreadsafeRandomTest);
   tcase_add_test(tc, replacementPolicyConcurrentRandomTest);
   tcase_add_test(tc, replacementPolicyClockRandomTest);
+  tcase_add_test(tc, replacementPolicyArcRandomTest);
   tcase_add_test(tc, replacementPolicyThreadsafeThreadTest);
   tcase_add_test(tc, replacementPolicyConcurrentThreadTest);
   tcase_add_test(tc, replacementPolicyClockThreadTest);
+  tcase_add_test(tc, replacementPolicyConcurrentArcThreadTest);
+  tcase_add_test(tc, replacementPolicyArcScanTest);
+  tcase_add_test(tc, replacementPolicyArcCapacityTest);
 
 
   /* --------------------------------------------- */
@@ -44,6 +44,7 @@ terms specified in this license.
 #include <stasis/util/latches.h>
 #include <stasis/util/random.h>
 #include <stasis/transactional.h>
+#include <stasis/transactionTable.h>
 
 #include <assert.h>
 
@@ -245,6 +246,51 @@ void * writingWorkerThread ( void * v ) {
   return NULL;
 }
 
+/** Allocate records, free some of them in an aborted transaction, and
+    the rest while allocating new ones.  Concurrent threads must never
+    be handed space that an uncommitted Tdealloc() freed. */
+void * allocatingDeallocatingWorkerThread ( void * v ) {
+  int offset = * (int *) v;
+  recordid * rids = malloc(RECORDS_PER_THREAD * sizeof(recordid));
+  int xid = Tbegin();
+  for(int i = 0; i < RECORDS_PER_THREAD; i++) {
+    int tmp = i + offset;
+    rids[i] = Talloc(xid, sizeof(int));
+    Tset(xid, rids[i], &tmp);
+  }
+  Tcommit(xid);
+
+  xid = Tbegin();
+  for(int i = 0; i < RECORDS_PER_THREAD; i += 2) {
+    Tdealloc(xid, rids[i]);
+  }
+  for(int i = 0; i < RECORDS_PER_THREAD; i += 2) {
+    int minusOne = -1;
+    recordid rid = Talloc(xid, sizeof(int));
+    Tset(xid, rid, &minusOne);
+  }
+  Tabort(xid);
+
+  xid = Tbegin();
+  for(int i = 1; i < RECORDS_PER_THREAD; i += 2) {
+    int tmp = -(i + offset);
+    Tdealloc(xid, rids[i]);
+    rids[i] = Talloc(xid, sizeof(int));
+    Tset(xid, rids[i], &tmp);
+  }
+  Tcommit(xid);
+
+  xid = Tbegin();
+  for(int i = 0; i < RECORDS_PER_THREAD; i++) {
+    int j;
+    Tread(xid, rids[i], &j);
+    assert(j == ((i % 2) ? -(i + offset) : i + offset));
+  }
+  Tcommit(xid);
+  free(rids);
+  return NULL;
+}
+
 /**
    @test
    Assuming that the Tset() operation is implemented correctly, checks
@@ -445,6 +491,27 @@ START_TEST(transactional_blobs_nothreads_abort) {
   Tdeinit();
 } END_TEST
 
+/**
+   @test
+   Concurrent Talloc() and Tdealloc() calls, with aborts.
+*/
+START_TEST(transactional_threads_alloc_dealloc) {
+  pthread_t workers[THREAD_COUNT];
+  int args[THREAD_COUNT];
+
+  Tinit();
+
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    args[i] = i * RECORDS_PER_THREAD;
+    pthread_create(&workers[i], NULL, allocatingDeallocatingWorkerThread, &args[i]);
+  }
+  for(int i = 0; i < THREAD_COUNT; i++) {
+    pthread_join(workers[i], NULL);
+  }
+
+  Tdeinit();
+} END_TEST
+
 /**
    @test
    Test LLADD in a multi-threaded envrionment, with a mix of transaction commits and aborts.
@@ -510,6 +577,40 @@ START_TEST(transactional_noop_xacts) {
   Tdeinit();
 } END_TEST
 
+START_TEST(transactional_many_xacts) {
+  Tinit();
+  stasis_transaction_table_t * tbl = stasis_runtime_transaction_table();
+  int xid = Tbegin();
+  recordid rid = Talloc(xid, sizeof(int));
+  Tcommit(xid);
+  // Run many more transactions at once than fit in the table's first segment.
+  const int count = 20 * MAX_TRANSACTIONS;
+  int * xids = malloc(sizeof(xids[0]) * count);
+  for(int i = 0; i < count; i++) {
+    xids[i] = Tbegin();
+    assert(xids[i] >= 0);
+    assert(stasis_transaction_table_minRecLSN(tbl) ==
+           (i ? stasis_transaction_table_get(tbl, xids[0])->recLSN : LSN_T_MAX));
+    Tset(xids[i], rid, &i);
+  }
+  int active_count;
+  free(stasis_transaction_table_list_active(tbl, &active_count));
+  assert(active_count == count);
+  // minRecLSN should follow the oldest running transaction.
+  for(int i = 0; i < count; i++) {
+    assert(stasis_transaction_table_minRecLSN(tbl) ==
+           stasis_transaction_table_get(tbl, xids[i])->recLSN);
+    if(i & 1) {
+      TsoftCommit(xids[i]);
+    } else {
+      Tcommit(xids[i]);
+    }
+  }
+  assert(stasis_transaction_table_minRecLSN(tbl) == LSN_T_MAX);
+  free(xids);
+  Tdeinit();
+} END_TEST
+
 /**
   Add suite declarations here
 */
@@ -523,11 +624,13 @@ Suite * check_suite(void) {
   tcase_add_test(tc, transactional_blobSmokeTest);
   tcase_add_test(tc, transactional_smokeTest);
   tcase_add_test(tc, transactional_noop_xacts);
+  tcase_add_test(tc, transactional_many_xacts);
   tcase_add_test(tc, transactional_nothreads_commit);
   tcase_add_test(tc, transactional_nothreads_abort);
   tcase_add_test(tc, transactional_threads_commit);
   tcase_add_test(tc, transactional_threads_softcommit);
   tcase_add_test(tc, transactional_threads_abort);
+  tcase_add_test(tc, transactional_threads_alloc_dealloc);
   tcase_add_test(tc, transactional_blobs_nothreads_abort);
   tcase_add_test(tc, transactional_blobs_threads_abort);
   /* --------------------------------------------- */
@@ -43,6 +43,11 @@ static char * logEntryToString(const LogEntry * le) {
 
     }
     break;
+  case XCHECKPOINT:
+    {
+      err = asprintf(&ret, "CHECKPOINT\tlsn=%9lld\tbegin=%9lld\tpages=%lld\n", le->LSN, getCheckpointBeginLSN(le), getCheckpointPageCount(le));
+    }
+    break;
   case XEND:
     {
       err = asprintf(&ret, "END  \tlsn=%9lld\tprevlsn=%9lld\txid=%4d\n", le->LSN, le->prevLSN, le->xid);